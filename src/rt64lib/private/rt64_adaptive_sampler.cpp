@@ -0,0 +1,186 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_adaptive_sampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+const int RT64::AdaptiveSampler::TileSize = 16;
+const unsigned int RT64::AdaptiveSampler::BaseUnits = 4;
+const unsigned int RT64::AdaptiveSampler::MinUnits = 1;
+const unsigned int RT64::AdaptiveSampler::MaxUnits = 16;
+const float RT64::AdaptiveSampler::VarianceScale = 1024.0f;
+const float RT64::AdaptiveSampler::MaxPixelVariance = 64.0f;
+
+namespace {
+	const int BisectionIterations = 48;
+};
+
+// Public
+
+RT64::AdaptiveSampler::AdaptiveSampler() {
+	width = 0;
+	height = 0;
+	tilesX = 0;
+	tilesY = 0;
+}
+
+void RT64::AdaptiveSampler::set(int width, int height) {
+	assert((width > 0) && (height > 0));
+	if ((this->width == width) && (this->height == height)) {
+		return;
+	}
+
+	this->width = width;
+	this->height = height;
+	tilesX = (width + TileSize - 1) / TileSize;
+	tilesY = (height + TileSize - 1) / TileSize;
+
+	// Tiles on the right and bottom edges can be smaller than the rest.
+	const size_t tileCount = (size_t)(tilesX) * tilesY;
+	pixelCounts.resize(tileCount);
+	for (int y = 0; y < tilesY; y++) {
+		const int tileHeight = std::min(TileSize, height - y * TileSize);
+		for (int x = 0; x < tilesX; x++) {
+			const int tileWidth = std::min(TileSize, width - x * TileSize);
+			pixelCounts[(size_t)(y) * tilesX + x] = (unsigned int)(tileWidth * tileHeight);
+		}
+	}
+
+	units.resize(tileCount);
+	weights.resize(tileCount);
+	reset();
+}
+
+void RT64::AdaptiveSampler::reset() {
+	std::fill(units.begin(), units.end(), BaseUnits);
+}
+
+void RT64::AdaptiveSampler::update(const uint32_t *tileVarianceSums) {
+	assert(tileVarianceSums != nullptr);
+
+	// The variance measured on each tile went down with the amount of samples it traced, so it's scaled back up by
+	// its units to estimate the variance of a single sample. Tiles otherwise keep swinging between too few and too many.
+	uint64_t totalPixels = 0;
+	for (size_t t = 0; t < units.size(); t++) {
+		const float meanVariance = (float)(tileVarianceSums[t]) / (VarianceScale * pixelCounts[t]);
+		weights[t] = meanVariance * units[t];
+		totalPixels += pixelCounts[t];
+	}
+
+	allocate(weights.data(), pixelCounts.data(), units.size(), totalPixels * BaseUnits, MinUnits, MaxUnits, units.data());
+}
+
+const unsigned int *RT64::AdaptiveSampler::getUnits() const {
+	return units.data();
+}
+
+int RT64::AdaptiveSampler::getTilesX() const {
+	return tilesX;
+}
+
+int RT64::AdaptiveSampler::getTilesY() const {
+	return tilesY;
+}
+
+int RT64::AdaptiveSampler::getTileCount() const {
+	return tilesX * tilesY;
+}
+
+void RT64::AdaptiveSampler::allocate(const float *weights, const unsigned int *pixelCounts, size_t tileCount, uint64_t budget, unsigned int minUnits, unsigned int maxUnits, unsigned int *units) {
+	assert((weights != nullptr) && (pixelCounts != nullptr) && (units != nullptr));
+	assert(minUnits <= maxUnits);
+	if (tileCount == 0) {
+		return;
+	}
+
+	uint64_t totalPixels = 0;
+	float maxWeight = 0.0f;
+	float minPositiveWeight = 0.0f;
+	for (size_t t = 0; t < tileCount; t++) {
+		totalPixels += pixelCounts[t];
+		if (weights[t] > 0.0f) {
+			maxWeight = std::max(maxWeight, weights[t]);
+			minPositiveWeight = (minPositiveWeight > 0.0f) ? std::min(minPositiveWeight, weights[t]) : weights[t];
+		}
+	}
+
+	// Continuous units of every tile for a given factor between the weights and the units.
+	auto continuousUnits = [=](size_t t, double factor) {
+		return std::min(std::max(factor * weights[t], (double)(minUnits)), (double)(maxUnits));
+	};
+
+	auto unitsUsed = [&](double factor) {
+		double used = 0.0;
+		for (size_t t = 0; t < tileCount; t++) {
+			used += continuousUnits(t, factor) * pixelCounts[t];
+		}
+
+		return used;
+	};
+
+	// Find the factor that spends the whole budget. The units only grow with it, so it can be bisected between zero
+	// and the factor that gives every tile with any weight the maximum. Without any weight, the budget is split evenly.
+	std::vector<double> continuous(tileCount);
+	if (maxWeight > 0.0f) {
+		double lowFactor = 0.0;
+		double highFactor = (double)(maxUnits) / minPositiveWeight;
+		if (unitsUsed(highFactor) <= (double)(budget)) {
+			lowFactor = highFactor;
+		}
+		else {
+			for (int i = 0; i < BisectionIterations; i++) {
+				const double midFactor = (lowFactor + highFactor) * 0.5;
+				if (unitsUsed(midFactor) <= (double)(budget)) {
+					lowFactor = midFactor;
+				}
+				else {
+					highFactor = midFactor;
+				}
+			}
+		}
+
+		for (size_t t = 0; t < tileCount; t++) {
+			continuous[t] = continuousUnits(t, lowFactor);
+		}
+	}
+	else {
+		const double evenUnits = std::min(std::max((double)(budget) / (double)(totalPixels), (double)(minUnits)), (double)(maxUnits));
+		std::fill(continuous.begin(), continuous.end(), evenUnits);
+	}
+
+	// Round down and hand out what's left of the budget to the tiles that lost the most by rounding.
+	uint64_t used = 0;
+	for (size_t t = 0; t < tileCount; t++) {
+		units[t] = (unsigned int)(continuous[t]);
+		used += (uint64_t)(units[t]) * pixelCounts[t];
+	}
+
+	std::vector<size_t> order(tileCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return (continuous[a] - units[a]) > (continuous[b] - units[b]);
+	});
+
+	for (size_t t : order) {
+		if ((units[t] < maxUnits) && ((continuous[t] - units[t]) > 0.0) && ((used + pixelCounts[t]) <= budget)) {
+			units[t]++;
+			used += pixelCounts[t];
+		}
+	}
+}
+
+unsigned int RT64::AdaptiveSampler::scaleSamples(unsigned int samples, unsigned int units) {
+	if (samples == 0) {
+		return 0;
+	}
+
+	return std::max((samples * units + BaseUnits / 2) / BaseUnits, 1U);
+}
+
+#endif
@@ -0,0 +1,66 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Distributes the soft light and GI samples of a view between square tiles of the output. The ray generation
+// shader in Tracer.hlsl keeps a running estimate of the variance of every pixel and adds up the relative variance
+// of each tile as fixed point, which is read back a frame later. Every tile gets a share of a fixed budget of sample
+// units proportional to the variance of a single sample, so flat lit areas give their samples to the penumbrae and
+// the noisy bounces. The budget is the one every tile would get with uniform sampling, so the total amount of rays
+// doesn't change. The constants and the sample count scaling must be kept in sync with the shader.
+//
+// The sampler has no dependencies on the graphics API so the allocation can be verified with synthetic variance maps.
+
+namespace RT64 {
+	class AdaptiveSampler {
+	public:
+		// Size in pixels of the square tiles samples are distributed between.
+		static const int TileSize;
+
+		// Units of a tile that traces the amount of samples the view was configured with.
+		static const unsigned int BaseUnits;
+
+		// Range of units a tile can get, as a fraction of the base.
+		static const unsigned int MinUnits;
+		static const unsigned int MaxUnits;
+
+		// Fixed point scale and per pixel limit of the relative variance added up by the shader.
+		static const float VarianceScale;
+		static const float MaxPixelVariance;
+	private:
+		int width;
+		int height;
+		int tilesX;
+		int tilesY;
+		std::vector<unsigned int> units;
+		std::vector<float> weights;
+		std::vector<unsigned int> pixelCounts;
+	public:
+		AdaptiveSampler();
+		void set(int width, int height);
+
+		// Goes back to uniform sampling.
+		void reset();
+
+		// Takes the variance sums of the last frame that used the current units and picks the units for the next one.
+		void update(const uint32_t *tileVarianceSums);
+		const unsigned int *getUnits() const;
+		int getTilesX() const;
+		int getTilesY() const;
+		int getTileCount() const;
+
+		// Splits a budget of units between tiles with the given pixel counts proportionally to their weights. Each tile
+		// gets between minUnits and maxUnits per pixel. The units used never exceed the budget unless it's smaller than
+		// the minimum of every tile.
+		static void allocate(const float *weights, const unsigned int *pixelCounts, size_t tileCount, uint64_t budget, unsigned int minUnits, unsigned int maxUnits, unsigned int *units);
+
+		// Amount of samples traced by a tile with the given units when the view uses the given amount of samples.
+		static unsigned int scaleSamples(unsigned int samples, unsigned int units);
+	};
+};
@@ -0,0 +1,62 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_buffer_cache.h"
+
+#include <cassert>
+
+// Private
+
+RT64::BufferCache::BufferCache(RenderDevice *renderDevice, uint64_t maxCachedBytes) {
+	assert(renderDevice != nullptr);
+	this->renderDevice = renderDevice;
+	this->maxCachedBytes = maxCachedBytes;
+	cachedBytes = 0;
+}
+
+RT64::BufferCache::~BufferCache() {
+	clear();
+}
+
+RT64::RenderBuffer *RT64::BufferCache::createUploadBuffer(uint64_t size) {
+	auto it = buffers.find(size);
+	if (it != buffers.end()) {
+		RenderBuffer *buffer = it->second;
+		buffers.erase(it);
+		cachedBytes -= size;
+		return buffer;
+	}
+
+	return renderDevice->createBuffer(RenderBufferDesc::UploadBuffer(size));
+}
+
+void RT64::BufferCache::recycle(RenderBuffer *buffer) {
+	assert(buffer != nullptr);
+
+	const RenderBufferDesc &desc = buffer->getDesc();
+	if ((desc.heapType != RenderHeapType::Upload) || ((cachedBytes + desc.size) > maxCachedBytes)) {
+		delete buffer;
+		return;
+	}
+
+	buffers.emplace(desc.size, buffer);
+	cachedBytes += desc.size;
+}
+
+void RT64::BufferCache::clear() {
+	for (auto it : buffers) {
+		delete it.second;
+	}
+
+	buffers.clear();
+	cachedBytes = 0;
+}
+
+uint64_t RT64::BufferCache::getCachedBytes() const {
+	return cachedBytes;
+}
+
+#endif
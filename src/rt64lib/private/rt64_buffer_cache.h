@@ -0,0 +1,32 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+#include "rt64_render_interface.h"
+
+// Keeps the upload buffers that were retired so they can be handed out again to uploads of the same size, which is
+// common for hosts that recreate the same meshes and textures every frame. Buffers must only be recycled once the GPU
+// is done with them, so the cache is meant to be fed by the retirement queue. Buffers that don't fit in the cache's
+// budget are deleted instead.
+
+namespace RT64 {
+	class BufferCache {
+	private:
+		RenderDevice *renderDevice;
+		uint64_t maxCachedBytes;
+		uint64_t cachedBytes;
+		std::multimap<uint64_t, RenderBuffer *> buffers;
+	public:
+		BufferCache(RenderDevice *renderDevice, uint64_t maxCachedBytes);
+		virtual ~BufferCache();
+		RenderBuffer *createUploadBuffer(uint64_t size);
+		void recycle(RenderBuffer *buffer);
+		void clear();
+		uint64_t getCachedBytes() const;
+	};
+};
@@ -0,0 +1,83 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_build_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Public
+
+RT64::BuildScheduler::BuildScheduler() { }
+
+void RT64::BuildScheduler::setSettings(const Settings &settings) {
+	this->settings = settings;
+}
+
+const RT64::BuildScheduler::Settings &RT64::BuildScheduler::getSettings() const {
+	return settings;
+}
+
+void RT64::BuildScheduler::enqueue(const void *key, uint64_t cost, bool required) {
+	assert(key != nullptr);
+	for (Build &build : pendingBuilds) {
+		if (build.key == key) {
+			build.cost = cost;
+			build.required = build.required || required;
+			return;
+		}
+	}
+
+	pendingBuilds.push_back({ key, cost, required });
+}
+
+void RT64::BuildScheduler::cancel(const void *key) {
+	pendingBuilds.erase(std::remove_if(pendingBuilds.begin(), pendingBuilds.end(), [key](const Build &build) {
+		return build.key == key;
+	}), pendingBuilds.end());
+}
+
+void RT64::BuildScheduler::schedule(std::vector<Build> &builds) {
+	builds.clear();
+
+	// Optional builds stop being scheduled as soon as one doesn't fit, so they're always done in the order they were requested.
+	std::vector<Build> remainingBuilds;
+	uint64_t optionalCost = 0;
+	bool optionalScheduled = false;
+	bool budgetSpent = false;
+	for (const Build &build : pendingBuilds) {
+		if (build.required) {
+			builds.push_back(build);
+		}
+		else if (!budgetSpent && (!optionalScheduled || (settings.frameBudget == 0) || ((optionalCost + build.cost) <= settings.frameBudget))) {
+			builds.push_back(build);
+			optionalCost += build.cost;
+			optionalScheduled = true;
+		}
+		else {
+			remainingBuilds.push_back(build);
+			budgetSpent = true;
+		}
+	}
+
+	pendingBuilds.swap(remainingBuilds);
+}
+
+bool RT64::BuildScheduler::isPending(const void *key) const {
+	for (const Build &build : pendingBuilds) {
+		if (build.key == key) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t RT64::BuildScheduler::getPendingCount() const {
+	return pendingBuilds.size();
+}
+
+#endif
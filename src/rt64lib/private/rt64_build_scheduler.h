@@ -0,0 +1,56 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Collects the bottom-level AS builds requested between frames so they can be recorded in a single batch at the start
+// of the next frame. Requesting a build again before it's done only keeps the latest one, so updating a mesh many
+// times in a row builds its AS once.
+//
+// Builds are either required, when there's no AS to trace against until the build is done, or optional, when the
+// previous AS can still be used for a few more frames. A budget can be set to spread the optional builds of a big
+// burst of updates across multiple frames. Required builds are never delayed.
+//
+// The scheduler has no dependencies on the graphics API so the batches can be verified without a GPU.
+
+namespace RT64 {
+	class BuildScheduler {
+	public:
+		struct Settings {
+			// Cost of the optional builds that can be done in a single frame. Zero means there's no limit.
+			uint64_t frameBudget = 0;
+		};
+
+		struct Build {
+			const void *key;
+			uint64_t cost;
+			bool required;
+		};
+	private:
+		Settings settings;
+		std::vector<Build> pendingBuilds;
+	public:
+		BuildScheduler();
+		void setSettings(const Settings &settings);
+		const Settings &getSettings() const;
+
+		// Requests a build for the key. If a build for the key is already pending, it keeps its place in the queue,
+		// uses the new cost and stays required if any of the requests were required.
+		void enqueue(const void *key, uint64_t cost, bool required);
+
+		// Removes the pending build for the key if there's any.
+		void cancel(const void *key);
+
+		// Moves the builds that must be done this frame to the vector in the order they were first requested. All the
+		// required builds are included, while optional builds are included until their cost goes over the budget. The
+		// oldest optional build is always included, so every build is eventually done no matter how big it is.
+		void schedule(std::vector<Build> &builds);
+		bool isPending(const void *key) const;
+		size_t getPendingCount() const;
+	};
+};
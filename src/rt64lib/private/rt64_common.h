@@ -38,16 +38,23 @@ namespace RT64 {
 		gOutput,
 		gAlbedo,
 		gNormal,
-		gHitDistance,
-		gHitColor,
-		gHitNormal,
-		gHitInstanceId,
-		gHitSpecular,
+		gHitBuffer,
+		gInstanceId,
+		gAccumColor,
+		gAccumDepth,
+		gPrevAccumColor,
+		gPrevAccumDepth,
+		gMotion,
+		gHitPrevPosition,
+		gDepth,
+		gVarianceMoments,
+		gTileVariance,
 		gBackground,
 		SceneBVH,
 		ViewParams,
 		SceneLights,
 		instanceProps,
+		gTileUnits,
 		gTextures,
 		MAX
 	};
@@ -56,11 +63,17 @@ namespace RT64 {
 		gOutput,
 		gAlbedo,
 		gNormal,
-		gHitDistance,
-		gHitColor,
-		gHitNormal,
-		gHitInstanceId,
-		gHitSpecular
+		gHitBuffer,
+		gInstanceId,
+		gAccumColor,
+		gAccumDepth,
+		gPrevAccumColor,
+		gPrevAccumDepth,
+		gMotion,
+		gHitPrevPosition,
+		gDepth,
+		gVarianceMoments,
+		gTileVariance
 	};
 
 	enum class SRVIndices : int {
@@ -70,11 +83,13 @@ namespace RT64 {
 		indexBuffer,
 		SceneLights,
 		instanceProps,
+		gTileUnits,
 		gTextures
 	};
 
 	enum class CBVIndices : int {
-		ViewParams
+		ViewParams,
+		TileParams
 	};
 
 	// Error string for last error or exception that was caught.
@@ -121,29 +136,10 @@ namespace RT64 {
 	struct InstanceProperties {
 		XMMATRIX objectToWorld;
 		XMMATRIX objectToWorldNormal;
+		XMMATRIX objectToWorldPrevious;
 		RT64_MATERIAL material;
 	};
 
-	struct AccelerationStructureBuffers {
-		AllocatedResource scratch;
-		UINT64 scratchSize;
-		AllocatedResource result;
-		UINT64 resultSize;
-		AllocatedResource instanceDesc;
-		UINT64 instanceDescSize;
-
-		AccelerationStructureBuffers() {
-			scratchSize = resultSize = instanceDescSize = 0;
-		}
-
-		void Release() {
-			scratch.Release();
-			result.Release();
-			instanceDesc.Release();
-			scratchSize = resultSize = instanceDescSize = 0;
-		}
-	};
-
 	// Points to a static array of data in memory using the IDxcBlob interface.
 	class StaticBlob : public IDxcBlob {
 	private:
@@ -0,0 +1,456 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_cpu_denoiser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#	include <emmintrin.h>
+#	define CPU_DENOISER_SSE
+#endif
+
+namespace {
+	const float Epsilon = 1e-6f;
+	const float AlbedoEpsilon = 1e-3f;
+	const float AtrousKernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	inline float luminance(const float *c) {
+		return c[0] * 0.2126f + c[1] * 0.7152f + c[2] * 0.0722f;
+	}
+
+	inline bool isNullNormal(const float *n) {
+		return (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) < Epsilon;
+	}
+
+	inline float normalWeight(const float *a, const float *b, float phiNormal) {
+		bool aNull = isNullNormal(a);
+		bool bNull = isNullNormal(b);
+		if (aNull || bNull) {
+			return (aNull && bNull) ? 1.0f : 0.0f;
+		}
+
+		float d = std::max(a[0] * b[0] + a[1] * b[1] + a[2] * b[2], 0.0f);
+		return powf(d, phiNormal);
+	}
+
+	inline const float *rowPointer(const float *base, size_t rowPitch, int y) {
+		return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(base) + rowPitch * y);
+	}
+
+	inline float *rowPointer(float *base, size_t rowPitch, int y) {
+		return reinterpret_cast<float *>(reinterpret_cast<uint8_t *>(base) + rowPitch * y);
+	}
+
+	// Computes dst = a + (b - a) * t for all four channels.
+	inline void lerp4(float *dst, const float *a, const float *b, float t) {
+#ifdef CPU_DENOISER_SSE
+		__m128 va = _mm_loadu_ps(a);
+		__m128 vb = _mm_loadu_ps(b);
+		_mm_storeu_ps(dst, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(t))));
+#else
+		for (int k = 0; k < 4; k++) {
+			dst[k] = a[k] + (b[k] - a[k]) * t;
+		}
+#endif
+	}
+};
+
+// Private
+
+void RT64::CPUDenoiser::startWorkers(unsigned int workerCount) {
+	workersStopping = false;
+	workers.reserve(workerCount);
+	for (unsigned int t = 0; t < workerCount; t++) {
+		// The calling thread runs the first slice of every pass. The workers only run the passes that start after they're created.
+		workers.emplace_back(&CPUDenoiser::workerLoop, this, t + 1, workerPassIndex);
+	}
+}
+
+void RT64::CPUDenoiser::stopWorkers() {
+	{
+		std::unique_lock<std::mutex> lock(workerMutex);
+		workersStopping = true;
+	}
+
+	workerChanged.notify_all();
+
+	for (std::thread &thread : workers) {
+		thread.join();
+	}
+
+	workers.clear();
+}
+
+void RT64::CPUDenoiser::workerLoop(unsigned int sliceIndex, uint64_t lastPassIndex) {
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(workerMutex);
+			workerChanged.wait(lock, [this, lastPassIndex]() { return workersStopping || (workerPassIndex != lastPassIndex); });
+			if (workersStopping) {
+				return;
+			}
+
+			lastPassIndex = workerPassIndex;
+		}
+
+		runSlice(sliceIndex);
+
+		{
+			std::unique_lock<std::mutex> lock(workerMutex);
+			workersRunning--;
+		}
+
+		workerChanged.notify_all();
+	}
+}
+
+void RT64::CPUDenoiser::runSlice(unsigned int sliceIndex) {
+	int rowStart = (int)(sliceIndex) * workerRowsPerSlice;
+	int rowEnd = std::min(rowStart + workerRowsPerSlice, height);
+	if (rowStart < rowEnd) {
+		(this->*workerPass)(rowStart, rowEnd, workerPassArg);
+	}
+}
+
+void RT64::CPUDenoiser::parallelRows(Pass pass, int arg) {
+	unsigned int threadCount = settings.threadCount;
+	if (threadCount == 0) {
+		threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+
+	if (threadCount <= 1) {
+		(this->*pass)(0, height, arg);
+		return;
+	}
+
+	// The workers are only created again if the amount of threads in the settings changed.
+	if (workers.size() != (threadCount - 1)) {
+		stopWorkers();
+		startWorkers(threadCount - 1);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(workerMutex);
+		workerPass = pass;
+		workerPassArg = arg;
+		workerRowsPerSlice = (height + threadCount - 1) / threadCount;
+		workersRunning = (unsigned int)(workers.size());
+		workerPassIndex++;
+	}
+
+	workerChanged.notify_all();
+
+	runSlice(0);
+
+	// The next pass reads the results of this one, so every slice must be done before returning.
+	std::unique_lock<std::mutex> lock(workerMutex);
+	workerChanged.wait(lock, [this]() { return workersRunning == 0; });
+}
+
+void RT64::CPUDenoiser::demodulatePass(int rowStart, int rowEnd, int /*arg*/) {
+	for (int y = rowStart; y < rowEnd; y++) {
+		const float *colorRow = rowPointer(inputs.color, inputs.rowPitch, y);
+		const float *albedoRow = rowPointer(inputs.albedo, inputs.rowPitch, y);
+		const float *normalRow = rowPointer(inputs.normal, inputs.rowPitch, y);
+		for (int x = 0; x < width; x++) {
+			size_t i = (size_t)(y) * width + x;
+			const float *c = colorRow + x * 4;
+			const float *a = albedoRow + x * 4;
+			memcpy(albedo[i].v, a, sizeof(Pixel));
+			memcpy(normal[i].v, normalRow + x * 4, sizeof(Pixel));
+
+			// Filter the illumination instead of the color so texture detail is preserved.
+			for (int k = 0; k < 3; k++) {
+				illumination[i].v[k] = (a[k] > AlbedoEpsilon) ? (c[k] / a[k]) : c[k];
+			}
+
+			illumination[i].v[3] = c[3];
+		}
+	}
+}
+
+void RT64::CPUDenoiser::temporalPass(int rowStart, int rowEnd, int /*arg*/) {
+	for (int y = rowStart; y < rowEnd; y++) {
+		const float *motionRow = (inputs.motion != nullptr) ? rowPointer(inputs.motion, inputs.motionRowPitch, y) : nullptr;
+		for (int x = 0; x < width; x++) {
+			size_t i = (size_t)(y) * width + x;
+			float lum = luminance(illumination[i].v);
+
+			// Reproject into the previous frame and validate the history sample.
+			int px = x;
+			int py = y;
+			if (motionRow != nullptr) {
+				px = (int)(floorf(x + 0.5f + motionRow[x * 2 + 0]));
+				py = (int)(floorf(y + 0.5f + motionRow[x * 2 + 1]));
+			}
+
+			bool valid = historyValid && (px >= 0) && (px < width) && (py >= 0) && (py < height);
+			size_t q = 0;
+			if (valid) {
+				q = (size_t)(py) * width + px;
+				valid = (historyLength[q] > 0);
+				valid = valid && (normalWeight(normal[i].v, historyNormal[q].v, 1.0f) >= settings.normalRejectThreshold);
+				valid = valid && (fabsf(luminance(albedo[i].v) - luminance(historyAlbedo[q].v)) <= settings.phiAlbedo);
+			}
+
+			if (valid) {
+				int length = std::min((int)(historyLength[q]) + 1, settings.maxHistoryLength);
+				float colorAlpha = std::max(settings.colorAlpha, 1.0f / length);
+				float momentsAlpha = std::max(settings.momentsAlpha, 1.0f / length);
+				lerp4(pingPong[0][i].v, historyIllumination[q].v, illumination[i].v, colorAlpha);
+				moments[i * 2 + 0] = historyMoments[q * 2 + 0] + (lum - historyMoments[q * 2 + 0]) * momentsAlpha;
+				moments[i * 2 + 1] = historyMoments[q * 2 + 1] + (lum * lum - historyMoments[q * 2 + 1]) * momentsAlpha;
+				currentLength[i] = (uint16_t)(length);
+			}
+			else {
+				pingPong[0][i] = illumination[i];
+				moments[i * 2 + 0] = lum;
+				moments[i * 2 + 1] = lum * lum;
+				currentLength[i] = 1;
+			}
+		}
+	}
+}
+
+void RT64::CPUDenoiser::variancePass(int rowStart, int rowEnd, int /*arg*/) {
+	const int MinTemporalLength = 4;
+	for (int y = rowStart; y < rowEnd; y++) {
+		for (int x = 0; x < width; x++) {
+			size_t i = (size_t)(y) * width + x;
+			float pixelVariance;
+			if (currentLength[i] >= MinTemporalLength) {
+				pixelVariance = std::max(moments[i * 2 + 1] - moments[i * 2 + 0] * moments[i * 2 + 0], 0.0f);
+			}
+			else {
+				// Not enough history, estimate the variance spatially instead.
+				float m1 = 0.0f, m2 = 0.0f, wSum = 0.0f;
+				for (int dy = -1; dy <= 1; dy++) {
+					int sy = std::min(std::max(y + dy, 0), height - 1);
+					for (int dx = -1; dx <= 1; dx++) {
+						int sx = std::min(std::max(x + dx, 0), width - 1);
+						size_t q = (size_t)(sy) * width + sx;
+						float w = normalWeight(normal[i].v, normal[q].v, settings.phiNormal);
+						m1 += moments[q * 2 + 0] * w;
+						m2 += moments[q * 2 + 1] * w;
+						wSum += w;
+					}
+				}
+
+				m1 /= std::max(wSum, Epsilon);
+				m2 /= std::max(wSum, Epsilon);
+
+				// Boost the variance of young samples so they're filtered more aggressively.
+				pixelVariance = std::max(m2 - m1 * m1, 0.0f) * ((float)(MinTemporalLength) / currentLength[i]);
+			}
+
+			variance[0][i] = pixelVariance;
+		}
+	}
+}
+
+void RT64::CPUDenoiser::atrousPass(int rowStart, int rowEnd, int iteration) {
+	const std::vector<Pixel> &src = pingPong[iteration & 1];
+	std::vector<Pixel> &dst = pingPong[(iteration + 1) & 1];
+	const std::vector<float> &srcVariance = variance[iteration & 1];
+	std::vector<float> &dstVariance = variance[(iteration + 1) & 1];
+	const int step = 1 << iteration;
+	for (int y = rowStart; y < rowEnd; y++) {
+		for (int x = 0; x < width; x++) {
+			size_t i = (size_t)(y) * width + x;
+
+			// Prefilter the variance with a 3x3 gaussian to make the luminance edge stopping more robust.
+			float gaussVariance = 0.0f;
+			for (int dy = -1; dy <= 1; dy++) {
+				int sy = std::min(std::max(y + dy, 0), height - 1);
+				for (int dx = -1; dx <= 1; dx++) {
+					int sx = std::min(std::max(x + dx, 0), width - 1);
+					float k = ((dx == 0) ? 0.5f : 0.25f) * ((dy == 0) ? 0.5f : 0.25f);
+					gaussVariance += srcVariance[(size_t)(sy) * width + sx] * k;
+				}
+			}
+
+			const float lumP = luminance(src[i].v);
+			const float albedoLumP = luminance(albedo[i].v);
+			const float phiL = settings.phiColor * sqrtf(std::max(gaussVariance, 0.0f)) + Epsilon;
+			float wSum = 0.0f;
+			float varianceSum = 0.0f;
+#ifdef CPU_DENOISER_SSE
+			__m128 colorSum = _mm_setzero_ps();
+#else
+			float colorSum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+#endif
+			for (int ky = -2; ky <= 2; ky++) {
+				int sy = y + ky * step;
+				if ((sy < 0) || (sy >= height)) {
+					continue;
+				}
+
+				for (int kx = -2; kx <= 2; kx++) {
+					int sx = x + kx * step;
+					if ((sx < 0) || (sx >= width)) {
+						continue;
+					}
+
+					size_t q = (size_t)(sy) * width + sx;
+					float h = AtrousKernel[abs(kx)] * AtrousKernel[abs(ky)];
+					float w = h;
+					if (q != i) {
+						float wL = fabsf(lumP - luminance(src[q].v)) / phiL;
+						float wA = fabsf(albedoLumP - luminance(albedo[q].v)) / settings.phiAlbedo;
+						w *= expf(-wL - wA) * normalWeight(normal[i].v, normal[q].v, settings.phiNormal);
+					}
+
+#ifdef CPU_DENOISER_SSE
+					colorSum = _mm_add_ps(colorSum, _mm_mul_ps(_mm_loadu_ps(src[q].v), _mm_set1_ps(w)));
+#else
+					for (int k = 0; k < 4; k++) {
+						colorSum[k] += src[q].v[k] * w;
+					}
+#endif
+					varianceSum += srcVariance[q] * w * w;
+					wSum += w;
+				}
+			}
+
+			// The center tap always contributes, so the weight sum can't be zero.
+			float invWSum = 1.0f / wSum;
+#ifdef CPU_DENOISER_SSE
+			_mm_storeu_ps(dst[i].v, _mm_mul_ps(colorSum, _mm_set1_ps(invWSum)));
+#else
+			for (int k = 0; k < 4; k++) {
+				dst[i].v[k] = colorSum[k] * invWSum;
+			}
+#endif
+			dstVariance[i] = varianceSum * invWSum * invWSum;
+		}
+	}
+}
+
+void RT64::CPUDenoiser::remodulatePass(int rowStart, int rowEnd, int arg) {
+	const std::vector<Pixel> &src = pingPong[arg & 1];
+	for (int y = rowStart; y < rowEnd; y++) {
+		float *colorRow = rowPointer(inputs.color, inputs.rowPitch, y);
+		for (int x = 0; x < width; x++) {
+			size_t i = (size_t)(y) * width + x;
+			float *c = colorRow + x * 4;
+			const float *a = albedo[i].v;
+			for (int k = 0; k < 3; k++) {
+				c[k] = (a[k] > AlbedoEpsilon) ? (src[i].v[k] * a[k]) : src[i].v[k];
+			}
+		}
+	}
+}
+
+// Public
+
+RT64::CPUDenoiser::CPUDenoiser() {
+	width = 0;
+	height = 0;
+	historyValid = false;
+	workerPass = nullptr;
+	workerPassArg = 0;
+	workerRowsPerSlice = 0;
+	workerPassIndex = 0;
+	workersRunning = 0;
+	workersStopping = false;
+}
+
+RT64::CPUDenoiser::~CPUDenoiser() {
+	stopWorkers();
+}
+
+void RT64::CPUDenoiser::set(int width, int height) {
+	assert((width > 0) && (height > 0));
+	if ((this->width == width) && (this->height == height)) {
+		return;
+	}
+
+	this->width = width;
+	this->height = height;
+
+	const size_t pixelCount = (size_t)(width) * height;
+	illumination.resize(pixelCount);
+	pingPong[0].resize(pixelCount);
+	pingPong[1].resize(pixelCount);
+	historyIllumination.resize(pixelCount);
+	historyNormal.resize(pixelCount);
+	historyAlbedo.resize(pixelCount);
+	historyMoments.resize(pixelCount * 2);
+	historyLength.resize(pixelCount);
+	moments.resize(pixelCount * 2);
+	currentLength.resize(pixelCount);
+	variance[0].resize(pixelCount);
+	variance[1].resize(pixelCount);
+	normal.resize(pixelCount);
+	albedo.resize(pixelCount);
+	reset();
+}
+
+void RT64::CPUDenoiser::setSettings(const Settings &settings) {
+	this->settings = settings;
+	this->settings.atrousIterations = std::max(this->settings.atrousIterations, 0);
+	this->settings.maxHistoryLength = std::max(std::min(this->settings.maxHistoryLength, (int)(UINT16_MAX)), 1);
+}
+
+const RT64::CPUDenoiser::Settings &RT64::CPUDenoiser::getSettings() const {
+	return settings;
+}
+
+void RT64::CPUDenoiser::reset() {
+	historyValid = false;
+	std::fill(historyLength.begin(), historyLength.end(), (uint16_t)(0));
+}
+
+void RT64::CPUDenoiser::denoise(const Inputs &inputs) {
+	assert((width > 0) && (height > 0));
+	assert(inputs.color != nullptr);
+	assert(inputs.albedo != nullptr);
+	assert(inputs.normal != nullptr);
+	assert(inputs.rowPitch >= (size_t)(width) * sizeof(Pixel));
+	this->inputs = inputs;
+
+	parallelRows(&CPUDenoiser::demodulatePass, 0);
+	parallelRows(&CPUDenoiser::temporalPass, 0);
+	parallelRows(&CPUDenoiser::variancePass, 0);
+
+	// The output of the first iteration is used as the history for the next frame.
+	const int iterations = settings.atrousIterations;
+	for (int i = 0; i < iterations; i++) {
+		parallelRows(&CPUDenoiser::atrousPass, i);
+		if (i == 0) {
+			historyIllumination = pingPong[1];
+		}
+	}
+
+	if (iterations == 0) {
+		historyIllumination = pingPong[0];
+	}
+
+	parallelRows(&CPUDenoiser::remodulatePass, iterations);
+
+	// Store the guides and moments for validating the history on the next frame.
+	historyNormal.swap(normal);
+	historyAlbedo.swap(albedo);
+	historyMoments.swap(moments);
+	historyLength.swap(currentLength);
+	historyValid = true;
+	this->inputs = Inputs();
+}
+
+int RT64::CPUDenoiser::getWidth() const {
+	return width;
+}
+
+int RT64::CPUDenoiser::getHeight() const {
+	return height;
+}
+
+#endif
@@ -0,0 +1,118 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Spatio-temporal variance-guided filter (SVGF) that runs entirely on the CPU. It's a portable alternative to the
+// OptiX denoiser and has no dependencies on D3D12, so it can be validated against reference images on any platform.
+//
+// Every pass only reads the results of the previous pass and writes one pixel per invocation, so each of them
+// maps directly to a compute shader dispatch. The rows of each pass are split between the calling thread and a
+// pool of workers that lives as long as the denoiser.
+
+namespace RT64 {
+	class CPUDenoiser {
+	public:
+		struct Settings {
+			// Amount of a-trous wavelet iterations. Each iteration doubles the filter footprint.
+			int atrousIterations = 4;
+
+			// Minimum weight of the current frame when blending against the history.
+			float colorAlpha = 0.2f;
+			float momentsAlpha = 0.2f;
+
+			// Edge stopping parameters for the luminance, normal and albedo guides.
+			float phiColor = 4.0f;
+			float phiNormal = 128.0f;
+			float phiAlbedo = 0.1f;
+
+			// Minimum dot product between the current and the previous normal to accept the history.
+			float normalRejectThreshold = 0.9f;
+
+			// Maximum length of the history used to weight the current frame.
+			int maxHistoryLength = 32;
+
+			// Amount of worker threads to split the rows between. Zero uses the hardware concurrency.
+			unsigned int threadCount = 0;
+		};
+
+		// All images are RGBA32F with the row pitch specified in bytes. Motion vectors are optional and
+		// point from the current pixel to its position in the previous frame, in pixels, stored as RG32F.
+		struct Inputs {
+			float *color = nullptr;
+			const float *albedo = nullptr;
+			const float *normal = nullptr;
+			const float *motion = nullptr;
+			size_t rowPitch = 0;
+			size_t motionRowPitch = 0;
+		};
+	private:
+		struct Pixel {
+			float v[4];
+		};
+
+		int width;
+		int height;
+		Settings settings;
+		std::vector<Pixel> illumination;
+		std::vector<Pixel> pingPong[2];
+		std::vector<Pixel> historyIllumination;
+		std::vector<Pixel> historyNormal;
+		std::vector<Pixel> historyAlbedo;
+		std::vector<float> historyMoments;
+		std::vector<uint16_t> historyLength;
+		std::vector<float> moments;
+		std::vector<uint16_t> currentLength;
+		std::vector<float> variance[2];
+		std::vector<Pixel> normal;
+		std::vector<Pixel> albedo;
+		bool historyValid;
+
+		// Only valid for the duration of denoise().
+		Inputs inputs;
+
+		typedef void (CPUDenoiser::*Pass)(int, int, int);
+		std::vector<std::thread> workers;
+		std::mutex workerMutex;
+		std::condition_variable workerChanged;
+		Pass workerPass;
+		int workerPassArg;
+		int workerRowsPerSlice;
+		uint64_t workerPassIndex;
+		unsigned int workersRunning;
+		bool workersStopping;
+
+		void startWorkers(unsigned int workerCount);
+		void stopWorkers();
+		void workerLoop(unsigned int sliceIndex, uint64_t lastPassIndex);
+		void runSlice(unsigned int sliceIndex);
+		void parallelRows(Pass pass, int arg);
+		void demodulatePass(int rowStart, int rowEnd, int arg);
+		void temporalPass(int rowStart, int rowEnd, int arg);
+		void variancePass(int rowStart, int rowEnd, int arg);
+		void atrousPass(int rowStart, int rowEnd, int iteration);
+		void remodulatePass(int rowStart, int rowEnd, int arg);
+	public:
+		CPUDenoiser();
+		virtual ~CPUDenoiser();
+		void set(int width, int height);
+		void setSettings(const Settings &settings);
+		const Settings &getSettings() const;
+
+		// Discards the accumulated history, for example after a camera cut.
+		void reset();
+
+		// Filters the color image in place. Alpha is preserved.
+		void denoise(const Inputs &inputs);
+		int getWidth() const;
+		int getHeight() const;
+	};
+};
@@ -11,24 +11,17 @@
 #include "rt64_device.h"
 
 #ifndef RT64_MINIMAL
+#include "rt64_geometry_pool.h"
 #include "rt64_inspector.h"
 #include "rt64_scene.h"
+#include "rt64_scratch_pool.h"
 #include "rt64_texture.h"
 
-#include "shaders/ComposePS.hlsl.h"
-#include "shaders/ComposeVS.hlsl.h"
-#include "shaders/Im3DPS.hlsl.h"
-#include "shaders/Im3DVS.hlsl.h"
-#include "shaders/Im3DGSPoints.hlsl.h"
-#include "shaders/Im3DGSLines.hlsl.h"
-#include "shaders/RasterPS.hlsl.h"
-#include "shaders/RasterVS.hlsl.h"
-#include "shaders/Shadow.hlsl.h"
-#include "shaders/Surface.hlsl.h"
-#include "shaders/Tracer.hlsl.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb/stb_image_write.h"
+#include "shaders/ShaderArchive.h"
+
+#include <filesystem>
+#include <future>
+#include <iomanip>
 #endif
 
 // Private
@@ -42,22 +35,42 @@ RT64::Device::Device(HWND hwnd) {
 	this->hwnd = hwnd;
 	d3dAllocator = nullptr;
 	d3dCommandListOpen = true;
-	lastCommandQueueBarrierActive = false;
-	lastCopyQueueBarrierActive = false;
+	renderDevice = nullptr;
+	renderContext = nullptr;
 	d3dRenderTargets[0] = nullptr;
 	d3dRenderTargets[1] = nullptr;
-	d3dRenderTargetReadbackRowWidth = 0;
+	captureSlotIndex = 0;
+	frameEncoder = nullptr;
+	captureFormat = FrameEncoder::Format::PNG;
+	captureFramesLeft = 0;
+	captureFrameNumber = 0;
+	d3dTimestampQueryHeap = nullptr;
+	d3dTimestampFrequency = 0;
 	width = 0;
 	height = 0;
 
+	// Shaders are only decompressed once the pipelines that use them are created.
+	shaderArchive = new ShaderArchive(ShaderArchiveBlob, sizeof(ShaderArchiveBlob));
+
 	updateSize();
 	loadPipeline();
 	loadAssets();
-	createRaytracingPipeline();
 #endif
 }
 
 RT64::Device::~Device() {
+#ifndef RT64_MINIMAL
+	// Write out any frames that are still being captured.
+	if (frameEncoder != nullptr) {
+		collectCapturedFrames(true);
+		delete frameEncoder;
+	}
+
+	delete renderContext;
+	delete shaderArchive;
+	delete renderDevice;
+#endif
+
 	/* TODO: Re-enable once resources are properly released.
 	if (d3dAllocator != nullptr) {
 		d3dAllocator->Release();
@@ -190,7 +203,7 @@ void RT64::Device::releaseRTVs() {
 		d3dRenderTargets[n] = nullptr;
 	}
 
-	d3dRenderTargetReadback.Release();
+	releaseCaptureBuffers();
 }
 
 void RT64::Device::createRTVs() {
@@ -211,21 +224,6 @@ void RT64::Device::createRTVs() {
 		d3dDevice->CreateRenderTargetView(d3dRenderTargets[n], nullptr, rtvHandle);
 		rtvHandle.Offset(1, d3dRtvDescriptorSize);
 	}
-
-	// Create the resource for render target readback.
-	UINT rowPadding;
-	CalculateTextureRowWidthPadding(width, 4, d3dRenderTargetReadbackRowWidth, rowPadding);
-
-	D3D12_RESOURCE_DESC resDesc = { };
-	resDesc.Format = DXGI_FORMAT_UNKNOWN;
-	resDesc.Width = (d3dRenderTargetReadbackRowWidth * height);
-	resDesc.Height = 1;
-	resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	resDesc.DepthOrArraySize = 1;
-	resDesc.MipLevels = 1;
-	resDesc.SampleDesc.Count = 1;
-	d3dRenderTargetReadback = allocateResource(D3D12_HEAP_TYPE_READBACK, &resDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
 }
 
 HWND RT64::Device::getHwnd() const {
@@ -240,6 +238,14 @@ ID3D12GraphicsCommandList4 *RT64::Device::getD3D12CommandList() {
 	return d3dCommandList;
 }
 
+RT64::RenderDevice *RT64::Device::getRenderDevice() {
+	return renderDevice;
+}
+
+RT64::RenderContext *RT64::Device::getRenderContext() {
+	return renderContext;
+}
+
 ID3D12StateObject *RT64::Device::getD3D12RtStateObject() {
 	return d3dRtStateObject;
 }
@@ -272,6 +278,22 @@ ID3D12PipelineState *RT64::Device::getComposePipelineState() {
 	return d3dComposePipelineState;
 }
 
+ID3D12RootSignature *RT64::Device::getUpscaleRootSignature() {
+	return d3dUpscaleRootSignature;
+}
+
+ID3D12PipelineState *RT64::Device::getUpscalePipelineState() {
+	return d3dUpscalePipelineState;
+}
+
+ID3D12RootSignature *RT64::Device::getReconstructRootSignature() {
+	return d3dReconstructRootSignature;
+}
+
+ID3D12PipelineState *RT64::Device::getReconstructPipelineState() {
+	return d3dReconstructPipelineState;
+}
+
 ID3D12RootSignature *RT64::Device::getIm3dRootSignature() {
 	return im3dRootSignature;
 }
@@ -288,6 +310,10 @@ ID3D12PipelineState *RT64::Device::getIm3dPipelineStateTriangle() {
 	return im3dPipelineStateTriangle;
 }
 
+RT64::ShaderArchive *RT64::Device::getShaderArchive() {
+	return shaderArchive;
+}
+
 CD3DX12_VIEWPORT RT64::Device::getD3D12Viewport() {
 	return d3dViewport;
 }
@@ -333,28 +359,32 @@ RT64::AllocatedResource RT64::Device::allocateBuffer(D3D12_HEAP_TYPE HeapType, u
 	return AllocatedResource(allocation);
 }
 
-void RT64::Device::setLastCommandQueueBarrier(const D3D12_RESOURCE_BARRIER &barrier) {
-	lastCommandQueueBarrier = barrier;
-	lastCommandQueueBarrierActive = true;
-}
-
-void RT64::Device::submitCommandQueueBarrier() {
-	if (lastCommandQueueBarrierActive) {
-		d3dCommandList->ResourceBarrier(1, &lastCommandQueueBarrier);
-		lastCommandQueueBarrierActive = false;
+void RT64::Device::addCopyQueueBarrier(RenderTexture *texture, RenderTextureAccess access) {
+	assert(texture != nullptr);
+	for (auto &barrier : copyQueueBarriers) {
+		if (barrier.first == texture) {
+			barrier.second = access;
+			return;
+		}
 	}
+
+	copyQueueBarriers.push_back({ texture, access });
 }
 
-void RT64::Device::setLastCopyQueueBarrier(const D3D12_RESOURCE_BARRIER &barrier) {
-	lastCopyQueueBarrier = barrier;
-	lastCopyQueueBarrierActive = true;
+void RT64::Device::cancelCopyQueueBarrier(RenderTexture *texture) {
+	assert(texture != nullptr);
+	copyQueueBarriers.erase(std::remove_if(copyQueueBarriers.begin(), copyQueueBarriers.end(), [texture](const std::pair<RenderTexture *, RenderTextureAccess> &barrier) {
+		return barrier.first == texture;
+	}), copyQueueBarriers.end());
 }
 
-void RT64::Device::submitCopyQueueBarrier() {
-	if (lastCopyQueueBarrierActive) {
-		d3dCommandList->ResourceBarrier(1, &lastCopyQueueBarrier);
-		lastCopyQueueBarrierActive = false;
+void RT64::Device::submitCopyQueueBarriers() {
+	RenderCommandList *commandList = renderDevice->getCommandList();
+	for (const auto &barrier : copyQueueBarriers) {
+		commandList->barrier(barrier.first, barrier.second);
 	}
+
+	copyQueueBarriers.clear();
 }
 
 int RT64::Device::getWidth() const {
@@ -383,6 +413,7 @@ void RT64::Device::loadPipeline() {
 	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 
 	D3D12_CHECK(d3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&d3dCommandQueue)));
+	createTimestampQueries();
 
 	// Describe and create the swap chain.
 	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
@@ -413,6 +444,14 @@ void RT64::Device::loadAssets() {
 		D3D12_COLOR_WRITE_ENABLE_ALL
 	};
 
+	const D3D12_RENDER_TARGET_BLEND_DESC opaqueBlendDesc = {
+		FALSE, FALSE,
+		D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
+		D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
+		D3D12_LOGIC_OP_NOOP,
+		D3D12_COLOR_WRITE_ENABLE_ALL
+	};
+
 	const D3D12_RENDER_TARGET_BLEND_DESC composeBlendDesc = {
 		TRUE, FALSE,
 		D3D12_BLEND_ONE, D3D12_BLEND_INV_SRC_ALPHA, D3D12_BLEND_OP_ADD,
@@ -442,6 +481,7 @@ void RT64::Device::loadAssets() {
 		psoDesc.SampleDesc.Count = 1;
 	};
 
+	// Root signatures are cheap to create, so they're all created before the pipelines that use them.
 	// Raster root signature.
 	{
 		nv_helpers_dx12::RootSignatureGenerator rsc;
@@ -454,123 +494,258 @@ void RT64::Device::loadAssets() {
 		d3dRootSignature = rsc.Generate(d3dDevice, false, true, true);
 	}
 
-	// Create the pipeline state, which includes compiling and loading shaders.
-	{
-		// Define the vertex input layout.
-		D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
-		{
-			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "COLOR", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 48, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "COLOR", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 64, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "COLOR", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 80, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "COLOR", 4, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 96, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-		};
-
-		// Describe and create the graphics pipeline state object (PSO).
-		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-		setPsoDefaults(psoDesc, alphaBlendDesc);
-		psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
-		psoDesc.pRootSignature = d3dRootSignature;
-		psoDesc.VS = CD3DX12_SHADER_BYTECODE(RasterVSBlob, sizeof(RasterVSBlob));
-		psoDesc.PS = CD3DX12_SHADER_BYTECODE(RasterPSBlob, sizeof(RasterPSBlob));
-		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		D3D12_CHECK(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&d3dPipelineState)));
-	}
-
 	// Im3d Root signature.
 	{
 		nv_helpers_dx12::RootSignatureGenerator rsc;
 		rsc.AddHeapRangesParameter({
-			{ UAV_INDEX(gHitDistance), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitDistance) },
-			{ UAV_INDEX(gHitColor), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitColor) },
-			{ UAV_INDEX(gHitNormal), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitNormal) },
-			{ UAV_INDEX(gHitInstanceId), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitInstanceId) },
-			{ UAV_INDEX(gHitSpecular), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitSpecular) },
+			{ UAV_INDEX(gHitBuffer), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitBuffer) },
 			{ CBV_INDEX(ViewParams), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, HEAP_INDEX(ViewParams) }
 		});
 
 		im3dRootSignature = rsc.Generate(d3dDevice, false, true, false);
 	}
 
-	// Im3d Pipeline state.
+	// Compose root signature.
 	{
-		// Define the vertex input layout.
-		D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
-		{
-			{ "POSITION_SIZE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0  }
-		};
-
-		// Describe and create the graphics pipeline state object (PSO).
-		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-		setPsoDefaults(psoDesc, alphaBlendDesc);
-
-		psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
-		psoDesc.pRootSignature = im3dRootSignature;
-		psoDesc.VS = CD3DX12_SHADER_BYTECODE(Im3DVSBlob, sizeof(Im3DVSBlob));
-		psoDesc.PS = CD3DX12_SHADER_BYTECODE(Im3DPSBlob, sizeof(Im3DPSBlob));
+		nv_helpers_dx12::RootSignatureGenerator rsc;
+		rsc.AddHeapRangesParameter({
+			{ 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0 }
+		});
 
-		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		D3D12_CHECK(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&im3dPipelineStateTriangle)));
+		// The region of the output that was traced, since it can be smaller than the output when the resolution is dynamic.
+		rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, 0, 0, 4);
+		d3dComposeRootSignature = rsc.Generate(d3dDevice, false, true, true);
+	}
 
-		psoDesc.GS = CD3DX12_SHADER_BYTECODE(Im3DGSPointsBlob, sizeof(Im3DGSPointsBlob));
-		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-		D3D12_CHECK(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&im3dPipelineStatePoint)));
+	// Upscale root signature.
+	{
+		nv_helpers_dx12::RootSignatureGenerator rsc;
+		rsc.AddHeapRangesParameter({
+			{ 0, 4, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0 }
+		});
 
-		psoDesc.GS = CD3DX12_SHADER_BYTECODE(Im3DGSLinesBlob, sizeof(Im3DGSLinesBlob));
-		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
-		D3D12_CHECK(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&im3dPipelineStateLine)));
+		rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, 0, 0, 7);
+		d3dUpscaleRootSignature = rsc.Generate(d3dDevice, false, true, false);
 	}
 
-	// Compose shader.
+	// Reconstruct root signature. The history is read as SRVs and the output buffers of the tracer are read and
+	// written as UAVs, which start after the registers of the render targets.
 	{
 		nv_helpers_dx12::RootSignatureGenerator rsc;
 		rsc.AddHeapRangesParameter({
-			{ 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0 }
+			{ 0, 3, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0 },
+			{ 3, 8, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3 }
 		});
 
-		d3dComposeRootSignature = rsc.Generate(d3dDevice, false, true, true);
+		rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, 0, 0, 8);
+		d3dReconstructRootSignature = rsc.Generate(d3dDevice, false, true, false);
 	}
 
+	// None of the pipelines depend on each other, so they're all created in parallel. The raytracing
+	// pipeline is by far the slowest one to create and it's started first.
+	openPipelineCache();
+	std::future<void> rtPipelineFuture = std::async(std::launch::async, [this]() {
+		createRaytracingPipeline();
+	});
+
+	auto shaderBytecode = [this](const char *name) {
+		const std::vector<uint8_t> &bytecode = shaderArchive->get(name);
+		return CD3DX12_SHADER_BYTECODE(bytecode.data(), bytecode.size());
+	};
+
+	// Raster pipeline state.
+	D3D12_INPUT_ELEMENT_DESC rasterInputElementDescs[] =
 	{
-		// Describe and create the graphics pipeline state object (PSO).
-		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-		setPsoDefaults(psoDesc, composeBlendDesc);
-		psoDesc.InputLayout = { nullptr, 0 };
-		psoDesc.pRootSignature = d3dComposeRootSignature;
-		psoDesc.VS = CD3DX12_SHADER_BYTECODE(ComposeVSBlob, sizeof(ComposeVSBlob));
-		psoDesc.PS = CD3DX12_SHADER_BYTECODE(ComposePSBlob, sizeof(ComposePSBlob));
-		psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		D3D12_CHECK(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&d3dComposePipelineState)));
-	}
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 48, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 64, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 80, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 4, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 96, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC rasterPsoDesc = {};
+	setPsoDefaults(rasterPsoDesc, alphaBlendDesc);
+	rasterPsoDesc.InputLayout = { rasterInputElementDescs, _countof(rasterInputElementDescs) };
+	rasterPsoDesc.pRootSignature = d3dRootSignature;
+	rasterPsoDesc.VS = shaderBytecode("RasterVS");
+	rasterPsoDesc.PS = shaderBytecode("RasterPS");
+	rasterPsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+
+	// Im3d pipeline states.
+	D3D12_INPUT_ELEMENT_DESC im3dInputElementDescs[] =
+	{
+		{ "POSITION_SIZE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0  }
+	};
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC im3dTrianglePsoDesc = {};
+	setPsoDefaults(im3dTrianglePsoDesc, alphaBlendDesc);
+	im3dTrianglePsoDesc.InputLayout = { im3dInputElementDescs, _countof(im3dInputElementDescs) };
+	im3dTrianglePsoDesc.pRootSignature = im3dRootSignature;
+	im3dTrianglePsoDesc.VS = shaderBytecode("Im3DVS");
+	im3dTrianglePsoDesc.PS = shaderBytecode("Im3DPS");
+	im3dTrianglePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC im3dPointPsoDesc = im3dTrianglePsoDesc;
+	im3dPointPsoDesc.GS = shaderBytecode("Im3DGSPoints");
+	im3dPointPsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC im3dLinePsoDesc = im3dTrianglePsoDesc;
+	im3dLinePsoDesc.GS = shaderBytecode("Im3DGSLines");
+	im3dLinePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+
+	// Compose pipeline state.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC composePsoDesc = {};
+	setPsoDefaults(composePsoDesc, composeBlendDesc);
+	composePsoDesc.InputLayout = { nullptr, 0 };
+	composePsoDesc.pRootSignature = d3dComposeRootSignature;
+	composePsoDesc.VS = shaderBytecode("ComposeVS");
+	composePsoDesc.PS = shaderBytecode("ComposePS");
+	composePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+
+	// Upscale pipeline state. It writes the color and the weight of the history at the same time.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC upscalePsoDesc = {};
+	setPsoDefaults(upscalePsoDesc, opaqueBlendDesc);
+	upscalePsoDesc.InputLayout = { nullptr, 0 };
+	upscalePsoDesc.pRootSignature = d3dUpscaleRootSignature;
+	upscalePsoDesc.VS = shaderBytecode("ComposeVS");
+	upscalePsoDesc.PS = shaderBytecode("UpscalePS");
+	upscalePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	upscalePsoDesc.NumRenderTargets = 2;
+	upscalePsoDesc.RTVFormats[0] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	upscalePsoDesc.RTVFormats[1] = DXGI_FORMAT_R32_FLOAT;
+
+	// Reconstruct pipeline state. It writes the color and the guides of the history at the same time.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC reconstructPsoDesc = {};
+	setPsoDefaults(reconstructPsoDesc, opaqueBlendDesc);
+	reconstructPsoDesc.InputLayout = { nullptr, 0 };
+	reconstructPsoDesc.pRootSignature = d3dReconstructRootSignature;
+	reconstructPsoDesc.VS = shaderBytecode("ComposeVS");
+	reconstructPsoDesc.PS = shaderBytecode("ReconstructPS");
+	reconstructPsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	reconstructPsoDesc.NumRenderTargets = 3;
+	reconstructPsoDesc.RTVFormats[0] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	reconstructPsoDesc.RTVFormats[1] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	reconstructPsoDesc.RTVFormats[2] = DXGI_FORMAT_R16_UINT;
+
+	auto createPipelineStateAsync = [this](const D3D12_GRAPHICS_PIPELINE_STATE_DESC &psoDesc) {
+		return std::async(std::launch::async, [this, psoDesc]() {
+			return createGraphicsPipelineState(psoDesc);
+		});
+	};
+
+	std::future<ID3D12PipelineState *> rasterFuture = createPipelineStateAsync(rasterPsoDesc);
+	std::future<ID3D12PipelineState *> im3dTriangleFuture = createPipelineStateAsync(im3dTrianglePsoDesc);
+	std::future<ID3D12PipelineState *> im3dPointFuture = createPipelineStateAsync(im3dPointPsoDesc);
+	std::future<ID3D12PipelineState *> im3dLineFuture = createPipelineStateAsync(im3dLinePsoDesc);
+	std::future<ID3D12PipelineState *> composeFuture = createPipelineStateAsync(composePsoDesc);
+	std::future<ID3D12PipelineState *> upscaleFuture = createPipelineStateAsync(upscalePsoDesc);
+	std::future<ID3D12PipelineState *> reconstructFuture = createPipelineStateAsync(reconstructPsoDesc);
+	d3dPipelineState = rasterFuture.get();
+	im3dPipelineStateTriangle = im3dTriangleFuture.get();
+	im3dPipelineStatePoint = im3dPointFuture.get();
+	im3dPipelineStateLine = im3dLineFuture.get();
+	d3dComposePipelineState = composeFuture.get();
+	d3dUpscalePipelineState = upscaleFuture.get();
+	d3dReconstructPipelineState = reconstructFuture.get();
+	rtPipelineFuture.get();
+
+	// The cache is only an optimization, so failing to write it isn't an error.
+	pipelineCache.save();
 
 	// Create the command list.
 	D3D12_CHECK(d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, d3dCommandAllocator, d3dPipelineState, IID_PPV_ARGS(&d3dCommandList)));
 
-	// Create synchronization objects and wait until assets have been uploaded to the GPU.
-	D3D12_CHECK(d3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&d3dFence)));
-	d3dFenceValue = 1;
+	// Resources used by the scene are created and recorded through the render interface.
+	renderDevice = new D3D12RenderDevice(d3dDevice, d3dAllocator, d3dCommandQueue, d3dCommandList);
 
-	// Create an event handle to use for frame synchronization.
-	d3dFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (d3dFenceEvent == nullptr) {
-		D3D12_CHECK(HRESULT_FROM_WIN32(GetLastError()));
-	}
+	// Create synchronization objects and wait until assets have been uploaded to the GPU.
+	renderContext = new RenderContext(renderDevice);
 
 	// Close command list and wait for it to finish.
 	waitForGPU();
 }
 
+void RT64::Device::openPipelineCache() {
+	// Blobs are only valid for the adapter and the driver that created them.
+	DXGI_ADAPTER_DESC1 desc;
+	D3D12_CHECK(d3dAdapter->GetDesc1(&desc));
+
+	LARGE_INTEGER driverVersion = {};
+	d3dAdapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+
+	const uint64_t environment[] = { desc.VendorId, desc.DeviceId, desc.SubSysId, desc.Revision, (uint64_t)(driverVersion.QuadPart), PipelineCache::FormatVersion };
+	const uint64_t environmentId = PipelineCache::hash(environment, sizeof(environment));
+
+	std::error_code ec;
+	std::filesystem::path cacheDirectory;
+	const char *localAppData = getenv("LOCALAPPDATA");
+	if (localAppData != nullptr) {
+		cacheDirectory = std::filesystem::u8path(localAppData) / "RT64";
+	}
+	else {
+		cacheDirectory = std::filesystem::temp_directory_path(ec) / "RT64";
+	}
+
+	pipelineCache.open((cacheDirectory / "pipelines.cache").u8string(), environmentId);
+}
+
+ID3D12PipelineState *RT64::Device::createGraphicsPipelineState(D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc) {
+	// The key only needs to tell apart the pipelines created by the device. A blob that doesn't match
+	// the description is rejected by the driver and the pipeline is just compiled again.
+	auto hashBytecode = [](const D3D12_SHADER_BYTECODE &bytecode, uint64_t seed) {
+		return PipelineCache::hash(bytecode.pShaderBytecode, bytecode.BytecodeLength, seed);
+	};
+
+	uint64_t key = hashBytecode(psoDesc.VS, 0);
+	key = hashBytecode(psoDesc.PS, key);
+	key = hashBytecode(psoDesc.GS, key);
+	key = PipelineCache::hash(&psoDesc.BlendState, sizeof(psoDesc.BlendState), key);
+	key = PipelineCache::hash(&psoDesc.RasterizerState, sizeof(psoDesc.RasterizerState), key);
+	key = PipelineCache::hash(&psoDesc.PrimitiveTopologyType, sizeof(psoDesc.PrimitiveTopologyType), key);
+	key = PipelineCache::hash(psoDesc.RTVFormats, sizeof(DXGI_FORMAT) * psoDesc.NumRenderTargets, key);
+	for (UINT i = 0; i < psoDesc.InputLayout.NumElements; i++) {
+		const D3D12_INPUT_ELEMENT_DESC &element = psoDesc.InputLayout.pInputElementDescs[i];
+		const uint32_t elementDesc[] = { element.SemanticIndex, (uint32_t)(element.Format), element.InputSlot, element.AlignedByteOffset };
+		key = PipelineCache::hash(element.SemanticName, strlen(element.SemanticName), key);
+		key = PipelineCache::hash(elementDesc, sizeof(elementDesc), key);
+	}
+
+	ID3D12PipelineState *pipelineState = nullptr;
+	std::vector<uint8_t> cachedBlob;
+	if (pipelineCache.find(key, cachedBlob)) {
+		psoDesc.CachedPSO = { cachedBlob.data(), cachedBlob.size() };
+		if (SUCCEEDED(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pipelineState)))) {
+			return pipelineState;
+		}
+
+		psoDesc.CachedPSO = {};
+	}
+
+	D3D12_CHECK(d3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pipelineState)));
+
+	ID3DBlob *blob = nullptr;
+	if (SUCCEEDED(pipelineState->GetCachedBlob(&blob))) {
+		pipelineCache.store(key, blob->GetBufferPointer(), blob->GetBufferSize());
+		blob->Release();
+	}
+
+	return pipelineState;
+}
+
 void RT64::Device::createRaytracingPipeline() {
 	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(d3dDevice);
 
 	// Shader libraries.
-	d3dTracerLibrary = new StaticBlob(TracerBlob, sizeof(TracerBlob));
-	d3dSurfaceLibrary = new StaticBlob(SurfaceBlob, sizeof(SurfaceBlob));
-	d3dShadowLibrary = new StaticBlob(ShadowBlob, sizeof(ShadowBlob));
+	const std::vector<uint8_t> &tracerBytecode = shaderArchive->get("Tracer");
+	const std::vector<uint8_t> &surfaceBytecode = shaderArchive->get("Surface");
+	const std::vector<uint8_t> &shadowBytecode = shaderArchive->get("Shadow");
+	d3dTracerLibrary = new StaticBlob(tracerBytecode.data(), tracerBytecode.size());
+	d3dSurfaceLibrary = new StaticBlob(surfaceBytecode.data(), surfaceBytecode.size());
+	d3dShadowLibrary = new StaticBlob(shadowBytecode.data(), shadowBytecode.size());
 
 	// Add shaders from library to the pipeline.
 	pipeline.AddLibrary(d3dTracerLibrary, { L"TraceRayGen" });
@@ -609,18 +784,28 @@ ID3D12RootSignature *RT64::Device::createTracerSignature() {
 		{ UAV_INDEX(gOutput), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gOutput) },
 		{ UAV_INDEX(gAlbedo), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gAlbedo) },
 		{ UAV_INDEX(gNormal), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gNormal) },
-		{ UAV_INDEX(gHitDistance), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitDistance) },
-		{ UAV_INDEX(gHitColor), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitColor) },
-		{ UAV_INDEX(gHitNormal), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitNormal) },
-		{ UAV_INDEX(gHitInstanceId), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitInstanceId) },
-		{ UAV_INDEX(gHitSpecular), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitSpecular) },
+		{ UAV_INDEX(gHitBuffer), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitBuffer) },
+		{ UAV_INDEX(gInstanceId), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gInstanceId) },
+		{ UAV_INDEX(gAccumColor), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gAccumColor) },
+		{ UAV_INDEX(gAccumDepth), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gAccumDepth) },
+		{ UAV_INDEX(gPrevAccumColor), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gPrevAccumColor) },
+		{ UAV_INDEX(gPrevAccumDepth), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gPrevAccumDepth) },
+		{ UAV_INDEX(gMotion), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gMotion) },
+		{ UAV_INDEX(gHitPrevPosition), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitPrevPosition) },
+		{ UAV_INDEX(gDepth), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gDepth) },
+		{ UAV_INDEX(gVarianceMoments), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gVarianceMoments) },
+		{ UAV_INDEX(gTileVariance), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gTileVariance) },
 		{ SRV_INDEX(gBackground), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(gBackground) },
 		{ SRV_INDEX(SceneBVH), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(SceneBVH) },
 		{ SRV_INDEX(SceneLights), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(SceneLights) },
 		{ SRV_INDEX(instanceProps), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(instanceProps) },
+		{ SRV_INDEX(gTileUnits), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(gTileUnits) },
 		{ CBV_INDEX(ViewParams), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, HEAP_INDEX(ViewParams) }
 	});
 
+	// Offset of the tile being traced. Stored directly in each ray generation record of the SBT.
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, CBV_INDEX(TileParams), 0, 2);
+
 	return rsc.Generate(d3dDevice, true, false, true);
 }
 
@@ -628,12 +813,12 @@ ID3D12RootSignature *RT64::Device::createSurfaceShadowSignature() {
 	nv_helpers_dx12::RootSignatureGenerator rsc;
 	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, SRV_INDEX(vertexBuffer));
 	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, SRV_INDEX(indexBuffer));
+
+	// The previous vertex buffer uses the same register as the vertex buffer in the next space.
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, SRV_INDEX(vertexBuffer), 1);
 	rsc.AddHeapRangesParameter({
-		{ UAV_INDEX(gHitDistance), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitDistance) },
-		{ UAV_INDEX(gHitColor), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitColor) },
-		{ UAV_INDEX(gHitNormal), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitNormal) },
-		{ UAV_INDEX(gHitInstanceId), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitInstanceId) },
-		{ UAV_INDEX(gHitSpecular), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitSpecular) },
+		{ UAV_INDEX(gHitBuffer), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitBuffer) },
+		{ UAV_INDEX(gHitPrevPosition), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, HEAP_INDEX(gHitPrevPosition) },
 		{ SRV_INDEX(instanceProps), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(instanceProps) },
 		{ SRV_INDEX(gTextures), 1024, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, HEAP_INDEX(gTextures) },
 		{ CBV_INDEX(ViewParams), 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, HEAP_INDEX(ViewParams) }
@@ -645,10 +830,12 @@ ID3D12RootSignature *RT64::Device::createSurfaceShadowSignature() {
 void RT64::Device::preRender() {
 	// Submit and wait for execution if command list was open.
 	if (d3dCommandListOpen) {
+		renderContext->queryCompactedSizes();
 		submitCommandList();
 		waitForGPU();
 	}
 
+	renderContext->releaseFrameResources();
 	resetCommandList();
 
 	// Set necessary state.
@@ -672,12 +859,15 @@ void RT64::Device::postRender(int vsyncInterval) {
 	CD3DX12_RESOURCE_BARRIER transitionBarrier = CD3DX12_RESOURCE_BARRIER::Transition(d3dRenderTargets[d3dFrameIndex], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
 	d3dCommandList->ResourceBarrier(1, &transitionBarrier);
 
+	resolveGpuTimers();
 	submitCommandList();
 
 	// Present the frame.
 	D3D12_CHECK(d3dSwapChain->Present(vsyncInterval, 0));
 
 	waitForGPU();
+	collectGpuTimers();
+	renderContext->releaseFrameResources();
 	d3dFrameIndex = d3dSwapChain->GetCurrentBackBufferIndex();
 
 	// Leave command list open.
@@ -685,8 +875,18 @@ void RT64::Device::postRender(int vsyncInterval) {
 }
 
 void RT64::Device::draw(int vsyncInterval) {
-	submitCommandQueueBarrier();
-	submitCopyQueueBarrier();
+	RT64_PROFILE_SCOPE(&profiler, "Draw", RT64_TIMING_CPU_DRAW);
+	submitCopyQueueBarriers();
+
+	// The bottom-level ASes must be ready before the scenes build their top-level ASes with them.
+	{
+		RT64_PROFILE_SCOPE(&profiler, "BLAS builds");
+		renderContext->uploadMeshVertices();
+		renderContext->prepareGeometryPools();
+		renderContext->compactBottomLevelASes();
+		renderContext->buildBottomLevelASes();
+		renderDevice->getCommandList()->accelerationStructureBarrier(nullptr);
+	}
 	
 	// Make sure that the size of the window is up to date.
 	updateSize();
@@ -703,6 +903,12 @@ void RT64::Device::draw(int vsyncInterval) {
 		scene->render();
 	}
 
+	// Capture the frame before the inspectors are drawn on top of it.
+	{
+		RT64_PROFILE_SCOPE(&profiler, "Capture");
+		captureRenderTarget();
+	}
+
 	// Scene has most likely changed the render target. Set it again for the inspectors to work properly.
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle = getD3D12RTV();
 	d3dCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
@@ -723,13 +929,22 @@ void RT64::Device::draw(int vsyncInterval) {
 
 	// Render the inspectors on the active view.
 	if (activeView != nullptr) {
+		RT64_PROFILE_SCOPE(&profiler, "Inspectors");
 		for (Inspector *inspector : inspectors) {
 			inspector->render(activeView, cursorPos.x, cursorPos.y);
 			inspector->reset();
 		}
 	}
 
-	postRender(vsyncInterval);
+	{
+		RT64_PROFILE_SCOPE(&profiler, "Present", RT64_TIMING_CPU_PRESENT);
+		postRender(vsyncInterval);
+	}
+
+	Counters *counters = renderContext->getCounters();
+	lastFrameCounters = *counters;
+	counters->resetFrame();
+	profiler.nextFrame();
 }
 
 void RT64::Device::addScene(Scene *scene) {
@@ -774,20 +989,42 @@ void RT64::Device::submitCommandList() {
 }
 
 void RT64::Device::waitForGPU() {
-	// Schedule a signal command in the queue.
-	d3dCommandQueue->Signal(d3dFence, d3dFenceValue);
+	renderContext->waitForGPU();
+}
 
-	// Wait until the fence has been processed.
-	d3dFence->SetEventOnCompletion(d3dFenceValue, d3dFenceEvent);
-	WaitForSingleObjectEx(d3dFenceEvent, INFINITE, FALSE);
+UINT64 RT64::Device::getFenceValue() const {
+	return renderContext->getFenceValue();
+}
 
-	// Increment the fence value.
-	d3dFenceValue++;
+UINT64 RT64::Device::getCompletedFenceValue() const {
+	return renderContext->getCompletedFenceValue();
 }
 
-void RT64::Device::dumpRenderTarget(const std::string &path) {
-	ID3D12Resource *renderTarget = getD3D12RenderTarget();
+void RT64::Device::captureRenderTarget() {
+	// Hand over the frames the GPU has finished copying since the last time.
+	collectCapturedFrames(false);
 
+	if (captureFramesLeft == 0) {
+		return;
+	}
+
+	// Only happens if the GPU falls behind by more frames than the size of the ring.
+	CaptureSlot &slot = captureSlots[captureSlotIndex];
+	if (slot.pending) {
+		collectCapturedFrames(true);
+	}
+
+	slot.width = width;
+	slot.height = height;
+	slot.rowPitch = ROUND_UP(width * 4, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UINT64 readbackSize = (UINT64)(slot.rowPitch) * height;
+	if (slot.readbackSize != readbackSize) {
+		slot.readback.Release();
+		slot.readback = allocateBuffer(D3D12_HEAP_TYPE_READBACK, readbackSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+		slot.readbackSize = readbackSize;
+	}
+
+	ID3D12Resource *renderTarget = getD3D12RenderTarget();
 	CD3DX12_RESOURCE_BARRIER transitionBarrier = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
 	d3dCommandList->ResourceBarrier(1, &transitionBarrier);
 
@@ -796,54 +1033,291 @@ void RT64::Device::dumpRenderTarget(const std::string &path) {
 	source.SubresourceIndex = 0;
 	source.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
 
-	D3D12_SUBRESOURCE_FOOTPRINT subresource = {};
-	subresource.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	subresource.Width = width;
-	subresource.Height = height;
-	subresource.RowPitch = d3dRenderTargetReadbackRowWidth;
-	subresource.Depth = 1;
-
-	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-	footprint.Offset = 0;
-	footprint.Footprint = subresource;
-
 	D3D12_TEXTURE_COPY_LOCATION destination = {};
-	destination.pResource = d3dRenderTargetReadback.Get();
-	destination.PlacedFootprint = footprint;
+	destination.pResource = slot.readback.Get();
 	destination.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-
+	destination.PlacedFootprint.Offset = 0;
+	destination.PlacedFootprint.Footprint.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	destination.PlacedFootprint.Footprint.Width = width;
+	destination.PlacedFootprint.Footprint.Height = height;
+	destination.PlacedFootprint.Footprint.Depth = 1;
+	destination.PlacedFootprint.Footprint.RowPitch = slot.rowPitch;
 	d3dCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
 
 	transitionBarrier = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
 	d3dCommandList->ResourceBarrier(1, &transitionBarrier);
 
-	// Wait until the resource is actually copied.
-	submitCommandList();
-	waitForGPU();
-	resetCommandList();
-	
-	// Save the render target copy to the target path.
-	unsigned char *bmpRGB = (unsigned char *)(malloc(width * height * 3));
-	{
-		UINT8 *pData;
-		d3dRenderTargetReadback.Get()->Map(0, nullptr, reinterpret_cast<void **>(&pData));
-		int i = 0;
-		for (int y = 0; y < height; y++) {
-			for (int x = 0; x < width; x++) {
-				bmpRGB[i++] = pData[y * d3dRenderTargetReadbackRowWidth + x * 4 + 0];
-				bmpRGB[i++] = pData[y * d3dRenderTargetReadbackRowWidth + x * 4 + 1];
-				bmpRGB[i++] = pData[y * d3dRenderTargetReadbackRowWidth + x * 4 + 2];
+	// The copy is done once the GPU signals the fence value that will be used after this command list is submitted.
+	const int LeadingZeroes = 8;
+	std::ostringstream oss;
+	oss << captureDirectory << "/" << std::setw(LeadingZeroes) << std::setfill('0') << captureFrameNumber++ << "." << FrameEncoder::getExtension(captureFormat);
+	slot.path = oss.str();
+	slot.format = captureFormat;
+	slot.fenceValue = getFenceValue();
+	slot.pending = true;
+	captureSlotIndex = (captureSlotIndex + 1) % CaptureRingSize;
+
+	if (captureFramesLeft > 0) {
+		captureFramesLeft--;
+	}
+}
+
+void RT64::Device::collectCapturedFrames(bool waitForCompletion) {
+	if (frameEncoder == nullptr) {
+		return;
+	}
+
+	// Visit the slots from the oldest to the newest so the frames are submitted in order.
+	for (UINT i = 0; i < CaptureRingSize; i++) {
+		CaptureSlot &slot = captureSlots[(captureSlotIndex + i) % CaptureRingSize];
+		if (!slot.pending) {
+			continue;
+		}
+
+		if (getCompletedFenceValue() < slot.fenceValue) {
+			if (!waitForCompletion) {
+				break;
 			}
+
+			waitForGPU();
 		}
-		d3dRenderTargetReadback.Get()->Unmap(0, nullptr);
+
+		FrameEncoder::Frame frame;
+		frame.width = slot.width;
+		frame.height = slot.height;
+		frame.format = slot.format;
+		frame.path = slot.path;
+		frame.rgba.resize((size_t)(slot.width) * slot.height * 4);
+
+		const size_t rowSize = (size_t)(slot.width) * 4;
+		UINT8 *pData;
+		D3D12_CHECK(slot.readback.Get()->Map(0, nullptr, reinterpret_cast<void **>(&pData)));
+		for (int y = 0; y < slot.height; y++) {
+			memcpy(&frame.rgba[y * rowSize], pData + (size_t)(y) * slot.rowPitch, rowSize);
+		}
+
+		CD3DX12_RANGE emptyRange(0, 0);
+		slot.readback.Get()->Unmap(0, &emptyRange);
+		slot.pending = false;
+
+		// Blocks if the encoders have too many frames queued already.
+		frameEncoder->submit(std::move(frame));
 	}
+}
 
-	stbi_write_bmp(path.c_str(), width, height, 3, bmpRGB);
-	free(bmpRGB);
+void RT64::Device::releaseCaptureBuffers() {
+	collectCapturedFrames(true);
 
-	// Reset the current render target.
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle = getD3D12RTV();
-	d3dCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+	for (UINT i = 0; i < CaptureRingSize; i++) {
+		captureSlots[i].readback.Release();
+		captureSlots[i].readbackSize = 0;
+	}
+}
+
+void RT64::Device::captureFrames(const std::string &directory, int format, int frameCount) {
+	captureFramesLeft = frameCount;
+	if (frameCount == 0) {
+		return;
+	}
+
+	if (frameEncoder == nullptr) {
+		frameEncoder = new FrameEncoder();
+	}
+
+	std::filesystem::create_directories(directory);
+	captureDirectory = directory;
+	captureFormat = (FrameEncoder::Format)(format);
+	captureFrameNumber = 0;
+}
+
+bool RT64::Device::isCapturingFrames() const {
+	return captureFramesLeft != 0;
+}
+
+RT64::Profiler *RT64::Device::getProfiler() {
+	return &profiler;
+}
+
+RT64::Device::Counters *RT64::Device::getCounters() {
+	return renderContext->getCounters();
+}
+
+void RT64::Device::setBuildBudget(unsigned int primitivesPerFrame) {
+	renderContext->setBuildBudget(primitivesPerFrame);
+}
+
+void RT64::Device::retire(RenderBuffer *buffer) {
+	renderContext->retire(buffer);
+}
+
+void RT64::Device::retire(RenderTexture *texture) {
+	renderContext->retire(texture);
+}
+
+void RT64::Device::retire(const RetirementQueue::Callback &callback) {
+	renderContext->retire(callback);
+}
+
+void RT64::Device::retire(AllocatedResource &resource) {
+	if (resource.IsNull()) {
+		return;
+	}
+
+	AllocatedResource retired = resource;
+	renderContext->retire([retired]() mutable {
+		retired.Release();
+	});
+
+	resource = AllocatedResource();
+}
+
+RT64::RenderBuffer *RT64::Device::createUploadBuffer(uint64_t size) {
+	return renderContext->createUploadBuffer(size);
+}
+
+void RT64::Device::retireUploadBuffer(RenderBuffer *buffer) {
+	renderContext->retireUploadBuffer(buffer);
+}
+
+void RT64::Device::getStats(RT64_DEVICE_STATS *stats) {
+	assert(stats != nullptr);
+	stats->rtInstances = lastFrameCounters.rtInstances;
+	stats->rasterBgInstances = lastFrameCounters.rasterBgInstances;
+	stats->rasterFgInstances = lastFrameCounters.rasterFgInstances;
+	stats->tlasBytes = lastFrameCounters.tlasBytes;
+	stats->descriptorsUsed = lastFrameCounters.descriptorsUsed;
+	stats->blasBuilds = lastFrameCounters.blasBuilds;
+	stats->blasUpdates = lastFrameCounters.blasUpdates;
+	stats->blasBuildsPending = (unsigned int)(renderContext->getPendingBuildCount());
+	stats->tlasBuilds = lastFrameCounters.tlasBuilds;
+	stats->tlasRefits = lastFrameCounters.tlasRefits;
+	stats->bytesUploaded = lastFrameCounters.bytesUploaded;
+	stats->sceneCount = (unsigned int)(scenes.size());
+	const Counters *counters = renderContext->getCounters();
+	GeometryPool *vertexPool = renderContext->getVertexPool();
+	GeometryPool *indexPool = renderContext->getIndexPool();
+	stats->meshCount = counters->meshCount;
+	stats->textureCount = counters->textureCount;
+	stats->blasBytes = counters->blasBytes;
+	stats->blasUncompactedBytes = counters->blasUncompactedBytes;
+	stats->scratchBytes = renderContext->getScratchPool()->getCapacity();
+	stats->geometryBytes = vertexPool->getAllocatedBytes() + indexPool->getAllocatedBytes();
+	stats->geometryCapacityBytes = vertexPool->getCapacityBytes() + indexPool->getCapacityBytes();
+	stats->geometryBlockCount = (unsigned int)(vertexPool->getBlockCount() + indexPool->getBlockCount());
+
+	// Walks every allocation, so it's only done when the stats are requested.
+	D3D12MA::Stats allocatorStats = {};
+	d3dAllocator->CalculateStats(&allocatorStats);
+	for (int h = 0; h < RT64_HEAP_COUNT; h++) {
+		stats->heapUsedBytes[h] = allocatorStats.HeapType[h].UsedBytes;
+		stats->heapAllocationCount[h] = allocatorStats.HeapType[h].AllocationCount;
+	}
+
+	D3D12MA::Budget gpuBudget = {}, cpuBudget = {};
+	d3dAllocator->GetBudget(&gpuBudget, &cpuBudget);
+	stats->gpuUsageBytes = gpuBudget.UsageBytes;
+	stats->gpuBudgetBytes = gpuBudget.BudgetBytes;
+	stats->cpuUsageBytes = cpuBudget.UsageBytes;
+	stats->cpuBudgetBytes = cpuBudget.BudgetBytes;
+}
+
+int RT64::Device::beginGpuTimer(const char *name, int stage, float *milliseconds) {
+	// Timers past the limit are ignored instead of failing the frame.
+	if (gpuTimers.size() >= MaxGpuTimers) {
+		return -1;
+	}
+
+	int timer = (int)(gpuTimers.size());
+	gpuTimers.push_back({ name, stage, profiler.getFrameIndex(), milliseconds, false });
+	d3dCommandList->EndQuery(d3dTimestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, timer * 2);
+	return timer;
+}
+
+void RT64::Device::endGpuTimer(int timer) {
+	if ((timer < 0) || (timer >= (int)(gpuTimers.size()))) {
+		return;
+	}
+
+	d3dCommandList->EndQuery(d3dTimestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, timer * 2 + 1);
+	gpuTimers[timer].ended = true;
+}
+
+bool RT64::Device::getFrameTimings(RT64_FRAME_TIMINGS *timings) const {
+	assert(timings != nullptr);
+
+	// Only frames that have been presented have both their CPU and GPU timings.
+	uint64_t frameIndex = profiler.getFrameIndex();
+	if (frameIndex == 0) {
+		return false;
+	}
+
+	double durationsUs[RT64_TIMING_COUNT];
+	timings->frameIndex = frameIndex - 1;
+	profiler.getStageDurations(timings->frameIndex, durationsUs, RT64_TIMING_COUNT);
+	for (int s = 0; s < RT64_TIMING_COUNT; s++) {
+		timings->milliseconds[s] = (float)(durationsUs[s] / 1000.0);
+	}
+
+	return true;
+}
+
+bool RT64::Device::exportChromeTrace(const std::string &path) const {
+	return profiler.exportChromeTrace(path);
+}
+
+void RT64::Device::createTimestampQueries() {
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = MaxGpuTimers * 2;
+	D3D12_CHECK(d3dDevice->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&d3dTimestampQueryHeap)));
+	D3D12_CHECK(d3dCommandQueue->GetTimestampFrequency(&d3dTimestampFrequency));
+	d3dTimestampReadback = allocateBuffer(D3D12_HEAP_TYPE_READBACK, MaxGpuTimers * 2 * sizeof(UINT64), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+	gpuTimers.reserve(MaxGpuTimers);
+}
+
+void RT64::Device::resolveGpuTimers() {
+	if (!gpuTimers.empty()) {
+		d3dCommandList->ResolveQueryData(d3dTimestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0, (UINT)(gpuTimers.size() * 2), d3dTimestampReadback.Get(), 0);
+	}
+}
+
+void RT64::Device::collectGpuTimers() {
+	if (gpuTimers.empty()) {
+		return;
+	}
+
+	// Place the GPU timestamps on the profiler's timeline by using the queue's calibration between the GPU and the CPU clocks.
+	UINT64 gpuCalibration = 0, cpuCalibration = 0;
+	LARGE_INTEGER qpcFrequency, qpcNow;
+	D3D12_CHECK(d3dCommandQueue->GetClockCalibration(&gpuCalibration, &cpuCalibration));
+	QueryPerformanceFrequency(&qpcFrequency);
+	QueryPerformanceCounter(&qpcNow);
+	const double calibrationUs = profiler.now() - (double)(qpcNow.QuadPart - (LONGLONG)(cpuCalibration)) * 1000000.0 / qpcFrequency.QuadPart;
+	const double ticksToUs = 1000000.0 / d3dTimestampFrequency;
+
+	const size_t readSize = gpuTimers.size() * 2 * sizeof(UINT64);
+	D3D12_RANGE readRange = { 0, readSize };
+	UINT64 *timestamps;
+	D3D12_CHECK(d3dTimestampReadback.Get()->Map(0, &readRange, (void **)(&timestamps)));
+	for (size_t i = 0; i < gpuTimers.size(); i++) {
+		const GpuTimer &timer = gpuTimers[i];
+		UINT64 beginTimestamp = timestamps[i * 2 + 0];
+		UINT64 endTimestamp = timestamps[i * 2 + 1];
+		if (!timer.ended || (endTimestamp < beginTimestamp)) {
+			continue;
+		}
+
+		double startUs = calibrationUs + ((double)(beginTimestamp) - (double)(gpuCalibration)) * ticksToUs;
+		double durationUs = (double)(endTimestamp - beginTimestamp) * ticksToUs;
+		profiler.record(timer.name, timer.stage, Profiler::Track::GPU, timer.frame, startUs, durationUs);
+		if (timer.milliseconds != nullptr) {
+			*timer.milliseconds += (float)(durationUs / 1000.0);
+		}
+	}
+
+	D3D12_RANGE writtenRange = { 0, 0 };
+	d3dTimestampReadback.Get()->Unmap(0, &writtenRange);
+	gpuTimers.clear();
 }
 
 #endif
@@ -877,4 +1351,55 @@ DLLEXPORT void RT64_DrawDevice(RT64_DEVICE *devicePtr, int vsyncInterval) {
 	RT64_CATCH_EXCEPTION();
 }
 
+DLLEXPORT void RT64_SetBuildBudget(RT64_DEVICE *devicePtr, unsigned int primitivesPerFrame) {
+	assert(devicePtr != nullptr);
+	try {
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		device->setBuildBudget(primitivesPerFrame);
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
+DLLEXPORT void RT64_GetDeviceStats(RT64_DEVICE *devicePtr, RT64_DEVICE_STATS *stats) {
+	assert(devicePtr != nullptr);
+	try {
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		device->getStats(stats);
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
+DLLEXPORT bool RT64_GetFrameTimings(RT64_DEVICE *devicePtr, RT64_FRAME_TIMINGS *timings) {
+	assert(devicePtr != nullptr);
+	assert(timings != nullptr);
+	try {
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		return device->getFrameTimings(timings);
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
+DLLEXPORT bool RT64_ExportChromeTrace(RT64_DEVICE *devicePtr, const char *path) {
+	assert(devicePtr != nullptr);
+	assert(path != nullptr);
+	try {
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		return device->exportChromeTrace(path);
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
+DLLEXPORT void RT64_CaptureFrames(RT64_DEVICE *devicePtr, const char *directory, int format, int frameCount) {
+	assert(devicePtr != nullptr);
+	assert((frameCount == 0) || (directory != nullptr));
+	assert((format >= RT64_CAPTURE_FORMAT_BMP) && (format <= RT64_CAPTURE_FORMAT_EXR));
+	try {
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		device->captureFrames((directory != nullptr) ? directory : std::string(), format, frameCount);
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
 #endif
\ No newline at end of file
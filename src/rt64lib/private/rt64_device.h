@@ -7,10 +7,16 @@
 #include "rt64_common.h"
 
 #ifndef RT64_MINIMAL
-#include "nv_helpers_dx12/BottomLevelASGenerator.h"
 #include "nv_helpers_dx12/RaytracingPipelineGenerator.h"
 #include "nv_helpers_dx12/RootSignatureGenerator.h"
 #include "nv_helpers_dx12/ShaderBindingTableGenerator.h"
+
+#include "rt64_frame_encoder.h"
+#include "rt64_pipeline_cache.h"
+#include "rt64_shader_archive.h"
+#include "rt64_profiler.h"
+#include "rt64_render_context.h"
+#include "rt64_render_interface_d3d12.h"
 #endif
 
 namespace RT64 {
@@ -19,6 +25,10 @@ namespace RT64 {
 	class Texture;
 
 	class Device {
+#ifndef RT64_MINIMAL
+	public:
+		typedef RenderContext::Counters Counters;
+#endif
 	private:
 		IDXGIAdapter1 *d3dAdapter;
 		ID3D12Device8 *d3dDevice;
@@ -30,6 +40,34 @@ namespace RT64 {
 #ifndef RT64_MINIMAL
 		static const UINT FrameCount = 2;
 
+		// Captured frames are copied into a ring of readback buffers and only read back once the
+		// GPU is done with them, so capturing never has to stall the frame that's being rendered.
+		static const UINT CaptureRingSize = 3;
+
+		struct CaptureSlot {
+			AllocatedResource readback;
+			UINT64 readbackSize = 0;
+			UINT64 fenceValue = 0;
+			UINT rowPitch = 0;
+			int width = 0;
+			int height = 0;
+			FrameEncoder::Format format = FrameEncoder::Format::PNG;
+			std::string path;
+			bool pending = false;
+		};
+
+		// GPU timers are pairs of timestamp queries that get resolved at the end of the frame and are
+		// added to the profiler once the device has waited for the GPU.
+		static const UINT MaxGpuTimers = 64;
+
+		struct GpuTimer {
+			const char *name;
+			int stage;
+			uint64_t frame;
+			float *milliseconds;
+			bool ended;
+		};
+
 		HWND hwnd;
 		int width;
 		int height;
@@ -40,16 +78,28 @@ namespace RT64 {
 		CD3DX12_VIEWPORT d3dViewport;
 		CD3DX12_RECT d3dScissorRect;
 		UINT d3dFrameIndex;
-		HANDLE d3dFenceEvent;
-		ID3D12Fence *d3dFence;
-		UINT64 d3dFenceValue;
 		D3D12MA::Allocator *d3dAllocator;
 		ID3D12CommandQueue *d3dCommandQueue;
 		ID3D12GraphicsCommandList4 *d3dCommandList;
+		RenderDevice *renderDevice;
+		RenderContext *renderContext;
 		IDXGISwapChain3 *d3dSwapChain;
 		ID3D12Resource *d3dRenderTargets[FrameCount];
-		AllocatedResource d3dRenderTargetReadback;
-		UINT d3dRenderTargetReadbackRowWidth;
+		CaptureSlot captureSlots[CaptureRingSize];
+		UINT captureSlotIndex;
+		FrameEncoder *frameEncoder;
+		std::string captureDirectory;
+		FrameEncoder::Format captureFormat;
+		int captureFramesLeft;
+		int captureFrameNumber;
+		Profiler profiler;
+		ID3D12QueryHeap *d3dTimestampQueryHeap;
+		AllocatedResource d3dTimestampReadback;
+		UINT64 d3dTimestampFrequency;
+		std::vector<GpuTimer> gpuTimers;
+		Counters lastFrameCounters;
+		PipelineCache pipelineCache;
+		ShaderArchive *shaderArchive;
 		ID3D12CommandAllocator *d3dCommandAllocator;
 		ID3D12RootSignature *d3dRootSignature;
 		ID3D12DescriptorHeap *d3dRtvHeap;
@@ -57,6 +107,10 @@ namespace RT64 {
 		ID3D12DescriptorHeap *d3dDsvHeap;
 		ID3D12RootSignature *d3dComposeRootSignature;
 		ID3D12PipelineState *d3dComposePipelineState;
+		ID3D12RootSignature *d3dUpscaleRootSignature;
+		ID3D12PipelineState *d3dUpscalePipelineState;
+		ID3D12RootSignature *d3dReconstructRootSignature;
+		ID3D12PipelineState *d3dReconstructPipelineState;
 		UINT d3dRtvDescriptorSize;
 		IDxcBlob *d3dTracerLibrary;
 		IDxcBlob *d3dSurfaceLibrary;
@@ -69,10 +123,7 @@ namespace RT64 {
 		ID3D12RootSignature *im3dRootSignature;
 		ID3D12StateObject *d3dRtStateObject;
 		ID3D12StateObjectProperties *d3dRtStateObjectProps;
-		D3D12_RESOURCE_BARRIER lastCommandQueueBarrier;
-		bool lastCommandQueueBarrierActive;
-		D3D12_RESOURCE_BARRIER lastCopyQueueBarrier;
-		bool lastCopyQueueBarrierActive;
+		std::vector<std::pair<RenderTexture *, RenderTextureAccess>> copyQueueBarriers;
 		bool d3dCommandListOpen;
 
 		void updateSize();
@@ -80,11 +131,19 @@ namespace RT64 {
 		void createRTVs();
 		void loadPipeline();
 		void loadAssets();
+		void openPipelineCache();
+		ID3D12PipelineState *createGraphicsPipelineState(D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc);
 		void createRaytracingPipeline();
 		ID3D12RootSignature *createTracerSignature();
 		ID3D12RootSignature *createSurfaceShadowSignature();
 		void preRender();
 		void postRender(int vsyncInterval);
+		void captureRenderTarget();
+		void collectCapturedFrames(bool waitForCompletion);
+		void releaseCaptureBuffers();
+		void createTimestampQueries();
+		void resolveGpuTimers();
+		void collectGpuTimers();
 #endif
 	public:
 		Device(HWND hwnd);
@@ -98,6 +157,8 @@ namespace RT64 {
 		HWND getHwnd() const;
 		ID3D12Device8 *getD3D12Device();
 		ID3D12GraphicsCommandList4 *getD3D12CommandList();
+		RenderDevice *getRenderDevice();
+		RenderContext *getRenderContext();
 		ID3D12StateObject *getD3D12RtStateObject();
 		ID3D12StateObjectProperties *getD3D12RtStateObjectProperties();
 		ID3D12Resource *getD3D12RenderTarget();
@@ -106,25 +167,55 @@ namespace RT64 {
 		ID3D12PipelineState *getD3D12PipelineState();
 		ID3D12RootSignature *getComposeRootSignature();
 		ID3D12PipelineState *getComposePipelineState();
+		ID3D12RootSignature *getUpscaleRootSignature();
+		ID3D12PipelineState *getUpscalePipelineState();
+		ID3D12RootSignature *getReconstructRootSignature();
+		ID3D12PipelineState *getReconstructPipelineState();
 		ID3D12RootSignature *getIm3dRootSignature();
 		ID3D12PipelineState *getIm3dPipelineStatePoint();
 		ID3D12PipelineState *getIm3dPipelineStateLine();
 		ID3D12PipelineState *getIm3dPipelineStateTriangle();
+		ShaderArchive *getShaderArchive();
 		CD3DX12_VIEWPORT getD3D12Viewport();
 		CD3DX12_RECT getD3D12ScissorRect(); 
 		AllocatedResource allocateResource(D3D12_HEAP_TYPE HeapType, _In_  const D3D12_RESOURCE_DESC *pDesc, D3D12_RESOURCE_STATES InitialResourceState, _In_opt_  const D3D12_CLEAR_VALUE *pOptimizedClearValue, bool committed = false, bool shared = false);
 		AllocatedResource allocateBuffer(D3D12_HEAP_TYPE HeapType, uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES InitialResourceState, bool committed = false, bool shared = false);
-		void setLastCommandQueueBarrier(const D3D12_RESOURCE_BARRIER &barrier);
-		void submitCommandQueueBarrier();
-		void setLastCopyQueueBarrier(const D3D12_RESOURCE_BARRIER &barrier);
-		void submitCopyQueueBarrier();
+		// Transitions the texture once the uploads recorded between frames are done. Only the last access given for
+		// each texture is used.
+		void addCopyQueueBarrier(RenderTexture *texture, RenderTextureAccess access);
+		void cancelCopyQueueBarrier(RenderTexture *texture);
+		void submitCopyQueueBarriers();
 		int getWidth() const;
 		int getHeight() const;
 		float getAspectRatio() const;
 		void resetCommandList();
 		void submitCommandList();
 		void waitForGPU();
-		void dumpRenderTarget(const std::string &path);
+		UINT64 getFenceValue() const;
+		UINT64 getCompletedFenceValue() const;
+		void captureFrames(const std::string &directory, int format, int frameCount);
+		bool isCapturingFrames() const;
+		Profiler *getProfiler();
+		Counters *getCounters();
+		void setBuildBudget(unsigned int primitivesPerFrame);
+
+		// Resources are released once the GPU is done with the commands that have been recorded so far.
+		void retire(RenderBuffer *buffer);
+		void retire(RenderTexture *texture);
+		void retire(const RetirementQueue::Callback &callback);
+
+		// Takes over the allocation and clears the handle, so the owner can allocate a new one right away.
+		void retire(AllocatedResource &resource);
+
+		// Upload buffers are recycled by a cache once they're retired, so the next uploads of the same size can reuse them.
+		RenderBuffer *createUploadBuffer(uint64_t size);
+		void retireUploadBuffer(RenderBuffer *buffer);
+		void getStats(RT64_DEVICE_STATS *stats);
+		// The duration of the timer is also added to the milliseconds once the frame is done, if they're provided.
+		int beginGpuTimer(const char *name, int stage = -1, float *milliseconds = nullptr);
+		void endGpuTimer(int timer);
+		bool getFrameTimings(RT64_FRAME_TIMINGS *timings) const;
+		bool exportChromeTrace(const std::string &path) const;
 #endif
 	};
 };
\ No newline at end of file
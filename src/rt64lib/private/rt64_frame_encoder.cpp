@@ -0,0 +1,201 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_frame_encoder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSSE3__)
+#	include <tmmintrin.h>
+#	define FRAME_ENCODER_SSSE3
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+#define TINYEXR_IMPLEMENTATION
+#include "tinyexr/tinyexr.h"
+
+namespace {
+	struct SRGBToLinearTable {
+		float values[256];
+
+		SRGBToLinearTable() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				values[i] = (c <= 0.04045f) ? (c / 12.92f) : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	const SRGBToLinearTable SRGBToLinear;
+};
+
+// Private
+
+void RT64::FrameEncoder::workerLoop() {
+	for (;;) {
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueChanged.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				return;
+			}
+
+			frame = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		// Let the producer know there's room in the queue again.
+		queueChanged.notify_all();
+
+		bool encoded = encode(frame);
+
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			framesInFlight--;
+			if (!encoded) {
+				framesFailed++;
+			}
+		}
+
+		queueChanged.notify_all();
+	}
+}
+
+bool RT64::FrameEncoder::encode(const Frame &frame) {
+	const size_t pixelCount = (size_t)(frame.width) * frame.height;
+	switch (frame.format) {
+	case Format::BMP:
+	case Format::PNG: {
+		std::vector<uint8_t> rgb(pixelCount * 3);
+		convertRGBA8ToRGB8(frame.rgba.data(), rgb.data(), pixelCount);
+		if (frame.format == Format::BMP) {
+			return stbi_write_bmp(frame.path.c_str(), frame.width, frame.height, 3, rgb.data()) != 0;
+		}
+		else {
+			return stbi_write_png(frame.path.c_str(), frame.width, frame.height, 3, rgb.data(), frame.width * 3) != 0;
+		}
+	}
+	case Format::EXR: {
+		std::vector<float> rgb(pixelCount * 3);
+		convertRGBA8ToLinearRGB32F(frame.rgba.data(), rgb.data(), pixelCount);
+
+		const char *err = nullptr;
+		int result = SaveEXR(rgb.data(), frame.width, frame.height, 3, 1, frame.path.c_str(), &err);
+		if (err != nullptr) {
+			FreeEXRErrorMessage(err);
+		}
+
+		return result == TINYEXR_SUCCESS;
+	}
+	default:
+		return false;
+	}
+}
+
+// Public
+
+RT64::FrameEncoder::FrameEncoder(unsigned int threadCount, size_t maxQueuedFrames) {
+	if (threadCount == 0) {
+		threadCount = std::max(std::thread::hardware_concurrency() / 2, 1U);
+	}
+
+	this->maxQueuedFrames = (maxQueuedFrames > 0) ? maxQueuedFrames : (size_t)(threadCount) * 2;
+	framesInFlight = 0;
+	framesFailed = 0;
+	stopping = false;
+
+	threads.reserve(threadCount);
+	for (unsigned int t = 0; t < threadCount; t++) {
+		threads.emplace_back(&FrameEncoder::workerLoop, this);
+	}
+}
+
+RT64::FrameEncoder::~FrameEncoder() {
+	// Workers only stop once the queue is empty, so every submitted frame is still written.
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+
+	queueChanged.notify_all();
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
+
+void RT64::FrameEncoder::submit(Frame &&frame) {
+	assert(frame.rgba.size() >= (size_t)(frame.width) * frame.height * 4);
+
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		queueChanged.wait(lock, [this]() { return queue.size() < maxQueuedFrames; });
+		queue.push_back(std::move(frame));
+		framesInFlight++;
+	}
+
+	queueChanged.notify_all();
+}
+
+void RT64::FrameEncoder::flush() {
+	std::unique_lock<std::mutex> lock(queueMutex);
+	queueChanged.wait(lock, [this]() { return framesInFlight == 0; });
+}
+
+size_t RT64::FrameEncoder::getQueuedFrameCount() {
+	std::unique_lock<std::mutex> lock(queueMutex);
+	return framesInFlight;
+}
+
+size_t RT64::FrameEncoder::getFailedFrameCount() {
+	std::unique_lock<std::mutex> lock(queueMutex);
+	return framesFailed;
+}
+
+void RT64::FrameEncoder::convertRGBA8ToRGB8(const uint8_t *src, uint8_t *dst, size_t pixelCount) {
+	size_t i = 0;
+#ifdef FRAME_ENCODER_SSSE3
+	// Each iteration converts four pixels and stores 16 bytes, of which only the first 12 are valid.
+	// The other 4 get overwritten by the next iteration, so at least two more pixels must follow.
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; (i + 6) <= pixelCount; i += 4) {
+		__m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 3), _mm_shuffle_epi8(rgba, shuffle));
+	}
+#endif
+	for (; i < pixelCount; i++) {
+		dst[i * 3 + 0] = src[i * 4 + 0];
+		dst[i * 3 + 1] = src[i * 4 + 1];
+		dst[i * 3 + 2] = src[i * 4 + 2];
+	}
+}
+
+void RT64::FrameEncoder::convertRGBA8ToLinearRGB32F(const uint8_t *src, float *dst, size_t pixelCount) {
+	for (size_t i = 0; i < pixelCount; i++) {
+		dst[i * 3 + 0] = SRGBToLinear.values[src[i * 4 + 0]];
+		dst[i * 3 + 1] = SRGBToLinear.values[src[i * 4 + 1]];
+		dst[i * 3 + 2] = SRGBToLinear.values[src[i * 4 + 2]];
+	}
+}
+
+const char *RT64::FrameEncoder::getExtension(Format format) {
+	switch (format) {
+	case Format::BMP:
+		return "bmp";
+	case Format::EXR:
+		return "exr";
+	case Format::PNG:
+	default:
+		return "png";
+	}
+}
+
+#endif
@@ -0,0 +1,72 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encodes captured frames to image files on a pool of background threads. It has no dependencies on D3D12,
+// so the device only has to copy the pixels out of the readback buffers and submit them.
+//
+// The amount of frames waiting to be encoded is bounded. Submitting a frame blocks the caller while the queue
+// is full, which slows down the renderer instead of letting the memory grow when the encoders fall behind.
+
+namespace RT64 {
+	class FrameEncoder {
+	public:
+		// Must match the RT64_CAPTURE_FORMAT_* constants.
+		enum class Format : int {
+			BMP,
+			PNG,
+			EXR
+		};
+
+		struct Frame {
+			// Tightly packed RGBA8 pixels.
+			std::vector<uint8_t> rgba;
+			int width = 0;
+			int height = 0;
+			Format format = Format::PNG;
+			std::string path;
+		};
+	private:
+		std::vector<std::thread> threads;
+		std::deque<Frame> queue;
+		std::mutex queueMutex;
+		std::condition_variable queueChanged;
+		size_t maxQueuedFrames;
+		size_t framesInFlight;
+		size_t framesFailed;
+		bool stopping;
+
+		void workerLoop();
+		bool encode(const Frame &frame);
+	public:
+		// Zero threads uses half of the hardware concurrency.
+		FrameEncoder(unsigned int threadCount = 0, size_t maxQueuedFrames = 0);
+		virtual ~FrameEncoder();
+
+		// Queues the frame for encoding. Blocks while the queue is full.
+		void submit(Frame &&frame);
+
+		// Blocks until every submitted frame has been written.
+		void flush();
+		size_t getQueuedFrameCount();
+		size_t getFailedFrameCount();
+
+		// Drops the alpha channel. Uses SSSE3 shuffles when available.
+		static void convertRGBA8ToRGB8(const uint8_t *src, uint8_t *dst, size_t pixelCount);
+
+		// Drops the alpha channel and converts the sRGB encoded colors to linear floats.
+		static void convertRGBA8ToLinearRGB32F(const uint8_t *src, float *dst, size_t pixelCount);
+		static const char *getExtension(Format format);
+	};
+};
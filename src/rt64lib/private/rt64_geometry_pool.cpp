@@ -0,0 +1,174 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_geometry_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Private
+
+RT64::GeometryPool::Block *RT64::GeometryPool::createBlock(uint64_t capacity) {
+	Block *block = new Block(capacity);
+	block->buffer = renderDevice->createBuffer(RenderBufferDesc::DefaultBuffer(capacity * elementSize));
+	blocks.push_back(block);
+	return block;
+}
+
+void RT64::GeometryPool::releaseBlock(Block *block) {
+	assert(block->allocations.empty());
+	blocks.erase(std::remove(blocks.begin(), blocks.end(), block), blocks.end());
+	retireCallback(block->buffer);
+	delete block;
+}
+
+// Public
+
+RT64::GeometryPool::GeometryPool(RenderDevice *renderDevice, uint64_t elementSize, uint64_t blockCapacity, const RetireCallback &retireCallback) {
+	assert(renderDevice != nullptr);
+	assert(elementSize > 0);
+	assert(blockCapacity > 0);
+	assert(retireCallback);
+	this->renderDevice = renderDevice;
+	this->elementSize = elementSize;
+	this->blockCapacity = blockCapacity;
+	this->retireCallback = retireCallback;
+}
+
+RT64::GeometryPool::~GeometryPool() {
+	for (Block *block : blocks) {
+		for (Allocation *allocation : block->allocations) {
+			delete allocation;
+		}
+
+		delete block->buffer;
+		delete block;
+	}
+}
+
+RT64::GeometryPool::Allocation *RT64::GeometryPool::allocate(uint64_t count) {
+	assert(count > 0);
+
+	Allocation *allocation = new Allocation();
+	allocation->count = count;
+	allocation->block = nullptr;
+	for (Block *block : blocks) {
+		if (block->allocator.allocate(count, allocation->offset)) {
+			allocation->block = block;
+			break;
+		}
+	}
+
+	if (allocation->block == nullptr) {
+		allocation->block = createBlock(std::max(count, blockCapacity));
+		allocation->block->allocator.allocate(count, allocation->offset);
+	}
+
+	allocation->block->allocations.insert(allocation);
+	return allocation;
+}
+
+void RT64::GeometryPool::free(Allocation *allocation) {
+	assert(allocation != nullptr);
+
+	Block *block = allocation->block;
+	block->allocator.free(allocation->offset);
+	block->allocations.erase(allocation);
+	delete allocation;
+}
+
+uint64_t RT64::GeometryPool::getByteOffset(const Allocation *allocation) const {
+	return allocation->offset * elementSize;
+}
+
+uint64_t RT64::GeometryPool::getByteSize(const Allocation *allocation) const {
+	return allocation->count * elementSize;
+}
+
+uint64_t RT64::GeometryPool::getDeviceAddress(const Allocation *allocation) const {
+	return allocation->block->buffer->getDeviceAddress() + getByteOffset(allocation);
+}
+
+void RT64::GeometryPool::barrier(RenderCommandList *commandList, RenderBufferAccess access) {
+	for (Block *block : blocks) {
+		commandList->barrier(block->buffer, access);
+	}
+}
+
+bool RT64::GeometryPool::defragment(RenderCommandList *commandList, float maxUsage) {
+	if (blocks.size() < 2) {
+		return false;
+	}
+
+	Block *sourceBlock = nullptr;
+	float sourceUsage = maxUsage;
+	for (Block *block : blocks) {
+		const float usage = (float)(block->allocator.getAllocatedSize()) / (float)(block->allocator.getCapacity());
+		if (usage < sourceUsage) {
+			sourceBlock = block;
+			sourceUsage = usage;
+		}
+	}
+
+	if (sourceBlock == nullptr) {
+		return false;
+	}
+
+	// Allocations that don't fit anywhere else stay where they are.
+	bool moved = false;
+	std::vector<Allocation *> allocations(sourceBlock->allocations.begin(), sourceBlock->allocations.end());
+	for (Allocation *allocation : allocations) {
+		for (Block *block : blocks) {
+			uint64_t offset = 0;
+			if ((block == sourceBlock) || !block->allocator.allocate(allocation->count, offset)) {
+				continue;
+			}
+
+			commandList->barrier(sourceBlock->buffer, RenderBufferAccess::CopySource);
+			commandList->barrier(block->buffer, RenderBufferAccess::CopyDest);
+			commandList->copyBufferRegion(block->buffer, offset * elementSize, sourceBlock->buffer, allocation->offset * elementSize, allocation->count * elementSize);
+
+			sourceBlock->allocator.free(allocation->offset);
+			sourceBlock->allocations.erase(allocation);
+			block->allocations.insert(allocation);
+			allocation->block = block;
+			allocation->offset = offset;
+			moved = true;
+			break;
+		}
+	}
+
+	if (sourceBlock->allocations.empty()) {
+		releaseBlock(sourceBlock);
+		return true;
+	}
+
+	return moved;
+}
+
+uint64_t RT64::GeometryPool::getAllocatedBytes() const {
+	uint64_t allocatedSize = 0;
+	for (const Block *block : blocks) {
+		allocatedSize += block->allocator.getAllocatedSize();
+	}
+
+	return allocatedSize * elementSize;
+}
+
+uint64_t RT64::GeometryPool::getCapacityBytes() const {
+	uint64_t capacity = 0;
+	for (const Block *block : blocks) {
+		capacity += block->allocator.getCapacity();
+	}
+
+	return capacity * elementSize;
+}
+
+size_t RT64::GeometryPool::getBlockCount() const {
+	return blocks.size();
+}
+
+#endif
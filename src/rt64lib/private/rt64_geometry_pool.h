@@ -0,0 +1,75 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include "rt64_range_allocator.h"
+#include "rt64_render_interface.h"
+
+// Suballocates the geometry of all the meshes from a few large buffers, so the meshes don't need a resource of their
+// own and the draws can keep the same buffers bound between them. Blocks are created as needed, and meshes that don't
+// fit in a regular block get a block of their own.
+//
+// Allocations that live in a block that is mostly empty can be moved to the other blocks with defragment(), which also
+// releases the block once it's empty. Users must always read the block and the offset from the allocation, since they
+// change when it is moved.
+//
+// The buffers of released blocks might still be in use by the GPU, so they're handed to the retire callback, which
+// must only delete them once the commands recorded so far are done.
+
+namespace RT64 {
+	class GeometryPool {
+	public:
+		typedef std::function<void(RenderBuffer *)> RetireCallback;
+		struct Block;
+
+		struct Allocation {
+			Block *block;
+
+			// In elements.
+			uint64_t offset;
+			uint64_t count;
+		};
+
+		struct Block {
+			RenderBuffer *buffer;
+			RangeAllocator allocator;
+			std::unordered_set<Allocation *> allocations;
+
+			Block(uint64_t capacity) : allocator(capacity) { }
+		};
+	private:
+		RenderDevice *renderDevice;
+		uint64_t elementSize;
+		uint64_t blockCapacity;
+		RetireCallback retireCallback;
+		std::vector<Block *> blocks;
+
+		Block *createBlock(uint64_t capacity);
+		void releaseBlock(Block *block);
+	public:
+		GeometryPool(RenderDevice *renderDevice, uint64_t elementSize, uint64_t blockCapacity, const RetireCallback &retireCallback);
+		virtual ~GeometryPool();
+		Allocation *allocate(uint64_t count);
+		void free(Allocation *allocation);
+		uint64_t getByteOffset(const Allocation *allocation) const;
+		uint64_t getByteSize(const Allocation *allocation) const;
+		uint64_t getDeviceAddress(const Allocation *allocation) const;
+
+		// Transitions all the blocks. Uploads leave the blocks as copy destinations, so this must be done before they are used.
+		void barrier(RenderCommandList *commandList, RenderBufferAccess access);
+
+		// Moves the allocations out of the least used block if it's below the given usage and the other blocks have room for
+		// them. Only one block is evacuated per call to keep the amount of copies low. Returns true if anything was moved or released.
+		bool defragment(RenderCommandList *commandList, float maxUsage);
+		uint64_t getAllocatedBytes() const;
+		uint64_t getCapacityBytes() const;
+		size_t getBlockCount() const;
+	};
+};
@@ -17,7 +17,6 @@
 #include "imgui/imgui_impl_win32.h"
 
 #include <algorithm>
-#include <filesystem>
 #include <iomanip>
 
 std::string dateAsFilename() {
@@ -35,7 +34,6 @@ RT64::Inspector::Inspector(Device* device) {
     cameraControl = false;
     cameraPanX = 0.0f;
     cameraPanY = 0.0f;
-    dumpFrameCount = 0;
 
     reset();
 
@@ -87,6 +85,7 @@ void RT64::Inspector::render(View *activeView, int cursorX, int cursorY) {
     Im3d::NewFrame();
 
     renderViewParams(activeView);
+    renderDeviceStats();
     renderMaterialInspector();
     renderLightInspector();
     renderCameraControl(activeView, cursorX, cursorY);
@@ -94,14 +93,6 @@ void RT64::Inspector::render(View *activeView, int cursorX, int cursorY) {
 
     Im3d::EndFrame();
 
-    // If dumping frames is active, save the current state of the RTV into a file.
-    if (!dumpPath.empty()) {
-        const int LeadingZeroes = 8;
-        std::ostringstream oss;
-        oss << dumpPath << "/" << std::setw(LeadingZeroes) << std::setfill('0') << dumpFrameCount++ << ".bmp";
-        device->dumpRenderTarget(oss.str());
-    }
-
     activeView->renderInspector(this);
 
     // Send the commands to D3D12.
@@ -126,24 +117,37 @@ void RT64::Inspector::renderViewParams(View *view) {
 	float ambGIMix = view->getAmbGIMixWeight();
     int resScale = lround(view->getResolutionScale() * 100.0f);
     bool denoiser = view->getDenoiserEnabled();
+    int denoiserMode = view->getDenoiserMode();
+    bool temporal = view->getTemporalEnabled();
+    bool adaptiveSampling = view->getAdaptiveSamplingEnabled();
+    int maxHitQueries = view->getMaxHitQueries();
+    int tileSize = view->getTileSize();
     ImGui::DragInt("Light samples", &softLightSamples, 0.1f, 0, 32);
     ImGui::DragInt("GI Bounces", &giBounces, 0.1f, 0, 32);
     ImGui::DragInt("Fake GI Env Bounces", &giEnvBounces, 0.1f, 0, 32);
     ImGui::DragInt("Max lights", &maxLightSamples, 0.1f, 0, 16);
 	ImGui::DragFloat("Ambient GI Mix", &ambGIMix, 0.01f, 0.0f, 1.0f);
     ImGui::DragInt("Resolution %", &resScale, 1, 1, 200);
-    ImGui::Checkbox("NVIDIA OptiX Denoiser", &denoiser);
+    ImGui::Checkbox("Denoiser", &denoiser);
+    ImGui::Combo("Denoiser mode", &denoiserMode, "NVIDIA OptiX\0CPU SVGF\0");
+    ImGui::Checkbox("Temporal accumulation", &temporal);
+    ImGui::Checkbox("Adaptive sampling", &adaptiveSampling);
+    ImGui::DragInt("Max hits", &maxHitQueries, 0.1f, 1, 16);
+    ImGui::DragInt("Tile size", &tileSize, 1, 0, 1024);
+
+    RT64_VIEW_STATS viewStats;
+    view->getStats(&viewStats);
+    ImGui::Text("Hit buffer: %.2f MB", viewStats.hitBufferBytes / (1024.0 * 1024.0));
+    ImGui::Text("Output buffers: %.2f MB", viewStats.outputBufferBytes / (1024.0 * 1024.0));
 
     // Dumping toggle.
-    bool isDumping = !dumpPath.empty();
+    bool isDumping = device->isCapturingFrames();
     if (ImGui::Button(isDumping ? "Stop dump" : "Dump frames")) {
         if (isDumping) {
-            dumpPath = std::string();
+            device->captureFrames(std::string(), RT64_CAPTURE_FORMAT_PNG, 0);
         }
         else {
-            dumpPath = "dump/" + dateAsFilename();
-            std::filesystem::create_directories(dumpPath);
-            dumpFrameCount = 0;
+            device->captureFrames("dump/" + dateAsFilename(), RT64_CAPTURE_FORMAT_PNG, RT64_CAPTURE_UNLIMITED);
         }
     }
 
@@ -154,7 +158,51 @@ void RT64::Inspector::renderViewParams(View *view) {
     view->setMaxLightSamples(maxLightSamples);
 	view->setAmbGIMixWeight(ambGIMix);
     view->setResolutionScale(resScale / 100.0f);
+    view->setDenoiserMode(denoiserMode);
     view->setDenoiserEnabled(denoiser);
+    view->setTemporalEnabled(temporal);
+    view->setAdaptiveSamplingEnabled(adaptiveSampling);
+    view->setMaxHitQueries(maxHitQueries);
+    view->setTileSize(tileSize);
+
+    ImGui::End();
+}
+
+void RT64::Inspector::renderDeviceStats() {
+    const double MB = 1024.0 * 1024.0;
+    RT64_DEVICE_STATS stats;
+    device->getStats(&stats);
+
+    ImGui::Begin("Device Stats");
+    ImGui::Text("Instances: %u RT, %u BG, %u FG", stats.rtInstances, stats.rasterBgInstances, stats.rasterFgInstances);
+    ImGui::Text("TLAS: %.2f MB", stats.tlasBytes / MB);
+    ImGui::Text("Descriptors: %u", stats.descriptorsUsed);
+    ImGui::Text("BLAS builds: %u, updates: %u, pending: %u", stats.blasBuilds, stats.blasUpdates, stats.blasBuildsPending);
+    ImGui::Text("TLAS builds: %u, refits: %u", stats.tlasBuilds, stats.tlasRefits);
+    ImGui::Text("Uploaded: %.2f MB", stats.bytesUploaded / MB);
+    ImGui::Text("Scenes: %u, meshes: %u, textures: %u", stats.sceneCount, stats.meshCount, stats.textureCount);
+    ImGui::Text("Geometry: %.2f MB of %.2f MB in %u blocks", stats.geometryBytes / MB, stats.geometryCapacityBytes / MB, stats.geometryBlockCount);
+    ImGui::Text("BLAS: %.2f MB (%.2f MB not compacted), scratch: %.2f MB", stats.blasBytes / MB, stats.blasUncompactedBytes / MB, stats.scratchBytes / MB);
+    ImGui::Separator();
+
+    const char *heapNames[RT64_HEAP_COUNT] = { "Default", "Upload", "Readback", "Custom" };
+    for (int h = 0; h < RT64_HEAP_COUNT; h++) {
+        ImGui::Text("%s heap: %.2f MB in %u allocations", heapNames[h], stats.heapUsedBytes[h] / MB, stats.heapAllocationCount[h]);
+    }
+
+    ImGui::Text("GPU memory: %.2f / %.2f MB", stats.gpuUsageBytes / MB, stats.gpuBudgetBytes / MB);
+    ImGui::Text("CPU memory: %.2f / %.2f MB", stats.cpuUsageBytes / MB, stats.cpuBudgetBytes / MB);
+
+    RT64_FRAME_TIMINGS timings;
+    if (device->getFrameTimings(&timings)) {
+        ImGui::Separator();
+        ImGui::Text("CPU: draw %.2f ms, view update %.2f ms, view render %.2f ms",
+            timings.milliseconds[RT64_TIMING_CPU_DRAW], timings.milliseconds[RT64_TIMING_CPU_VIEW_UPDATE], timings.milliseconds[RT64_TIMING_CPU_VIEW_RENDER]);
+        ImGui::Text("GPU: raster %.2f ms, rays %.2f ms, reconstruct %.2f ms, denoise %.2f ms, upscale %.2f ms, compose %.2f ms",
+            timings.milliseconds[RT64_TIMING_GPU_BACKGROUND_RASTER] + timings.milliseconds[RT64_TIMING_GPU_FOREGROUND_RASTER],
+            timings.milliseconds[RT64_TIMING_GPU_RAY_DISPATCH], timings.milliseconds[RT64_TIMING_GPU_RECONSTRUCT], timings.milliseconds[RT64_TIMING_GPU_DENOISE],
+            timings.milliseconds[RT64_TIMING_GPU_UPSCALE], timings.milliseconds[RT64_TIMING_GPU_COMPOSE]);
+    }
 
     ImGui::End();
 }
@@ -24,12 +24,11 @@ namespace RT64 {
 		float cameraPanX;
 		float cameraPanY;
 		int prevCursorX, prevCursorY;
-		std::string dumpPath;
-		int dumpFrameCount;
 		std::vector<std::string> toPrint;
 
 		void setupWithView(View *view, int cursorX, int cursorY);
 		void renderViewParams(View *view);
+		void renderDeviceStats();
 		void renderMaterialInspector();
 		void renderLightInspector();
 		void renderPrint();
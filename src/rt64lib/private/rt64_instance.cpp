@@ -21,16 +21,26 @@ RT64::Instance::Instance(Scene *scene) {
 	normalTexture = nullptr;
 	specularTexture = nullptr;
 	transform = XMMatrixIdentity();
+	previousTransform = XMMatrixIdentity();
+	transformSet = false;
 	material = DefaultMaterial;
 	scissorRect = { 0, 0, 0, 0 };
 	viewportRect = { 0, 0, 0, 0 };
 	flags = 0;
+}
+
+RT64::Instance::~Instance() { }
 
-	scene->addInstance(this);
+RT64::Scene *RT64::Instance::getScene() const {
+	return scene;
 }
 
-RT64::Instance::~Instance() {
-	scene->removeInstance(this);
+void RT64::Instance::setSceneHandle(SlotMap<Instance *>::Handle handle) {
+	sceneHandle = handle;
+}
+
+RT64::SlotMap<RT64::Instance *>::Handle RT64::Instance::getSceneHandle() const {
+	return sceneHandle;
 }
 
 void RT64::Instance::setMesh(Mesh* mesh) {
@@ -80,12 +90,26 @@ void RT64::Instance::setTransform(float m[4][4]) {
 		m[2][0], m[2][1], m[2][2], m[2][3],
 		m[3][0], m[3][1], m[3][2], m[3][3]
 	);
+
+	// Instances that were never rendered before don't have any motion.
+	if (!transformSet) {
+		previousTransform = transform;
+		transformSet = true;
+	}
 }
 
 XMMATRIX RT64::Instance::getTransform() const {
 	return transform;
 }
 
+XMMATRIX RT64::Instance::getPreviousTransform() const {
+	return previousTransform;
+}
+
+void RT64::Instance::storePreviousTransform() {
+	previousTransform = transform;
+}
+
 void RT64::Instance::setScissorRect(const RT64_RECT &rect) {
 	scissorRect = rect;
 }
@@ -122,7 +146,7 @@ unsigned int RT64::Instance::getFlags() const {
 
 DLLEXPORT RT64_INSTANCE *RT64_CreateInstance(RT64_SCENE *scenePtr) {
 	RT64::Scene *scene = (RT64::Scene *)(scenePtr);
-	RT64::Instance *instance = new RT64::Instance(scene);
+	RT64::Instance *instance = scene->createInstance();
 	return (RT64_INSTANCE *)(instance);
 }
 
@@ -144,7 +168,8 @@ DLLEXPORT void RT64_SetInstanceDescription(RT64_INSTANCE *instancePtr, RT64_INST
 }
 
 DLLEXPORT void RT64_DestroyInstance(RT64_INSTANCE *instancePtr) {
-	delete (RT64::Instance *)(instancePtr);
+	RT64::Instance *instance = (RT64::Instance *)(instancePtr);
+	instance->getScene()->destroyInstance(instance);
 }
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "rt64_common.h"
+#include "rt64_slot_map.h"
 
 namespace RT64 {
 	class Mesh;
@@ -14,11 +15,14 @@ namespace RT64 {
 	class Instance {
 	private:
 		Scene *scene;
+		SlotMap<Instance *>::Handle sceneHandle;
 		Mesh *mesh;
 		Texture *diffuseTexture;
 		Texture* normalTexture;
 		Texture* specularTexture;
 		XMMATRIX transform;
+		XMMATRIX previousTransform;
+		bool transformSet;
 		RT64_MATERIAL material;
 		RT64_RECT scissorRect;
 		RT64_RECT viewportRect;
@@ -26,6 +30,9 @@ namespace RT64 {
 	public:
 		Instance(Scene *scene);
 		virtual ~Instance();
+		Scene *getScene() const;
+		void setSceneHandle(SlotMap<Instance *>::Handle handle);
+		SlotMap<Instance *>::Handle getSceneHandle() const;
 		void setMesh(Mesh *mesh);
 		Mesh *getMesh() const;
 		void setMaterial(const RT64_MATERIAL &material);
@@ -38,6 +45,8 @@ namespace RT64 {
 		Texture* getSpecularTexture() const;
 		void setTransform(float m[4][4]);
 		XMMATRIX getTransform() const;
+		XMMATRIX getPreviousTransform() const;
+		void storePreviousTransform();
 		void setScissorRect(const RT64_RECT &rect);
 		RT64_RECT getScissorRect() const;
 		bool hasScissorRect() const;
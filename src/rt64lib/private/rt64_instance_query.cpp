@@ -0,0 +1,194 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_instance_query.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Private
+
+void RT64::InstanceQueryQueue::resolveCompletedSlots() {
+	for (unsigned int s = 0; s < SlotCount; s++) {
+		Slot &slot = slots[s];
+		if (!slot.inFlight || !backend->isSlotComplete(s)) {
+			continue;
+		}
+
+		const size_t regionIdCount = RegionSize * RegionSize;
+		slotIds.resize(slot.regions.size() * regionIdCount);
+		backend->readSlot(s, (unsigned int)(slot.regions.size()), slotIds.data());
+
+		for (QueryId queryId : slot.queries) {
+			auto it = queries.find(queryId);
+			if (it == queries.end()) {
+				continue;
+			}
+
+			Query &query = it->second;
+			const Region &region = slot.regions[query.regionIndex];
+			int localX = query.x - region.x;
+			int localY = query.y - region.y;
+			uint16_t instanceId = slotIds[query.regionIndex * regionIdCount + localY * RegionSize + localX];
+			query.instance = (instanceId != NoHitInstanceId) ? backend->getInstance(s, instanceId) : nullptr;
+			query.ready = true;
+		}
+
+		slot.inFlight = false;
+		slot.regions.clear();
+		slot.queries.clear();
+	}
+}
+
+// Public
+
+RT64::InstanceQueryQueue::InstanceQueryQueue(Backend *backend) {
+	assert(backend != nullptr);
+	this->backend = backend;
+	slotIndex = 0;
+	nextQueryId = InvalidQueryId + 1;
+	width = 0;
+	height = 0;
+}
+
+RT64::InstanceQueryQueue::~InstanceQueryQueue() { }
+
+void RT64::InstanceQueryQueue::setDimensions(int width, int height) {
+	this->width = width;
+	this->height = height;
+}
+
+RT64::InstanceQueryQueue::QueryId RT64::InstanceQueryQueue::request(int x, int y) {
+	QueryId queryId = nextQueryId++;
+	if (nextQueryId == InvalidQueryId) {
+		nextQueryId++;
+	}
+
+	Query &query = queries[queryId];
+	query.x = x;
+	query.y = y;
+	query.submitted = false;
+	query.ready = false;
+	query.regionIndex = 0;
+	query.instance = nullptr;
+	pendingQueries.push_back(queryId);
+	return queryId;
+}
+
+void RT64::InstanceQueryQueue::submit() {
+	resolveCompletedSlots();
+
+	if (pendingQueries.empty()) {
+		return;
+	}
+
+	// The GPU is still using the next slot of the ring. Try again next frame.
+	Slot &slot = slots[slotIndex];
+	if (slot.inFlight) {
+		return;
+	}
+
+	std::vector<QueryId> deferredQueries;
+	for (QueryId queryId : pendingQueries) {
+		auto it = queries.find(queryId);
+		if (it == queries.end()) {
+			continue;
+		}
+
+		// Queries outside of the buffer can be answered right away.
+		Query &query = it->second;
+		if ((query.x < 0) || (query.x >= width) || (query.y < 0) || (query.y >= height)) {
+			query.instance = nullptr;
+			query.ready = true;
+			continue;
+		}
+
+		// Merge the query into a region that's already being copied if possible.
+		Region region = { (query.x / RegionSize) * RegionSize, (query.y / RegionSize) * RegionSize };
+		auto regionIt = std::find_if(slot.regions.begin(), slot.regions.end(), [&region](const Region &r) {
+			return (r.x == region.x) && (r.y == region.y);
+		});
+
+		if (regionIt != slot.regions.end()) {
+			query.regionIndex = (unsigned int)(regionIt - slot.regions.begin());
+		}
+		else if (slot.regions.size() < MaxRegionsPerSlot) {
+			query.regionIndex = (unsigned int)(slot.regions.size());
+			slot.regions.push_back(region);
+		}
+		else {
+			deferredQueries.push_back(queryId);
+			continue;
+		}
+
+		query.submitted = true;
+		slot.queries.push_back(queryId);
+	}
+
+	pendingQueries = std::move(deferredQueries);
+
+	if (slot.regions.empty()) {
+		return;
+	}
+
+	backend->beginSlot(slotIndex);
+	for (size_t r = 0; r < slot.regions.size(); r++) {
+		const Region &region = slot.regions[r];
+		int regionWidth = std::min((int)(RegionSize), width - region.x);
+		int regionHeight = std::min((int)(RegionSize), height - region.y);
+		backend->copyRegion(slotIndex, (unsigned int)(r), region.x, region.y, regionWidth, regionHeight);
+	}
+
+	backend->endSlot(slotIndex);
+	slot.inFlight = true;
+	slotIndex = (slotIndex + 1) % SlotCount;
+}
+
+bool RT64::InstanceQueryQueue::poll(QueryId queryId, void **instance) {
+	resolveCompletedSlots();
+
+	auto it = queries.find(queryId);
+	if (it == queries.end()) {
+		if (instance != nullptr) {
+			*instance = nullptr;
+		}
+
+		return true;
+	}
+
+	if (!it->second.ready) {
+		return false;
+	}
+
+	if (instance != nullptr) {
+		*instance = it->second.instance;
+	}
+
+	queries.erase(it);
+	return true;
+}
+
+void RT64::InstanceQueryQueue::clear() {
+	queries.clear();
+	pendingQueries.clear();
+	for (unsigned int s = 0; s < SlotCount; s++) {
+		slots[s].inFlight = false;
+		slots[s].regions.clear();
+		slots[s].queries.clear();
+	}
+
+	slotIndex = 0;
+}
+
+size_t RT64::InstanceQueryQueue::getQueryCount() const {
+	return queries.size();
+}
+
+size_t RT64::InstanceQueryQueue::getPendingQueryCount() const {
+	return pendingQueries.size();
+}
+
+#endif
@@ -0,0 +1,109 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Resolves which instance was hit at a pixel of a view without stalling the renderer. Requested pixels are
+// grouped into small square regions of the instance ID buffer, which the backend copies into a ring of readback
+// slots at the end of a frame. The results are read once the GPU is done with the slot, a frame or two later.
+//
+// The queue only does the bookkeeping and has no dependencies on D3D12. The backend records the copies and
+// reads them back, so the logic can be driven without a GPU.
+
+namespace RT64 {
+	class InstanceQueryQueue {
+	public:
+		typedef unsigned int QueryId;
+
+		static const QueryId InvalidQueryId = 0;
+		static const unsigned int SlotCount = 3;
+		static const int RegionSize = 8;
+		static const unsigned int MaxRegionsPerSlot = 64;
+		static const uint16_t NoHitInstanceId = 0xFFFF;
+
+		class Backend {
+		public:
+			virtual ~Backend() { }
+
+			// Called before the regions of a slot are copied.
+			virtual void beginSlot(unsigned int slot) = 0;
+
+			// Copies a region of the instance ID buffer into the slot. The region is at most RegionSize pixels wide and tall.
+			virtual void copyRegion(unsigned int slot, unsigned int regionIndex, int x, int y, int width, int height) = 0;
+
+			// Called after all the regions of a slot have been copied.
+			virtual void endSlot(unsigned int slot) = 0;
+
+			// Whether the GPU has finished the copies of the slot.
+			virtual bool isSlotComplete(unsigned int slot) = 0;
+
+			// Reads back the slot as RegionSize x RegionSize tightly packed IDs per region.
+			virtual void readSlot(unsigned int slot, unsigned int regionCount, uint16_t *ids) = 0;
+
+			// Converts an ID read from the slot into the instance it referred to when the frame was traced. Returns null if
+			// that instance doesn't exist anymore.
+			virtual void *getInstance(unsigned int slot, uint16_t instanceId) = 0;
+		};
+	private:
+		struct Query {
+			int x;
+			int y;
+			bool submitted;
+			bool ready;
+			unsigned int regionIndex;
+			void *instance;
+		};
+
+		struct Region {
+			int x;
+			int y;
+		};
+
+		struct Slot {
+			bool inFlight = false;
+			std::vector<Region> regions;
+			std::vector<QueryId> queries;
+		};
+
+		Backend *backend;
+		std::unordered_map<QueryId, Query> queries;
+		std::vector<QueryId> pendingQueries;
+		std::vector<uint16_t> slotIds;
+		Slot slots[SlotCount];
+		unsigned int slotIndex;
+		QueryId nextQueryId;
+		int width;
+		int height;
+
+		void resolveCompletedSlots();
+	public:
+		InstanceQueryQueue(Backend *backend);
+		virtual ~InstanceQueryQueue();
+
+		// Size of the instance ID buffer. Queries outside of it resolve to no instance.
+		void setDimensions(int width, int height);
+
+		// Queues a query for the pixel in instance ID buffer coordinates.
+		QueryId request(int x, int y);
+
+		// Copies the regions of the queries that haven't been submitted yet. Must be called once the instance ID
+		// buffer has been written for the frame. Queries that don't fit in the slot wait for the next frame, and
+		// nothing is copied if the GPU hasn't finished with the next slot of the ring yet.
+		void submit();
+
+		// Returns true and removes the query once its result is available. Unknown queries count as resolved
+		// with no instance so callers never wait on them forever.
+		bool poll(QueryId queryId, void **instance);
+
+		// Forgets every query and slot. Any result the backend was preparing is ignored.
+		void clear();
+		size_t getQueryCount() const;
+		size_t getPendingQueryCount() const;
+	};
+};
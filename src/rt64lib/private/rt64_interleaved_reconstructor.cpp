@@ -0,0 +1,313 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_interleaved_reconstructor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include "rt64_temporal_upscaler.h"
+
+const float RT64::InterleavedReconstructor::DepthTolerance = 0.1f;
+const float RT64::InterleavedReconstructor::NormalThreshold = 0.8f;
+const float RT64::InterleavedReconstructor::StaticMotionThreshold = 0.01f;
+const unsigned int RT64::InterleavedReconstructor::NoInstanceId = 0xFFFF;
+
+// Private
+
+RT64::InterleavedReconstructor::Guide RT64::InterleavedReconstructor::inputGuide(const FrameInputs &inputs, int x, int y) const {
+	const size_t p = (size_t)(y) * width + x;
+	Guide guide;
+	guide.depth = inputs.depth[p];
+	guide.instanceId = inputs.instanceId[p];
+	memcpy(guide.normal, &inputs.normal[p * 4], sizeof(guide.normal));
+	return guide;
+}
+
+void RT64::InterleavedReconstructor::sampleHistory(float x, float y, float color[4]) const {
+	const float fx = x - 0.5f;
+	const float fy = y - 0.5f;
+	const int x0 = (int)(floorf(fx));
+	const int y0 = (int)(floorf(fy));
+	float wx[4], wy[4];
+	TemporalUpscaler::catmullRomWeights(fx - x0, wx);
+	TemporalUpscaler::catmullRomWeights(fy - y0, wy);
+	memset(color, 0, sizeof(float) * 4);
+	for (int j = 0; j < 4; j++) {
+		const int sy = std::min(std::max(y0 - 1 + j, 0), historyHeight - 1);
+		for (int i = 0; i < 4; i++) {
+			const int sx = std::min(std::max(x0 - 1 + i, 0), historyWidth - 1);
+			const float *c = &historyColor[((size_t)(sy) * historyWidth + sx) * 4];
+			for (int k = 0; k < 4; k++) {
+				color[k] += c[k] * wx[i] * wy[j];
+			}
+		}
+	}
+}
+
+// Public
+
+RT64::InterleavedReconstructor::InterleavedReconstructor() {
+	width = 0;
+	height = 0;
+	historyWidth = 0;
+	historyHeight = 0;
+	historyValid = false;
+}
+
+void RT64::InterleavedReconstructor::set(int width, int height) {
+	assert((width > 0) && (height > 0));
+	this->width = width;
+	this->height = height;
+}
+
+void RT64::InterleavedReconstructor::reset() {
+	historyValid = false;
+}
+
+void RT64::InterleavedReconstructor::reconstruct(const FrameInputs &inputs, float *outColor) {
+	assert((width > 0) && (height > 0));
+	assert((inputs.color != nullptr) && (inputs.normal != nullptr) && (inputs.depth != nullptr) && (inputs.instanceId != nullptr));
+	assert(outColor != nullptr);
+
+	const size_t pixelCount = (size_t)(width) * height;
+	nextColor.resize(pixelCount * 4);
+	nextGuides.resize(pixelCount);
+
+	// Positions in the frame are scaled to the history if it was reconstructed at another size.
+	const bool sameSize = (historyWidth == width) && (historyHeight == height);
+	const float historyScaleX = historyValid ? ((float)(historyWidth) / width) : 1.0f;
+	const float historyScaleY = historyValid ? ((float)(historyHeight) / height) : 1.0f;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const size_t p = (size_t)(y) * width + x;
+			float *result = &nextColor[p * 4];
+			if (isTraced(inputs.pattern, inputs.frameIndex, x, y)) {
+				memcpy(result, &inputs.color[p * 4], sizeof(float) * 4);
+				nextGuides[p] = inputGuide(inputs, x, y);
+				memcpy(&outColor[p * 4], result, sizeof(float) * 4);
+				continue;
+			}
+
+			// Gather the pixels around that were traced this frame. The closest one to the camera is used to
+			// find the history, so the edges of the objects in front keep moving with them.
+			int neighbors[8][2];
+			int neighborCount = 0;
+			int closest = -1;
+			float closestDepth = 0.0f;
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					const int sx = x + dx;
+					const int sy = y + dy;
+					if (((dx == 0) && (dy == 0)) || (sx < 0) || (sx >= width) || (sy < 0) || (sy >= height) || !isTraced(inputs.pattern, inputs.frameIndex, sx, sy)) {
+						continue;
+					}
+
+					const size_t q = (size_t)(sy) * width + sx;
+					const bool hit = (inputs.instanceId[q] != NoInstanceId);
+					if ((closest < 0) || (hit && ((closestDepth <= 0.0f) || (inputs.depth[q] < closestDepth)))) {
+						closest = neighborCount;
+						closestDepth = hit ? inputs.depth[q] : 0.0f;
+					}
+
+					neighbors[neighborCount][0] = sx;
+					neighbors[neighborCount][1] = sy;
+					neighborCount++;
+				}
+			}
+
+			// Nothing around was traced, which can only happen on regions narrower than the pattern.
+			if (neighborCount == 0) {
+				if (historyValid) {
+					const int hx = std::min((int)((x + 0.5f) * historyScaleX), historyWidth - 1);
+					const int hy = std::min((int)((y + 0.5f) * historyScaleY), historyHeight - 1);
+					const size_t h = (size_t)(hy) * historyWidth + hx;
+					memcpy(result, &historyColor[h * 4], sizeof(float) * 4);
+					nextGuides[p] = historyGuides[h];
+				}
+				else {
+					memset(result, 0, sizeof(float) * 4);
+					nextGuides[p] = Guide();
+				}
+
+				memcpy(&outColor[p * 4], result, sizeof(float) * 4);
+				continue;
+			}
+
+			const int closestX = neighbors[closest][0];
+			const int closestY = neighbors[closest][1];
+			Guide reference = inputGuide(inputs, closestX, closestY);
+
+			// The history is only used if it shows the same surface as one of the traced pixels.
+			bool useHistory = false;
+			bool staticHistory = false;
+			float history[4];
+			if (historyValid) {
+				float motionX = 0.0f;
+				float motionY = 0.0f;
+				if (inputs.motion != nullptr) {
+					const size_t q = (size_t)(closestY) * width + closestX;
+					motionX = inputs.motion[q * 2 + 0];
+					motionY = inputs.motion[q * 2 + 1];
+				}
+
+				// The guides are taken from the closest pixel of the history, while the color is resampled with a
+				// Catmull-Rom filter so the moving surfaces stay sharp.
+				const float historyX = (x + 0.5f + motionX) * historyScaleX;
+				const float historyY = (y + 0.5f + motionY) * historyScaleY;
+				const int hx = (int)(floorf(historyX));
+				const int hy = (int)(floorf(historyY));
+				if ((hx >= 0) && (hx < historyWidth) && (hy >= 0) && (hy < historyHeight)) {
+					const Guide &historyGuide = historyGuides[(size_t)(hy) * historyWidth + hx];
+					for (int n = 0; (n < neighborCount) && !useHistory; n++) {
+						useHistory = guideWeight(historyGuide, inputGuide(inputs, neighbors[n][0], neighbors[n][1])) > 0.0f;
+					}
+
+					// A pixel that didn't move shows what it showed when it was last traced, at most a cycle of the pattern
+					// ago, so its history is read as is. Clamping it would replace any detail finer than the pattern with
+					// the range of the traced pixels around it, and a static image would never converge. No pixel maps exactly
+					// to one of the history if the size changed, so it's filtered and clamped like moving history.
+					staticHistory = sameSize && (fabsf(motionX) <= StaticMotionThreshold) && (fabsf(motionY) <= StaticMotionThreshold);
+					if (useHistory && staticHistory) {
+						memcpy(history, &historyColor[((size_t)(hy) * historyWidth + hx) * 4], sizeof(float) * 4);
+						reference = historyGuide;
+					}
+					else if (useHistory) {
+						sampleHistory(historyX, historyY, history);
+						reference = historyGuide;
+					}
+				}
+			}
+
+			// Interpolate the traced pixels that belong to the same surface and find the range of their colors.
+			float spatial[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float minColor[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+			float maxColor[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			float spatialWeight = 0.0f;
+			for (int n = 0; n < neighborCount; n++) {
+				const int sx = neighbors[n][0];
+				const int sy = neighbors[n][1];
+				const float *c = &inputs.color[((size_t)(sy) * width + sx) * 4];
+				const float w = guideWeight(reference, inputGuide(inputs, sx, sy));
+				for (int k = 0; k < 4; k++) {
+					spatial[k] += c[k] * w;
+					minColor[k] = std::min(minColor[k], c[k]);
+					maxColor[k] = std::max(maxColor[k], c[k]);
+				}
+
+				spatialWeight += w;
+			}
+
+			if (spatialWeight > 0.0f) {
+				for (int k = 0; k < 4; k++) {
+					spatial[k] /= spatialWeight;
+				}
+			}
+			else {
+				memcpy(spatial, &inputs.color[((size_t)(closestY) * width + closestX) * 4], sizeof(float) * 4);
+			}
+
+			// Moving history is clamped to the colors around it, so it can't show something that's no longer there.
+			for (int k = 0; k < 4; k++) {
+				if (useHistory) {
+					result[k] = staticHistory ? history[k] : std::min(std::max(history[k], minColor[k]), maxColor[k]);
+				}
+				else {
+					result[k] = spatial[k];
+				}
+			}
+
+			nextGuides[p] = reference;
+			memcpy(&outColor[p * 4], result, sizeof(float) * 4);
+		}
+	}
+
+	historyColor.swap(nextColor);
+	historyGuides.swap(nextGuides);
+	historyWidth = width;
+	historyHeight = height;
+	historyValid = true;
+}
+
+bool RT64::InterleavedReconstructor::isHistoryValid() const {
+	return historyValid;
+}
+
+unsigned int RT64::InterleavedReconstructor::phaseCount(Pattern pattern) {
+	switch (pattern) {
+	case Pattern::Checkerboard:
+		return 2;
+	case Pattern::Interleaved:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+void RT64::InterleavedReconstructor::launchDimensions(Pattern pattern, int width, int height, int &launchWidth, int &launchHeight) {
+	launchWidth = (pattern != Pattern::Full) ? ((width + 1) / 2) : width;
+	launchHeight = (pattern == Pattern::Interleaved) ? ((height + 1) / 2) : height;
+}
+
+void RT64::InterleavedReconstructor::launchToPixel(Pattern pattern, unsigned int frameIndex, int regionX, int regionY, int launchX, int launchY, int &x, int &y) {
+	// Checkerboard traces every other pixel of each row, starting on alternate columns on every row and frame.
+	// Interleaved traces one pixel of every 2x2 block, visiting the corners of the block in diagonal order.
+	const unsigned int phase = frameIndex % phaseCount(pattern);
+	switch (pattern) {
+	case Pattern::Checkerboard:
+		y = regionY + launchY;
+		x = regionX + launchX * 2 + (int)(((unsigned int)(y - regionX) + phase) & 1);
+		break;
+	case Pattern::Interleaved: {
+		const unsigned int offsetX = (phase ^ (phase >> 1)) & 1;
+		const unsigned int offsetY = phase & 1;
+		x = regionX + launchX * 2 + (int)((offsetX - (unsigned int)(regionX)) & 1);
+		y = regionY + launchY * 2 + (int)((offsetY - (unsigned int)(regionY)) & 1);
+		break;
+	}
+	default:
+		x = regionX + launchX;
+		y = regionY + launchY;
+		break;
+	}
+}
+
+bool RT64::InterleavedReconstructor::isTraced(Pattern pattern, unsigned int frameIndex, int x, int y) {
+	const unsigned int phase = frameIndex % phaseCount(pattern);
+	switch (pattern) {
+	case Pattern::Checkerboard:
+		return (((unsigned int)(x + y) + phase) & 1) == 0;
+	case Pattern::Interleaved:
+		return ((unsigned int)(x & 1) == ((phase ^ (phase >> 1)) & 1)) && ((unsigned int)(y & 1) == (phase & 1));
+	default:
+		return true;
+	}
+}
+
+float RT64::InterleavedReconstructor::guideWeight(const Guide &a, const Guide &b) {
+	if (a.instanceId != b.instanceId) {
+		return 0.0f;
+	}
+
+	// Pixels where nothing was hit only show the background.
+	if (a.instanceId == NoInstanceId) {
+		return 1.0f;
+	}
+
+	const float maxDepth = std::max(a.depth, b.depth);
+	const float depthWeight = (maxDepth > 0.0f) ? std::max(1.0f - fabsf(a.depth - b.depth) / (DepthTolerance * maxDepth), 0.0f) : 1.0f;
+
+	// Normals are only written for surfaces that receive light, so they're ignored if either of them is missing.
+	const float normalDot = a.normal[0] * b.normal[0] + a.normal[1] * b.normal[1] + a.normal[2] * b.normal[2];
+	const float normalLengths = (a.normal[0] * a.normal[0] + a.normal[1] * a.normal[1] + a.normal[2] * a.normal[2]) * (b.normal[0] * b.normal[0] + b.normal[1] * b.normal[1] + b.normal[2] * b.normal[2]);
+	const float normalWeight = (normalLengths > 0.0f) ? std::min(std::max((normalDot - NormalThreshold) / (1.0f - NormalThreshold), 0.0f), 1.0f) : 1.0f;
+	return depthWeight * normalWeight;
+}
+
+#endif
@@ -0,0 +1,97 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU reference of the reconstruction in ReconstructPS.hlsl. When the view only traces a checkerboard or an
+// interleaved pattern of its pixels, the pattern changes every frame and the pixels that were skipped are filled
+// with the previous frame and with the traced pixels around them. The instance ID, the depth and the normal of the
+// traced pixels guide which of them and whether the history can be trusted. The constants and the math must be
+// kept in sync with the shader and the pixel mapping of the ray generation shader in Tracer.hlsl, so the filter can
+// be verified against reference images without a GPU.
+//
+// Colors and normals are RGBA32F like the output buffers of the view. Only the XYZ components of the normals are used.
+
+namespace RT64 {
+	class InterleavedReconstructor {
+	public:
+		// Must match the RT64_TRACE_PATTERN_* constants.
+		enum class Pattern : unsigned int {
+			Full = 0,
+			Checkerboard = 1,
+			Interleaved = 2
+		};
+
+		// Maximum relative difference between the depths of two pixels that belong to the same surface.
+		static const float DepthTolerance;
+
+		// Minimum cosine between the normals of two pixels that belong to the same surface.
+		static const float NormalThreshold;
+
+		// Largest motion in pixels for which the history of a pixel is read as is instead of being filtered and clamped.
+		static const float StaticMotionThreshold;
+
+		// Instance ID stored on pixels where nothing was hit.
+		static const unsigned int NoInstanceId;
+
+		struct Guide {
+			float depth = 0.0f;
+			unsigned int instanceId = NoInstanceId;
+			float normal[3] = { 0.0f, 0.0f, 0.0f };
+		};
+
+		struct FrameInputs {
+			// Buffers of the whole frame. Only the pixels traced this frame are read. The motion vectors point
+			// from each pixel to its position in the previous frame, in pixels, and are optional.
+			const float *color = nullptr;
+			const float *normal = nullptr;
+			const float *depth = nullptr;
+			const uint16_t *instanceId = nullptr;
+			const float *motion = nullptr;
+			Pattern pattern = Pattern::Full;
+			unsigned int frameIndex = 0;
+		};
+	private:
+		int width;
+		int height;
+		int historyWidth;
+		int historyHeight;
+		bool historyValid;
+		std::vector<float> historyColor;
+		std::vector<Guide> historyGuides;
+		std::vector<float> nextColor;
+		std::vector<Guide> nextGuides;
+
+		Guide inputGuide(const FrameInputs &inputs, int x, int y) const;
+		void sampleHistory(float x, float y, float color[4]) const;
+	public:
+		InterleavedReconstructor();
+
+		// The history is kept when the size changes. Its positions are scaled to the size it was reconstructed at on the
+		// next frame, and it's always filtered and clamped since no pixel maps exactly to one of the history.
+		void set(int width, int height);
+		void reset();
+
+		// Fills the pixels that weren't traced this frame and writes the whole frame to outColor (RGBA32F).
+		void reconstruct(const FrameInputs &inputs, float *outColor);
+		bool isHistoryValid() const;
+
+		// Amount of frames it takes for the pattern to trace every pixel once.
+		static unsigned int phaseCount(Pattern pattern);
+
+		// Size of the ray dispatch that traces the pattern on a region of the given size.
+		static void launchDimensions(Pattern pattern, int width, int height, int &launchWidth, int &launchHeight);
+
+		// Pixel traced by a ray of the dispatch. The result can be past the region when its size is odd.
+		static void launchToPixel(Pattern pattern, unsigned int frameIndex, int regionX, int regionY, int launchX, int launchY, int &x, int &y);
+		static bool isTraced(Pattern pattern, unsigned int frameIndex, int x, int y);
+
+		// Similarity between the surfaces of two pixels, from zero if they're different surfaces to one if they're the same.
+		static float guideWeight(const Guide &a, const Guide &b);
+	};
+};
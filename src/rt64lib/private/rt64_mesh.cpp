@@ -6,186 +6,407 @@
 
 #include "../public/rt64.h"
 #include "rt64_mesh.h"
-#include "rt64_device.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "rt64_render_context.h"
+#include "rt64_scratch_pool.h"
+
+namespace {
+	// Unmodified vertices between two updated ranges are copied along with them if the ranges are this close.
+	const uint64_t VertexRangeMergeDistance = 64;
+};
 
 // Private
 
-RT64::Mesh::Mesh(Device *device, int flags) {
-	assert(device != nullptr);
-	this->device = device;
+RT64::Mesh::Mesh(RenderContext *renderContext, int flags) : dirtyVertexRanges(VertexRangeMergeDistance) {
+	assert(renderContext != nullptr);
+	this->renderContext = renderContext;
 	this->flags = flags;
+	vertexAllocation = nullptr;
+	vertexBufferUpload = nullptr;
+	prevVertexBuffer = nullptr;
+	prevVertexBufferValid = false;
+	indexAllocation = nullptr;
+	indexBufferUpload = nullptr;
 	vertexCount = 0;
 	indexCount = 0;
+	bottomLevelASResult = nullptr;
+	bottomLevelASSize = 0;
+	bottomLevelASScratchSize = 0;
+	bottomLevelASUpdateScratchSize = 0;
+	bottomLevelASVersion = 0;
+	bottomLevelASCompacted = false;
+	renderContext->getCounters()->meshCount++;
 }
 
 RT64::Mesh::~Mesh() {
-	vertexBuffer.Release();
-	vertexBufferUpload.Release();
-	indexBuffer.Release();
-	indexBufferUpload.Release();
-	d3dBottomLevelASBuffers.Release();
+	renderContext->getCounters()->meshCount--;
+	renderContext->cancelBottomLevelASBuild(this);
+	renderContext->cancelVertexUpload(this);
+	renderContext->cancelCompaction(this);
+	releaseVertexBuffers();
+	releaseIndexBuffers();
+	releaseBottomLevelAS();
 }
 
-void RT64::Mesh::updateVertexBuffer(RT64_VERTEX *vertexArray, int vertexCount) {
-	const UINT vertexBufferSize = vertexCount * sizeof(RT64_VERTEX);
+void RT64::Mesh::releaseVertexBuffers() {
+	// The range is only handed to another mesh once the GPU is done with the commands that read it.
+	if (vertexAllocation != nullptr) {
+		GeometryPool *vertexPool = renderContext->getVertexPool();
+		GeometryPool::Allocation *allocation = vertexAllocation;
+		renderContext->retire([vertexPool, allocation]() {
+			vertexPool->free(allocation);
+		});
+	}
 
-	if (!vertexBuffer.IsNull() && (this->vertexCount != vertexCount)) {
-		vertexBuffer.Release();
-		vertexBufferUpload.Release();
+	if (vertexBufferUpload != nullptr) {
+		renderContext->retireUploadBuffer(vertexBufferUpload);
+	}
 
-		// Discard the BLAS since it won't be compatible anymore even if it's updatable.
-		d3dBottomLevelASBuffers.Release();
+	if (prevVertexBuffer != nullptr) {
+		renderContext->retire(prevVertexBuffer);
 	}
 
-	if (vertexBuffer.IsNull()) {
-		CD3DX12_RESOURCE_DESC uploadBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize);
-		vertexBufferUpload = device->allocateResource(D3D12_HEAP_TYPE_UPLOAD, &uploadBufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr);
+	vertexAllocation = nullptr;
+	vertexBufferUpload = nullptr;
+	prevVertexBuffer = nullptr;
+	prevVertexBufferValid = false;
+	dirtyVertexRanges.clear();
+}
+
+void RT64::Mesh::releaseIndexBuffers() {
+	if (indexAllocation != nullptr) {
+		GeometryPool *indexPool = renderContext->getIndexPool();
+		GeometryPool::Allocation *allocation = indexAllocation;
+		renderContext->retire([indexPool, allocation]() {
+			indexPool->free(allocation);
+		});
+	}
 
-		CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize);
-		vertexBuffer = device->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+	if (indexBufferUpload != nullptr) {
+		renderContext->retireUploadBuffer(indexBufferUpload);
 	}
 
+	indexAllocation = nullptr;
+	indexBufferUpload = nullptr;
+}
+
+void RT64::Mesh::releaseBottomLevelAS() {
+	if (bottomLevelASResult != nullptr) {
+		RenderContext::Counters *counters = renderContext->getCounters();
+		counters->blasBytes -= bottomLevelASSize;
+		counters->blasUncompactedBytes -= bottomLevelASCompacted ? 0 : bottomLevelASSize;
+
+		// Builds or compactions that use the AS might've been recorded already.
+		renderContext->retire(bottomLevelASResult);
+
+		// Any compacted sizes queried for the AS no longer apply.
+		bottomLevelASVersion++;
+	}
+
+	bottomLevelASResult = nullptr;
+	bottomLevelASSize = 0;
+	bottomLevelASCompacted = false;
+}
+
+void RT64::Mesh::updateVertexBuffer(RT64_VERTEX *vertexArray, int vertexCount) {
 	// Copy data to upload heap.
-	UINT8 *pDataBegin;
-	CD3DX12_RANGE readRange(0, 0);
-	D3D12_CHECK(vertexBufferUpload.Get()->Map(0, &readRange, reinterpret_cast<void**>(&pDataBegin)));
-	memcpy(pDataBegin, vertexArray, vertexBufferSize);
-	vertexBufferUpload.Get()->Unmap(0, nullptr);
-	
-	// Copy resource to the real default resource.
-	device->getD3D12CommandList()->CopyResource(vertexBuffer.Get(), vertexBufferUpload.Get());
+	void *pDataBegin = mapVertexBuffer(vertexCount);
+	memcpy(pDataBegin, vertexArray, vertexCount * sizeof(RT64_VERTEX));
+	unmapVertexBuffer();
+}
+
+RT64_VERTEX *RT64::Mesh::mapVertexBuffer(int vertexCount) {
+	const uint64_t vertexBufferSize = vertexCount * sizeof(RT64_VERTEX);
+
+	if ((vertexAllocation != nullptr) && (this->vertexCount != vertexCount)) {
+		releaseVertexBuffers();
+
+		// Discard the BLAS since it won't be compatible anymore even if it's updatable.
+		releaseBottomLevelAS();
+	}
 
-	// Wait for the resource to finish copying before switching to generic read.
-	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(vertexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
-	device->getD3D12CommandList()->ResourceBarrier(1, &transition);
+	if (vertexAllocation == nullptr) {
+		vertexBufferUpload = renderContext->createUploadBuffer(vertexBufferSize);
+		vertexAllocation = renderContext->getVertexPool()->allocate(vertexCount);
+	}
+	else {
+		savePreviousVertices();
+	}
 
-	// Configure vertex buffer view.
-	d3dVertexBufferView.BufferLocation = vertexBuffer.Get()->GetGPUVirtualAddress();
-	d3dVertexBufferView.StrideInBytes = sizeof(RT64_VERTEX);
-	d3dVertexBufferView.SizeInBytes = vertexBufferSize;
+	// The whole buffer is copied, so any ranges that were pending are already included.
+	dirtyVertexRanges.clear();
 
 	// Store the new vertex count.
 	this->vertexCount = vertexCount;
+
+	return (RT64_VERTEX *)(vertexBufferUpload->map());
+}
+
+void RT64::Mesh::unmapVertexBuffer() {
+	RenderCommandList *commandList = renderContext->getRenderDevice()->getCommandList();
+	GeometryPool *vertexPool = renderContext->getVertexPool();
+	vertexBufferUpload->unmap();
+	renderContext->getCounters()->bytesUploaded += vertexBufferUpload->getDesc().size;
+	
+	// Copy resource to the real default resource. The pool is transitioned back to generic read once before the frame.
+	commandList->barrier(vertexAllocation->block->buffer, RenderBufferAccess::CopyDest);
+	commandList->copyBufferRegion(vertexAllocation->block->buffer, vertexPool->getByteOffset(vertexAllocation), vertexBufferUpload, 0, vertexPool->getByteSize(vertexAllocation));
+}
+
+void RT64::Mesh::savePreviousVertices() {
+	if (flags & RT64_MESH_RAYTRACE_UPDATABLE) {
+		// Updatable meshes keep the vertices they had before the update so the motion vectors can account
+		// for the deformation. The buffer is only created the first time the mesh is updated in place.
+		RenderDevice *renderDevice = renderContext->getRenderDevice();
+		RenderCommandList *commandList = renderDevice->getCommandList();
+		GeometryPool *vertexPool = renderContext->getVertexPool();
+		const uint64_t vertexBufferSize = vertexPool->getByteSize(vertexAllocation);
+		if (prevVertexBuffer == nullptr) {
+			prevVertexBuffer = renderDevice->createBuffer(RenderBufferDesc::DefaultBuffer(vertexBufferSize));
+		}
+
+		commandList->barrier(vertexAllocation->block->buffer, RenderBufferAccess::CopySource);
+		commandList->barrier(prevVertexBuffer, RenderBufferAccess::CopyDest);
+		commandList->copyBufferRegion(prevVertexBuffer, 0, vertexAllocation->block->buffer, vertexPool->getByteOffset(vertexAllocation), vertexBufferSize);
+		commandList->barrier(prevVertexBuffer, RenderBufferAccess::Read);
+		prevVertexBufferValid = true;
+	}
+}
+
+void RT64::Mesh::updateVertexRange(const RT64_VERTEX *vertexArray, int firstVertex, int vertexCount) {
+	if (vertexAllocation == nullptr) {
+		throw std::runtime_error("The mesh must be set before its vertices can be updated.");
+	}
+
+	if ((firstVertex < 0) || (vertexCount < 0) || ((firstVertex + vertexCount) > this->vertexCount)) {
+		throw std::runtime_error("The vertex range is out of the bounds of the mesh.");
+	}
+
+	if (vertexCount == 0) {
+		return;
+	}
+
+	// The previous vertices must be saved before the first range of the frame is copied. Since the copies are only
+	// recorded later, the vertex buffer still holds the vertices of the last frame at this point.
+	if (dirtyVertexRanges.empty()) {
+		savePreviousVertices();
+		renderContext->queueVertexUpload(this);
+	}
+
+	// The upload buffer always holds all the vertices, so merged ranges can include vertices that weren't updated.
+	const uint64_t rangeOffset = firstVertex * sizeof(RT64_VERTEX);
+	const uint64_t rangeSize = vertexCount * sizeof(RT64_VERTEX);
+	uint8_t *pDataBegin = (uint8_t *)(vertexBufferUpload->map());
+	memcpy(pDataBegin + rangeOffset, vertexArray, rangeSize);
+	vertexBufferUpload->unmap();
+	renderContext->getCounters()->bytesUploaded += rangeSize;
+
+	dirtyVertexRanges.add(firstVertex, firstVertex + vertexCount);
+	updateBottomLevelAS();
+}
+
+void RT64::Mesh::uploadDirtyVertices() {
+	if (dirtyVertexRanges.empty()) {
+		return;
+	}
+
+	RenderCommandList *commandList = renderContext->getRenderDevice()->getCommandList();
+	RenderBuffer *vertexBuffer = vertexAllocation->block->buffer;
+	const uint64_t vertexBufferOffset = renderContext->getVertexPool()->getByteOffset(vertexAllocation);
+	commandList->barrier(vertexBuffer, RenderBufferAccess::CopyDest);
+	for (const RangeSet::Range &range : dirtyVertexRanges.getRanges()) {
+		const uint64_t rangeOffset = range.begin * sizeof(RT64_VERTEX);
+		commandList->copyBufferRegion(vertexBuffer, vertexBufferOffset + rangeOffset, vertexBufferUpload, rangeOffset, (range.end - range.begin) * sizeof(RT64_VERTEX));
+	}
+
+	dirtyVertexRanges.clear();
 }
 
 void RT64::Mesh::updateIndexBuffer(unsigned int *indexArray, int indexCount) {
-	const UINT indexBufferSize = indexCount * sizeof(unsigned int);
+	RenderDevice *renderDevice = renderContext->getRenderDevice();
+	RenderCommandList *commandList = renderDevice->getCommandList();
+	const uint64_t indexBufferSize = indexCount * sizeof(unsigned int);
 
-	if (!indexBuffer.IsNull() && (this->indexCount != indexCount)) {
-		indexBuffer.Release();
-		indexBufferUpload.Release();
+	if ((indexAllocation != nullptr) && (this->indexCount != indexCount)) {
+		releaseIndexBuffers();
 
 		// Discard the BLAS since it won't be compatible anymore even if it's updatable.
-		d3dBottomLevelASBuffers.Release();
+		releaseBottomLevelAS();
 	}
 
-	if (indexBuffer.IsNull()) {
-		CD3DX12_RESOURCE_DESC uploadBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
-		indexBufferUpload = device->allocateResource(D3D12_HEAP_TYPE_UPLOAD, &uploadBufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr);
-
-		CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
-		indexBuffer = device->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
+	if (indexAllocation == nullptr) {
+		indexBufferUpload = renderContext->createUploadBuffer(indexBufferSize);
+		indexAllocation = renderContext->getIndexPool()->allocate(indexCount);
 	}
 
 	// Copy data to upload heap.
-	UINT8 *pDataBegin;
-	CD3DX12_RANGE readRange(0, 0);
-	D3D12_CHECK(indexBufferUpload.Get()->Map(0, &readRange, reinterpret_cast<void **>(&pDataBegin)));
+	void *pDataBegin = indexBufferUpload->map();
 	memcpy(pDataBegin, indexArray, indexBufferSize);
-	indexBufferUpload.Get()->Unmap(0, nullptr);
+	indexBufferUpload->unmap();
+	renderContext->getCounters()->bytesUploaded += indexBufferSize;
 	
-	// Copy resource to the real default resource.
-	device->getD3D12CommandList()->CopyResource(indexBuffer.Get(), indexBufferUpload.Get());
-
-	// Wait for the resource to finish copying before switching to generic read.
-	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(indexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
-	device->getD3D12CommandList()->ResourceBarrier(1, &transition);
-
-	// Configure index buffer view.
-	d3dIndexBufferView.BufferLocation = indexBuffer.Get()->GetGPUVirtualAddress();
-	d3dIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-	d3dIndexBufferView.SizeInBytes = indexBufferSize;
+	// Copy resource to the real default resource. The pool is transitioned back to generic read once before the frame.
+	commandList->barrier(indexAllocation->block->buffer, RenderBufferAccess::CopyDest);
+	commandList->copyBufferRegion(indexAllocation->block->buffer, renderContext->getIndexPool()->getByteOffset(indexAllocation), indexBufferUpload, 0, indexBufferSize);
 
 	this->indexCount = indexCount;
 }
 
 void RT64::Mesh::updateBottomLevelAS() {
-	if (flags & RT64_MESH_RAYTRACE_ENABLED) {
-		// Create and store the bottom level AS buffers.
-		createBottomLevelAS({ { getVertexBuffer(), getVertexCount() } }, { { getIndexBuffer(), getIndexCount() } });
-
-		// Submit this result as the last barrier for the command queue.
-		D3D12_RESOURCE_BARRIER barrier;
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-		barrier.UAV.pResource = d3dBottomLevelASBuffers.result.Get();
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		device->setLastCommandQueueBarrier(barrier);
+	// Meshes that were only mapped don't have any indices yet.
+	if ((flags & RT64_MESH_RAYTRACE_ENABLED) && (indexAllocation != nullptr)) {
+		// The build is done along with all the others at the start of the next frame. It can only be delayed further if
+		// there's a previous AS that can be traced against in the meantime.
+		renderContext->queueBottomLevelASBuild(this, bottomLevelASResult == nullptr);
 	}
 }
 
-void RT64::Mesh::createBottomLevelAS(std::vector<std::pair<ID3D12Resource *, uint32_t>> vVertexBuffers, std::vector<std::pair<ID3D12Resource *, uint32_t>> vIndexBuffers) {
+void RT64::Mesh::buildBottomLevelAS() {
 	bool updatable = flags & RT64_MESH_RAYTRACE_UPDATABLE;
 	if (!updatable) {
 		// Release the previously stored AS buffers if there's any.
-		d3dBottomLevelASBuffers.Release();
+		releaseBottomLevelAS();
 	}
-	
-	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
-	for (size_t i = 0; i < vVertexBuffers.size(); i++) {
-		if ((i < vIndexBuffers.size()) && (vIndexBuffers[i].second > 0)) {
-			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first, 0, vVertexBuffers[i].second, sizeof(RT64_VERTEX), vIndexBuffers[i].first, 0, vIndexBuffers[i].second, nullptr, 0, true);
-		}
-		else {
-			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first, 0, vVertexBuffers[i].second, sizeof(RT64_VERTEX), 0, 0);
-		}
+
+	RenderBottomLevelASMesh asMesh;
+	asMesh.vertexBuffer = vertexAllocation->block->buffer;
+	asMesh.vertexOffset = renderContext->getVertexPool()->getByteOffset(vertexAllocation);
+	asMesh.vertexCount = vertexCount;
+	asMesh.vertexStride = sizeof(RT64_VERTEX);
+	asMesh.indexBuffer = indexAllocation->block->buffer;
+	asMesh.indexOffset = renderContext->getIndexPool()->getByteOffset(indexAllocation);
+	asMesh.indexCount = indexCount;
+
+	// Meshes that are never updated in place can be compacted once the GPU reports how much memory they really need.
+	RenderBottomLevelASDesc asDesc;
+	asDesc.meshes.push_back(asMesh);
+	asDesc.updatable = updatable;
+	asDesc.compactable = !updatable;
+
+	RenderDevice *renderDevice = renderContext->getRenderDevice();
+	RenderContext::Counters *counters = renderContext->getCounters();
+	RenderBuffer *previousResult = bottomLevelASResult;
+	if (bottomLevelASResult == nullptr) {
+		RenderAccelerationStructureSizes sizes = renderDevice->getBottomLevelASSizes(asDesc);
+		bottomLevelASResult = renderDevice->createBuffer(RenderBufferDesc::AccelerationStructureBuffer(sizes.resultSize));
+		bottomLevelASSize = sizes.resultSize;
+		bottomLevelASScratchSize = sizes.scratchSize;
+		bottomLevelASUpdateScratchSize = sizes.updateScratchSize;
+		counters->blasBytes += bottomLevelASSize;
+		counters->blasUncompactedBytes += bottomLevelASSize;
 	}
 
-	UINT64 resultSizeInBytes = 0;
-	UINT64 scratchSizeInBytes = 0;
-	ID3D12Resource *previousResult = d3dBottomLevelASBuffers.result.Get();
-	bottomLevelAS.ComputeASBufferSizes(device->getD3D12Device(), updatable, &scratchSizeInBytes, &resultSizeInBytes);
+	// The scratch memory is only needed while the build is running, so it's taken from the pool shared by all the builds of the frame.
+	ScratchBufferPool::Allocation scratch = renderContext->getScratchPool()->allocate((previousResult != nullptr) ? bottomLevelASUpdateScratchSize : bottomLevelASScratchSize, renderContext->getFenceValue());
+	renderDevice->getCommandList()->buildBottomLevelAS(asDesc, scratch.buffer, scratch.offset, bottomLevelASResult, previousResult);
+	bottomLevelASVersion++;
 
-	if (d3dBottomLevelASBuffers.result.IsNull()) {
-		d3dBottomLevelASBuffers.scratch = device->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, scratchSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON);
-		d3dBottomLevelASBuffers.result = device->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, resultSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
+	if (previousResult != nullptr) {
+		counters->blasUpdates++;
 	}
+	else {
+		counters->blasBuilds++;
+	}
+
+	if (asDesc.compactable) {
+		renderContext->queueCompaction(this);
+	}
+}
+
+void RT64::Mesh::compactBottomLevelAS(uint64_t compactedSize) {
+	assert(bottomLevelASResult != nullptr);
+	assert(!bottomLevelASCompacted);
+
+	compactedSize = ((compactedSize + RenderAccelerationStructureScratchAlignment - 1) / RenderAccelerationStructureScratchAlignment) * RenderAccelerationStructureScratchAlignment;
+	if (compactedSize >= bottomLevelASSize) {
+		return;
+	}
+
+	RenderDevice *renderDevice = renderContext->getRenderDevice();
+	RenderBuffer *compactedResult = renderDevice->createBuffer(RenderBufferDesc::AccelerationStructureBuffer(compactedSize));
+	renderDevice->getCommandList()->compactAccelerationStructure(compactedResult, bottomLevelASResult);
+	renderContext->retire(bottomLevelASResult);
+
+	RenderContext::Counters *counters = renderContext->getCounters();
+	counters->blasBytes -= bottomLevelASSize;
+	counters->blasUncompactedBytes -= bottomLevelASSize;
+	counters->blasBytes += compactedSize;
+	bottomLevelASResult = compactedResult;
+	bottomLevelASSize = compactedSize;
+	bottomLevelASCompacted = true;
+
+	// The address changed, so the top-level ASes that use it must be rebuilt.
+	bottomLevelASVersion++;
+}
 
-	bottomLevelAS.Generate(device->getD3D12CommandList(), d3dBottomLevelASBuffers.scratch.Get(), d3dBottomLevelASBuffers.result.Get(), (previousResult != nullptr), previousResult);
+RT64::RenderBuffer *RT64::Mesh::getVertexBuffer() const {
+	return (vertexAllocation != nullptr) ? vertexAllocation->block->buffer : nullptr;
 }
 
-ID3D12Resource *RT64::Mesh::getVertexBuffer() const {
-	return vertexBuffer.Get();
+uint32_t RT64::Mesh::getFirstVertex() const {
+	return (vertexAllocation != nullptr) ? (uint32_t)(vertexAllocation->offset) : 0;
 }
 
-const D3D12_VERTEX_BUFFER_VIEW *RT64::Mesh::getVertexBufferView() const {
-	return &d3dVertexBufferView;
+uint64_t RT64::Mesh::getVertexBufferAddress() const {
+	return (vertexAllocation != nullptr) ? renderContext->getVertexPool()->getDeviceAddress(vertexAllocation) : 0;
+}
+
+uint64_t RT64::Mesh::getPreviousVertexBufferAddress() const {
+	if (prevVertexBufferValid) {
+		return prevVertexBuffer->getDeviceAddress();
+	}
+	else {
+		return getVertexBufferAddress();
+	}
+}
+
+void RT64::Mesh::discardPreviousVertices() {
+	prevVertexBufferValid = false;
 }
 
 int RT64::Mesh::getVertexCount() const {
 	return vertexCount;
 }
 
-ID3D12Resource *RT64::Mesh::getIndexBuffer() const {
-	return indexBuffer.Get();
+RT64::RenderBuffer *RT64::Mesh::getIndexBuffer() const {
+	return (indexAllocation != nullptr) ? indexAllocation->block->buffer : nullptr;
 }
 
-const D3D12_INDEX_BUFFER_VIEW *RT64::Mesh::getIndexBufferView() const {
-	return &d3dIndexBufferView;
+uint32_t RT64::Mesh::getFirstIndex() const {
+	return (indexAllocation != nullptr) ? (uint32_t)(indexAllocation->offset) : 0;
+}
+
+uint64_t RT64::Mesh::getIndexBufferAddress() const {
+	return (indexAllocation != nullptr) ? renderContext->getIndexPool()->getDeviceAddress(indexAllocation) : 0;
 }
 
 int RT64::Mesh::getIndexCount() const {
 	return indexCount;
 }
 
-ID3D12Resource *RT64::Mesh::getBottomLevelASResult() const {
-	return d3dBottomLevelASBuffers.result.Get();
+RT64::RenderBuffer *RT64::Mesh::getBottomLevelASResult() const {
+	return bottomLevelASResult;
+}
+
+uint32_t RT64::Mesh::getBottomLevelASVersion() const {
+	return bottomLevelASVersion;
 }
 
 // Public
 
+// The library is only built on Windows. The mesh itself only depends on the render context, so the tests build it
+// without the exports on other platforms.
+#ifdef _WIN32
+
+#include "rt64_device.h"
+
 DLLEXPORT RT64_MESH *RT64_CreateMesh(RT64_DEVICE *devicePtr, int flags) {
 	RT64::Device *device = (RT64::Device *)(devicePtr);
-	return (RT64_MESH *)(new RT64::Mesh(device, flags));
+	return (RT64_MESH *)(new RT64::Mesh(device->getRenderContext(), flags));
 }
 
 DLLEXPORT void RT64_SetMesh(RT64_MESH *meshPtr, RT64_VERTEX *vertexArray, int vertexCount, unsigned int *indexArray, int indexCount) {
@@ -200,8 +421,41 @@ DLLEXPORT void RT64_SetMesh(RT64_MESH *meshPtr, RT64_VERTEX *vertexArray, int ve
 	mesh->updateBottomLevelAS();
 }
 
+DLLEXPORT RT64_VERTEX *RT64_MapMeshVertices(RT64_MESH *meshPtr, int vertexCount) {
+	assert(meshPtr != nullptr);
+	assert(vertexCount > 0);
+	try {
+		RT64::Mesh *mesh = (RT64::Mesh *)(meshPtr);
+		return mesh->mapVertexBuffer(vertexCount);
+	}
+	RT64_CATCH_EXCEPTION();
+	return nullptr;
+}
+
+DLLEXPORT void RT64_UnmapMeshVertices(RT64_MESH *meshPtr) {
+	assert(meshPtr != nullptr);
+	try {
+		RT64::Mesh *mesh = (RT64::Mesh *)(meshPtr);
+		mesh->unmapVertexBuffer();
+		mesh->updateBottomLevelAS();
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
+DLLEXPORT void RT64_UpdateMeshVertices(RT64_MESH *meshPtr, int firstVertex, int vertexCount, RT64_VERTEX *vertexArray) {
+	assert(meshPtr != nullptr);
+	assert((vertexArray != nullptr) || (vertexCount == 0));
+	try {
+		RT64::Mesh *mesh = (RT64::Mesh *)(meshPtr);
+		mesh->updateVertexRange(vertexArray, firstVertex, vertexCount);
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
 DLLEXPORT void RT64_DestroyMesh(RT64_MESH * meshPtr) {
 	delete (RT64::Mesh *)(meshPtr);
 }
 
+#endif
+
 #endif
\ No newline at end of file
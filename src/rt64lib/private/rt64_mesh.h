@@ -4,38 +4,76 @@
 
 #pragma once
 
-#include "rt64_common.h"
+#include "../public/rt64.h"
+#include "rt64_geometry_pool.h"
+#include "rt64_range_set.h"
+#include "rt64_render_interface.h"
 
 namespace RT64 {
-	class Device;
+	class RenderContext;
 
 	class Mesh {
 	private:
-		Device *device;
-		AllocatedResource vertexBuffer;
-		AllocatedResource vertexBufferUpload;
-		D3D12_VERTEX_BUFFER_VIEW d3dVertexBufferView;
-		AllocatedResource indexBuffer;
-		AllocatedResource indexBufferUpload;
-		D3D12_INDEX_BUFFER_VIEW d3dIndexBufferView;
+		RenderContext *renderContext;
+		GeometryPool::Allocation *vertexAllocation;
+		RenderBuffer *vertexBufferUpload;
+		RenderBuffer *prevVertexBuffer;
+		bool prevVertexBufferValid;
+		GeometryPool::Allocation *indexAllocation;
+		RenderBuffer *indexBufferUpload;
 		int vertexCount;
 		int indexCount;
-		RT64::AccelerationStructureBuffers d3dBottomLevelASBuffers;
+		RangeSet dirtyVertexRanges;
+		RenderBuffer *bottomLevelASResult;
+		uint64_t bottomLevelASSize;
+		uint64_t bottomLevelASScratchSize;
+		uint64_t bottomLevelASUpdateScratchSize;
+		uint32_t bottomLevelASVersion;
+		bool bottomLevelASCompacted;
 		int flags;
 
-		void createBottomLevelAS(std::vector<std::pair<ID3D12Resource *, uint32_t>> vVertexBuffers, std::vector<std::pair<ID3D12Resource *, uint32_t>> vIndexBuffers);
+		void releaseVertexBuffers();
+		void releaseIndexBuffers();
+		void releaseBottomLevelAS();
+		void savePreviousVertices();
 	public:
-		Mesh(Device *device, int flags);
+		Mesh(RenderContext *renderContext, int flags);
 		virtual ~Mesh();
 		void updateVertexBuffer(RT64_VERTEX *vertexArray, int vertexCount);
-		ID3D12Resource *getVertexBuffer() const;
-		const D3D12_VERTEX_BUFFER_VIEW *getVertexBufferView() const;
+
+		// Lets the host write the vertices directly into the upload buffer. The whole buffer is copied once it's unmapped,
+		// so every vertex must be written.
+		RT64_VERTEX *mapVertexBuffer(int vertexCount);
+		void unmapVertexBuffer();
+
+		// Only the ranges that were updated are copied to the vertex buffer, and the copies are recorded by the render
+		// context before the bottom level ASes are built. Updatable meshes refit their AS instead of building it again.
+		void updateVertexRange(const RT64_VERTEX *vertexArray, int firstVertex, int vertexCount);
+		void uploadDirtyVertices();
+		// The geometry is suballocated from the render context's pools, so the buffers are shared with other meshes and the
+		// first vertex and index must be used as offsets. They can change between frames when the pools are defragmented.
+		RenderBuffer *getVertexBuffer() const;
+		uint32_t getFirstVertex() const;
+		uint64_t getVertexBufferAddress() const;
+		uint64_t getPreviousVertexBufferAddress() const;
+		void discardPreviousVertices();
 		int getVertexCount() const;
 		void updateIndexBuffer(unsigned int *indexArray, int indexCount);
-		ID3D12Resource *getIndexBuffer() const;
-		const D3D12_INDEX_BUFFER_VIEW *getIndexBufferView() const;
+		RenderBuffer *getIndexBuffer() const;
+		uint32_t getFirstIndex() const;
+		uint64_t getIndexBufferAddress() const;
 		int getIndexCount() const;
 		void updateBottomLevelAS();
-		ID3D12Resource *getBottomLevelASResult() const;
+
+		// Records the build requested by the last update. Called by the render context when it flushes the pending builds.
+		void buildBottomLevelAS();
+		RenderBuffer *getBottomLevelASResult() const;
+
+		// Changes every time the bottom level AS is built, updated, compacted or released.
+		uint32_t getBottomLevelASVersion() const;
+
+		// Replaces the bottom level AS with a copy of the given size. Must only be called once the size reported by the
+		// GPU for the current version of the AS has been read back. The previous result is released after the frame.
+		void compactBottomLevelAS(uint64_t compactedSize);
 	};
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocates objects from chunks of memory that are never moved or released until the pool is destroyed, so objects
+// created one after the other end up next to each other in memory and their addresses can be used as handles. The
+// memory of destroyed objects is reused by the next objects that are created.
+
+namespace RT64 {
+	template<typename T, size_t ChunkSize = 256>
+	class ObjectPool {
+	private:
+		union Entry {
+			Entry *nextFree;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		};
+
+		std::vector<uint8_t *> chunks;
+		Entry *freeList = nullptr;
+		size_t objectCount = 0;
+
+		void allocateChunk() {
+			// The chunk is aligned by hand since the default allocator only guarantees the fundamental alignment.
+			uint8_t *chunk = new uint8_t[ChunkSize * sizeof(Entry) + alignof(Entry)];
+			chunks.push_back(chunk);
+
+			void *alignedChunk = chunk;
+			size_t space = ChunkSize * sizeof(Entry) + alignof(Entry);
+			Entry *entries = (Entry *)(std::align(alignof(Entry), ChunkSize * sizeof(Entry), alignedChunk, space));
+			for (size_t i = 0; i < ChunkSize; i++) {
+				entries[i].nextFree = (i + 1 < ChunkSize) ? &entries[i + 1] : freeList;
+			}
+
+			freeList = &entries[0];
+		}
+	public:
+		ObjectPool() = default;
+		ObjectPool(const ObjectPool &) = delete;
+		ObjectPool &operator=(const ObjectPool &) = delete;
+
+		~ObjectPool() {
+			assert((objectCount == 0) && "All the objects must be destroyed before the pool.");
+			for (uint8_t *chunk : chunks) {
+				delete[] chunk;
+			}
+		}
+
+		template<typename... Args>
+		T *create(Args &&... args) {
+			if (freeList == nullptr) {
+				allocateChunk();
+			}
+
+			Entry *entry = freeList;
+			freeList = entry->nextFree;
+
+			T *object;
+			try {
+				object = new (&entry->storage) T(std::forward<Args>(args)...);
+			}
+			catch (...) {
+				entry->nextFree = freeList;
+				freeList = entry;
+				throw;
+			}
+
+			objectCount++;
+			return object;
+		}
+
+		void destroy(T *object) {
+			assert(object != nullptr);
+			object->~T();
+
+			Entry *entry = reinterpret_cast<Entry *>(object);
+			entry->nextFree = freeList;
+			freeList = entry;
+			objectCount--;
+		}
+
+		size_t getObjectCount() const {
+			return objectCount;
+		}
+	};
+};
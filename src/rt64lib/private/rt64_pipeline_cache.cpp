@@ -0,0 +1,349 @@
+//
+// RT64
+//
+
+#include "rt64_pipeline_cache.h"
+
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include "xxhash/xxhash64.h"
+
+namespace {
+	const char FileMagic[8] = { 'R', 'T', '6', '4', 'P', 'S', 'O', 'C' };
+	const size_t HeaderSize = 32;
+	const size_t TableEntrySize = 32;
+	const size_t BlobAlignment = 8;
+
+	uint32_t readU32(const uint8_t *src) {
+		uint32_t value;
+		memcpy(&value, src, sizeof(value));
+		return value;
+	}
+
+	uint64_t readU64(const uint8_t *src) {
+		uint64_t value;
+		memcpy(&value, src, sizeof(value));
+		return value;
+	}
+
+	void writeU32(std::vector<uint8_t> &dst, size_t offset, uint32_t value) {
+		memcpy(dst.data() + offset, &value, sizeof(value));
+	}
+
+	void writeU64(std::vector<uint8_t> &dst, size_t offset, uint64_t value) {
+		memcpy(dst.data() + offset, &value, sizeof(value));
+	}
+};
+
+// Private
+
+bool RT64::PipelineCache::mapFile() {
+#ifdef _WIN32
+	HANDLE file = CreateFileW(std::filesystem::u8path(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	mappedData = (const uint8_t *)(view);
+	mappedSize = (size_t)(fileSize.QuadPart);
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if ((fstat(file, &fileStat) != 0) || (fileStat.st_size == 0)) {
+		::close(file);
+		return false;
+	}
+
+	void *view = mmap(nullptr, (size_t)(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	mappedData = (const uint8_t *)(view);
+	mappedSize = (size_t)(fileStat.st_size);
+#endif
+	return true;
+}
+
+void RT64::PipelineCache::unmapFile() {
+	if (mappedData == nullptr) {
+		return;
+	}
+
+	// Entries can't keep pointing into the file once it's gone.
+	for (auto &it : entries) {
+		Entry &entry = it.second;
+		if (entry.mappedData != nullptr) {
+			entry.ownedData.assign(entry.mappedData, entry.mappedData + entry.size);
+			entry.mappedData = nullptr;
+		}
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mappedData);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	munmap((void *)(mappedData), mappedSize);
+#endif
+	mappedData = nullptr;
+	mappedSize = 0;
+}
+
+RT64::PipelineCache::LoadResult RT64::PipelineCache::parseMappedFile() {
+	if ((mappedSize < HeaderSize) || (memcmp(mappedData, FileMagic, sizeof(FileMagic)) != 0)) {
+		return LoadResult::Corrupted;
+	}
+
+	const uint32_t version = readU32(mappedData + 8);
+	const uint32_t entryCount = readU32(mappedData + 12);
+	const uint64_t fileEnvironmentId = readU64(mappedData + 16);
+	const uint64_t tableChecksum = readU64(mappedData + 24);
+	if ((version != FormatVersion) || (fileEnvironmentId != environmentId)) {
+		return LoadResult::Stale;
+	}
+
+	const uint64_t tableSize = (uint64_t)(entryCount) * TableEntrySize;
+	if ((HeaderSize + tableSize) > mappedSize) {
+		return LoadResult::Corrupted;
+	}
+
+	const uint8_t *table = mappedData + HeaderSize;
+	if (hash(table, (size_t)(tableSize)) != tableChecksum) {
+		return LoadResult::Corrupted;
+	}
+
+	const uint64_t dataStart = HeaderSize + tableSize;
+	for (uint32_t i = 0; i < entryCount; i++) {
+		const uint8_t *tableEntry = table + (size_t)(i) * TableEntrySize;
+		const uint64_t key = readU64(tableEntry + 0);
+		const uint64_t offset = readU64(tableEntry + 8);
+		const uint64_t size = readU64(tableEntry + 16);
+		if ((offset < dataStart) || (offset > mappedSize) || (size > (mappedSize - offset))) {
+			entries.clear();
+			return LoadResult::Corrupted;
+		}
+
+		Entry &entry = entries[key];
+		entry.mappedData = mappedData + offset;
+		entry.size = size;
+		entry.checksum = readU64(tableEntry + 24);
+	}
+
+	return LoadResult::Loaded;
+}
+
+// Public
+
+RT64::PipelineCache::PipelineCache() {
+	environmentId = 0;
+	dirty = false;
+	mappedData = nullptr;
+	mappedSize = 0;
+#ifdef _WIN32
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+#endif
+}
+
+RT64::PipelineCache::~PipelineCache() {
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	entries.clear();
+	unmapFile();
+}
+
+RT64::PipelineCache::LoadResult RT64::PipelineCache::open(const std::string &path, uint64_t environmentId) {
+	clear();
+
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	this->path = path;
+	this->environmentId = environmentId;
+	if (!mapFile()) {
+		dirty = true;
+		return LoadResult::Missing;
+	}
+
+	LoadResult result = parseMappedFile();
+	if (result == LoadResult::Loaded) {
+		dirty = false;
+	}
+	else {
+		entries.clear();
+		unmapFile();
+		dirty = true;
+	}
+
+	return result;
+}
+
+bool RT64::PipelineCache::find(uint64_t key, std::vector<uint8_t> &blob) {
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		return false;
+	}
+
+	// Blobs that are still in the file are only verified when they're used.
+	Entry &entry = it->second;
+	if (entry.mappedData != nullptr) {
+		if (hash(entry.mappedData, (size_t)(entry.size)) != entry.checksum) {
+			entries.erase(it);
+			dirty = true;
+			return false;
+		}
+
+		blob.assign(entry.mappedData, entry.mappedData + entry.size);
+	}
+	else {
+		blob = entry.ownedData;
+	}
+
+	return true;
+}
+
+void RT64::PipelineCache::store(uint64_t key, const void *data, size_t size) {
+	assert((data != nullptr) || (size == 0));
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	Entry &entry = entries[key];
+	entry.mappedData = nullptr;
+	entry.ownedData.assign((const uint8_t *)(data), (const uint8_t *)(data) + size);
+	entry.size = size;
+	entry.checksum = hash(data, size);
+	dirty = true;
+}
+
+bool RT64::PipelineCache::save() {
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	if (!dirty || path.empty()) {
+		return true;
+	}
+
+	// Lay out the whole file in memory first.
+	const size_t tableSize = entries.size() * TableEntrySize;
+	size_t fileSize = HeaderSize + tableSize;
+	for (const auto &it : entries) {
+		fileSize = ((fileSize + BlobAlignment - 1) / BlobAlignment) * BlobAlignment;
+		fileSize += (size_t)(it.second.size);
+	}
+
+	std::vector<uint8_t> fileData(fileSize, 0);
+	memcpy(fileData.data(), FileMagic, sizeof(FileMagic));
+	writeU32(fileData, 8, FormatVersion);
+	writeU32(fileData, 12, (uint32_t)(entries.size()));
+	writeU64(fileData, 16, environmentId);
+
+	size_t tableOffset = HeaderSize;
+	size_t blobOffset = HeaderSize + tableSize;
+	for (const auto &it : entries) {
+		const Entry &entry = it.second;
+		blobOffset = ((blobOffset + BlobAlignment - 1) / BlobAlignment) * BlobAlignment;
+		const uint8_t *entryData = (entry.mappedData != nullptr) ? entry.mappedData : entry.ownedData.data();
+		if (entry.size > 0) {
+			memcpy(fileData.data() + blobOffset, entryData, (size_t)(entry.size));
+		}
+
+		writeU64(fileData, tableOffset + 0, it.first);
+		writeU64(fileData, tableOffset + 8, blobOffset);
+		writeU64(fileData, tableOffset + 16, entry.size);
+		writeU64(fileData, tableOffset + 24, entry.checksum);
+		tableOffset += TableEntrySize;
+		blobOffset += (size_t)(entry.size);
+	}
+
+	writeU64(fileData, 24, hash(fileData.data() + HeaderSize, tableSize));
+
+	// The file can't be replaced while it's mapped.
+	unmapFile();
+
+	std::error_code ec;
+	std::filesystem::path filePath = std::filesystem::u8path(path);
+	std::filesystem::path tempPath = filePath;
+	tempPath += ".tmp";
+	if (filePath.has_parent_path()) {
+		std::filesystem::create_directories(filePath.parent_path(), ec);
+	}
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		file.write((const char *)(fileData.data()), fileData.size());
+		if (file.fail()) {
+			file.close();
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tempPath, filePath, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	dirty = false;
+	return true;
+}
+
+void RT64::PipelineCache::clear() {
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	entries.clear();
+	unmapFile();
+	dirty = true;
+}
+
+size_t RT64::PipelineCache::getEntryCount() const {
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	return entries.size();
+}
+
+bool RT64::PipelineCache::isDirty() const {
+	std::unique_lock<std::mutex> lock(entriesMutex);
+	return dirty;
+}
+
+uint64_t RT64::PipelineCache::hash(const void *data, size_t size, uint64_t seed) {
+	return XXHash64::hash(data, size, seed);
+}
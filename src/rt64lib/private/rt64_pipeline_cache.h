@@ -0,0 +1,80 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Stores the blobs the driver returns for the pipelines so they don't need to be compiled again on the next launch.
+// The container is memory-mapped when opened and only the entries that are requested get copied out of it.
+//
+// File layout, little endian:
+//   Header:  char magic[8], uint32 version, uint32 entryCount, uint64 environmentId, uint64 tableChecksum.
+//   Table:   entryCount x { uint64 key, uint64 offset, uint64 size, uint64 checksum }.
+//   Blobs:   8-byte aligned, referenced by the table.
+//
+// The environment ID identifies the adapter and the driver. A file written for another environment is discarded.
+// A file with a broken header or table is discarded as a whole, while a blob whose checksum doesn't match is only
+// dropped when it's looked up. Saving always writes a new file and moves it over the old one.
+
+namespace RT64 {
+	class PipelineCache {
+	public:
+		static const uint32_t FormatVersion = 1;
+
+		enum class LoadResult {
+			Loaded,
+			Missing,
+			Stale,
+			Corrupted
+		};
+	private:
+		struct Entry {
+			const uint8_t *mappedData = nullptr;
+			uint64_t checksum = 0;
+			uint64_t size = 0;
+			std::vector<uint8_t> ownedData;
+		};
+
+		std::string path;
+		uint64_t environmentId;
+		std::unordered_map<uint64_t, Entry> entries;
+		mutable std::mutex entriesMutex;
+		bool dirty;
+		const uint8_t *mappedData;
+		size_t mappedSize;
+#ifdef _WIN32
+		void *fileHandle;
+		void *mappingHandle;
+#endif
+
+		bool mapFile();
+		void unmapFile();
+		LoadResult parseMappedFile();
+	public:
+		PipelineCache();
+		virtual ~PipelineCache();
+
+		// Maps the file and validates it. The cache is left empty and ready to be saved again if the file can't be used.
+		LoadResult open(const std::string &path, uint64_t environmentId);
+
+		// Copies the blob stored for the key. Returns false if there's none or if it was corrupted.
+		bool find(uint64_t key, std::vector<uint8_t> &blob);
+
+		// Stores a blob for the key, replacing the previous one. Can be called from multiple threads.
+		void store(uint64_t key, const void *data, size_t size);
+
+		// Writes the cache back to the file if anything changed since it was opened.
+		bool save();
+		void clear();
+		size_t getEntryCount() const;
+		bool isDirty() const;
+		static uint64_t hash(const void *data, size_t size, uint64_t seed = 0);
+	};
+};
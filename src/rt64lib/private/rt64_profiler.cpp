@@ -0,0 +1,193 @@
+//
+// RT64
+//
+
+#include "rt64_profiler.h"
+
+#include <cassert>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <thread>
+
+namespace {
+	// Thread ID used for the GPU track in the Chrome trace. It can't collide with a CPU thread.
+	const uint32_t GPUTraceThreadId = 0;
+
+	void writeEscapedString(std::ostream &stream, const char *str) {
+		stream << '"';
+		for (const char *c = str; *c != '\0'; c++) {
+			if ((*c == '"') || (*c == '\\')) {
+				stream << '\\';
+			}
+
+			if ((unsigned char)(*c) >= 0x20) {
+				stream << *c;
+			}
+		}
+
+		stream << '"';
+	}
+};
+
+// Private
+
+RT64::Profiler::Scope::Scope(Profiler *profiler, const char *name, int stage) {
+	assert(profiler != nullptr);
+	this->profiler = profiler;
+	this->name = name;
+	this->stage = stage;
+	frame = profiler->getFrameIndex();
+	startUs = profiler->now();
+}
+
+RT64::Profiler::Scope::~Scope() {
+	profiler->record(name, stage, Track::CPU, frame, startUs, profiler->now() - startUs);
+}
+
+// Public
+
+RT64::Profiler::Profiler(size_t capacity) {
+	assert(capacity > 0);
+	this->capacity = capacity;
+	slots = std::make_unique<Slot[]>(capacity);
+	for (size_t i = 0; i < capacity; i++) {
+		slots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+
+	writeIndex.store(0);
+	frameIndex.store(0);
+	epoch = std::chrono::steady_clock::now();
+}
+
+RT64::Profiler::~Profiler() { }
+
+double RT64::Profiler::now() const {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void RT64::Profiler::record(const char *name, int stage, Track track, uint64_t frame, double startUs, double durationUs) {
+	// The sequence is marked while the slot is written, and is set to the index plus one once it's done. A writer that
+	// laps another one in the same slot waits for it, and an event never replaces a newer one.
+	uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+	Slot &slot = slots[index % capacity];
+	uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	while (true) {
+		if (sequence == WritingSequence) {
+			std::this_thread::yield();
+			sequence = slot.sequence.load(std::memory_order_relaxed);
+		}
+		else if (sequence > index) {
+			return;
+		}
+		else if (slot.sequence.compare_exchange_weak(sequence, WritingSequence, std::memory_order_acquire, std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.event.name = name;
+	slot.event.stage = stage;
+	slot.event.track = track;
+	slot.event.threadId = (track == Track::GPU) ? GPUTraceThreadId : getCurrentThreadId();
+	slot.event.frame = frame;
+	slot.event.startUs = startUs;
+	slot.event.durationUs = durationUs;
+	slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void RT64::Profiler::nextFrame() {
+	frameIndex.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t RT64::Profiler::getFrameIndex() const {
+	return frameIndex.load(std::memory_order_relaxed);
+}
+
+void RT64::Profiler::collect(std::vector<Event> &events) const {
+	events.clear();
+
+	uint64_t endIndex = writeIndex.load(std::memory_order_acquire);
+	uint64_t startIndex = (endIndex > capacity) ? (endIndex - capacity) : 0;
+	events.reserve((size_t)(endIndex - startIndex));
+	for (uint64_t index = startIndex; index < endIndex; index++) {
+		const Slot &slot = slots[index % capacity];
+		if (slot.sequence.load(std::memory_order_acquire) != (index + 1)) {
+			continue;
+		}
+
+		Event event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != (index + 1)) {
+			continue;
+		}
+
+		events.push_back(event);
+	}
+}
+
+void RT64::Profiler::getStageDurations(uint64_t frame, double *durationsUs, int stageCount) const {
+	assert(durationsUs != nullptr);
+	for (int s = 0; s < stageCount; s++) {
+		durationsUs[s] = 0.0;
+	}
+
+	// Events are mostly recorded in frame order, so the search can stop once it's well into older frames.
+	uint64_t endIndex = writeIndex.load(std::memory_order_acquire);
+	uint64_t startIndex = (endIndex > capacity) ? (endIndex - capacity) : 0;
+	for (uint64_t index = endIndex; index > startIndex; index--) {
+		const Slot &slot = slots[(index - 1) % capacity];
+		if (slot.sequence.load(std::memory_order_acquire) != index) {
+			continue;
+		}
+
+		Event event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != index) {
+			continue;
+		}
+
+		if ((event.frame + 1) < frame) {
+			break;
+		}
+
+		if ((event.frame == frame) && (event.stage >= 0) && (event.stage < stageCount)) {
+			durationsUs[event.stage] += event.durationUs;
+		}
+	}
+}
+
+bool RT64::Profiler::exportChromeTrace(const std::string &path) const {
+	std::vector<Event> events;
+	collect(events);
+
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	writeChromeTrace(file, events);
+	return !file.fail();
+}
+
+void RT64::Profiler::writeChromeTrace(std::ostream &stream, const std::vector<Event> &events) {
+	stream << std::fixed << std::setprecision(3);
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPUTraceThreadId << ",\"args\":{\"name\":\"GPU\"}}";
+	for (const Event &event : events) {
+		stream << ",\n{\"name\":";
+		writeEscapedString(stream, (event.name != nullptr) ? event.name : "");
+		stream << ",\"cat\":\"" << ((event.track == Track::GPU) ? "gpu" : "cpu") << "\"";
+		stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadId;
+		stream << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs;
+		stream << ",\"args\":{\"frame\":" << event.frame << "}}";
+	}
+
+	stream << "\n]}\n";
+}
+
+uint32_t RT64::Profiler::getCurrentThreadId() {
+	// Never returns the ID reserved for the GPU track.
+	uint32_t threadId = (uint32_t)(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	return (threadId != GPUTraceThreadId) ? threadId : 1;
+}
@@ -0,0 +1,94 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Records timed events from any thread into a fixed size ring without taking locks. Writers claim a slot with an
+// atomic increment and publish it with a sequence number, and readers skip any slot that was being overwritten
+// while they copied it. Old events are silently replaced once the ring wraps around, and writers only wait on each
+// other when one of them laps another in the same slot.
+//
+// The profiler has no dependencies on D3D12. GPU events are recorded by the device once their timestamps have been
+// read back and converted to the same timeline as the CPU events.
+
+namespace RT64 {
+	class Profiler {
+	public:
+		static const size_t DefaultCapacity = 16384;
+
+		enum class Track : uint32_t {
+			CPU,
+			GPU
+		};
+
+		struct Event {
+			// Must point to a string that outlives the profiler, usually a literal.
+			const char *name = nullptr;
+			int stage = -1;
+			Track track = Track::CPU;
+			uint32_t threadId = 0;
+			uint64_t frame = 0;
+			double startUs = 0.0;
+			double durationUs = 0.0;
+		};
+
+		// Records the time spent between its construction and its destruction.
+		class Scope {
+		private:
+			Profiler *profiler;
+			const char *name;
+			int stage;
+			uint64_t frame;
+			double startUs;
+		public:
+			Scope(Profiler *profiler, const char *name, int stage = -1);
+			~Scope();
+		};
+	private:
+		static const uint64_t WritingSequence = UINT64_MAX;
+
+		struct Slot {
+			std::atomic<uint64_t> sequence;
+			Event event;
+		};
+
+		std::unique_ptr<Slot[]> slots;
+		size_t capacity;
+		std::atomic<uint64_t> writeIndex;
+		std::atomic<uint64_t> frameIndex;
+		std::chrono::steady_clock::time_point epoch;
+	public:
+		Profiler(size_t capacity = DefaultCapacity);
+		virtual ~Profiler();
+
+		// Microseconds since the profiler was created.
+		double now() const;
+		void record(const char *name, int stage, Track track, uint64_t frame, double startUs, double durationUs);
+		void nextFrame();
+		uint64_t getFrameIndex() const;
+
+		// Copies the events that are currently in the ring, from oldest to newest.
+		void collect(std::vector<Event> &events) const;
+
+		// Adds up the durations of the events of a frame by their stage. Only the most recent events are searched,
+		// so it's meant to be used on the last frames.
+		void getStageDurations(uint64_t frame, double *durationsUs, int stageCount) const;
+		bool exportChromeTrace(const std::string &path) const;
+		static void writeChromeTrace(std::ostream &stream, const std::vector<Event> &events);
+		static uint32_t getCurrentThreadId();
+	};
+};
+
+#define RT64_PROFILE_CONCAT_INNER(a, b) a##b
+#define RT64_PROFILE_CONCAT(a, b) RT64_PROFILE_CONCAT_INNER(a, b)
+#define RT64_PROFILE_SCOPE(profiler, ...) RT64::Profiler::Scope RT64_PROFILE_CONCAT(profileScope, __LINE__)(profiler, __VA_ARGS__)
@@ -0,0 +1,115 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_range_allocator.h"
+
+#include <cassert>
+
+// Private
+
+void RT64::RangeAllocator::addFreeRange(uint64_t offset, uint64_t size) {
+	freeRanges[offset] = size;
+	freeRangesBySize.insert({ size, offset });
+}
+
+void RT64::RangeAllocator::removeFreeRange(std::map<uint64_t, uint64_t>::iterator it) {
+	auto range = freeRangesBySize.equal_range(it->second);
+	for (auto sizeIt = range.first; sizeIt != range.second; sizeIt++) {
+		if (sizeIt->second == it->first) {
+			freeRangesBySize.erase(sizeIt);
+			break;
+		}
+	}
+
+	freeRanges.erase(it);
+}
+
+// Public
+
+RT64::RangeAllocator::RangeAllocator(uint64_t capacity) {
+	this->capacity = capacity;
+	allocatedSize = 0;
+	if (capacity > 0) {
+		addFreeRange(0, capacity);
+	}
+}
+
+bool RT64::RangeAllocator::allocate(uint64_t size, uint64_t &offset) {
+	assert(size > 0);
+
+	auto sizeIt = freeRangesBySize.lower_bound(size);
+	if (sizeIt == freeRangesBySize.end()) {
+		return false;
+	}
+
+	// Take the allocation from the start of the range and leave the rest of it free.
+	const uint64_t rangeSize = sizeIt->first;
+	offset = sizeIt->second;
+	freeRangesBySize.erase(sizeIt);
+	freeRanges.erase(offset);
+	if (rangeSize > size) {
+		addFreeRange(offset + size, rangeSize - size);
+	}
+
+	allocations[offset] = size;
+	allocatedSize += size;
+	return true;
+}
+
+void RT64::RangeAllocator::free(uint64_t offset) {
+	auto allocationIt = allocations.find(offset);
+	assert((allocationIt != allocations.end()) && "The offset wasn't allocated.");
+
+	uint64_t size = allocationIt->second;
+	allocatedSize -= size;
+	allocations.erase(allocationIt);
+
+	// Merge with the free ranges right after and right before the freed one.
+	auto nextIt = freeRanges.find(offset + size);
+	if (nextIt != freeRanges.end()) {
+		size += nextIt->second;
+		removeFreeRange(nextIt);
+	}
+
+	auto prevIt = freeRanges.lower_bound(offset);
+	if (prevIt != freeRanges.begin()) {
+		prevIt--;
+		if ((prevIt->first + prevIt->second) == offset) {
+			offset = prevIt->first;
+			size += prevIt->second;
+			removeFreeRange(prevIt);
+		}
+	}
+
+	addFreeRange(offset, size);
+}
+
+uint64_t RT64::RangeAllocator::getCapacity() const {
+	return capacity;
+}
+
+uint64_t RT64::RangeAllocator::getAllocatedSize() const {
+	return allocatedSize;
+}
+
+uint64_t RT64::RangeAllocator::getAllocationCount() const {
+	return allocations.size();
+}
+
+uint64_t RT64::RangeAllocator::getLargestFreeRange() const {
+	return freeRangesBySize.empty() ? 0 : freeRangesBySize.rbegin()->first;
+}
+
+float RT64::RangeAllocator::getFragmentation() const {
+	const uint64_t freeSize = capacity - allocatedSize;
+	if (freeSize == 0) {
+		return 0.0f;
+	}
+
+	return 1.0f - (float)(getLargestFreeRange()) / (float)(freeSize);
+}
+
+#endif
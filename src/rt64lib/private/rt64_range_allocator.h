@@ -0,0 +1,44 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+// Suballocates ranges of elements from a fixed capacity. Free ranges are kept both by offset, so they can be merged
+// with their neighbours when a range is freed, and by size, so allocations can pick the smallest range they fit in.
+// Picking the best fit keeps the large free ranges intact for as long as possible.
+//
+// The allocator works with elements instead of bytes so every offset it returns is aligned to the element size.
+// It has no dependencies on the graphics API so its fragmentation can be measured without a GPU.
+
+namespace RT64 {
+	class RangeAllocator {
+	private:
+		uint64_t capacity;
+		uint64_t allocatedSize;
+		std::map<uint64_t, uint64_t> freeRanges;
+		std::multimap<uint64_t, uint64_t> freeRangesBySize;
+		std::unordered_map<uint64_t, uint64_t> allocations;
+
+		void addFreeRange(uint64_t offset, uint64_t size);
+		void removeFreeRange(std::map<uint64_t, uint64_t>::iterator it);
+	public:
+		RangeAllocator(uint64_t capacity);
+
+		// Returns false if there's no free range big enough for the size.
+		bool allocate(uint64_t size, uint64_t &offset);
+		void free(uint64_t offset);
+		uint64_t getCapacity() const;
+		uint64_t getAllocatedSize() const;
+		uint64_t getAllocationCount() const;
+		uint64_t getLargestFreeRange() const;
+
+		// How much of the free space can't be used by a single allocation, from 0 when all of it is in a single range
+		// to almost 1 when it's split in many small ranges.
+		float getFragmentation() const;
+	};
+};
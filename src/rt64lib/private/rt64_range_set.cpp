@@ -0,0 +1,68 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_range_set.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Public
+
+RT64::RangeSet::RangeSet(uint64_t mergeDistance) {
+	this->mergeDistance = mergeDistance;
+}
+
+void RT64::RangeSet::add(uint64_t begin, uint64_t end) {
+	assert(begin <= end);
+	if (begin == end) {
+		return;
+	}
+
+	// Find the first range that ends close enough to the new one to be merged with it.
+	auto first = std::lower_bound(ranges.begin(), ranges.end(), begin, [this](const Range &range, uint64_t value) {
+		return (range.end + mergeDistance) < value;
+	});
+
+	// Absorb all the ranges that start close enough to the end of the new one.
+	auto last = first;
+	while ((last != ranges.end()) && (last->begin <= (end + mergeDistance))) {
+		begin = std::min(begin, last->begin);
+		end = std::max(end, last->end);
+		last++;
+	}
+
+	if (first == last) {
+		ranges.insert(first, { begin, end });
+	}
+	else {
+		first->begin = begin;
+		first->end = end;
+		ranges.erase(first + 1, last);
+	}
+}
+
+void RT64::RangeSet::clear() {
+	ranges.clear();
+}
+
+bool RT64::RangeSet::empty() const {
+	return ranges.empty();
+}
+
+const std::vector<RT64::RangeSet::Range> &RT64::RangeSet::getRanges() const {
+	return ranges;
+}
+
+uint64_t RT64::RangeSet::getSize() const {
+	uint64_t size = 0;
+	for (const Range &range : ranges) {
+		size += range.end - range.begin;
+	}
+
+	return size;
+}
+
+#endif
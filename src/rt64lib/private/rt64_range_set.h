@@ -0,0 +1,37 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Keeps a sorted list of the ranges that were modified in a buffer so they can be copied with as few copies as
+// possible. Ranges that overlap or are closer than the merge distance are combined into a single one, since copying
+// the few unmodified elements between them is cheaper than recording another copy.
+//
+// The set has no dependencies on the graphics API so the merging can be verified without a GPU.
+
+namespace RT64 {
+	class RangeSet {
+	public:
+		// Elements from begin up to, but not including, end.
+		struct Range {
+			uint64_t begin;
+			uint64_t end;
+		};
+	private:
+		std::vector<Range> ranges;
+		uint64_t mergeDistance;
+	public:
+		RangeSet(uint64_t mergeDistance = 0);
+		void add(uint64_t begin, uint64_t end);
+		void clear();
+		bool empty() const;
+		const std::vector<Range> &getRanges() const;
+
+		// Total amount of elements covered by the ranges.
+		uint64_t getSize() const;
+	};
+};
@@ -0,0 +1,265 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "../public/rt64.h"
+#include "rt64_render_context.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "rt64_buffer_cache.h"
+#include "rt64_geometry_pool.h"
+#include "rt64_mesh.h"
+#include "rt64_scratch_pool.h"
+
+namespace {
+	// Sizes of the regular blocks of the geometry pools, in elements.
+	const uint64_t VertexPoolBlockCapacity = 512 * 1024;
+	const uint64_t IndexPoolBlockCapacity = 4 * 1024 * 1024;
+
+	// Blocks of the geometry pools that are used less than this are emptied into the other blocks if there's room.
+	const float GeometryPoolDefragmentUsage = 0.25f;
+
+	// Retired upload buffers are kept for reuse until they add up to this size.
+	const uint64_t UploadBufferCacheSize = 64 * 1024 * 1024;
+};
+
+// Private
+
+RT64::RenderContext::RenderContext(RenderDevice *renderDevice) {
+	assert(renderDevice != nullptr);
+	this->renderDevice = renderDevice;
+	compactedSizeBuffer = nullptr;
+	compactedSizeReadback = nullptr;
+
+	// The buffers the pools stop using are released once the GPU is done with the commands recorded until then.
+	auto retireBuffer = [this](RenderBuffer *buffer) {
+		retire(buffer);
+	};
+
+	scratchPool = new ScratchBufferPool(renderDevice, retireBuffer);
+	vertexPool = new GeometryPool(renderDevice, sizeof(RT64_VERTEX), VertexPoolBlockCapacity, retireBuffer);
+	indexPool = new GeometryPool(renderDevice, sizeof(unsigned int), IndexPoolBlockCapacity, retireBuffer);
+	uploadBufferCache = new BufferCache(renderDevice, UploadBufferCacheSize);
+	fence = renderDevice->createFence();
+	fenceValue = 1;
+}
+
+RT64::RenderContext::~RenderContext() {
+	// The retired resources might be returned to the pools, so they're released before the pools.
+	retirementQueue.flush();
+	delete uploadBufferCache;
+	delete compactedSizeBuffer;
+	delete compactedSizeReadback;
+	delete scratchPool;
+	delete vertexPool;
+	delete indexPool;
+	delete fence;
+}
+
+RT64::RenderDevice *RT64::RenderContext::getRenderDevice() {
+	return renderDevice;
+}
+
+void RT64::RenderContext::waitForGPU() {
+	// Schedule a signal command in the queue.
+	renderDevice->signal(fence, fenceValue);
+
+	// Wait until the fence has been processed.
+	fence->wait(fenceValue);
+
+	// Increment the fence value.
+	fenceValue++;
+}
+
+uint64_t RT64::RenderContext::getFenceValue() const {
+	return fenceValue;
+}
+
+uint64_t RT64::RenderContext::getCompletedFenceValue() const {
+	return fence->getCompletedValue();
+}
+
+void RT64::RenderContext::releaseFrameResources() {
+	const uint64_t completedFenceValue = getCompletedFenceValue();
+	retirementQueue.collect(completedFenceValue);
+	scratchPool->reset(completedFenceValue);
+}
+
+RT64::RenderContext::Counters *RT64::RenderContext::getCounters() {
+	return &counters;
+}
+
+RT64::GeometryPool *RT64::RenderContext::getVertexPool() {
+	return vertexPool;
+}
+
+RT64::GeometryPool *RT64::RenderContext::getIndexPool() {
+	return indexPool;
+}
+
+RT64::ScratchBufferPool *RT64::RenderContext::getScratchPool() {
+	return scratchPool;
+}
+
+void RT64::RenderContext::retire(RenderBuffer *buffer) {
+	assert(buffer != nullptr);
+	retirementQueue.retire(fenceValue, [buffer]() {
+		delete buffer;
+	});
+}
+
+void RT64::RenderContext::retire(RenderTexture *texture) {
+	assert(texture != nullptr);
+	retirementQueue.retire(fenceValue, [texture]() {
+		delete texture;
+	});
+}
+
+void RT64::RenderContext::retire(const RetirementQueue::Callback &callback) {
+	retirementQueue.retire(fenceValue, callback);
+}
+
+RT64::RenderBuffer *RT64::RenderContext::createUploadBuffer(uint64_t size) {
+	return uploadBufferCache->createUploadBuffer(size);
+}
+
+void RT64::RenderContext::retireUploadBuffer(RenderBuffer *buffer) {
+	assert(buffer != nullptr);
+	BufferCache *cache = uploadBufferCache;
+	retirementQueue.retire(fenceValue, [cache, buffer]() {
+		cache->recycle(buffer);
+	});
+}
+
+void RT64::RenderContext::queueVertexUpload(Mesh *mesh) {
+	assert(mesh != nullptr);
+	if (std::find(vertexUploadMeshes.begin(), vertexUploadMeshes.end(), mesh) == vertexUploadMeshes.end()) {
+		vertexUploadMeshes.push_back(mesh);
+	}
+}
+
+void RT64::RenderContext::cancelVertexUpload(Mesh *mesh) {
+	assert(mesh != nullptr);
+	vertexUploadMeshes.erase(std::remove(vertexUploadMeshes.begin(), vertexUploadMeshes.end(), mesh), vertexUploadMeshes.end());
+}
+
+void RT64::RenderContext::queueBottomLevelASBuild(Mesh *mesh, bool required) {
+	assert(mesh != nullptr);
+	buildScheduler.enqueue(mesh, mesh->getIndexCount() / 3, required);
+}
+
+void RT64::RenderContext::cancelBottomLevelASBuild(Mesh *mesh) {
+	assert(mesh != nullptr);
+	buildScheduler.cancel(mesh);
+}
+
+void RT64::RenderContext::setBuildBudget(unsigned int primitivesPerFrame) {
+	BuildScheduler::Settings settings = buildScheduler.getSettings();
+	settings.frameBudget = primitivesPerFrame;
+	buildScheduler.setSettings(settings);
+}
+
+size_t RT64::RenderContext::getPendingBuildCount() const {
+	return buildScheduler.getPendingCount();
+}
+
+void RT64::RenderContext::queueCompaction(Mesh *mesh) {
+	assert(mesh != nullptr);
+	if (std::find(compactionCandidates.begin(), compactionCandidates.end(), mesh) == compactionCandidates.end()) {
+		compactionCandidates.push_back(mesh);
+	}
+}
+
+void RT64::RenderContext::cancelCompaction(Mesh *mesh) {
+	assert(mesh != nullptr);
+	compactionCandidates.erase(std::remove(compactionCandidates.begin(), compactionCandidates.end(), mesh), compactionCandidates.end());
+	compactionQueries.erase(std::remove_if(compactionQueries.begin(), compactionQueries.end(), [mesh](const CompactionQuery &query) {
+		return query.mesh == mesh;
+	}), compactionQueries.end());
+}
+
+void RT64::RenderContext::uploadMeshVertices() {
+	for (Mesh *mesh : vertexUploadMeshes) {
+		mesh->uploadDirtyVertices();
+	}
+
+	vertexUploadMeshes.clear();
+}
+
+void RT64::RenderContext::prepareGeometryPools() {
+	// Moving the geometry around doesn't invalidate the bottom-level ASes, as they don't reference the vertices after they're built.
+	RenderCommandList *commandList = renderDevice->getCommandList();
+	vertexPool->defragment(commandList, GeometryPoolDefragmentUsage);
+	indexPool->defragment(commandList, GeometryPoolDefragmentUsage);
+	vertexPool->barrier(commandList, RenderBufferAccess::Read);
+	indexPool->barrier(commandList, RenderBufferAccess::Read);
+}
+
+void RT64::RenderContext::buildBottomLevelASes() {
+	// All the uploads were recorded when the meshes were updated, so the builds can run back to back without any
+	// barriers between them. They use separate ranges of the scratch pool and the caller waits for all of them at once.
+	buildScheduler.schedule(scheduledBuilds);
+	for (const BuildScheduler::Build &build : scheduledBuilds) {
+		Mesh *mesh = (Mesh *)(build.key);
+		mesh->buildBottomLevelAS();
+	}
+
+	scheduledBuilds.clear();
+}
+
+void RT64::RenderContext::queryCompactedSizes() {
+	if (compactionCandidates.empty()) {
+		return;
+	}
+
+	RenderCommandList *commandList = renderDevice->getCommandList();
+	if (compactedSizeBuffer == nullptr) {
+		const uint64_t bufferSize = MaxCompactionQueries * sizeof(uint64_t);
+		compactedSizeBuffer = renderDevice->createBuffer(RenderBufferDesc::DefaultBuffer(bufferSize, RenderBufferFlagUnorderedAccess));
+		compactedSizeReadback = renderDevice->createBuffer(RenderBufferDesc::ReadbackBuffer(bufferSize));
+	}
+
+	// The sizes are only valid once the builds are done.
+	commandList->accelerationStructureBarrier(nullptr);
+	commandList->barrier(compactedSizeBuffer, RenderBufferAccess::UnorderedAccess);
+
+	// Any candidates over the limit are left for the next frame.
+	const size_t queryCount = std::min(compactionCandidates.size(), (size_t)(MaxCompactionQueries));
+	for (size_t i = 0; i < queryCount; i++) {
+		Mesh *mesh = compactionCandidates[i];
+		RenderBuffer *result = mesh->getBottomLevelASResult();
+		if (result != nullptr) {
+			commandList->queryCompactedSize(result, compactedSizeBuffer, compactionQueries.size() * sizeof(uint64_t));
+			compactionQueries.push_back({ mesh, mesh->getBottomLevelASVersion() });
+		}
+	}
+
+	compactionCandidates.erase(compactionCandidates.begin(), compactionCandidates.begin() + queryCount);
+
+	commandList->barrier(compactedSizeBuffer, RenderBufferAccess::CopySource);
+	commandList->copyBufferRegion(compactedSizeReadback, 0, compactedSizeBuffer, 0, compactionQueries.size() * sizeof(uint64_t));
+}
+
+void RT64::RenderContext::compactBottomLevelASes() {
+	if (compactionQueries.empty()) {
+		return;
+	}
+
+	// The frame that queried the sizes has already been waited on.
+	const uint64_t *compactedSizes = (const uint64_t *)(compactedSizeReadback->map());
+	for (size_t i = 0; i < compactionQueries.size(); i++) {
+		const CompactionQuery &query = compactionQueries[i];
+		if ((compactedSizes[i] > 0) && (query.mesh->getBottomLevelASVersion() == query.bottomLevelASVersion)) {
+			query.mesh->compactBottomLevelAS(compactedSizes[i]);
+		}
+	}
+
+	compactedSizeReadback->unmap();
+	compactionQueries.clear();
+}
+
+#endif
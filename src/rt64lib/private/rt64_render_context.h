@@ -0,0 +1,134 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rt64_build_scheduler.h"
+#include "rt64_render_interface.h"
+#include "rt64_retirement_queue.h"
+
+// Everything the meshes and the scenes need to manage their GPU resources through the render interface: the fence that
+// tracks the recorded commands, the retirement of the resources they stop using, the geometry and scratch pools, the
+// upload buffer cache, and the vertex uploads, bottom-level AS builds and compactions queued by the meshes.
+//
+// The device owns the context and drives it once per frame. Nothing in it depends on the graphics API, so the scene
+// logic that uses it can be driven by a mock render device without a GPU.
+
+namespace RT64 {
+	class BufferCache;
+	class GeometryPool;
+	class Mesh;
+	class ScratchBufferPool;
+
+	class RenderContext {
+	public:
+		// Maintained by the hot paths with plain increments. The per-frame counters are reset once the frame is presented.
+		struct Counters {
+			unsigned int rtInstances = 0;
+			unsigned int rasterBgInstances = 0;
+			unsigned int rasterFgInstances = 0;
+			uint64_t tlasBytes = 0;
+			unsigned int descriptorsUsed = 0;
+			unsigned int blasBuilds = 0;
+			unsigned int blasUpdates = 0;
+			unsigned int tlasBuilds = 0;
+			unsigned int tlasRefits = 0;
+			uint64_t bytesUploaded = 0;
+			unsigned int meshCount = 0;
+			unsigned int textureCount = 0;
+			uint64_t blasBytes = 0;
+			uint64_t blasUncompactedBytes = 0;
+
+			void resetFrame() {
+				rtInstances = rasterBgInstances = rasterFgInstances = 0;
+				tlasBytes = 0;
+				descriptorsUsed = 0;
+				blasBuilds = blasUpdates = 0;
+				tlasBuilds = tlasRefits = 0;
+				bytesUploaded = 0;
+			}
+		};
+	private:
+		// The compacted sizes of the bottom-level ASes are queried at the end of a frame and the meshes are compacted at
+		// the start of the next one, once the sizes have been read back. The version is used to discard the sizes of the
+		// ASes that were rebuilt in the meantime.
+		static const uint32_t MaxCompactionQueries = 256;
+
+		struct CompactionQuery {
+			Mesh *mesh;
+			uint32_t bottomLevelASVersion;
+		};
+
+		RenderDevice *renderDevice;
+		RenderFence *fence;
+		uint64_t fenceValue;
+		RetirementQueue retirementQueue;
+		BufferCache *uploadBufferCache;
+		GeometryPool *vertexPool;
+		GeometryPool *indexPool;
+		ScratchBufferPool *scratchPool;
+		std::vector<Mesh *> vertexUploadMeshes;
+		BuildScheduler buildScheduler;
+		std::vector<BuildScheduler::Build> scheduledBuilds;
+		std::vector<Mesh *> compactionCandidates;
+		std::vector<CompactionQuery> compactionQueries;
+		RenderBuffer *compactedSizeBuffer;
+		RenderBuffer *compactedSizeReadback;
+		Counters counters;
+	public:
+		RenderContext(RenderDevice *renderDevice);
+		virtual ~RenderContext();
+		RenderDevice *getRenderDevice();
+
+		// Signals the fence once the GPU is done with all the work submitted so far and waits for it.
+		void waitForGPU();
+
+		// Value the fence will be signaled with once the commands recorded so far are done.
+		uint64_t getFenceValue() const;
+		uint64_t getCompletedFenceValue() const;
+
+		// Releases the resources the GPU is done with and rewinds the scratch pool if it can be reused.
+		void releaseFrameResources();
+		Counters *getCounters();
+		GeometryPool *getVertexPool();
+		GeometryPool *getIndexPool();
+		ScratchBufferPool *getScratchPool();
+
+		// Resources are released once the GPU is done with the commands that have been recorded so far.
+		void retire(RenderBuffer *buffer);
+		void retire(RenderTexture *texture);
+		void retire(const RetirementQueue::Callback &callback);
+
+		// Upload buffers are recycled by a cache once they're retired, so the next uploads of the same size can reuse them.
+		RenderBuffer *createUploadBuffer(uint64_t size);
+		void retireUploadBuffer(RenderBuffer *buffer);
+		void queueVertexUpload(Mesh *mesh);
+		void cancelVertexUpload(Mesh *mesh);
+		void queueBottomLevelASBuild(Mesh *mesh, bool required);
+		void cancelBottomLevelASBuild(Mesh *mesh);
+		void setBuildBudget(unsigned int primitivesPerFrame);
+		size_t getPendingBuildCount() const;
+		void queueCompaction(Mesh *mesh);
+		void cancelCompaction(Mesh *mesh);
+
+		// Records the copies of the vertex ranges the meshes updated since the last frame.
+		void uploadMeshVertices();
+
+		// Defragments the geometry pools and transitions them so the builds and the draws can read them.
+		void prepareGeometryPools();
+
+		// Records the builds picked by the scheduler for this frame. The caller must wait for them before they're used.
+		void buildBottomLevelASes();
+
+		// Records the queries of the compacted sizes of the ASes built so far. Must be the last thing recorded before
+		// the commands are submitted, so the sizes can be read back once the GPU is done.
+		void queryCompactedSizes();
+
+		// Compacts the ASes whose sizes were queried by the last frame. The GPU must be done with that frame.
+		void compactBottomLevelASes();
+	};
+};
@@ -0,0 +1,270 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Thin interface over the graphics API for everything the scene needs to manage its GPU resources: buffers, textures,
+// acceleration structures, descriptor sets, fences and the commands that fill them. The D3D12 device is one
+// implementation of it, and the scene logic written against it can be driven by a mock device without a GPU.
+//
+// Objects created by the device are owned by the caller and released with delete before the device is destroyed.
+// Resources keep track of the access they were last transitioned to, so barriers only need to specify the new one.
+
+namespace RT64 {
+	enum class RenderHeapType {
+		Default,
+		Upload,
+		Readback
+	};
+
+	enum class RenderFormat {
+		Unknown,
+		R8G8B8A8_UNORM,
+		R16_UINT,
+		R32_UINT,
+		R32G32_FLOAT,
+		R32G32_UINT,
+		R32G32B32_FLOAT,
+		R32G32B32A32_FLOAT,
+		R32G32B32A32_UINT
+	};
+
+	enum RenderBufferFlags {
+		RenderBufferFlagNone = 0x0,
+		RenderBufferFlagUnorderedAccess = 0x1,
+		RenderBufferFlagAccelerationStructure = 0x2
+	};
+
+	enum RenderTextureFlags {
+		RenderTextureFlagNone = 0x0,
+		RenderTextureFlagUnorderedAccess = 0x1,
+		RenderTextureFlagRenderTarget = 0x2
+	};
+
+	enum class RenderBufferAccess {
+		Common,
+		Read,
+		CopySource,
+		CopyDest,
+		UnorderedAccess,
+		AccelerationStructure
+	};
+
+	enum class RenderTextureAccess {
+		Common,
+		ShaderRead,
+		CopySource,
+		CopyDest,
+		UnorderedAccess,
+		RenderTarget
+	};
+
+	struct RenderBufferDesc {
+		uint64_t size = 0;
+		RenderHeapType heapType = RenderHeapType::Default;
+		uint32_t flags = RenderBufferFlagNone;
+
+		static RenderBufferDesc DefaultBuffer(uint64_t size, uint32_t flags = RenderBufferFlagNone) {
+			return { size, RenderHeapType::Default, flags };
+		}
+
+		static RenderBufferDesc UploadBuffer(uint64_t size) {
+			return { size, RenderHeapType::Upload, RenderBufferFlagNone };
+		}
+
+		static RenderBufferDesc ReadbackBuffer(uint64_t size) {
+			return { size, RenderHeapType::Readback, RenderBufferFlagNone };
+		}
+
+		static RenderBufferDesc AccelerationStructureBuffer(uint64_t size) {
+			return { size, RenderHeapType::Default, RenderBufferFlagUnorderedAccess | RenderBufferFlagAccelerationStructure };
+		}
+
+		static RenderBufferDesc ScratchBuffer(uint64_t size) {
+			return { size, RenderHeapType::Default, RenderBufferFlagUnorderedAccess };
+		}
+	};
+
+	struct RenderTextureDesc {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		RenderFormat format = RenderFormat::Unknown;
+		uint32_t flags = RenderTextureFlagNone;
+
+		static RenderTextureDesc Texture2D(uint32_t width, uint32_t height, RenderFormat format, uint32_t flags = RenderTextureFlagNone) {
+			return { width, height, format, flags };
+		}
+	};
+
+	struct RenderRect {
+		int32_t left = 0;
+		int32_t top = 0;
+		int32_t right = 0;
+		int32_t bottom = 0;
+
+		bool isEmpty() const {
+			return (right <= left) || (bottom <= top);
+		}
+	};
+
+	struct RenderViewport {
+		float x = 0.0f;
+		float y = 0.0f;
+		float width = 0.0f;
+		float height = 0.0f;
+		float minDepth = 0.0f;
+		float maxDepth = 1.0f;
+
+		bool isEmpty() const {
+			return (width <= 0.0f) || (height <= 0.0f);
+		}
+	};
+
+	class RenderBuffer {
+	public:
+		virtual ~RenderBuffer() { }
+
+		// Only buffers on the upload and readback heaps can be mapped.
+		virtual void *map() = 0;
+		virtual void unmap() = 0;
+		virtual const RenderBufferDesc &getDesc() const = 0;
+		virtual uint64_t getDeviceAddress() const = 0;
+	};
+
+	class RenderTexture {
+	public:
+		virtual ~RenderTexture() { }
+		virtual const RenderTextureDesc &getDesc() const = 0;
+	};
+
+	struct RenderBottomLevelASMesh {
+		RenderBuffer *vertexBuffer = nullptr;
+		uint64_t vertexOffset = 0;
+		uint32_t vertexCount = 0;
+		uint32_t vertexStride = 0;
+
+		// Positions are always read as three floats at the start of every vertex. The offsets are in bytes.
+		RenderBuffer *indexBuffer = nullptr;
+		uint64_t indexOffset = 0;
+		uint32_t indexCount = 0;
+		bool opaque = true;
+	};
+
+	struct RenderBottomLevelASDesc {
+		std::vector<RenderBottomLevelASMesh> meshes;
+		bool updatable = false;
+
+		// Allows querying the compacted size after it's built so it can be copied into a smaller buffer.
+		bool compactable = false;
+	};
+
+	// Same layout as the instance descriptions consumed by both D3D12 and Vulkan.
+	struct RenderTopLevelASInstance {
+		float transform[3][4];
+		uint32_t instanceId : 24;
+		uint32_t instanceMask : 8;
+		uint32_t hitGroupIndex : 24;
+		uint32_t flags : 8;
+		uint64_t bottomLevelASAddress;
+	};
+
+	static_assert(sizeof(RenderTopLevelASInstance) == 64, "The instance must match the layout expected by the graphics APIs.");
+
+	enum RenderTopLevelASInstanceFlags {
+		RenderTopLevelASInstanceFlagNone = 0x0,
+		RenderTopLevelASInstanceFlagCullDisable = 0x1
+	};
+
+	struct RenderTopLevelASDesc {
+		// Upload buffer with an array of RenderTopLevelASInstance. Only needed when building.
+		RenderBuffer *instanceBuffer = nullptr;
+		uint32_t instanceCount = 0;
+		bool updatable = false;
+	};
+
+	// Alignment required for the offsets into scratch buffers. The sizes returned by the devices are multiples of it.
+	const uint64_t RenderAccelerationStructureScratchAlignment = 256;
+
+	struct RenderAccelerationStructureSizes {
+		uint64_t scratchSize = 0;
+		uint64_t resultSize = 0;
+		uint64_t updateScratchSize = 0;
+	};
+
+	class RenderDescriptorSet {
+	public:
+		virtual ~RenderDescriptorSet() { }
+		virtual void setConstantBuffer(uint32_t index, RenderBuffer *buffer, uint64_t size) = 0;
+
+		// The buffer can be null if there are no elements, which leaves an empty view in the entry.
+		virtual void setStructuredBuffer(uint32_t index, RenderBuffer *buffer, uint32_t elementCount, uint32_t elementStride) = 0;
+		virtual void setReadWriteBuffer(uint32_t index, RenderBuffer *buffer, RenderFormat format, uint32_t elementCount) = 0;
+		virtual void setTexture(uint32_t index, RenderTexture *texture) = 0;
+		virtual void setReadWriteTexture(uint32_t index, RenderTexture *texture) = 0;
+		virtual void setAccelerationStructure(uint32_t index, RenderBuffer *buffer) = 0;
+		virtual uint32_t getEntryCount() const = 0;
+	};
+
+	class RenderFence {
+	public:
+		virtual ~RenderFence() { }
+		virtual uint64_t getCompletedValue() const = 0;
+
+		// Blocks the calling thread until the fence reaches the value.
+		virtual void wait(uint64_t value) = 0;
+	};
+
+	class RenderCommandList {
+	public:
+		virtual ~RenderCommandList() { }
+
+		// Transitions the resource from the access it was last used with. Does nothing if it's the same one.
+		virtual void barrier(RenderBuffer *buffer, RenderBufferAccess access) = 0;
+		virtual void barrier(RenderTexture *texture, RenderTextureAccess access) = 0;
+
+		// Waits for any builds writing to the acceleration structure before it's read or built on top of. Waits for
+		// the builds of all acceleration structures if the buffer is null.
+		virtual void accelerationStructureBarrier(RenderBuffer *buffer) = 0;
+		virtual void copyBuffer(RenderBuffer *dst, RenderBuffer *src) = 0;
+		virtual void copyBufferRegion(RenderBuffer *dst, uint64_t dstOffset, RenderBuffer *src, uint64_t srcOffset, uint64_t size) = 0;
+
+		// The rows in the source buffer must be aligned to the device's texture row alignment.
+		virtual void copyBufferToTexture(RenderTexture *dst, RenderBuffer *src, uint64_t srcOffset, uint32_t rowPitch) = 0;
+
+		// Updates the acceleration structure in place instead of building it from scratch if a source is provided.
+		// The scratch offset must be aligned to RenderAccelerationStructureScratchAlignment.
+		virtual void buildBottomLevelAS(const RenderBottomLevelASDesc &desc, RenderBuffer *scratch, uint64_t scratchOffset, RenderBuffer *result, RenderBuffer *updateSource) = 0;
+		virtual void buildTopLevelAS(const RenderTopLevelASDesc &desc, RenderBuffer *scratch, RenderBuffer *result, RenderBuffer *updateSource) = 0;
+
+		// Writes the compacted size of a compactable acceleration structure as a 64-bit integer. The build must be
+		// finished with a barrier first. The destination must be a buffer on the default heap with unordered access.
+		virtual void queryCompactedSize(RenderBuffer *accelerationStructure, RenderBuffer *dst, uint64_t dstOffset) = 0;
+
+		// Copies the acceleration structure into a buffer that is only as big as its compacted size.
+		virtual void compactAccelerationStructure(RenderBuffer *dst, RenderBuffer *src) = 0;
+	};
+
+	class RenderDevice {
+	public:
+		virtual ~RenderDevice() { }
+		virtual RenderBuffer *createBuffer(const RenderBufferDesc &desc) = 0;
+		virtual RenderTexture *createTexture(const RenderTextureDesc &desc) = 0;
+		virtual RenderDescriptorSet *createDescriptorSet(uint32_t entryCount) = 0;
+		virtual RenderFence *createFence() = 0;
+
+		// The command list is owned by the device and is only valid to record on while it's open.
+		virtual RenderCommandList *getCommandList() = 0;
+
+		// Signals the fence with the value once the GPU is done with all the work submitted so far.
+		virtual void signal(RenderFence *fence, uint64_t value) = 0;
+		virtual RenderAccelerationStructureSizes getBottomLevelASSizes(const RenderBottomLevelASDesc &desc) = 0;
+		virtual RenderAccelerationStructureSizes getTopLevelASSizes(const RenderTopLevelASDesc &desc) = 0;
+		virtual uint32_t getTextureRowAlignment() const = 0;
+		virtual uint32_t getConstantBufferAlignment() const = 0;
+	};
+};
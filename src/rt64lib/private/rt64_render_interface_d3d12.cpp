@@ -0,0 +1,558 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_render_interface_d3d12.h"
+
+namespace {
+	DXGI_FORMAT toDXGI(RT64::RenderFormat format) {
+		switch (format) {
+		case RT64::RenderFormat::R8G8B8A8_UNORM:
+			return DXGI_FORMAT_R8G8B8A8_UNORM;
+		case RT64::RenderFormat::R16_UINT:
+			return DXGI_FORMAT_R16_UINT;
+		case RT64::RenderFormat::R32_UINT:
+			return DXGI_FORMAT_R32_UINT;
+		case RT64::RenderFormat::R32G32_FLOAT:
+			return DXGI_FORMAT_R32G32_FLOAT;
+		case RT64::RenderFormat::R32G32_UINT:
+			return DXGI_FORMAT_R32G32_UINT;
+		case RT64::RenderFormat::R32G32B32_FLOAT:
+			return DXGI_FORMAT_R32G32B32_FLOAT;
+		case RT64::RenderFormat::R32G32B32A32_FLOAT:
+			return DXGI_FORMAT_R32G32B32A32_FLOAT;
+		case RT64::RenderFormat::R32G32B32A32_UINT:
+			return DXGI_FORMAT_R32G32B32A32_UINT;
+		default:
+			return DXGI_FORMAT_UNKNOWN;
+		}
+	}
+
+	D3D12_RESOURCE_STATES toD3D12(RT64::RenderBufferAccess access) {
+		switch (access) {
+		case RT64::RenderBufferAccess::Read:
+			return D3D12_RESOURCE_STATE_GENERIC_READ;
+		case RT64::RenderBufferAccess::CopySource:
+			return D3D12_RESOURCE_STATE_COPY_SOURCE;
+		case RT64::RenderBufferAccess::CopyDest:
+			return D3D12_RESOURCE_STATE_COPY_DEST;
+		case RT64::RenderBufferAccess::UnorderedAccess:
+			return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		case RT64::RenderBufferAccess::AccelerationStructure:
+			return D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
+		default:
+			return D3D12_RESOURCE_STATE_COMMON;
+		}
+	}
+
+	D3D12_RESOURCE_STATES toD3D12(RT64::RenderTextureAccess access) {
+		switch (access) {
+		case RT64::RenderTextureAccess::ShaderRead:
+			return D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		case RT64::RenderTextureAccess::CopySource:
+			return D3D12_RESOURCE_STATE_COPY_SOURCE;
+		case RT64::RenderTextureAccess::CopyDest:
+			return D3D12_RESOURCE_STATE_COPY_DEST;
+		case RT64::RenderTextureAccess::UnorderedAccess:
+			return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		case RT64::RenderTextureAccess::RenderTarget:
+			return D3D12_RESOURCE_STATE_RENDER_TARGET;
+		default:
+			return D3D12_RESOURCE_STATE_COMMON;
+		}
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS getAddress(RT64::RenderBuffer *buffer) {
+		return (buffer != nullptr) ? buffer->getDeviceAddress() : 0;
+	}
+
+	ID3D12Resource *getResource(RT64::RenderBuffer *buffer) {
+		return (buffer != nullptr) ? static_cast<RT64::D3D12RenderBuffer *>(buffer)->getD3D12Resource() : nullptr;
+	}
+
+	ID3D12Resource *getResource(RT64::RenderTexture *texture) {
+		return static_cast<RT64::D3D12RenderTexture *>(texture)->getD3D12Resource();
+	}
+
+	void fillGeometryDescs(const RT64::RenderBottomLevelASDesc &desc, std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> &geometryDescs) {
+		geometryDescs.resize(desc.meshes.size());
+		for (size_t i = 0; i < desc.meshes.size(); i++) {
+			const RT64::RenderBottomLevelASMesh &mesh = desc.meshes[i];
+			const bool indexed = (mesh.indexBuffer != nullptr) && (mesh.indexCount > 0);
+			D3D12_RAYTRACING_GEOMETRY_DESC &geometryDesc = geometryDescs[i];
+			geometryDesc = {};
+			geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+			geometryDesc.Triangles.VertexBuffer.StartAddress = getAddress(mesh.vertexBuffer) + mesh.vertexOffset;
+			geometryDesc.Triangles.VertexBuffer.StrideInBytes = mesh.vertexStride;
+			geometryDesc.Triangles.VertexCount = mesh.vertexCount;
+			geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+			geometryDesc.Triangles.IndexBuffer = indexed ? (getAddress(mesh.indexBuffer) + mesh.indexOffset) : 0;
+			geometryDesc.Triangles.IndexFormat = indexed ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_UNKNOWN;
+			geometryDesc.Triangles.IndexCount = indexed ? mesh.indexCount : 0;
+			geometryDesc.Flags = mesh.opaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+			geometryDesc.Flags |= D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION;
+		}
+	}
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS toBuildFlags(bool updatable, bool compactable, bool update) {
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+		if (updatable) {
+			flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+		}
+
+		if (compactable) {
+			flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+		}
+
+		if (update) {
+			flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+		}
+
+		return flags;
+	}
+
+	RT64::RenderAccelerationStructureSizes toSizes(const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO &info) {
+		RT64::RenderAccelerationStructureSizes sizes;
+		sizes.scratchSize = ROUND_UP(info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		sizes.resultSize = ROUND_UP(info.ResultDataMaxSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		sizes.updateScratchSize = ROUND_UP(info.UpdateScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		return sizes;
+	}
+};
+
+// D3D12RenderBuffer
+
+RT64::D3D12RenderBuffer::D3D12RenderBuffer(D3D12MA::Allocator *d3dAllocator, const RenderBufferDesc &desc) {
+	assert(d3dAllocator != nullptr);
+	assert(desc.size > 0);
+	this->desc = desc;
+
+	D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE;
+	if (desc.flags & RenderBufferFlagUnorderedAccess) {
+		resourceFlags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+	}
+
+	// Buffers on the upload and readback heaps can't leave their initial state, while acceleration
+	// structures must be created in the only state they can ever be in.
+	D3D12MA::ALLOCATION_DESC allocationDesc = {};
+	switch (desc.heapType) {
+	case RenderHeapType::Upload:
+		allocationDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+		access = RenderBufferAccess::Read;
+		break;
+	case RenderHeapType::Readback:
+		allocationDesc.HeapType = D3D12_HEAP_TYPE_READBACK;
+		access = RenderBufferAccess::CopyDest;
+		break;
+	default:
+		allocationDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+		access = (desc.flags & RenderBufferFlagAccelerationStructure) ? RenderBufferAccess::AccelerationStructure : RenderBufferAccess::Common;
+		break;
+	}
+
+	CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(desc.size, resourceFlags);
+	D3D12MA::Allocation *allocation = nullptr;
+	ID3D12Resource *d3dResource = nullptr;
+	D3D12_CHECK(d3dAllocator->CreateResource(&allocationDesc, &bufferDesc, toD3D12(access), nullptr, &allocation, IID_PPV_ARGS(&d3dResource)));
+	resource = AllocatedResource(allocation);
+}
+
+RT64::D3D12RenderBuffer::~D3D12RenderBuffer() {
+	resource.Release();
+}
+
+void *RT64::D3D12RenderBuffer::map() {
+	assert(desc.heapType != RenderHeapType::Default);
+
+	// Nothing is read back from upload buffers.
+	void *data = nullptr;
+	CD3DX12_RANGE readRange(0, 0);
+	D3D12_CHECK(resource.Get()->Map(0, (desc.heapType == RenderHeapType::Upload) ? &readRange : nullptr, &data));
+	return data;
+}
+
+void RT64::D3D12RenderBuffer::unmap() {
+	CD3DX12_RANGE writtenRange(0, 0);
+	resource.Get()->Unmap(0, (desc.heapType == RenderHeapType::Readback) ? &writtenRange : nullptr);
+}
+
+const RT64::RenderBufferDesc &RT64::D3D12RenderBuffer::getDesc() const {
+	return desc;
+}
+
+uint64_t RT64::D3D12RenderBuffer::getDeviceAddress() const {
+	return resource.Get()->GetGPUVirtualAddress();
+}
+
+ID3D12Resource *RT64::D3D12RenderBuffer::getD3D12Resource() const {
+	return resource.Get();
+}
+
+D3D12_RESOURCE_STATES RT64::D3D12RenderBuffer::getD3D12State() const {
+	return toD3D12(access);
+}
+
+// D3D12RenderTexture
+
+RT64::D3D12RenderTexture::D3D12RenderTexture(D3D12MA::Allocator *d3dAllocator, const RenderTextureDesc &desc) {
+	assert(d3dAllocator != nullptr);
+	this->desc = desc;
+	access = RenderTextureAccess::Common;
+
+	D3D12_RESOURCE_FLAGS resourceFlags = D3D12_RESOURCE_FLAG_NONE;
+	if (desc.flags & RenderTextureFlagUnorderedAccess) {
+		resourceFlags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+	}
+
+	if (desc.flags & RenderTextureFlagRenderTarget) {
+		resourceFlags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	}
+
+	D3D12MA::ALLOCATION_DESC allocationDesc = {};
+	allocationDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+
+	CD3DX12_RESOURCE_DESC textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(toDXGI(desc.format), desc.width, desc.height, 1, 1, 1, 0, resourceFlags);
+	D3D12MA::Allocation *allocation = nullptr;
+	ID3D12Resource *d3dResource = nullptr;
+	D3D12_CHECK(d3dAllocator->CreateResource(&allocationDesc, &textureDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, &allocation, IID_PPV_ARGS(&d3dResource)));
+	resource = AllocatedResource(allocation);
+}
+
+RT64::D3D12RenderTexture::~D3D12RenderTexture() {
+	resource.Release();
+}
+
+const RT64::RenderTextureDesc &RT64::D3D12RenderTexture::getDesc() const {
+	return desc;
+}
+
+ID3D12Resource *RT64::D3D12RenderTexture::getD3D12Resource() const {
+	return resource.Get();
+}
+
+D3D12_RESOURCE_STATES RT64::D3D12RenderTexture::getD3D12State() const {
+	return toD3D12(access);
+}
+
+// D3D12RenderDescriptorSet
+
+RT64::D3D12RenderDescriptorSet::D3D12RenderDescriptorSet(ID3D12Device8 *d3dDevice, uint32_t entryCount) {
+	assert(d3dDevice != nullptr);
+	assert(entryCount > 0);
+	this->d3dDevice = d3dDevice;
+	this->entryCount = entryCount;
+
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = entryCount;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	D3D12_CHECK(d3dDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&d3dHeap)));
+	d3dHandleIncrement = d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+RT64::D3D12RenderDescriptorSet::~D3D12RenderDescriptorSet() {
+	d3dHeap->Release();
+}
+
+void RT64::D3D12RenderDescriptorSet::setConstantBuffer(uint32_t index, RenderBuffer *buffer, uint64_t size) {
+	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+	cbvDesc.BufferLocation = buffer->getDeviceAddress();
+	cbvDesc.SizeInBytes = (UINT)(ROUND_UP(size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+	d3dDevice->CreateConstantBufferView(&cbvDesc, getD3D12CPUHandle(index));
+}
+
+void RT64::D3D12RenderDescriptorSet::setStructuredBuffer(uint32_t index, RenderBuffer *buffer, uint32_t elementCount, uint32_t elementStride) {
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = elementCount;
+	srvDesc.Buffer.StructureByteStride = elementStride;
+	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	d3dDevice->CreateShaderResourceView(getResource(buffer), &srvDesc, getD3D12CPUHandle(index));
+}
+
+void RT64::D3D12RenderDescriptorSet::setReadWriteBuffer(uint32_t index, RenderBuffer *buffer, RenderFormat format, uint32_t elementCount) {
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Format = toDXGI(format);
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = elementCount;
+	d3dDevice->CreateUnorderedAccessView(getResource(buffer), nullptr, &uavDesc, getD3D12CPUHandle(index));
+}
+
+void RT64::D3D12RenderDescriptorSet::setTexture(uint32_t index, RenderTexture *texture) {
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = toDXGI(texture->getDesc().format);
+	d3dDevice->CreateShaderResourceView(getResource(texture), &srvDesc, getD3D12CPUHandle(index));
+}
+
+void RT64::D3D12RenderDescriptorSet::setReadWriteTexture(uint32_t index, RenderTexture *texture) {
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	uavDesc.Format = toDXGI(texture->getDesc().format);
+	d3dDevice->CreateUnorderedAccessView(getResource(texture), nullptr, &uavDesc, getD3D12CPUHandle(index));
+}
+
+void RT64::D3D12RenderDescriptorSet::setAccelerationStructure(uint32_t index, RenderBuffer *buffer) {
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.RaytracingAccelerationStructure.Location = buffer->getDeviceAddress();
+	d3dDevice->CreateShaderResourceView(nullptr, &srvDesc, getD3D12CPUHandle(index));
+}
+
+uint32_t RT64::D3D12RenderDescriptorSet::getEntryCount() const {
+	return entryCount;
+}
+
+ID3D12DescriptorHeap *RT64::D3D12RenderDescriptorSet::getD3D12Heap() const {
+	return d3dHeap;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE RT64::D3D12RenderDescriptorSet::getD3D12CPUHandle(uint32_t index) const {
+	assert(index < entryCount);
+	D3D12_CPU_DESCRIPTOR_HANDLE handle = d3dHeap->GetCPUDescriptorHandleForHeapStart();
+	handle.ptr += (SIZE_T)(index) * d3dHandleIncrement;
+	return handle;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE RT64::D3D12RenderDescriptorSet::getD3D12GPUHandle(uint32_t index) const {
+	assert(index < entryCount);
+	D3D12_GPU_DESCRIPTOR_HANDLE handle = d3dHeap->GetGPUDescriptorHandleForHeapStart();
+	handle.ptr += (UINT64)(index) * d3dHandleIncrement;
+	return handle;
+}
+
+// D3D12RenderFence
+
+RT64::D3D12RenderFence::D3D12RenderFence(ID3D12Device8 *d3dDevice) {
+	assert(d3dDevice != nullptr);
+	D3D12_CHECK(d3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&d3dFence)));
+
+	d3dFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (d3dFenceEvent == nullptr) {
+		D3D12_CHECK(HRESULT_FROM_WIN32(GetLastError()));
+	}
+}
+
+RT64::D3D12RenderFence::~D3D12RenderFence() {
+	CloseHandle(d3dFenceEvent);
+	d3dFence->Release();
+}
+
+uint64_t RT64::D3D12RenderFence::getCompletedValue() const {
+	return d3dFence->GetCompletedValue();
+}
+
+void RT64::D3D12RenderFence::wait(uint64_t value) {
+	if (d3dFence->GetCompletedValue() < value) {
+		D3D12_CHECK(d3dFence->SetEventOnCompletion(value, d3dFenceEvent));
+		WaitForSingleObjectEx(d3dFenceEvent, INFINITE, FALSE);
+	}
+}
+
+ID3D12Fence *RT64::D3D12RenderFence::getD3D12Fence() const {
+	return d3dFence;
+}
+
+// D3D12RenderCommandList
+
+RT64::D3D12RenderCommandList::D3D12RenderCommandList(ID3D12GraphicsCommandList4 *d3dCommandList) {
+	this->d3dCommandList = d3dCommandList;
+}
+
+void RT64::D3D12RenderCommandList::barrier(RenderBuffer *buffer, RenderBufferAccess access) {
+	D3D12RenderBuffer *d3d12Buffer = static_cast<D3D12RenderBuffer *>(buffer);
+
+	// Buffers outside of the default heap and acceleration structures never change their state.
+	if ((d3d12Buffer->getDesc().heapType != RenderHeapType::Default) || (d3d12Buffer->access == RenderBufferAccess::AccelerationStructure)) {
+		assert((d3d12Buffer->access == access) && "The buffer can't be transitioned.");
+		return;
+	}
+
+	if (d3d12Buffer->access == access) {
+		return;
+	}
+
+	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(d3d12Buffer->getD3D12Resource(), d3d12Buffer->getD3D12State(), toD3D12(access));
+	d3dCommandList->ResourceBarrier(1, &transition);
+	d3d12Buffer->access = access;
+}
+
+void RT64::D3D12RenderCommandList::barrier(RenderTexture *texture, RenderTextureAccess access) {
+	D3D12RenderTexture *d3d12Texture = static_cast<D3D12RenderTexture *>(texture);
+	if (d3d12Texture->access == access) {
+		return;
+	}
+
+	CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(d3d12Texture->getD3D12Resource(), d3d12Texture->getD3D12State(), toD3D12(access));
+	d3dCommandList->ResourceBarrier(1, &transition);
+	d3d12Texture->access = access;
+}
+
+void RT64::D3D12RenderCommandList::accelerationStructureBarrier(RenderBuffer *buffer) {
+	CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV((buffer != nullptr) ? getResource(buffer) : nullptr);
+	d3dCommandList->ResourceBarrier(1, &barrier);
+}
+
+void RT64::D3D12RenderCommandList::copyBuffer(RenderBuffer *dst, RenderBuffer *src) {
+	d3dCommandList->CopyResource(getResource(dst), getResource(src));
+}
+
+void RT64::D3D12RenderCommandList::copyBufferRegion(RenderBuffer *dst, uint64_t dstOffset, RenderBuffer *src, uint64_t srcOffset, uint64_t size) {
+	d3dCommandList->CopyBufferRegion(getResource(dst), dstOffset, getResource(src), srcOffset, size);
+}
+
+void RT64::D3D12RenderCommandList::copyBufferToTexture(RenderTexture *dst, RenderBuffer *src, uint64_t srcOffset, uint32_t rowPitch) {
+	const RenderTextureDesc &textureDesc = dst->getDesc();
+	D3D12_TEXTURE_COPY_LOCATION source = {};
+	source.pResource = getResource(src);
+	source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	source.PlacedFootprint.Offset = srcOffset;
+	source.PlacedFootprint.Footprint.Format = toDXGI(textureDesc.format);
+	source.PlacedFootprint.Footprint.Width = textureDesc.width;
+	source.PlacedFootprint.Footprint.Height = textureDesc.height;
+	source.PlacedFootprint.Footprint.Depth = 1;
+	source.PlacedFootprint.Footprint.RowPitch = rowPitch;
+
+	D3D12_TEXTURE_COPY_LOCATION destination = {};
+	destination.pResource = getResource(dst);
+	destination.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	destination.SubresourceIndex = 0;
+	d3dCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+}
+
+// The scratch buffer is transitioned by the builds since D3D12 requires it to be in the UAV state.
+
+void RT64::D3D12RenderCommandList::buildBottomLevelAS(const RenderBottomLevelASDesc &desc, RenderBuffer *scratch, uint64_t scratchOffset, RenderBuffer *result, RenderBuffer *updateSource) {
+	assert((updateSource == nullptr) || desc.updatable);
+	barrier(scratch, RenderBufferAccess::UnorderedAccess);
+
+	std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs;
+	fillGeometryDescs(desc, geometryDescs);
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+	buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+	buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	buildDesc.Inputs.NumDescs = (UINT)(geometryDescs.size());
+	buildDesc.Inputs.pGeometryDescs = geometryDescs.data();
+	buildDesc.Inputs.Flags = toBuildFlags(desc.updatable, desc.compactable, updateSource != nullptr);
+	buildDesc.DestAccelerationStructureData = result->getDeviceAddress();
+	buildDesc.ScratchAccelerationStructureData = scratch->getDeviceAddress() + scratchOffset;
+	buildDesc.SourceAccelerationStructureData = getAddress(updateSource);
+	d3dCommandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+}
+
+void RT64::D3D12RenderCommandList::buildTopLevelAS(const RenderTopLevelASDesc &desc, RenderBuffer *scratch, RenderBuffer *result, RenderBuffer *updateSource) {
+	assert(desc.instanceBuffer != nullptr);
+	assert((updateSource == nullptr) || desc.updatable);
+	barrier(scratch, RenderBufferAccess::UnorderedAccess);
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+	buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+	buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	buildDesc.Inputs.NumDescs = desc.instanceCount;
+	buildDesc.Inputs.InstanceDescs = desc.instanceBuffer->getDeviceAddress();
+	buildDesc.Inputs.Flags = toBuildFlags(desc.updatable, false, updateSource != nullptr);
+	buildDesc.DestAccelerationStructureData = result->getDeviceAddress();
+	buildDesc.ScratchAccelerationStructureData = scratch->getDeviceAddress();
+	buildDesc.SourceAccelerationStructureData = getAddress(updateSource);
+	d3dCommandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+}
+
+void RT64::D3D12RenderCommandList::queryCompactedSize(RenderBuffer *accelerationStructure, RenderBuffer *dst, uint64_t dstOffset) {
+	assert(static_cast<D3D12RenderBuffer *>(dst)->access == RenderBufferAccess::UnorderedAccess);
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuildDesc = {};
+	postbuildDesc.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+	postbuildDesc.DestBuffer = dst->getDeviceAddress() + dstOffset;
+
+	D3D12_GPU_VIRTUAL_ADDRESS source = accelerationStructure->getDeviceAddress();
+	d3dCommandList->EmitRaytracingAccelerationStructurePostbuildInfo(&postbuildDesc, 1, &source);
+}
+
+void RT64::D3D12RenderCommandList::compactAccelerationStructure(RenderBuffer *dst, RenderBuffer *src) {
+	d3dCommandList->CopyRaytracingAccelerationStructure(dst->getDeviceAddress(), src->getDeviceAddress(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+}
+
+// D3D12RenderDevice
+
+RT64::D3D12RenderDevice::D3D12RenderDevice(ID3D12Device8 *d3dDevice, D3D12MA::Allocator *d3dAllocator, ID3D12CommandQueue *d3dCommandQueue, ID3D12GraphicsCommandList4 *d3dCommandList) : commandList(d3dCommandList) {
+	assert(d3dDevice != nullptr);
+	assert(d3dAllocator != nullptr);
+	assert(d3dCommandQueue != nullptr);
+	this->d3dDevice = d3dDevice;
+	this->d3dAllocator = d3dAllocator;
+	this->d3dCommandQueue = d3dCommandQueue;
+}
+
+RT64::RenderBuffer *RT64::D3D12RenderDevice::createBuffer(const RenderBufferDesc &desc) {
+	return new D3D12RenderBuffer(d3dAllocator, desc);
+}
+
+RT64::RenderTexture *RT64::D3D12RenderDevice::createTexture(const RenderTextureDesc &desc) {
+	return new D3D12RenderTexture(d3dAllocator, desc);
+}
+
+RT64::RenderDescriptorSet *RT64::D3D12RenderDevice::createDescriptorSet(uint32_t entryCount) {
+	return new D3D12RenderDescriptorSet(d3dDevice, entryCount);
+}
+
+RT64::RenderFence *RT64::D3D12RenderDevice::createFence() {
+	return new D3D12RenderFence(d3dDevice);
+}
+
+RT64::RenderCommandList *RT64::D3D12RenderDevice::getCommandList() {
+	return &commandList;
+}
+
+void RT64::D3D12RenderDevice::signal(RenderFence *fence, uint64_t value) {
+	D3D12_CHECK(d3dCommandQueue->Signal(static_cast<D3D12RenderFence *>(fence)->getD3D12Fence(), value));
+}
+
+RT64::RenderAccelerationStructureSizes RT64::D3D12RenderDevice::getBottomLevelASSizes(const RenderBottomLevelASDesc &desc) {
+	std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs;
+	fillGeometryDescs(desc, geometryDescs);
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	inputs.NumDescs = (UINT)(geometryDescs.size());
+	inputs.pGeometryDescs = geometryDescs.data();
+	inputs.Flags = toBuildFlags(desc.updatable, desc.compactable, false);
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+	d3dDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+	return toSizes(info);
+}
+
+RT64::RenderAccelerationStructureSizes RT64::D3D12RenderDevice::getTopLevelASSizes(const RenderTopLevelASDesc &desc) {
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	inputs.NumDescs = desc.instanceCount;
+	inputs.Flags = toBuildFlags(desc.updatable, false, false);
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+	d3dDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+	return toSizes(info);
+}
+
+uint32_t RT64::D3D12RenderDevice::getTextureRowAlignment() const {
+	return D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+}
+
+uint32_t RT64::D3D12RenderDevice::getConstantBufferAlignment() const {
+	return D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+}
+
+#endif
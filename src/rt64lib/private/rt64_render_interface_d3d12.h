@@ -0,0 +1,115 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include "rt64_common.h"
+#include "rt64_render_interface.h"
+
+// D3D12 implementation of the render interface. Resources are allocated with D3D12MA and commands are recorded
+// on the device's command list. The native objects are exposed so the parts of the renderer that are still
+// written against D3D12 can use the resources created through the interface.
+
+namespace RT64 {
+	class D3D12RenderBuffer : public RenderBuffer {
+	private:
+		AllocatedResource resource;
+		RenderBufferDesc desc;
+	public:
+		RenderBufferAccess access;
+
+		D3D12RenderBuffer(D3D12MA::Allocator *d3dAllocator, const RenderBufferDesc &desc);
+		virtual ~D3D12RenderBuffer();
+		virtual void *map() override;
+		virtual void unmap() override;
+		virtual const RenderBufferDesc &getDesc() const override;
+		virtual uint64_t getDeviceAddress() const override;
+		ID3D12Resource *getD3D12Resource() const;
+		D3D12_RESOURCE_STATES getD3D12State() const;
+	};
+
+	class D3D12RenderTexture : public RenderTexture {
+	private:
+		AllocatedResource resource;
+		RenderTextureDesc desc;
+	public:
+		RenderTextureAccess access;
+
+		D3D12RenderTexture(D3D12MA::Allocator *d3dAllocator, const RenderTextureDesc &desc);
+		virtual ~D3D12RenderTexture();
+		virtual const RenderTextureDesc &getDesc() const override;
+		ID3D12Resource *getD3D12Resource() const;
+		D3D12_RESOURCE_STATES getD3D12State() const;
+	};
+
+	class D3D12RenderDescriptorSet : public RenderDescriptorSet {
+	private:
+		ID3D12Device8 *d3dDevice;
+		ID3D12DescriptorHeap *d3dHeap;
+		UINT d3dHandleIncrement;
+		uint32_t entryCount;
+	public:
+		D3D12RenderDescriptorSet(ID3D12Device8 *d3dDevice, uint32_t entryCount);
+		virtual ~D3D12RenderDescriptorSet();
+		virtual void setConstantBuffer(uint32_t index, RenderBuffer *buffer, uint64_t size) override;
+		virtual void setStructuredBuffer(uint32_t index, RenderBuffer *buffer, uint32_t elementCount, uint32_t elementStride) override;
+		virtual void setReadWriteBuffer(uint32_t index, RenderBuffer *buffer, RenderFormat format, uint32_t elementCount) override;
+		virtual void setTexture(uint32_t index, RenderTexture *texture) override;
+		virtual void setReadWriteTexture(uint32_t index, RenderTexture *texture) override;
+		virtual void setAccelerationStructure(uint32_t index, RenderBuffer *buffer) override;
+		virtual uint32_t getEntryCount() const override;
+		ID3D12DescriptorHeap *getD3D12Heap() const;
+		D3D12_CPU_DESCRIPTOR_HANDLE getD3D12CPUHandle(uint32_t index) const;
+		D3D12_GPU_DESCRIPTOR_HANDLE getD3D12GPUHandle(uint32_t index) const;
+	};
+
+	class D3D12RenderFence : public RenderFence {
+	private:
+		ID3D12Fence *d3dFence;
+		HANDLE d3dFenceEvent;
+	public:
+		D3D12RenderFence(ID3D12Device8 *d3dDevice);
+		virtual ~D3D12RenderFence();
+		virtual uint64_t getCompletedValue() const override;
+		virtual void wait(uint64_t value) override;
+		ID3D12Fence *getD3D12Fence() const;
+	};
+
+	class D3D12RenderCommandList : public RenderCommandList {
+	private:
+		ID3D12GraphicsCommandList4 *d3dCommandList;
+	public:
+		D3D12RenderCommandList(ID3D12GraphicsCommandList4 *d3dCommandList);
+		virtual void barrier(RenderBuffer *buffer, RenderBufferAccess access) override;
+		virtual void barrier(RenderTexture *texture, RenderTextureAccess access) override;
+		virtual void accelerationStructureBarrier(RenderBuffer *buffer) override;
+		virtual void copyBuffer(RenderBuffer *dst, RenderBuffer *src) override;
+		virtual void copyBufferRegion(RenderBuffer *dst, uint64_t dstOffset, RenderBuffer *src, uint64_t srcOffset, uint64_t size) override;
+		virtual void copyBufferToTexture(RenderTexture *dst, RenderBuffer *src, uint64_t srcOffset, uint32_t rowPitch) override;
+		virtual void buildBottomLevelAS(const RenderBottomLevelASDesc &desc, RenderBuffer *scratch, uint64_t scratchOffset, RenderBuffer *result, RenderBuffer *updateSource) override;
+		virtual void buildTopLevelAS(const RenderTopLevelASDesc &desc, RenderBuffer *scratch, RenderBuffer *result, RenderBuffer *updateSource) override;
+		virtual void queryCompactedSize(RenderBuffer *accelerationStructure, RenderBuffer *dst, uint64_t dstOffset) override;
+		virtual void compactAccelerationStructure(RenderBuffer *dst, RenderBuffer *src) override;
+	};
+
+	class D3D12RenderDevice : public RenderDevice {
+	private:
+		ID3D12Device8 *d3dDevice;
+		D3D12MA::Allocator *d3dAllocator;
+		ID3D12CommandQueue *d3dCommandQueue;
+		D3D12RenderCommandList commandList;
+	public:
+		D3D12RenderDevice(ID3D12Device8 *d3dDevice, D3D12MA::Allocator *d3dAllocator, ID3D12CommandQueue *d3dCommandQueue, ID3D12GraphicsCommandList4 *d3dCommandList);
+		virtual RenderBuffer *createBuffer(const RenderBufferDesc &desc) override;
+		virtual RenderTexture *createTexture(const RenderTextureDesc &desc) override;
+		virtual RenderDescriptorSet *createDescriptorSet(uint32_t entryCount) override;
+		virtual RenderFence *createFence() override;
+		virtual RenderCommandList *getCommandList() override;
+		virtual void signal(RenderFence *fence, uint64_t value) override;
+		virtual RenderAccelerationStructureSizes getBottomLevelASSizes(const RenderBottomLevelASDesc &desc) override;
+		virtual RenderAccelerationStructureSizes getTopLevelASSizes(const RenderTopLevelASDesc &desc) override;
+		virtual uint32_t getTextureRowAlignment() const override;
+		virtual uint32_t getConstantBufferAlignment() const override;
+	};
+};
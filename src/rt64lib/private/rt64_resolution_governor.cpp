@@ -0,0 +1,70 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_resolution_governor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Public
+
+RT64::ResolutionGovernor::ResolutionGovernor() {
+	scale = 1.0f;
+	filteredCost = 0.0f;
+	costValid = false;
+}
+
+void RT64::ResolutionGovernor::setSettings(const Settings &settings) {
+	this->settings = settings;
+	this->settings.targetMilliseconds = std::max(this->settings.targetMilliseconds, 0.0f);
+	this->settings.minScale = std::max(this->settings.minScale, 0.01f);
+	this->settings.maxScale = std::max(this->settings.maxScale, this->settings.minScale);
+	this->settings.smoothing = std::max(std::min(this->settings.smoothing, 1.0f), 0.01f);
+	this->settings.tolerance = std::max(this->settings.tolerance, 0.0f);
+	this->settings.maxStep = std::max(this->settings.maxStep, 0.001f);
+	scale = std::max(std::min(scale, this->settings.maxScale), this->settings.minScale);
+}
+
+const RT64::ResolutionGovernor::Settings &RT64::ResolutionGovernor::getSettings() const {
+	return settings;
+}
+
+bool RT64::ResolutionGovernor::isEnabled() const {
+	return settings.targetMilliseconds > 0.0f;
+}
+
+void RT64::ResolutionGovernor::reset(float scale) {
+	this->scale = std::max(std::min(scale, settings.maxScale), settings.minScale);
+	filteredCost = 0.0f;
+	costValid = false;
+}
+
+float RT64::ResolutionGovernor::update(float gpuMilliseconds) {
+	if (!isEnabled() || !(gpuMilliseconds > 0.0f)) {
+		return scale;
+	}
+
+	const float cost = gpuMilliseconds / (scale * scale);
+	filteredCost = costValid ? (filteredCost + (cost - filteredCost) * settings.smoothing) : cost;
+	costValid = true;
+
+	const float filteredMilliseconds = filteredCost * scale * scale;
+	if (std::abs(filteredMilliseconds - settings.targetMilliseconds) <= (settings.targetMilliseconds * settings.tolerance)) {
+		return scale;
+	}
+
+	float targetScale = std::sqrt(settings.targetMilliseconds / filteredCost);
+	targetScale = std::max(std::min(targetScale, scale + settings.maxStep), scale - settings.maxStep);
+	scale = std::max(std::min(targetScale, settings.maxScale), settings.minScale);
+	return scale;
+}
+
+float RT64::ResolutionGovernor::getScale() const {
+	return scale;
+}
+
+#endif
@@ -0,0 +1,52 @@
+//
+// RT64
+//
+
+#pragma once
+
+// Picks the resolution scale of a view so the GPU time it takes to trace it stays close to a target. The cost of
+// tracing is assumed to grow with the amount of pixels, so every measurement is turned into a cost per unit of area
+// and the scale for the next frame is the one that would make that cost match the target. The cost is smoothed to
+// ignore single slow frames, and the scale isn't changed while the time is within a margin of the target so it doesn't
+// keep moving back and forth.
+//
+// The governor has no dependencies on the graphics API so the control loop can be verified with simulated timings.
+
+namespace RT64 {
+	class ResolutionGovernor {
+	public:
+		struct Settings {
+			// The governor is disabled if the target is zero.
+			float targetMilliseconds = 0.0f;
+			float minScale = 0.5f;
+			float maxScale = 1.0f;
+
+			// Weight given to the newest measurement when smoothing the cost.
+			float smoothing = 0.25f;
+
+			// Fraction of the target the time can be away from it without changing the scale.
+			float tolerance = 0.05f;
+
+			// Largest change of the scale in a single frame.
+			float maxStep = 0.1f;
+		};
+	private:
+		Settings settings;
+		float scale;
+		float filteredCost;
+		bool costValid;
+	public:
+		ResolutionGovernor();
+		void setSettings(const Settings &settings);
+		const Settings &getSettings() const;
+		bool isEnabled() const;
+
+		// Discards the previous measurements and starts again from the scale.
+		void reset(float scale);
+
+		// Takes the GPU time of the last frame, which must've been rendered with the current scale, and returns the scale
+		// to use for the next one.
+		float update(float gpuMilliseconds);
+		float getScale() const;
+	};
+};
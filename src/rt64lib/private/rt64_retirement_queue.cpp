@@ -0,0 +1,53 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_retirement_queue.h"
+
+#include <cassert>
+
+// Private
+
+RT64::RetirementQueue::RetirementQueue() { }
+
+RT64::RetirementQueue::~RetirementQueue() {
+	assert(entries.empty() && "The queue must be flushed by its owner before it's destroyed.");
+}
+
+void RT64::RetirementQueue::retire(uint64_t fenceValue, const Callback &callback) {
+	assert(callback);
+
+	// Entries must stay sorted so they can be collected from the front. Waiting for a later value is always safe.
+	if (!entries.empty() && (entries.back().fenceValue > fenceValue)) {
+		fenceValue = entries.back().fenceValue;
+	}
+
+	entries.push_back({ fenceValue, callback });
+}
+
+size_t RT64::RetirementQueue::collect(uint64_t completedFenceValue) {
+	size_t releasedCount = 0;
+	while (!entries.empty() && (entries.front().fenceValue <= completedFenceValue)) {
+		// The callback is moved out first, since it's allowed to retire more entries.
+		Callback callback = std::move(entries.front().callback);
+		entries.pop_front();
+		callback();
+		releasedCount++;
+	}
+
+	return releasedCount;
+}
+
+void RT64::RetirementQueue::flush() {
+	while (!entries.empty()) {
+		collect(entries.back().fenceValue);
+	}
+}
+
+size_t RT64::RetirementQueue::getPendingCount() const {
+	return entries.size();
+}
+
+#endif
@@ -0,0 +1,44 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Defers the release of objects the GPU might still be using until the fence value that was current when they were
+// retired has been reached. Owners retire their resources with the fence value that will be signaled once the commands
+// recorded so far are done, and the queue releases them in the order they were retired once collect() is called with a
+// completed value that is at least as high.
+//
+// The release is done by a callback, so the owner can also return the resource to a pool instead of deleting it. The
+// queue has no dependencies on the graphics API so the ordering can be verified with a fake fence.
+
+namespace RT64 {
+	class RetirementQueue {
+	public:
+		typedef std::function<void()> Callback;
+	private:
+		struct Entry {
+			uint64_t fenceValue;
+			Callback callback;
+		};
+
+		std::deque<Entry> entries;
+	public:
+		RetirementQueue();
+		virtual ~RetirementQueue();
+		void retire(uint64_t fenceValue, const Callback &callback);
+
+		// Runs the callbacks of all the entries that were retired with a fence value up to the completed one. Returns the
+		// amount of entries that were released.
+		size_t collect(uint64_t completedFenceValue);
+
+		// Runs the callbacks of all the entries. Must only be done once the GPU is idle.
+		void flush();
+		size_t getPendingCount() const;
+	};
+};
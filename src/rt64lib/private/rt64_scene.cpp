@@ -14,6 +14,7 @@
 
 #include "rt64_device.h"
 #include "rt64_instance.h"
+#include "rt64_mesh.h"
 #include "rt64_view.h"
 
 // Private
@@ -21,35 +22,335 @@
 RT64::Scene::Scene(Device *device) {
 	assert(device != nullptr);
 	this->device = device;
+	renderContext = device->getRenderContext();
+	lightsBuffer = nullptr;
 	lightsBufferSize = 0;
 	lightsCount = 0;
+	topLevelASScratch = nullptr;
+	topLevelASResult = nullptr;
+	topLevelASInstances = nullptr;
+	topLevelASScratchSize = 0;
+	topLevelASResultSize = 0;
+	topLevelASInstancesSize = 0;
+	activeInstancesBufferProps = nullptr;
+	activeInstancesBufferPropsSize = 0;
 	device->addScene(this);
 }
 
 RT64::Scene::~Scene() {
 	device->removeScene(this);
 
-	lightsBuffer.Release();
+	if (lightsBuffer != nullptr) {
+		renderContext->retireUploadBuffer(lightsBuffer);
+	}
 
 	for (int i = 0; i < views.size(); i++) {
 		delete views[i];
 	}
 
-	for (int i = 0; i < instances.size(); i++) {
-		delete instances[i];
+	releaseTopLevelAS();
+
+	if (activeInstancesBufferProps != nullptr) {
+		renderContext->retireUploadBuffer(activeInstancesBufferProps);
+	}
+
+	// Instance records hold no GPU resources, so the retired ones can go back to the pool right away.
+	instanceRetirements.flush();
+	instances.compact();
+	for (Instance *instance : instances.getValues()) {
+		instancePool.destroy(instance);
 	}
 }
 
 void RT64::Scene::update() {
+	RT64_PROFILE_SCOPE(device->getProfiler(), "Scene update", RT64_TIMING_CPU_SCENE_UPDATE);
+
+	// Close the holes left by the instances removed since the last frame before the views gather them.
+	instanceRetirements.collect(renderContext->getCompletedFenceValue());
+	instances.compact();
+
+	// Everything that only depends on the instances is shared by all the views, so it's only prepared once per frame.
+	gatherInstances();
+
+	if (!rtInstances.empty()) {
+		RT64_PROFILE_SCOPE(device->getProfiler(), "Build TLAS");
+		createTopLevelAS();
+	}
+
+	if (!getInstances().empty()) {
+		createInstancePropertiesBuffer();
+		updateInstancePropertiesBuffer();
+	}
+
+	RenderContext::Counters *counters = renderContext->getCounters();
+	counters->rtInstances += (unsigned int)(rtInstances.size());
+	counters->rasterBgInstances += (unsigned int)(rasterBgInstances.size());
+	counters->rasterFgInstances += (unsigned int)(rasterFgInstances.size());
+
 	for (View *view : views) {
 		view->update();
 	}
 }
 
+void RT64::Scene::gatherInstances() {
+	rtInstances.clear();
+	rasterBgInstances.clear();
+	rasterFgInstances.clear();
+	usedTextures.clear();
+	if (getInstances().empty()) {
+		return;
+	}
+
+	// Create the active instance vectors.
+	RenderInstance renderInstance;
+	Mesh *usedMesh = nullptr;
+	size_t totalInstances = getInstances().size();
+	unsigned int instFlags = 0;
+	unsigned int screenHeight = device->getHeight();
+	rtInstances.reserve(totalInstances);
+	rasterBgInstances.reserve(totalInstances);
+	rasterFgInstances.reserve(totalInstances);
+	usedTextures.reserve(1024);
+
+	for (Instance *instance : getInstances()) {
+		instFlags = instance->getFlags();
+		usedMesh = instance->getMesh();
+		renderInstance.instance = instance;
+		renderInstance.bottomLevelAS = usedMesh->getBottomLevelASResult();
+		renderInstance.bottomLevelASVersion = usedMesh->getBottomLevelASVersion();
+		renderInstance.transform = instance->getTransform();
+		renderInstance.previousTransform = instance->getPreviousTransform();
+		renderInstance.material = instance->getMaterial();
+		renderInstance.indexCount = usedMesh->getIndexCount();
+		renderInstance.indexBuffer = usedMesh->getIndexBuffer();
+		renderInstance.vertexBuffer = usedMesh->getVertexBuffer();
+		renderInstance.firstIndex = usedMesh->getFirstIndex();
+		renderInstance.firstVertex = usedMesh->getFirstVertex();
+		renderInstance.prevVertexBufferAddress = usedMesh->getPreviousVertexBufferAddress();
+		renderInstance.material.diffuseTexIndex = (int)(usedTextures.size());
+		renderInstance.flags = (instFlags & RT64_INSTANCE_DISABLE_BACKFACE_CULLING) ? RenderTopLevelASInstanceFlagCullDisable : RenderTopLevelASInstanceFlagNone;
+		usedTextures.push_back(instance->getDiffuseTexture());
+
+		if (instance->hasScissorRect()) {
+			RT64_RECT rect = instance->getScissorRect();
+			renderInstance.scissorRect.left = rect.x;
+			renderInstance.scissorRect.top = screenHeight - rect.y - rect.h;
+			renderInstance.scissorRect.right = rect.x + rect.w;
+			renderInstance.scissorRect.bottom = screenHeight - rect.y;
+		}
+		else {
+			renderInstance.scissorRect = RenderRect();
+		}
+
+		if (instance->hasViewportRect()) {
+			RT64_RECT rect = instance->getViewportRect();
+			renderInstance.viewport.x = static_cast<float>(rect.x);
+			renderInstance.viewport.y = static_cast<float>(screenHeight - rect.y - rect.h);
+			renderInstance.viewport.width = static_cast<float>(rect.w);
+			renderInstance.viewport.height = static_cast<float>(rect.h);
+		}
+		else {
+			renderInstance.viewport = RenderViewport();
+		}
+
+		if (instance->getNormalTexture() != nullptr) {
+			renderInstance.material.normalTexIndex = (int)(usedTextures.size());
+			usedTextures.push_back(instance->getNormalTexture());
+		}
+		else {
+			renderInstance.material.normalTexIndex = -1;
+		}
+
+		if (instance->getSpecularTexture() != nullptr) {
+			renderInstance.material.specularTexIndex = (int)(usedTextures.size());
+			usedTextures.push_back(instance->getSpecularTexture());
+		}
+		else {
+			renderInstance.material.specularTexIndex = -1;
+		}
+		
+		if (renderInstance.bottomLevelAS != nullptr) {
+			rtInstances.push_back(renderInstance);
+		}
+		else if (instFlags & RT64_INSTANCE_RASTER_BACKGROUND) {
+			rasterBgInstances.push_back(renderInstance);
+		}
+		else {
+			rasterFgInstances.push_back(renderInstance);
+		}
+	}
+}
+
+void RT64::Scene::createTopLevelAS() {
+	RenderDevice *renderDevice = renderContext->getRenderDevice();
+	RenderCommandList *commandList = renderDevice->getCommandList();
+
+	// As for the bottom-level AS, the building the AS requires some scratch
+	// space to store temporary data in addition to the actual AS. In the case
+	// of the top-level AS, the instance descriptors also need to be stored in
+	// GPU memory.
+	RenderTopLevelASDesc asDesc;
+	asDesc.instanceCount = (uint32_t)(rtInstances.size());
+	asDesc.updatable = true;
+
+	RenderAccelerationStructureSizes sizes = renderDevice->getTopLevelASSizes(asDesc);
+	const uint64_t scratchSize = std::max(sizes.scratchSize, sizes.updateScratchSize);
+	const uint64_t instancesSize = ROUND_UP(rtInstances.size() * sizeof(RenderTopLevelASInstance), renderDevice->getConstantBufferAlignment());
+	
+	// Release the previous buffers and reallocate them if they're not big enough.
+	if ((topLevelASScratchSize < scratchSize) || (topLevelASResultSize < sizes.resultSize) || (topLevelASInstancesSize < instancesSize)) {
+		releaseTopLevelAS();
+
+		// Create the scratch and result buffers. Since the build is all done on
+		// GPU, those can be allocated on the default heap
+		topLevelASScratch = renderDevice->createBuffer(RenderBufferDesc::ScratchBuffer(scratchSize));
+		topLevelASResult = renderDevice->createBuffer(RenderBufferDesc::AccelerationStructureBuffer(sizes.resultSize));
+
+		// The buffer describing the instances: ID, shader binding information,
+		// matrices ... Those will be copied into the buffer through mapping, so
+		// the buffer has to be allocated on the upload heap.
+		topLevelASInstances = renderDevice->createBuffer(RenderBufferDesc::UploadBuffer(instancesSize));
+
+		topLevelASScratchSize = scratchSize;
+		topLevelASResultSize = sizes.resultSize;
+		topLevelASInstancesSize = instancesSize;
+
+		// The new result buffer doesn't hold anything that can be refitted.
+		topLevelASTracker.invalidate();
+	}
+
+	// Gather all the instances. The transforms are stored as the transposed 3x4 matrix.
+	topLevelASInstanceData.resize(rtInstances.size());
+	topLevelASVersions.resize(rtInstances.size());
+	for (size_t i = 0; i < rtInstances.size(); i++) {
+		RenderTopLevelASInstance &asInstance = topLevelASInstanceData[i];
+		XMMATRIX transposed = XMMatrixTranspose(rtInstances[i].transform);
+		memcpy(asInstance.transform, &transposed, sizeof(asInstance.transform));
+		asInstance.instanceId = (uint32_t)(i);
+		asInstance.instanceMask = 0xFF;
+		asInstance.hitGroupIndex = (uint32_t)(2 * i);
+		asInstance.flags = rtInstances[i].flags;
+		asInstance.bottomLevelASAddress = rtInstances[i].bottomLevelAS->getDeviceAddress();
+		topLevelASVersions[i] = rtInstances[i].bottomLevelASVersion;
+	}
+
+	RenderContext::Counters *counters = renderContext->getCounters();
+	counters->tlasBytes += sizes.resultSize;
+
+	// Refit the previous AS in place if only the transforms or the contents of the bottom-level ASes changed.
+	TopLevelASTracker::Action action = topLevelASTracker.update(topLevelASInstanceData.data(), topLevelASVersions.data(), topLevelASInstanceData.size());
+	if (action == TopLevelASTracker::Action::None) {
+		return;
+	}
+
+	void *pData = topLevelASInstances->map();
+	memcpy(pData, topLevelASInstanceData.data(), topLevelASInstanceData.size() * sizeof(RenderTopLevelASInstance));
+	topLevelASInstances->unmap();
+
+	// After all the buffers are allocated we can build the acceleration structure.
+	asDesc.instanceBuffer = topLevelASInstances;
+	commandList->buildTopLevelAS(asDesc, topLevelASScratch, topLevelASResult, (action == TopLevelASTracker::Action::Refit) ? topLevelASResult : nullptr);
+	commandList->accelerationStructureBarrier(topLevelASResult);
+
+	if (action == TopLevelASTracker::Action::Refit) {
+		counters->tlasRefits++;
+	}
+	else {
+		counters->tlasBuilds++;
+	}
+
+	counters->bytesUploaded += rtInstances.size() * sizeof(RenderTopLevelASInstance);
+}
+
+void RT64::Scene::releaseTopLevelAS() {
+	// The buffers might still be used by the frames that were already recorded.
+	if (topLevelASScratch != nullptr) {
+		renderContext->retire(topLevelASScratch);
+	}
+
+	if (topLevelASResult != nullptr) {
+		renderContext->retire(topLevelASResult);
+	}
+
+	if (topLevelASInstances != nullptr) {
+		renderContext->retire(topLevelASInstances);
+	}
+
+	topLevelASScratch = nullptr;
+	topLevelASResult = nullptr;
+	topLevelASInstances = nullptr;
+	topLevelASScratchSize = 0;
+	topLevelASResultSize = 0;
+	topLevelASInstancesSize = 0;
+}
+
+void RT64::Scene::createInstancePropertiesBuffer() {
+	RenderDevice *renderDevice = renderContext->getRenderDevice();
+	uint64_t newBufferSize = ROUND_UP(getRenderInstanceCount() * sizeof(InstanceProperties), renderDevice->getConstantBufferAlignment());
+	if (activeInstancesBufferPropsSize != newBufferSize) {
+		if (activeInstancesBufferProps != nullptr) {
+			renderContext->retireUploadBuffer(activeInstancesBufferProps);
+		}
+
+		activeInstancesBufferProps = renderContext->createUploadBuffer(newBufferSize);
+		activeInstancesBufferPropsSize = newBufferSize;
+	}
+}
+
+void RT64::Scene::updateInstancePropertiesBuffer() {
+	InstanceProperties *current = (InstanceProperties *)(activeInstancesBufferProps->map());
+
+	for (const RenderInstance &inst : rtInstances) {
+		// Store world transform and the one used in the previous frame.
+		current->objectToWorld = inst.transform;
+		current->objectToWorldPrevious = inst.previousTransform;
+
+		// Store matrix to transform normal.
+		XMMATRIX upper3x3 = current->objectToWorld;
+		upper3x3.r[0].m128_f32[3] = 0.f;
+		upper3x3.r[1].m128_f32[3] = 0.f;
+		upper3x3.r[2].m128_f32[3] = 0.f;
+		upper3x3.r[3].m128_f32[0] = 0.f;
+		upper3x3.r[3].m128_f32[1] = 0.f;
+		upper3x3.r[3].m128_f32[2] = 0.f;
+		upper3x3.r[3].m128_f32[3] = 1.f;
+
+		XMVECTOR det;
+		current->objectToWorldNormal = XMMatrixTranspose(XMMatrixInverse(&det, upper3x3));
+
+		// Store material.
+		current->material = inst.material;
+		current++;
+	}
+
+	for (const RenderInstance &inst : rasterBgInstances) {
+		current->material = inst.material;
+		current++;
+	}
+
+	for (const RenderInstance& inst : rasterFgInstances) {
+		current->material = inst.material;
+		current++;
+	}
+
+	activeInstancesBufferProps->unmap();
+	renderContext->getCounters()->bytesUploaded += getRenderInstanceCount() * sizeof(InstanceProperties);
+}
+
 void RT64::Scene::render() {
 	for (View *view : views) {
 		view->render();
 	}
+
+	// Every view has rendered this frame, so the current state becomes the previous one for the motion vectors.
+	for (Instance *instance : getInstances()) {
+		instance->storePreviousTransform();
+
+		Mesh *mesh = instance->getMesh();
+		if (mesh != nullptr) {
+			mesh->discardPreviousVertices();
+		}
+	}
 }
 
 void RT64::Scene::resize() {
@@ -58,18 +359,22 @@ void RT64::Scene::resize() {
 	}
 }
 
-void RT64::Scene::addInstance(Instance *instance) {
-	assert(instance != nullptr);
-	instances.push_back(instance);
+RT64::Instance *RT64::Scene::createInstance() {
+	Instance *instance = instancePool.create(this);
+	instance->setSceneHandle(instances.insert(instance));
+	return instance;
 }
 
-void RT64::Scene::removeInstance(Instance *instance) {
+void RT64::Scene::destroyInstance(Instance *instance) {
 	assert(instance != nullptr);
 
-	auto it = std::find(instances.begin(), instances.end(), instance);
-	if (it != instances.end()) {
-		instances.erase(it);
-	}
+	bool removed = instances.remove(instance->getSceneHandle());
+	assert(removed && "The instance was already destroyed.");
+
+	ObjectPool<Instance> *pool = &instancePool;
+	instanceRetirements.retire(renderContext->getFenceValue(), [pool, instance]() {
+		pool->destroy(instance);
+	});
 }
 
 void RT64::Scene::addView(View *view) {
@@ -89,16 +394,19 @@ void RT64::Scene::setLights(RT64_LIGHT *lightArray, int lightCount) {
 	static std::uniform_real_distribution<float> randomDistribution(0.0f, 1.0f);
 
 	assert(lightCount > 0);
-	size_t newSize = ROUND_UP(sizeof(RT64_LIGHT) * lightCount, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	RenderDevice *renderDevice = renderContext->getRenderDevice();
+	size_t newSize = ROUND_UP(sizeof(RT64_LIGHT) * lightCount, renderDevice->getConstantBufferAlignment());
 	if (newSize != lightsBufferSize) {
-		lightsBuffer.Release();
-		lightsBuffer = getDevice()->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, newSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+		if (lightsBuffer != nullptr) {
+			renderContext->retireUploadBuffer(lightsBuffer);
+		}
+
+		lightsBuffer = renderContext->createUploadBuffer(newSize);
 		lightsBufferSize = newSize;
 	}
 
-	uint8_t *pData;
 	size_t i = 0;
-	D3D12_CHECK(lightsBuffer.Get()->Map(0, nullptr, (void **)&pData));
+	uint8_t *pData = (uint8_t *)(lightsBuffer->map());
 	if (lightArray != nullptr) {
 		memcpy(pData, lightArray, sizeof(RT64_LIGHT) * lightCount);
 
@@ -118,12 +426,12 @@ void RT64::Scene::setLights(RT64_LIGHT *lightArray, int lightCount) {
 		}
 	}
 
-	lightsBuffer.Get()->Unmap(0, nullptr);
+	lightsBuffer->unmap();
 	lightsCount = lightCount;
 }
 
-ID3D12Resource *RT64::Scene::getLightsBuffer() const {
-	return lightsBuffer.Get();
+RT64::RenderBuffer *RT64::Scene::getLightsBuffer() const {
+	return lightsBuffer;
 }
 
 int RT64::Scene::getLightsCount() const {
@@ -131,7 +439,41 @@ int RT64::Scene::getLightsCount() const {
 }
 
 const std::vector<RT64::Instance *> &RT64::Scene::getInstances() const {
-	return instances;
+	assert(instances.isCompact() && "The instances must be compacted by the scene update before they're gathered.");
+	return instances.getValues();
+}
+
+RT64::Instance *RT64::Scene::findInstance(SlotMap<Instance *>::Handle handle) {
+	Instance **instance = instances.get(handle);
+	return (instance != nullptr) ? *instance : nullptr;
+}
+
+const std::vector<RT64::Scene::RenderInstance> &RT64::Scene::getRtInstances() const {
+	return rtInstances;
+}
+
+const std::vector<RT64::Scene::RenderInstance> &RT64::Scene::getRasterBgInstances() const {
+	return rasterBgInstances;
+}
+
+const std::vector<RT64::Scene::RenderInstance> &RT64::Scene::getRasterFgInstances() const {
+	return rasterFgInstances;
+}
+
+size_t RT64::Scene::getRenderInstanceCount() const {
+	return rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size();
+}
+
+const std::vector<RT64::Texture *> &RT64::Scene::getUsedTextures() const {
+	return usedTextures;
+}
+
+RT64::RenderBuffer *RT64::Scene::getTopLevelAS() const {
+	return topLevelASResult;
+}
+
+RT64::RenderBuffer *RT64::Scene::getInstancePropertiesBuffer() const {
+	return activeInstancesBufferProps;
 }
 
 RT64::Device *RT64::Scene::getDevice() const {
@@ -4,22 +4,76 @@
 
 #pragma once
 
-#include "rt64_common.h"
+#include <DirectXMath.h>
+
+#include "../public/rt64.h"
+#include "rt64_object_pool.h"
+#include "rt64_render_interface.h"
+#include "rt64_retirement_queue.h"
+#include "rt64_slot_map.h"
+#include "rt64_top_level_as_tracker.h"
 
 namespace RT64 {
 	class Device;
 	class Inspector;
 	class Instance;
+	class RenderContext;
+	class Texture;
 	class View;
 
 	class Scene {
+	public:
+		// State of an instance as it's drawn or traced during the frame.
+		struct RenderInstance {
+			Instance *instance;
+			RenderBuffer *vertexBuffer;
+			RenderBuffer *indexBuffer;
+			uint32_t firstVertex;
+			uint32_t firstIndex;
+			int indexCount;
+			RenderBuffer *bottomLevelAS;
+			uint32_t bottomLevelASVersion;
+			uint64_t prevVertexBufferAddress;
+			DirectX::XMMATRIX transform;
+			DirectX::XMMATRIX previousTransform;
+			RT64_MATERIAL material;
+			RenderRect scissorRect;
+			RenderViewport viewport;
+			unsigned int flags;
+		};
 	private:
 		Device *device;
-		std::vector<Instance *> instances;
+		RenderContext *renderContext;
+		ObjectPool<Instance> instancePool;
+		SlotMap<Instance *> instances;
+		RetirementQueue instanceRetirements;
 		std::vector<View *> views;
-		AllocatedResource lightsBuffer;
+		RenderBuffer *lightsBuffer;
 		size_t lightsBufferSize;
 		int lightsCount;
+
+		// Shared by all the views. The views only own their camera parameters and the resources they render to.
+		std::vector<RenderInstance> rtInstances;
+		std::vector<RenderInstance> rasterBgInstances;
+		std::vector<RenderInstance> rasterFgInstances;
+		std::vector<Texture *> usedTextures;
+		RenderBuffer *topLevelASScratch;
+		RenderBuffer *topLevelASResult;
+		RenderBuffer *topLevelASInstances;
+		uint64_t topLevelASScratchSize;
+		uint64_t topLevelASResultSize;
+		uint64_t topLevelASInstancesSize;
+		std::vector<RenderTopLevelASInstance> topLevelASInstanceData;
+		std::vector<uint32_t> topLevelASVersions;
+		TopLevelASTracker topLevelASTracker;
+		RenderBuffer *activeInstancesBufferProps;
+		uint64_t activeInstancesBufferPropsSize;
+
+		void gatherInstances();
+		void createTopLevelAS();
+		void releaseTopLevelAS();
+		void createInstancePropertiesBuffer();
+		void updateInstancePropertiesBuffer();
 	public:
 		Scene(Device *device);
 		virtual ~Scene();
@@ -28,13 +82,28 @@ namespace RT64 {
 		void resize();
 		void setLights(RT64_LIGHT *lightArray, int lightCount);
 		int getLightsCount() const;
-		ID3D12Resource *getLightsBuffer() const;
-		void addInstance(Instance *instance);
-		void removeInstance(Instance *instance);
+		RenderBuffer *getLightsBuffer() const;
+		Instance *createInstance();
+
+		// The instance stops being drawn right away, but its record is only reused once the GPU is done with the frames
+		// that drew it, so the instance queries that are still pending don't resolve to a different instance.
+		void destroyInstance(Instance *instance);
 		void addView(View *view);
 		void removeView(View *view);
 		const std::vector<View *> &getViews() const;
 		const std::vector<Instance *> &getInstances() const;
+
+		// Returns null if the instance was destroyed after the handle was taken.
+		Instance *findInstance(SlotMap<Instance *>::Handle handle);
+		const std::vector<RenderInstance> &getRtInstances() const;
+		const std::vector<RenderInstance> &getRasterBgInstances() const;
+		const std::vector<RenderInstance> &getRasterFgInstances() const;
+
+		// The instance properties buffer holds the traced instances first, followed by the background and the foreground ones.
+		size_t getRenderInstanceCount() const;
+		const std::vector<Texture *> &getUsedTextures() const;
+		RenderBuffer *getTopLevelAS() const;
+		RenderBuffer *getInstancePropertiesBuffer() const;
 		Device *getDevice() const;
 	};
 };
\ No newline at end of file
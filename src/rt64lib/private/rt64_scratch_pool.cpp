@@ -0,0 +1,76 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_scratch_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+	const uint64_t MinCapacity = 1024 * 1024;
+};
+
+// Public
+
+RT64::ScratchBufferPool::ScratchBufferPool(RenderDevice *renderDevice, const RetireCallback &retireCallback) {
+	assert(renderDevice != nullptr);
+	assert(retireCallback);
+	this->renderDevice = renderDevice;
+	this->retireCallback = retireCallback;
+	buffer = nullptr;
+	capacity = 0;
+	offset = 0;
+	retiredUsage = 0;
+	peakUsage = 0;
+	usedFenceValue = 0;
+}
+
+RT64::ScratchBufferPool::~ScratchBufferPool() {
+	delete buffer;
+}
+
+RT64::ScratchBufferPool::Allocation RT64::ScratchBufferPool::allocate(uint64_t size, uint64_t fenceValue) {
+	const uint64_t alignedSize = ((size + RenderAccelerationStructureScratchAlignment - 1) / RenderAccelerationStructureScratchAlignment) * RenderAccelerationStructureScratchAlignment;
+	if ((offset + alignedSize) > capacity) {
+		// The ranges already handed out stay valid until the GPU is done with them.
+		if (buffer != nullptr) {
+			retiredUsage += capacity;
+			retireCallback(buffer);
+		}
+
+		capacity = std::max(std::max(capacity * 2, alignedSize), MinCapacity);
+		buffer = renderDevice->createBuffer(RenderBufferDesc::ScratchBuffer(capacity));
+		offset = 0;
+	}
+
+	Allocation allocation;
+	allocation.buffer = buffer;
+	allocation.offset = offset;
+	offset += alignedSize;
+	usedFenceValue = std::max(usedFenceValue, fenceValue);
+	peakUsage = std::max(peakUsage, retiredUsage + offset);
+	return allocation;
+}
+
+bool RT64::ScratchBufferPool::reset(uint64_t completedFenceValue) {
+	if (completedFenceValue < usedFenceValue) {
+		return false;
+	}
+
+	offset = 0;
+	retiredUsage = 0;
+	return true;
+}
+
+uint64_t RT64::ScratchBufferPool::getCapacity() const {
+	return capacity;
+}
+
+uint64_t RT64::ScratchBufferPool::getPeakUsage() const {
+	return peakUsage;
+}
+
+#endif
@@ -0,0 +1,50 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "rt64_render_interface.h"
+
+// Hands out ranges of a shared scratch buffer to the acceleration structure builds recorded during a frame, so the
+// meshes don't need to keep a scratch buffer of their own alive between builds. Ranges never overlap until the pool
+// is reset, so the builds don't need barriers between them. Every allocation is tagged with the fence value that will
+// be signaled once the build that uses it is done, and the pool is only rewound once that value has been completed.
+//
+// When a frame needs more than the current buffer can hold, a bigger buffer is created and the old one is handed to
+// the retire callback, which must only delete it once the commands recorded so far are done.
+
+namespace RT64 {
+	class ScratchBufferPool {
+	public:
+		typedef std::function<void(RenderBuffer *)> RetireCallback;
+
+		struct Allocation {
+			RenderBuffer *buffer = nullptr;
+			uint64_t offset = 0;
+		};
+	private:
+		RenderDevice *renderDevice;
+		RetireCallback retireCallback;
+		RenderBuffer *buffer;
+		uint64_t capacity;
+		uint64_t offset;
+		uint64_t retiredUsage;
+		uint64_t peakUsage;
+		uint64_t usedFenceValue;
+	public:
+		ScratchBufferPool(RenderDevice *renderDevice, const RetireCallback &retireCallback);
+		virtual ~ScratchBufferPool();
+		Allocation allocate(uint64_t size, uint64_t fenceValue);
+
+		// Rewinds the pool if the GPU is done with all the builds that used it. Returns whether it was rewound.
+		bool reset(uint64_t completedFenceValue);
+		uint64_t getCapacity() const;
+
+		// Largest amount of scratch memory used by a single frame since the pool was created.
+		uint64_t getPeakUsage() const;
+	};
+};
@@ -0,0 +1,295 @@
+//
+// RT64
+//
+
+#include "rt64_shader_archive.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "xxhash/xxhash32.h"
+
+namespace {
+	const char ArchiveMagic[8] = { 'R', 'T', '6', '4', 'S', 'H', 'D', 'R' };
+	const size_t HeaderSize = 16;
+	const size_t IndexEntrySize = 64;
+
+	// Compression parameters. The format itself only limits the offset to 16 bits.
+	const int HashLog = 14;
+	const size_t MinMatchLength = 4;
+	const size_t MaxMatchOffset = 65535;
+
+	// Matches can't reach into the last bytes of the input, which always end up as literals.
+	const size_t LastLiterals = 5;
+	const size_t MatchFindLimit = 12;
+
+	uint32_t readU32(const uint8_t *src) {
+		uint32_t value;
+		memcpy(&value, src, sizeof(value));
+		return value;
+	}
+
+	void writeU32(std::vector<uint8_t> &dst, size_t offset, uint32_t value) {
+		memcpy(dst.data() + offset, &value, sizeof(value));
+	}
+
+	void writeLength(std::vector<uint8_t> &dst, size_t length) {
+		while (length >= 255) {
+			dst.push_back(255);
+			length -= 255;
+		}
+
+		dst.push_back((uint8_t)(length));
+	}
+
+	bool readLength(const uint8_t *&src, const uint8_t *srcEnd, size_t &length) {
+		uint8_t value;
+		do {
+			if (src >= srcEnd) {
+				return false;
+			}
+
+			value = *src++;
+			length += value;
+		} while (value == 255);
+
+		return true;
+	}
+
+	void writeSequence(std::vector<uint8_t> &dst, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength) {
+		const size_t matchCode = (matchLength > 0) ? (matchLength - MinMatchLength) : 0;
+		uint8_t token = (uint8_t)((std::min(literalLength, (size_t)(15)) << 4) | std::min(matchCode, (size_t)(15)));
+		dst.push_back(token);
+		if (literalLength >= 15) {
+			writeLength(dst, literalLength - 15);
+		}
+
+		dst.insert(dst.end(), literals, literals + literalLength);
+
+		// The last sequence only has literals.
+		if (matchLength == 0) {
+			return;
+		}
+
+		dst.push_back((uint8_t)(offset & 0xFF));
+		dst.push_back((uint8_t)(offset >> 8));
+		if (matchCode >= 15) {
+			writeLength(dst, matchCode - 15);
+		}
+	}
+};
+
+// Private
+
+void RT64::ShaderArchive::decodeEntry(Entry &entry) {
+	entry.bytecode.resize(entry.size);
+	if (entry.flags & EntryCompressed) {
+		if (!decompress(entry.storedData, entry.storedSize, entry.bytecode.data(), entry.bytecode.size())) {
+			throw std::runtime_error("Shader " + entry.name + " in the archive can't be decompressed.");
+		}
+	}
+	else if (entry.size > 0) {
+		memcpy(entry.bytecode.data(), entry.storedData, entry.size);
+	}
+
+	if (XXHash32::hash(entry.bytecode.data(), entry.bytecode.size(), 0) != entry.checksum) {
+		throw std::runtime_error("Shader " + entry.name + " in the archive is corrupted.");
+	}
+
+	entry.decoded = true;
+}
+
+// Public
+
+RT64::ShaderArchive::ShaderArchive(const uint8_t *data, size_t size) {
+	assert(data != nullptr);
+	if ((size < HeaderSize) || (memcmp(data, ArchiveMagic, sizeof(ArchiveMagic)) != 0) || (readU32(data + 8) != FormatVersion)) {
+		throw std::runtime_error("The shader archive is invalid.");
+	}
+
+	entryCount = readU32(data + 12);
+	if ((HeaderSize + entryCount * IndexEntrySize) > size) {
+		throw std::runtime_error("The shader archive's index is truncated.");
+	}
+
+	entries = std::make_unique<Entry[]>(entryCount);
+	for (size_t i = 0; i < entryCount; i++) {
+		const uint8_t *indexEntry = data + HeaderSize + i * IndexEntrySize;
+		Entry &entry = entries[i];
+		entry.name.assign((const char *)(indexEntry), strnlen((const char *)(indexEntry), MaxNameLength));
+
+		const uint32_t offset = readU32(indexEntry + 40);
+		entry.storedSize = readU32(indexEntry + 44);
+		entry.size = readU32(indexEntry + 48);
+		entry.checksum = readU32(indexEntry + 52);
+		entry.flags = readU32(indexEntry + 56);
+		if ((offset > size) || (entry.storedSize > (size - offset))) {
+			throw std::runtime_error("Shader " + entry.name + " is out of the archive's bounds.");
+		}
+
+		entry.storedData = data + offset;
+		entryIndices[entry.name] = i;
+	}
+}
+
+RT64::ShaderArchive::~ShaderArchive() { }
+
+const std::vector<uint8_t> &RT64::ShaderArchive::get(const std::string &name) {
+	auto it = entryIndices.find(name);
+	if (it == entryIndices.end()) {
+		throw std::runtime_error("Shader " + name + " is not in the archive.");
+	}
+
+	Entry &entry = entries[it->second];
+	std::call_once(entry.decodeFlag, [this, &entry]() {
+		decodeEntry(entry);
+	});
+
+	return entry.bytecode;
+}
+
+size_t RT64::ShaderArchive::getEntryCount() const {
+	return entryCount;
+}
+
+bool RT64::ShaderArchive::isDecoded(const std::string &name) const {
+	auto it = entryIndices.find(name);
+	return (it != entryIndices.end()) && entries[it->second].decoded;
+}
+
+void RT64::ShaderArchive::build(const std::vector<Source> &sources, bool compress, std::vector<uint8_t> &archive) {
+	const size_t indexSize = sources.size() * IndexEntrySize;
+	archive.assign(HeaderSize + indexSize, 0);
+	memcpy(archive.data(), ArchiveMagic, sizeof(ArchiveMagic));
+	writeU32(archive, 8, FormatVersion);
+	writeU32(archive, 12, (uint32_t)(sources.size()));
+
+	std::vector<uint8_t> compressed;
+	for (size_t i = 0; i < sources.size(); i++) {
+		const Source &source = sources[i];
+		if (source.name.size() > MaxNameLength) {
+			throw std::runtime_error("Shader name " + source.name + " is too long for the archive.");
+		}
+
+		// Shaders that don't get any smaller are stored as they are.
+		uint32_t flags = 0;
+		const uint8_t *storedData = source.bytecode.data();
+		size_t storedSize = source.bytecode.size();
+		if (compress) {
+			ShaderArchive::compress(source.bytecode.data(), source.bytecode.size(), compressed);
+			if (compressed.size() < source.bytecode.size()) {
+				flags |= EntryCompressed;
+				storedData = compressed.data();
+				storedSize = compressed.size();
+			}
+		}
+
+		const size_t indexOffset = HeaderSize + i * IndexEntrySize;
+		memcpy(archive.data() + indexOffset, source.name.data(), source.name.size());
+		writeU32(archive, indexOffset + 40, (uint32_t)(archive.size()));
+		writeU32(archive, indexOffset + 44, (uint32_t)(storedSize));
+		writeU32(archive, indexOffset + 48, (uint32_t)(source.bytecode.size()));
+		writeU32(archive, indexOffset + 52, XXHash32::hash(source.bytecode.data(), source.bytecode.size(), 0));
+		writeU32(archive, indexOffset + 56, flags);
+		archive.insert(archive.end(), storedData, storedData + storedSize);
+	}
+}
+
+void RT64::ShaderArchive::compress(const uint8_t *src, size_t srcSize, std::vector<uint8_t> &dst) {
+	dst.clear();
+	dst.reserve(srcSize + (srcSize / 255) + 16);
+
+	size_t anchor = 0;
+	if (srcSize > MatchFindLimit) {
+		std::vector<int64_t> hashTable(1 << HashLog, -1);
+		const size_t matchFindEnd = srcSize - MatchFindLimit;
+		const size_t matchEnd = srcSize - LastLiterals;
+		size_t pos = 0;
+		while (pos < matchFindEnd) {
+			const uint32_t sequence = readU32(src + pos);
+			const uint32_t hashIndex = (sequence * 2654435761U) >> (32 - HashLog);
+			const int64_t candidate = hashTable[hashIndex];
+			hashTable[hashIndex] = (int64_t)(pos);
+			if ((candidate < 0) || ((pos - (size_t)(candidate)) > MaxMatchOffset) || (readU32(src + candidate) != sequence)) {
+				pos++;
+				continue;
+			}
+
+			size_t matchLength = MinMatchLength;
+			while (((pos + matchLength) < matchEnd) && (src[candidate + matchLength] == src[pos + matchLength])) {
+				matchLength++;
+			}
+
+			writeSequence(dst, src + anchor, pos - anchor, pos - (size_t)(candidate), matchLength);
+			pos += matchLength;
+			anchor = pos;
+		}
+	}
+
+	writeSequence(dst, src + anchor, srcSize - anchor, 0, 0);
+}
+
+bool RT64::ShaderArchive::decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize) {
+	const uint8_t *srcEnd = src + srcSize;
+	size_t dstPos = 0;
+	while (src < srcEnd) {
+		const uint8_t token = *src++;
+		size_t literalLength = token >> 4;
+		if ((literalLength == 15) && !readLength(src, srcEnd, literalLength)) {
+			return false;
+		}
+
+		if ((literalLength > (size_t)(srcEnd - src)) || (literalLength > (dstSize - dstPos))) {
+			return false;
+		}
+
+		if (literalLength > 0) {
+			memcpy(dst + dstPos, src, literalLength);
+		}
+
+		src += literalLength;
+		dstPos += literalLength;
+
+		// The last sequence ends right after its literals.
+		if (src == srcEnd) {
+			break;
+		}
+
+		if ((srcEnd - src) < 2) {
+			return false;
+		}
+
+		const size_t offset = (size_t)(src[0]) | ((size_t)(src[1]) << 8);
+		src += 2;
+		if ((offset == 0) || (offset > dstPos)) {
+			return false;
+		}
+
+		size_t matchLength = token & 0xF;
+		if ((matchLength == 15) && !readLength(src, srcEnd, matchLength)) {
+			return false;
+		}
+
+		matchLength += MinMatchLength;
+		if (matchLength > (dstSize - dstPos)) {
+			return false;
+		}
+
+		// Matches that overlap with the bytes they're writing must be copied one byte at a time.
+		const uint8_t *match = dst + dstPos - offset;
+		if (offset >= matchLength) {
+			memcpy(dst + dstPos, match, matchLength);
+		}
+		else {
+			for (size_t i = 0; i < matchLength; i++) {
+				dst[dstPos + i] = match[i];
+			}
+		}
+
+		dstPos += matchLength;
+	}
+
+	return dstPos == dstSize;
+}
@@ -0,0 +1,74 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Archive of all the shader bytecode the library embeds. It's built by the shaderpack tool and every shader is only
+// decompressed the first time it's requested.
+//
+// Archive layout, little endian:
+//   Header:  char magic[8], uint32 version, uint32 entryCount.
+//   Index:   entryCount x { char name[40], uint32 offset, uint32 storedSize, uint32 size, uint32 checksum, uint32 flags, uint32 reserved }.
+//   Data:    referenced by the index. Compressed entries use an LZ77 stream of sequences in the same layout as an LZ4 block.
+//
+// The checksum is the XXHash32 of the decompressed bytecode.
+
+namespace RT64 {
+	class ShaderArchive {
+	public:
+		static const uint32_t FormatVersion = 1;
+		static const size_t MaxNameLength = 40;
+
+		enum EntryFlags {
+			EntryCompressed = 0x1
+		};
+
+		struct Source {
+			std::string name;
+			std::vector<uint8_t> bytecode;
+		};
+	private:
+		struct Entry {
+			std::string name;
+			const uint8_t *storedData = nullptr;
+			uint32_t storedSize = 0;
+			uint32_t size = 0;
+			uint32_t checksum = 0;
+			uint32_t flags = 0;
+			std::once_flag decodeFlag;
+			std::atomic<bool> decoded { false };
+			std::vector<uint8_t> bytecode;
+		};
+
+		std::unique_ptr<Entry[]> entries;
+		size_t entryCount;
+		std::unordered_map<std::string, size_t> entryIndices;
+
+		void decodeEntry(Entry &entry);
+	public:
+		// The archive data must outlive the archive. Throws if the index is malformed.
+		ShaderArchive(const uint8_t *data, size_t size);
+		virtual ~ShaderArchive();
+
+		// Returns the bytecode of the shader, decompressing it first if it's the first time it's requested. Can be
+		// called from multiple threads. Throws if there's no shader with the name or if it's corrupted.
+		const std::vector<uint8_t> &get(const std::string &name);
+		size_t getEntryCount() const;
+		bool isDecoded(const std::string &name) const;
+
+		// Only used when building the archive.
+		static void build(const std::vector<Source> &sources, bool compress, std::vector<uint8_t> &archive);
+		static void compress(const uint8_t *src, size_t srcSize, std::vector<uint8_t> &dst);
+		static bool decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+	};
+};
@@ -0,0 +1,122 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// Stores values in a dense array that can be iterated in the order they were inserted, while handing out handles
+// that stay valid until the value is removed. Handles carry a generation, so a handle to a removed value is never
+// confused with the value that reuses its slot.
+//
+// Removing a value only leaves a hole in the dense array, so it's O(1). The holes are closed by compact(), which moves
+// the values that are left without changing their order. Keeping the order matters for the users that draw the values
+// in the same order they were created.
+
+namespace RT64 {
+	template<typename T>
+	class SlotMap {
+	public:
+		struct Handle {
+			uint32_t index = UINT32_MAX;
+			uint32_t generation = 0;
+		};
+	private:
+		struct Slot {
+			uint32_t valueIndex;
+			uint32_t generation;
+		};
+
+		static const uint32_t InvalidIndex = UINT32_MAX;
+
+		std::vector<T> values;
+		std::vector<uint32_t> valueSlots;
+		std::vector<Slot> slots;
+		std::vector<uint32_t> freeSlots;
+		size_t holeCount = 0;
+	public:
+		Handle insert(const T &value) {
+			Handle handle;
+			if (freeSlots.empty()) {
+				handle.index = (uint32_t)(slots.size());
+				slots.push_back({ InvalidIndex, 0 });
+			}
+			else {
+				handle.index = freeSlots.back();
+				freeSlots.pop_back();
+			}
+
+			Slot &slot = slots[handle.index];
+			slot.valueIndex = (uint32_t)(values.size());
+			handle.generation = slot.generation;
+			values.push_back(value);
+			valueSlots.push_back(handle.index);
+			return handle;
+		}
+
+		// Returns false if the handle was already removed.
+		bool remove(Handle handle) {
+			if (!contains(handle)) {
+				return false;
+			}
+
+			Slot &slot = slots[handle.index];
+			values[slot.valueIndex] = T();
+			valueSlots[slot.valueIndex] = InvalidIndex;
+			slot.valueIndex = InvalidIndex;
+			slot.generation++;
+			freeSlots.push_back(handle.index);
+			holeCount++;
+			return true;
+		}
+
+		bool contains(Handle handle) const {
+			return (handle.index < slots.size()) && (slots[handle.index].generation == handle.generation) && (slots[handle.index].valueIndex != InvalidIndex);
+		}
+
+		T *get(Handle handle) {
+			return contains(handle) ? &values[slots[handle.index].valueIndex] : nullptr;
+		}
+
+		void compact() {
+			if (holeCount == 0) {
+				return;
+			}
+
+			uint32_t dst = 0;
+			for (uint32_t src = 0; src < (uint32_t)(values.size()); src++) {
+				if (valueSlots[src] == InvalidIndex) {
+					continue;
+				}
+
+				if (dst != src) {
+					values[dst] = values[src];
+					valueSlots[dst] = valueSlots[src];
+					slots[valueSlots[dst]].valueIndex = dst;
+				}
+
+				dst++;
+			}
+
+			values.resize(dst);
+			valueSlots.resize(dst);
+			holeCount = 0;
+		}
+
+		// Removed values are left as default-constructed values until the map is compacted.
+		const std::vector<T> &getValues() const {
+			return values;
+		}
+
+		bool isCompact() const {
+			return holeCount == 0;
+		}
+
+		size_t size() const {
+			return values.size() - holeCount;
+		}
+	};
+};
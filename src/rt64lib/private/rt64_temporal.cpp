@@ -0,0 +1,148 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_temporal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+const float RT64::TemporalAccumulator::MinBlendAlpha = 0.1f;
+const float RT64::TemporalAccumulator::DepthTolerance = 0.05f;
+const unsigned int RT64::TemporalAccumulator::MaxHistoryLength = 32;
+const unsigned int RT64::TemporalAccumulator::NoInstanceId = 0xFFFF;
+
+// Public
+
+RT64::TemporalAccumulator::TemporalAccumulator() {
+	width = 0;
+	height = 0;
+	historyWidth = 0;
+	historyHeight = 0;
+	historyValid = false;
+	memset(prevViewProj, 0, sizeof(prevViewProj));
+}
+
+void RT64::TemporalAccumulator::set(int width, int height) {
+	assert((width > 0) && (height > 0));
+	this->width = width;
+	this->height = height;
+}
+
+void RT64::TemporalAccumulator::reset() {
+	historyValid = false;
+}
+
+void RT64::TemporalAccumulator::accumulate(const FrameInputs &inputs, float *outColor) {
+	assert((width > 0) && (height > 0));
+	assert((inputs.color != nullptr) && (inputs.worldPosition != nullptr) && (inputs.instanceId != nullptr));
+	assert(outColor != nullptr);
+
+	const size_t pixelCount = (size_t)(width) * height;
+	nextColor.resize(pixelCount * 4);
+	nextDepth.resize(pixelCount);
+	nextInstanceId.resize(pixelCount);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const size_t i = (size_t)(y) * width + x;
+			const float *color = &inputs.color[i * 4];
+			const float *position = &inputs.worldPosition[i * 3];
+			const float *prevPosition = (inputs.previousWorldPosition != nullptr) ? &inputs.previousWorldPosition[i * 3] : position;
+			const unsigned int instanceId = inputs.instanceId[i];
+			float clipPos[4];
+			float depth = (instanceId != NoInstanceId) ? transformPoint(inputs.viewProj, position, clipPos) : 0.0f;
+
+			// Look for a valid history sample. The history can be smaller or bigger than the frame if the size changed.
+			unsigned int historyLength = 0;
+			const float *history = nullptr;
+			Reprojection reprojection;
+			if (historyValid && (instanceId != NoInstanceId) && reproject(prevViewProj, prevPosition, historyWidth, historyHeight, reprojection)) {
+				const size_t q = (size_t)(reprojection.y) * historyWidth + (size_t)(reprojection.x);
+				if (isHistorySampleValid(instanceId, reprojection.depth, historyInstanceId[q], historyDepth[q])) {
+					history = &historyColor[q * 4];
+					historyLength = (unsigned int)(history[3]);
+				}
+			}
+
+			float *result = &nextColor[i * 4];
+			if (history != nullptr) {
+				float alpha = blendAlpha(historyLength);
+				for (int k = 0; k < 3; k++) {
+					result[k] = history[k] + (color[k] - history[k]) * alpha;
+				}
+			}
+			else {
+				memcpy(result, color, sizeof(float) * 3);
+			}
+
+			result[3] = (float)(std::min(historyLength + 1, MaxHistoryLength));
+			nextDepth[i] = depth;
+			nextInstanceId[i] = (uint16_t)(instanceId);
+
+			memcpy(&outColor[i * 4], result, sizeof(float) * 3);
+			outColor[i * 4 + 3] = color[3];
+		}
+	}
+
+	historyColor.swap(nextColor);
+	historyDepth.swap(nextDepth);
+	historyInstanceId.swap(nextInstanceId);
+	memcpy(prevViewProj, inputs.viewProj, sizeof(prevViewProj));
+	historyWidth = width;
+	historyHeight = height;
+	historyValid = true;
+}
+
+bool RT64::TemporalAccumulator::isHistoryValid() const {
+	return historyValid;
+}
+
+float RT64::TemporalAccumulator::transformPoint(const float matrix[16], const float position[3], float clipPos[4]) {
+	for (int j = 0; j < 4; j++) {
+		clipPos[j] = position[0] * matrix[j] + position[1] * matrix[4 + j] + position[2] * matrix[8 + j] + matrix[12 + j];
+	}
+
+	return clipPos[3];
+}
+
+bool RT64::TemporalAccumulator::reproject(const float prevViewProj[16], const float position[3], int width, int height, Reprojection &result) {
+	float clipPos[4];
+	transformPoint(prevViewProj, position, clipPos);
+
+	// Behind the previous camera.
+	if (clipPos[3] <= 0.0f) {
+		return false;
+	}
+
+	// Invert the mapping used by the ray generation shader to build the ray direction.
+	float ndcX = clipPos[0] / clipPos[3];
+	float ndcY = clipPos[1] / clipPos[3];
+	float px = floorf((ndcX * 0.5f + 0.5f) * width);
+	float py = floorf((0.5f - ndcY * 0.5f) * height);
+	if ((px < 0.0f) || (px >= width) || (py < 0.0f) || (py >= height)) {
+		return false;
+	}
+
+	result.x = px;
+	result.y = py;
+	result.depth = clipPos[3];
+	return true;
+}
+
+bool RT64::TemporalAccumulator::isHistorySampleValid(unsigned int instanceId, float expectedDepth, unsigned int historyInstanceId, float historyDepth) {
+	if ((instanceId == NoInstanceId) || (instanceId != historyInstanceId)) {
+		return false;
+	}
+
+	return fabsf(expectedDepth - historyDepth) <= (DepthTolerance * std::max(expectedDepth, historyDepth));
+}
+
+float RT64::TemporalAccumulator::blendAlpha(unsigned int historyLength) {
+	return std::max(1.0f / (historyLength + 1), MinBlendAlpha);
+}
+
+#endif
@@ -0,0 +1,86 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU reference of the temporal accumulation done by the ray generation shader in Tracer.hlsl. The constants
+// and the math must be kept in sync with the shader so synthetic scenes can be used to verify the reprojection
+// and the history rejection heuristics without a GPU.
+//
+// Matrices are stored in the same memory layout as DirectXMath and transform row vectors (position * matrix).
+
+namespace RT64 {
+	class TemporalAccumulator {
+	public:
+		// Weight of the current frame once the history is long enough.
+		static const float MinBlendAlpha;
+
+		// Maximum relative difference between the reprojected depth and the depth stored in the history.
+		static const float DepthTolerance;
+
+		// Maximum amount of frames the history can represent.
+		static const unsigned int MaxHistoryLength;
+
+		// Instance ID stored on pixels where nothing was hit.
+		static const unsigned int NoInstanceId;
+
+		struct Reprojection {
+			float x;
+			float y;
+			float depth;
+		};
+
+		struct FrameInputs {
+			// RGBA32F color, XYZ world position (three floats per pixel) and the instance ID of the closest hit.
+			// The previous world position is optional and accounts for the motion of the instances. The current
+			// world position is reprojected instead if it's not provided.
+			const float *color = nullptr;
+			const float *worldPosition = nullptr;
+			const float *previousWorldPosition = nullptr;
+			const uint16_t *instanceId = nullptr;
+			float viewProj[16];
+		};
+	private:
+		int width;
+		int height;
+		int historyWidth;
+		int historyHeight;
+		bool historyValid;
+		float prevViewProj[16];
+		std::vector<float> historyColor;
+		std::vector<float> historyDepth;
+		std::vector<uint16_t> historyInstanceId;
+		std::vector<float> nextColor;
+		std::vector<float> nextDepth;
+		std::vector<uint16_t> nextInstanceId;
+	public:
+		TemporalAccumulator();
+
+		// The history is kept when the size changes and it's reprojected into the new size on the next frame, like the
+		// view does when the dynamic resolution changes the region that is traced.
+		void set(int width, int height);
+		void reset();
+
+		// Blends the frame with the history and writes the result to outColor (RGBA32F). Alpha is not blended.
+		void accumulate(const FrameInputs &inputs, float *outColor);
+		bool isHistoryValid() const;
+
+		// Transforms a world position with the given matrix and returns the view depth, which is the W component of the result.
+		static float transformPoint(const float matrix[16], const float position[3], float clipPos[4]);
+
+		// Projects a world position with the previous frame's view projection matrix and returns the pixel it
+		// was visible at. The pixel mapping is the inverse of the ray direction computed in the ray generation shader.
+		static bool reproject(const float prevViewProj[16], const float position[3], int width, int height, Reprojection &result);
+
+		// Rejects history samples that belong to another instance or that were occluded in the previous frame.
+		static bool isHistorySampleValid(unsigned int instanceId, float expectedDepth, unsigned int historyInstanceId, float historyDepth);
+
+		// Weight of the current frame for a given history length.
+		static float blendAlpha(unsigned int historyLength);
+	};
+};
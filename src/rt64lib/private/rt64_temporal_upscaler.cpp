@@ -0,0 +1,233 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_temporal_upscaler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+const float RT64::TemporalUpscaler::KernelSharpness = 2.29f;
+const float RT64::TemporalUpscaler::MaxHistoryWeight = 8.0f;
+const float RT64::TemporalUpscaler::ClampDeviations = 1.5f;
+const unsigned int RT64::TemporalUpscaler::JitterPhasesPerPixel = 8;
+
+// Private
+
+void RT64::TemporalUpscaler::sampleHistory(float x, float y, float color[4], float &weight) const {
+	memset(color, 0, sizeof(float) * 4);
+	weight = 0.0f;
+
+	// The position is in pixels and the centers of the pixels are at half coordinates.
+	if ((x < 0.0f) || (x >= width) || (y < 0.0f) || (y >= height)) {
+		return;
+	}
+
+	// The color is resampled with a Catmull-Rom filter, since the blur of a bilinear filter would add up over the frames.
+	// The weight is only interpolated bilinearly so it can't become negative.
+	const float fx = x - 0.5f;
+	const float fy = y - 0.5f;
+	const int x0 = (int)(floorf(fx));
+	const int y0 = (int)(floorf(fy));
+	const float tx = fx - x0;
+	const float ty = fy - y0;
+	float wx[4], wy[4];
+	catmullRomWeights(tx, wx);
+	catmullRomWeights(ty, wy);
+	for (int j = 0; j < 4; j++) {
+		const int sy = std::min(std::max(y0 - 1 + j, 0), height - 1);
+		for (int i = 0; i < 4; i++) {
+			const int sx = std::min(std::max(x0 - 1 + i, 0), width - 1);
+			const size_t q = (size_t)(sy) * width + sx;
+			const float w = wx[i] * wy[j];
+			for (int k = 0; k < 4; k++) {
+				color[k] += historyColor[q * 4 + k] * w;
+			}
+
+			if (((i == 1) || (i == 2)) && ((j == 1) || (j == 2))) {
+				weight += historyWeight[q] * ((i == 2) ? tx : (1.0f - tx)) * ((j == 2) ? ty : (1.0f - ty));
+			}
+		}
+	}
+}
+
+// Public
+
+RT64::TemporalUpscaler::TemporalUpscaler() {
+	width = 0;
+	height = 0;
+	historyValid = false;
+}
+
+void RT64::TemporalUpscaler::set(int width, int height) {
+	assert((width > 0) && (height > 0));
+	if ((this->width == width) && (this->height == height)) {
+		return;
+	}
+
+	this->width = width;
+	this->height = height;
+
+	const size_t pixelCount = (size_t)(width) * height;
+	historyColor.resize(pixelCount * 4);
+	historyWeight.resize(pixelCount);
+	nextColor.resize(pixelCount * 4);
+	nextWeight.resize(pixelCount);
+	reset();
+}
+
+void RT64::TemporalUpscaler::reset() {
+	historyValid = false;
+}
+
+void RT64::TemporalUpscaler::upscale(const FrameInputs &inputs, float *outColor) {
+	assert((width > 0) && (height > 0));
+	assert((inputs.color != nullptr) && (inputs.width > 0) && (inputs.height > 0));
+	assert(outColor != nullptr);
+
+	const size_t colorRowPitch = (inputs.colorRowPitch > 0) ? inputs.colorRowPitch : (size_t)(inputs.width) * sizeof(float) * 4;
+	const size_t motionRowPitch = (inputs.motionRowPitch > 0) ? inputs.motionRowPitch : (size_t)(inputs.width) * sizeof(float) * 2;
+	auto inputColor = [&](int x, int y) {
+		return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(inputs.color) + colorRowPitch * y) + x * 4;
+	};
+
+	auto inputMotion = [&](int x, int y) {
+		return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(inputs.motion) + motionRowPitch * y) + x * 2;
+	};
+
+	const float scaleX = (float)(width) / inputs.width;
+	const float scaleY = (float)(height) / inputs.height;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			// Find the sample closest to the center of the output pixel.
+			const float ix = (x + 0.5f) / scaleX;
+			const float iy = (y + 0.5f) / scaleY;
+			const int cx = std::min(std::max((int)(floorf(ix - inputs.jitterX)), 0), inputs.width - 1);
+			const int cy = std::min(std::max((int)(floorf(iy - inputs.jitterY)), 0), inputs.height - 1);
+
+			// Filter the samples around it and gather the statistics of the neighborhood.
+			float current[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float meanSq[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float currentWeight = 0.0f;
+			int sampleCount = 0;
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					const int sx = cx + dx;
+					const int sy = cy + dy;
+					if ((sx < 0) || (sx >= inputs.width) || (sy < 0) || (sy >= inputs.height)) {
+						continue;
+					}
+
+					const float *c = inputColor(sx, sy);
+					const float w = sampleWeight((sx + 0.5f + inputs.jitterX - ix) * scaleX, (sy + 0.5f + inputs.jitterY - iy) * scaleY);
+					for (int k = 0; k < 4; k++) {
+						current[k] += c[k] * w;
+						mean[k] += c[k];
+						meanSq[k] += c[k] * c[k];
+					}
+
+					currentWeight += w;
+					sampleCount++;
+				}
+			}
+
+			if (currentWeight > 0.0f) {
+				for (int k = 0; k < 4; k++) {
+					current[k] /= currentWeight;
+				}
+			}
+			else {
+				memcpy(current, inputColor(cx, cy), sizeof(float) * 4);
+			}
+
+			// Reproject the center of the output pixel with the motion of the closest sample.
+			float history[4];
+			float weight = 0.0f;
+			if (historyValid) {
+				float motionX = 0.0f;
+				float motionY = 0.0f;
+				if (inputs.motion != nullptr) {
+					const float *m = inputMotion(cx, cy);
+					motionX = m[0];
+					motionY = m[1];
+				}
+
+				sampleHistory(x + 0.5f + motionX * scaleX, y + 0.5f + motionY * scaleY, history, weight);
+			}
+
+			// Clamp the history to the colors around the pixel to reject it where it's no longer visible.
+			float *result = &nextColor[((size_t)(y) * width + x) * 4];
+			weight = std::min(weight, MaxHistoryWeight);
+			for (int k = 0; k < 4; k++) {
+				const float m = mean[k] / sampleCount;
+				const float deviation = sqrtf(std::max(meanSq[k] / sampleCount - m * m, 0.0f)) * ClampDeviations;
+				const float h = std::min(std::max(history[k], m - deviation), m + deviation);
+				result[k] = (weight > 0.0f) ? ((h * weight + current[k] * currentWeight) / (weight + currentWeight)) : current[k];
+			}
+
+			nextWeight[(size_t)(y) * width + x] = weight + currentWeight;
+			memcpy(&outColor[((size_t)(y) * width + x) * 4], result, sizeof(float) * 4);
+		}
+	}
+
+	historyColor.swap(nextColor);
+	historyWeight.swap(nextWeight);
+	historyValid = true;
+}
+
+bool RT64::TemporalUpscaler::isHistoryValid() const {
+	return historyValid;
+}
+
+int RT64::TemporalUpscaler::getWidth() const {
+	return width;
+}
+
+int RT64::TemporalUpscaler::getHeight() const {
+	return height;
+}
+
+unsigned int RT64::TemporalUpscaler::jitterPhaseCount(int inputWidth, int inputHeight, int outputWidth, int outputHeight) {
+	assert((inputWidth > 0) && (inputHeight > 0));
+	const double ratio = ((double)(outputWidth) * outputHeight) / ((double)(inputWidth) * inputHeight);
+	return JitterPhasesPerPixel * (unsigned int)(std::max(std::round(ratio), 1.0));
+}
+
+void RT64::TemporalUpscaler::jitterOffset(unsigned int frameIndex, unsigned int phaseCount, float &x, float &y) {
+	// The first element of the sequence is skipped since it's always zero.
+	const unsigned int index = (frameIndex % std::max(phaseCount, 1U)) + 1;
+	x = halton(index, 2) - 0.5f;
+	y = halton(index, 3) - 0.5f;
+}
+
+float RT64::TemporalUpscaler::halton(unsigned int index, unsigned int base) {
+	float result = 0.0f;
+	float fraction = 1.0f;
+	while (index > 0) {
+		fraction /= base;
+		result += fraction * (index % base);
+		index /= base;
+	}
+
+	return result;
+}
+
+void RT64::TemporalUpscaler::catmullRomWeights(float t, float weights[4]) {
+	const float t2 = t * t;
+	const float t3 = t2 * t;
+	weights[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+	weights[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+	weights[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+	weights[3] = 0.5f * (t3 - t2);
+}
+
+float RT64::TemporalUpscaler::sampleWeight(float dx, float dy) {
+	return expf(-KernelSharpness * (dx * dx + dy * dy));
+}
+
+#endif
@@ -0,0 +1,83 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU reference of the temporal upscaler in UpscalePS.hlsl. The primary rays are jittered inside their pixel every
+// frame, and every pixel of the output gathers the samples closest to it and blends them with its history, which
+// is found with the motion vectors. Over a few frames the output accumulates samples from every position inside
+// its area, so it can have more detail than a single low resolution frame. The constants and the math must be kept
+// in sync with the shader so the reconstruction can be verified against reference images without a GPU.
+//
+// Colors are premultiplied RGBA32F and all four channels are reconstructed the same way.
+
+namespace RT64 {
+	class TemporalUpscaler {
+	public:
+		// Falloff of the weight of a sample with its squared distance to the center of the output pixel, in output pixels.
+		static const float KernelSharpness;
+
+		// Maximum weight the history can have against the samples of the current frame.
+		static const float MaxHistoryWeight;
+
+		// Amount of standard deviations of the neighborhood the history can be away from its mean.
+		static const float ClampDeviations;
+
+		// Different jitter positions used for each output pixel covered by a sample.
+		static const unsigned int JitterPhasesPerPixel;
+
+		struct FrameInputs {
+			// Color and motion vectors of the samples traced this frame. The motion vectors point from each sample
+			// to its position in the previous frame, in input pixels, and are optional. Row pitches are in bytes
+			// and can be zero if the rows are tightly packed.
+			const float *color = nullptr;
+			const float *motion = nullptr;
+			size_t colorRowPitch = 0;
+			size_t motionRowPitch = 0;
+			int width = 0;
+			int height = 0;
+
+			// Offset of the samples from the center of their pixels, in input pixels.
+			float jitterX = 0.0f;
+			float jitterY = 0.0f;
+		};
+	private:
+		int width;
+		int height;
+		bool historyValid;
+		std::vector<float> historyColor;
+		std::vector<float> historyWeight;
+		std::vector<float> nextColor;
+		std::vector<float> nextWeight;
+
+		void sampleHistory(float x, float y, float color[4], float &weight) const;
+	public:
+		TemporalUpscaler();
+		void set(int width, int height);
+		void reset();
+
+		// Reconstructs the frame at the output resolution and writes it to outColor (RGBA32F, tightly packed).
+		void upscale(const FrameInputs &inputs, float *outColor);
+		bool isHistoryValid() const;
+		int getWidth() const;
+		int getHeight() const;
+
+		// Amount of jitter positions to cycle through so every output pixel gets samples from all over its area.
+		static unsigned int jitterPhaseCount(int inputWidth, int inputHeight, int outputWidth, int outputHeight);
+
+		// Jitter of the given frame, in the range [-0.5, 0.5). It follows the Halton sequence in bases 2 and 3.
+		static void jitterOffset(unsigned int frameIndex, unsigned int phaseCount, float &x, float &y);
+		static float halton(unsigned int index, unsigned int base);
+
+		// Weights of the four texels around a position with the given fraction for a Catmull-Rom filter.
+		static void catmullRomWeights(float t, float weights[4]);
+
+		// Weight of a sample at the given offset from the center of the output pixel, in output pixels.
+		static float sampleWeight(float dx, float dy);
+	};
+};
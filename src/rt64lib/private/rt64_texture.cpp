@@ -13,48 +13,22 @@
 // Private
 
 RT64::Texture::Texture(Device *device, const void *bytes, int width, int height, int stride) {
-	assert(bytes != nullptr);
-
 	this->device = device;
+	this->height = height;
 
 	UINT rowWidth, rowPadding;
 	CalculateTextureRowWidthPadding(width, stride, rowWidth, rowPadding);
+	rowPitch = rowWidth;
 
-	{
-		// Describe the texture
-		D3D12_RESOURCE_DESC textureDesc = {};
-		textureDesc.Width = width;
-		textureDesc.Height = height;
-		textureDesc.MipLevels = 1;
-		textureDesc.DepthOrArraySize = 1;
-		textureDesc.SampleDesc.Count = 1;
-		textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-
-		// Create the texture resource
-		texture = device->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
-
-		// Describe the resource
-		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Width = (rowWidth * height);
-		resourceDesc.Height = 1;
-		resourceDesc.DepthOrArraySize = 1;
-		resourceDesc.MipLevels = 1;
-		resourceDesc.SampleDesc.Count = 1;
-		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-
-		// Create the upload heap
-		textureUpload = device->allocateResource(D3D12_HEAP_TYPE_UPLOAD, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr);
-	}
+	// Create the texture and the buffer used to upload it.
+	RenderDevice *renderDevice = device->getRenderDevice();
+	texture = renderDevice->createTexture(RenderTextureDesc::Texture2D(width, height, RenderFormat::R8G8B8A8_UNORM));
+	textureUpload = device->createUploadBuffer((uint64_t)(rowPitch) * height);
 
 	// Upload texture.
-	{
+	if (bytes != nullptr) {
 		// Copy the pixel data to the upload heap resource
-		UINT8* pData;
-		textureUpload.Get()->Map(0, nullptr, reinterpret_cast<void**>(&pData));
-
+		UINT8 *pData = (UINT8 *)(textureUpload->map());
 		if (rowPadding == 0) {
 			memcpy(pData, bytes, width * height * stride);
 		}
@@ -65,56 +39,46 @@ RT64::Texture::Texture(Device *device, const void *bytes, int width, int height,
 			}
 		}
 
-		textureUpload.Get()->Unmap(0, nullptr);
-
-		// Describe the upload heap resource location for the copy
-		D3D12_SUBRESOURCE_FOOTPRINT subresource = {};
-		subresource.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		subresource.Width = width;
-		subresource.Height = height;
-		subresource.RowPitch = rowWidth;
-		subresource.Depth = 1;
-
-		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-		footprint.Offset = 0;
-		//footprint.Offset = texture.offset;
-		footprint.Footprint = subresource;
-		
-		D3D12_TEXTURE_COPY_LOCATION source = {};
-		source.pResource = textureUpload.Get();
-		source.PlacedFootprint = footprint;
-		source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-
-		// Describe the default heap resource location for the copy
-		D3D12_TEXTURE_COPY_LOCATION destination = {};
-		destination.pResource = texture.Get();
-		destination.SubresourceIndex = 0;
-		destination.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-
-		// Reset the command list.
-		auto d3dCommandList = device->getD3D12CommandList();
-		
-		// Copy the buffer resource from the upload heap to the texture resource on the default heap.
-		d3dCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
-		
-		// Transition the texture to a shader resource.
-		D3D12_RESOURCE_BARRIER barrier = {};
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		barrier.Transition.pResource = texture.Get();
-		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		device->setLastCopyQueueBarrier(barrier);
+		unmapUpload();
 	}
+	else {
+		// The host is expected to upload the contents later, but the texture must be readable in the meantime.
+		device->addCopyQueueBarrier(texture, RenderTextureAccess::ShaderRead);
+	}
+
+	device->getCounters()->textureCount++;
 }
 
 RT64::Texture::~Texture() {
-	texture.Release();
-	textureUpload.Release();
+	device->getCounters()->textureCount--;
+	device->cancelCopyQueueBarrier(texture);
+
+	// Copies and draws that use the texture might've been recorded already.
+	device->retire(texture);
+	device->retireUploadBuffer(textureUpload);
+}
+
+RT64::RenderTexture *RT64::Texture::getTexture() const {
+	return texture;
+}
+
+void *RT64::Texture::mapUpload(uint32_t *rowPitch) {
+	assert(rowPitch != nullptr);
+	*rowPitch = this->rowPitch;
+	return textureUpload->map();
 }
 
-ID3D12Resource *RT64::Texture::getTexture() {
-	return texture.Get();
+void RT64::Texture::unmapUpload() {
+	textureUpload->unmap();
+	device->getCounters()->bytesUploaded += (uint64_t)(rowPitch) * height;
+
+	// Copy the buffer resource from the upload heap to the texture resource on the default heap.
+	RenderCommandList *commandList = device->getRenderDevice()->getCommandList();
+	commandList->barrier(texture, RenderTextureAccess::CopyDest);
+	commandList->copyBufferToTexture(texture, textureUpload, 0, rowPitch);
+
+	// Transition the texture to a shader resource.
+	device->addCopyQueueBarrier(texture, RenderTextureAccess::ShaderRead);
 }
 
 // Public
@@ -124,6 +88,26 @@ DLLEXPORT RT64_TEXTURE *RT64_CreateTextureFromRGBA8(RT64_DEVICE *devicePtr, cons
 	return (RT64_TEXTURE *)(new RT64::Texture(device, bytes, width, height, stride));
 }
 
+DLLEXPORT void *RT64_MapTextureUpload(RT64_TEXTURE *texturePtr, unsigned int *rowPitch) {
+	assert(texturePtr != nullptr);
+	assert(rowPitch != nullptr);
+	try {
+		RT64::Texture *texture = (RT64::Texture *)(texturePtr);
+		return texture->mapUpload(rowPitch);
+	}
+	RT64_CATCH_EXCEPTION();
+	return nullptr;
+}
+
+DLLEXPORT void RT64_UnmapTextureUpload(RT64_TEXTURE *texturePtr) {
+	assert(texturePtr != nullptr);
+	try {
+		RT64::Texture *texture = (RT64::Texture *)(texturePtr);
+		texture->unmapUpload();
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
 DLLEXPORT void RT64_DestroyTexture(RT64_TEXTURE *texturePtr) {
 	delete (RT64::Texture *)(texturePtr);
 }
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "rt64_common.h"
+#include "rt64_render_interface.h"
 
 namespace RT64 {
 	class Device;
@@ -12,11 +13,18 @@ namespace RT64 {
 	class Texture {
 	private:
 		Device *device;
-		AllocatedResource texture;
-		AllocatedResource textureUpload;
+		RenderTexture *texture;
+		RenderBuffer *textureUpload;
+		int height;
+		uint32_t rowPitch;
 	public:
+		// The contents are undefined if no bytes are given until the texture is uploaded with mapUpload().
 		Texture(Device *device, const void *bytes, int width, int height, int stride);
 		virtual ~Texture();
-		ID3D12Resource *getTexture();
+		RenderTexture *getTexture() const;
+
+		// Rows must be written with the returned pitch, which includes the padding required for copying them to the texture.
+		void *mapUpload(uint32_t *rowPitch);
+		void unmapUpload();
 	};
-};
\ No newline at end of file
+};
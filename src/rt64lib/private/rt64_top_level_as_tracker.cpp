@@ -0,0 +1,124 @@
+//
+// RT64
+//
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_top_level_as_tracker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	// Used instead of the extent when all the instances are at the same position.
+	const float MinExtent = 1.0f;
+};
+
+// Private
+
+void RT64::TopLevelASTracker::fillStates(const RenderTopLevelASInstance *instances, const uint32_t *bottomLevelASVersions, size_t count, std::vector<InstanceState> &states) {
+	states.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		InstanceState &state = states[i];
+		state.bottomLevelASAddress = instances[i].bottomLevelASAddress;
+		state.bottomLevelASVersion = bottomLevelASVersions[i];
+		state.flags = instances[i].flags;
+		memcpy(state.transform, instances[i].transform, sizeof(state.transform));
+	}
+}
+
+// Public
+
+RT64::TopLevelASTracker::TopLevelASTracker() {
+	builtExtent = MinExtent;
+	refitCount = 0;
+	valid = false;
+}
+
+void RT64::TopLevelASTracker::setSettings(const Settings &settings) {
+	this->settings = settings;
+}
+
+const RT64::TopLevelASTracker::Settings &RT64::TopLevelASTracker::getSettings() const {
+	return settings;
+}
+
+RT64::TopLevelASTracker::Action RT64::TopLevelASTracker::update(const RenderTopLevelASInstance *instances, const uint32_t *bottomLevelASVersions, size_t count) {
+	assert((instances != nullptr) || (count == 0));
+	assert((bottomLevelASVersions != nullptr) || (count == 0));
+
+	bool sameLayout = valid && (count == lastInstances.size());
+	bool unchanged = sameLayout;
+	for (size_t i = 0; (i < count) && sameLayout; i++) {
+		const InstanceState &last = lastInstances[i];
+		sameLayout = (last.bottomLevelASAddress == instances[i].bottomLevelASAddress) && (last.flags == instances[i].flags);
+		unchanged = unchanged && sameLayout && (last.bottomLevelASVersion == bottomLevelASVersions[i]) && (memcmp(last.transform, instances[i].transform, sizeof(last.transform)) == 0);
+	}
+
+	if (unchanged) {
+		return Action::None;
+	}
+
+	fillStates(instances, bottomLevelASVersions, count, lastInstances);
+
+	if (sameLayout && (refitCount < settings.maxRefits) && (estimateDegradation(instances, count) <= settings.maxDegradation)) {
+		refitCount++;
+		return Action::Refit;
+	}
+
+	// Store the instances and the extent of their positions as the reference for the next refits.
+	builtInstances = lastInstances;
+	float minPos[3] = { INFINITY, INFINITY, INFINITY };
+	float maxPos[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (size_t i = 0; i < count; i++) {
+		for (int c = 0; c < 3; c++) {
+			minPos[c] = std::min(minPos[c], instances[i].transform[c][3]);
+			maxPos[c] = std::max(maxPos[c], instances[i].transform[c][3]);
+		}
+	}
+
+	float extentSq = 0.0f;
+	for (int c = 0; (c < 3) && (count > 0); c++) {
+		extentSq += (maxPos[c] - minPos[c]) * (maxPos[c] - minPos[c]);
+	}
+
+	builtExtent = std::max(sqrtf(extentSq), MinExtent);
+	refitCount = 0;
+	valid = true;
+	return Action::Build;
+}
+
+void RT64::TopLevelASTracker::invalidate() {
+	valid = false;
+}
+
+unsigned int RT64::TopLevelASTracker::getRefitCount() const {
+	return refitCount;
+}
+
+float RT64::TopLevelASTracker::estimateDegradation(const RenderTopLevelASInstance *instances, size_t count) const {
+	assert(count == builtInstances.size());
+
+	float degradation = 0.0f;
+	for (size_t i = 0; i < count; i++) {
+		const float (&built)[3][4] = builtInstances[i].transform;
+		const float (&current)[3][4] = instances[i].transform;
+		float translationSq = 0.0f;
+		float basisDifference = 0.0f;
+		for (int r = 0; r < 3; r++) {
+			const float dt = current[r][3] - built[r][3];
+			translationSq += dt * dt;
+			for (int c = 0; c < 3; c++) {
+				basisDifference = std::max(basisDifference, fabsf(current[r][c] - built[r][c]));
+			}
+		}
+
+		degradation = std::max(degradation, (sqrtf(translationSq) / builtExtent) + basisDifference);
+	}
+
+	return degradation;
+}
+
+#endif
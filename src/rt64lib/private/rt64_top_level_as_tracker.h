@@ -0,0 +1,72 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rt64_render_interface.h"
+
+// Decides how the top-level AS of a scene must be updated from one frame to the next. A refit keeps the hierarchy
+// that was built and only recomputes its bounds, so it's only possible when the instances reference the same bottom
+// level ASes in the same order with the same flags. The hierarchy gets worse the more the instances move away from
+// where they were when it was built, so a full build is done again once the estimated degradation or the amount of
+// refits in a row goes over the limits.
+//
+// The tracker has no dependencies on the graphics API so the decisions can be verified without a GPU.
+
+namespace RT64 {
+	class TopLevelASTracker {
+	public:
+		enum class Action {
+			// Nothing changed since the last frame, so the previous top-level AS can be used as it is.
+			None,
+			Refit,
+			Build
+		};
+
+		struct Settings {
+			// Amount of refits in a row before a full build is forced.
+			unsigned int maxRefits = 120;
+
+			// Full builds are forced when the degradation goes over this value. See estimateDegradation().
+			float maxDegradation = 0.25f;
+		};
+	private:
+		struct InstanceState {
+			uint64_t bottomLevelASAddress;
+			uint32_t bottomLevelASVersion;
+			uint32_t flags;
+			float transform[3][4];
+		};
+
+		Settings settings;
+		std::vector<InstanceState> builtInstances;
+		std::vector<InstanceState> lastInstances;
+		float builtExtent;
+		unsigned int refitCount;
+		bool valid;
+
+		static void fillStates(const RenderTopLevelASInstance *instances, const uint32_t *bottomLevelASVersions, size_t count, std::vector<InstanceState> &states);
+	public:
+		TopLevelASTracker();
+		void setSettings(const Settings &settings);
+		const Settings &getSettings() const;
+
+		// Compares the instances against the previous frame and returns what must be done with the top-level AS. The
+		// versions must change whenever a bottom-level AS is built or updated, even if its address is the same.
+		Action update(const RenderTopLevelASInstance *instances, const uint32_t *bottomLevelASVersions, size_t count);
+
+		// Forces the next update to be a full build. Must be called when the top-level AS's buffers are recreated.
+		void invalidate();
+		unsigned int getRefitCount() const;
+
+		// How much the instances have moved since the last full build. The translation is relative to the extent of
+		// the instances' positions when the hierarchy was built, and any change in rotation or scale is added as the
+		// largest difference between the elements of the matrices. Only the instance that moved the most counts.
+		float estimateDegradation(const RenderTopLevelASInstance *instances, size_t count) const;
+	};
+};
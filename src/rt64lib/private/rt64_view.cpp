@@ -9,11 +9,14 @@
 #include <map>
 #include <set>
 
+#include "rt64_cpu_denoiser.h"
 #include "rt64_denoiser.h"
 #include "rt64_device.h"
 #include "rt64_instance.h"
+#include "rt64_interleaved_reconstructor.h"
 #include "rt64_mesh.h"
 #include "rt64_scene.h"
+#include "rt64_temporal_upscaler.h"
 #include "rt64_texture.h"
 #include "rt64_view.h"
 
@@ -21,36 +24,179 @@
 #include "xxhash/xxhash32.h"
 
 namespace {
-	const int MaxQueries = 16 + 1;
+	const int MaxHitQueries = 16;
+	const int HitRecordSize = 16;
+
+	// Layout of the compose heap. The output is either composed directly or through the history the upscaler wrote
+	// to, and the upscaler reads the output, the motion vectors and the history it doesn't write to.
+	const int ComposeOutputDescriptor = 0;
+	const int ComposeUpscaledDescriptor = 1;
+	const int UpscaleInputsDescriptor = 3;
+	const int UpscaleInputCount = 4;
+
+	// The reconstruction reads the history it doesn't write to and fills the output buffers of the tracer.
+	const int ReconstructInputsDescriptor = UpscaleInputsDescriptor + UpscaleInputCount * 2;
+	const int ReconstructInputCount = 11;
+	const int ComposeHeapSize = ReconstructInputsDescriptor + ReconstructInputCount * 2;
 };
 
 // Private
 
-RT64::View::View(Scene *scene) {
+RT64::View::InstanceQueryBackend::InstanceQueryBackend(View *view) {
+	this->view = view;
+	for (unsigned int s = 0; s < InstanceQueryQueue::SlotCount; s++) {
+		fenceValues[s] = 0;
+	}
+}
+
+void RT64::View::InstanceQueryBackend::release() {
+	for (unsigned int s = 0; s < InstanceQueryQueue::SlotCount; s++) {
+		view->scene->getDevice()->retire(readbacks[s]);
+		instances[s].clear();
+	}
+}
+
+UINT64 RT64::View::InstanceQueryBackend::getAllocatedBytes() const {
+	UINT64 bytes = 0;
+	for (unsigned int s = 0; s < InstanceQueryQueue::SlotCount; s++) {
+		if (!readbacks[s].IsNull()) {
+			bytes += readbacks[s].Get()->GetDesc().Width;
+		}
+	}
+
+	return bytes;
+}
+
+void RT64::View::InstanceQueryBackend::beginSlot(unsigned int slot) {
+	// Every region is stored as RegionSize rows with the minimum pitch. This also keeps the offset of each region aligned.
+	if (readbacks[slot].IsNull()) {
+		const UINT64 readbackSize = (UINT64)(InstanceQueryQueue::MaxRegionsPerSlot) * InstanceQueryQueue::RegionSize * D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+		readbacks[slot] = view->scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_READBACK, readbackSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+	}
+
+	auto d3dCommandList = view->scene->getDevice()->getD3D12CommandList();
+	CD3DX12_RESOURCE_BARRIER rtBarrier = CD3DX12_RESOURCE_BARRIER::Transition(view->rtInstanceId.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	d3dCommandList->ResourceBarrier(1, &rtBarrier);
+}
+
+void RT64::View::InstanceQueryBackend::copyRegion(unsigned int slot, unsigned int regionIndex, int x, int y, int width, int height) {
+	D3D12_TEXTURE_COPY_LOCATION dstLocation = {};
+	dstLocation.pResource = readbacks[slot].Get();
+	dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	dstLocation.PlacedFootprint.Offset = (UINT64)(regionIndex) * InstanceQueryQueue::RegionSize * D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+	dstLocation.PlacedFootprint.Footprint.Format = DXGI_FORMAT_R16_UINT;
+	dstLocation.PlacedFootprint.Footprint.Width = width;
+	dstLocation.PlacedFootprint.Footprint.Height = height;
+	dstLocation.PlacedFootprint.Footprint.Depth = 1;
+	dstLocation.PlacedFootprint.Footprint.RowPitch = D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+
+	CD3DX12_TEXTURE_COPY_LOCATION srcLocation(view->rtInstanceId.Get(), 0);
+	CD3DX12_BOX srcBox(x, y, x + width, y + height);
+	view->scene->getDevice()->getD3D12CommandList()->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, &srcBox);
+}
+
+void RT64::View::InstanceQueryBackend::endSlot(unsigned int slot) {
+	auto d3dCommandList = view->scene->getDevice()->getD3D12CommandList();
+	CD3DX12_RESOURCE_BARRIER rtBarrier = CD3DX12_RESOURCE_BARRIER::Transition(view->rtInstanceId.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	d3dCommandList->ResourceBarrier(1, &rtBarrier);
+
+	// The IDs in the buffer are indices into the instances of the last frame that was traced, which aren't the ones
+	// the scene holds anymore if it was updated since.
+	instances[slot] = view->tracedInstances;
+
+	// The copies are done once the GPU reaches the fence that's signaled at the end of this frame.
+	fenceValues[slot] = view->scene->getDevice()->getFenceValue();
+}
+
+bool RT64::View::InstanceQueryBackend::isSlotComplete(unsigned int slot) {
+	return view->scene->getDevice()->getCompletedFenceValue() >= fenceValues[slot];
+}
+
+void RT64::View::InstanceQueryBackend::readSlot(unsigned int slot, unsigned int regionCount, uint16_t *ids) {
+	const int regionSize = InstanceQueryQueue::RegionSize;
+	const size_t readSize = (size_t)(regionCount) * regionSize * D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+	D3D12_RANGE readRange = { 0, readSize };
+	uint8_t *pData;
+	D3D12_CHECK(readbacks[slot].Get()->Map(0, &readRange, (void **)(&pData)));
+	for (unsigned int r = 0; r < regionCount; r++) {
+		for (int row = 0; row < regionSize; row++) {
+			const uint8_t *rowData = pData + ((size_t)(r) * regionSize + row) * D3D12_TEXTURE_DATA_PITCH_ALIGNMENT;
+			memcpy(ids + ((size_t)(r) * regionSize + row) * regionSize, rowData, regionSize * sizeof(uint16_t));
+		}
+	}
+
+	D3D12_RANGE writtenRange = { 0, 0 };
+	readbacks[slot].Get()->Unmap(0, &writtenRange);
+}
+
+void *RT64::View::InstanceQueryBackend::getInstance(unsigned int slot, uint16_t instanceId) {
+	// The handle is only resolved now, so an instance destroyed while the query was in flight resolves to nothing.
+	return (instanceId < instances[slot].size()) ? view->scene->findInstance(instances[slot][instanceId]) : nullptr;
+}
+
+RT64::View::View(Scene *scene) : instanceQueryBackend(this), instanceQueries(&instanceQueryBackend) {
 	assert(scene != nullptr);
 	this->scene = scene;
-	descriptorHeap = nullptr;
-	descriptorHeapEntryCount = 0;
+	descriptorSet = nullptr;
 	composeHeap = nullptr;
+	upscaleRtvHeap = nullptr;
+	reconstructRtvHeap = nullptr;
 	sbtStorageSize = 0;
-	activeInstancesBufferPropsSize = 0;
 	viewParamsBufferData.randomSeed = 0;
 	viewParamsBufferData.softLightSamples = 0;
 	viewParamsBufferData.giBounces = 0;
 	viewParamsBufferData.maxLightSamples = 12;
 	viewParamsBufferData.ambGIMixWeight = 0.8f;
 	viewParamsBufferData.frameCount = 0;
+	viewParamsBufferData.maxHitQueries = MaxHitQueries;
+	viewParamsBufferData.tileSize = 0;
+	viewParamsBufferData.temporalEnabled = 0;
+	viewParamsBufferData.temporalHistoryValid = 0;
+	viewParamsBufferData.tracePattern = RT64_TRACE_PATTERN_FULL;
+	viewParamsBufferData.adaptiveSamplingEnabled = 0;
+	viewParamsBufferData.varianceHistoryValid = 0;
+	viewParamsBufferData.prevResolution[0] = 0.0f;
+	viewParamsBufferData.prevResolution[1] = 0.0f;
+	viewParamsBufferData.prevViewProj = XMMatrixIdentity();
 	viewParamsBufferSize = 0;
-	viewParamsBufferUpdatedThisFrame = false;
 	rtWidth = 0;
 	rtHeight = 0;
+	rtAllocWidth = 0;
+	rtAllocHeight = 0;
 	rtScale = 1.0f;
 	resolutionScale = 1.0f;
+	outputBuffersDirty = false;
+	rtGpuMilliseconds = 0.0f;
 	denoiserEnabled = false;
+	denoiserMode = RT64_DENOISER_OPTIX;
 	denoiser = nullptr;
+	cpuDenoiser = nullptr;
+	cpuDenoiserRowPitch = 0;
+	cpuDenoiserMotionRowPitch = 0;
+	cpuDenoiserImageSize = 0;
+	cpuDenoiserSlotIndex = 0;
+	for (unsigned int s = 0; s < CPUDenoiserSlotCount; s++) {
+		cpuDenoiserSlots[s].fenceValue = 0;
+		cpuDenoiserSlots[s].width = 0;
+		cpuDenoiserSlots[s].height = 0;
+		cpuDenoiserSlots[s].pending = false;
+	}
+
 	perspectiveControlActive = false;
 	im3dVertexCount = 0;
-	rtHitInstanceIdReadbackUpdated = false;
+	rtHitBufferSize = 0;
+	rtAccumIndex = 0;
+	rtUpscaleIndex = 0;
+	upscalerEnabled = false;
+	upscaleHistoryValid = false;
+	rtReconstructIndex = 0;
+	reconstructHistoryValid = false;
+	tileCapacity = 0;
+	tileVarianceFenceValue = 0;
+	tileVariancePending = false;
+	tileUnitsDirty = false;
+	viewParamsBufferData.jitter[0] = 0.0f;
+	viewParamsBufferData.jitter[1] = 0.0f;
 	scissorApplied = false;
 	viewportApplied = false;
 
@@ -62,10 +208,25 @@ RT64::View::View(Scene *scene) {
 
 RT64::View::~View() {
 	delete denoiser;
+	delete cpuDenoiser;
 
 	scene->removeView(this);
 
+	instanceQueries.clear();
+	instanceQueryBackend.release();
 	releaseOutputBuffers();
+	scene->getDevice()->retire(sbtStorage);
+	scene->getDevice()->retire(viewParamBufferResource);
+	scene->getDevice()->retire(im3dVertexBuffer);
+	delete descriptorSet;
+
+	if (upscaleRtvHeap != nullptr) {
+		upscaleRtvHeap->Release();
+	}
+
+	if (reconstructRtvHeap != nullptr) {
+		reconstructRtvHeap->Release();
+	}
 }
 
 void RT64::View::createOutputBuffers() {
@@ -74,10 +235,12 @@ void RT64::View::createOutputBuffers() {
 	outputRtvDescriptorSize = scene->getDevice()->getD3D12Device()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	int screenWidth = scene->getDevice()->getWidth();
 	int screenHeight = scene->getDevice()->getHeight();
-	rtWidth = lround(screenWidth * rtScale);
-	rtHeight = lround(screenHeight * rtScale);
-	viewParamsBufferData.resolution[0] = (float)(rtWidth);
-	viewParamsBufferData.resolution[1] = (float)(rtHeight);
+
+	// The buffers are created for the largest scale the governor can pick, so changing the resolution
+	// only changes the region of the buffers that is traced.
+	const float allocScale = resolutionGovernor.isEnabled() ? resolutionGovernor.getSettings().maxScale : rtScale;
+	rtAllocWidth = std::max((int)(lround(screenWidth * allocScale)), 1);
+	rtAllocHeight = std::max((int)(lround(screenHeight * allocScale)), 1);
 	viewParamsBufferData.resolution[2] = (float)(screenWidth);
 	viewParamsBufferData.resolution[3] = (float)(screenHeight);
 
@@ -103,23 +266,133 @@ void RT64::View::createOutputBuffers() {
 	rasterBg = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, &clearValue);
 
 	// Create buffers for raytracing output.
-	resDesc.Width = rtWidth;
-	resDesc.Height = rtHeight;
+	resDesc.Width = rtAllocWidth;
+	resDesc.Height = rtAllocHeight;
 	resDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
 	resDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 	rtOutput = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, nullptr, true, true);
 	rtAlbedo = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
 	rtNormal = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
 	
-	// Create hit result buffers.
-	UINT64 hitCountBufferSizeOne = rtWidth * rtHeight;
-	UINT64 hitCountBufferSizeAll = hitCountBufferSizeOne * MaxQueries;
-	rtHitDistance = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, hitCountBufferSizeAll * 4, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	rtHitColor = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, hitCountBufferSizeAll * 8, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	rtHitNormal = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, hitCountBufferSizeAll * 8, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	rtHitInstanceId = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, hitCountBufferSizeAll * 2, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	rtHitSpecular = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, hitCountBufferSizeAll * 2, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	rtHitInstanceIdReadback = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_READBACK, hitCountBufferSizeOne * 2, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+	// Create the buffer for the closest instance ID of each pixel. Only the regions requested by the instance queries are read back.
+	resDesc.Format = DXGI_FORMAT_R16_UINT;
+	rtInstanceId = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
+
+	// Create the hit buffer. All hits are stored as compact records and the buffer only
+	// needs to be as big as a single tile if tiled tracing is enabled.
+	const int tileSize = (int)(viewParamsBufferData.tileSize);
+	const int rtHitWidth = (tileSize > 0) ? std::min(tileSize, rtAllocWidth) : rtAllocWidth;
+	const int rtHitHeight = (tileSize > 0) ? std::min(tileSize, rtAllocHeight) : rtAllocHeight;
+	rtHitBufferSize = (UINT64)(rtHitWidth) * rtHitHeight * (viewParamsBufferData.maxHitQueries + 1) * HitRecordSize;
+	rtHitBuffer = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, rtHitBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	rtHitPrevPosition = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, (UINT64)(rtHitWidth) * rtHitHeight * sizeof(float) * 4, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	// Create the buffer for the motion vectors of the closest hits.
+	resDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	rtMotion = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
+
+	// Create the history buffers for temporal accumulation. They alternate between being read and written every frame.
+	if (viewParamsBufferData.temporalEnabled) {
+		for (int i = 0; i < 2; i++) {
+			resDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			rtAccumColor[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
+			resDesc.Format = DXGI_FORMAT_R32G32_UINT;
+			rtAccumDepth[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
+		}
+	}
+
+	// Create the luminance moments of every pixel and the buffers that carry the variance of the tiles of adaptive sampling
+	// to the CPU and their sample units back. They're sized for the largest amount of tiles so they don't depend on the scale.
+	if (viewParamsBufferData.adaptiveSamplingEnabled) {
+		resDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+		rtVarianceMoments = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
+
+		const int tileSize = AdaptiveSampler::TileSize;
+		tileCapacity = ((rtAllocWidth + tileSize - 1) / tileSize) * ((rtAllocHeight + tileSize - 1) / tileSize);
+		const UINT64 tileBufferSize = (UINT64)(tileCapacity) * sizeof(uint32_t);
+		tileVariance = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, tileBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		tileVarianceClear = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, tileBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+		tileVarianceReadback = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_READBACK, tileBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+		tileUnits = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, tileBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+		// The variance of the tiles is cleared every frame by copying this buffer over it.
+		uint8_t *clearData = nullptr;
+		CD3DX12_RANGE emptyRange(0, 0);
+		D3D12_CHECK(tileVarianceClear.Get()->Map(0, &emptyRange, reinterpret_cast<void **>(&clearData)));
+		memset(clearData, 0, (size_t)(tileBufferSize));
+		tileVarianceClear.Get()->Unmap(0, nullptr);
+	}
+
+	adaptiveSampler.reset();
+
+	// Create the depth of the closest hits and the history of the reconstruction when only a pattern of the pixels is traced
+	// every frame. The history alternates between being read and written every frame like the other ones.
+	if (viewParamsBufferData.tracePattern != RT64_TRACE_PATTERN_FULL) {
+		resDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		rtDepth = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, true, true);
+
+		resDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+		for (int i = 0; i < 2; i++) {
+			resDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			rtReconstructColor[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, nullptr);
+			rtReconstructGuide[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, nullptr);
+			resDesc.Format = DXGI_FORMAT_R16_UINT;
+			rtReconstructInstanceId[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, nullptr);
+		}
+
+		// The color and the guides of each history are next to each other so they can be bound with a single handle.
+		if (reconstructRtvHeap == nullptr) {
+			D3D12_DESCRIPTOR_HEAP_DESC reconstructRtvHeapDesc = {};
+			reconstructRtvHeapDesc.NumDescriptors = 6;
+			reconstructRtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+			reconstructRtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+			D3D12_CHECK(scene->getDevice()->getD3D12Device()->CreateDescriptorHeap(&reconstructRtvHeapDesc, IID_PPV_ARGS(&reconstructRtvHeap)));
+		}
+
+		CD3DX12_CPU_DESCRIPTOR_HANDLE reconstructRtvHandle(reconstructRtvHeap->GetCPUDescriptorHandleForHeapStart());
+		for (int i = 0; i < 2; i++) {
+			ID3D12Resource *historyResources[] = { rtReconstructColor[i].Get(), rtReconstructGuide[i].Get(), rtReconstructInstanceId[i].Get() };
+			for (ID3D12Resource *resource : historyResources) {
+				scene->getDevice()->getD3D12Device()->CreateRenderTargetView(resource, nullptr, reconstructRtvHandle);
+				reconstructRtvHandle.Offset(1, outputRtvDescriptorSize);
+			}
+		}
+	}
+
+	reconstructHistoryValid = false;
+
+	// Create the history of the upscaler. It has the resolution of the screen, so it stays valid when the resolution
+	// scale changes, and it alternates between being read and written every frame.
+	if (upscalerEnabled) {
+		resDesc.Width = screenWidth;
+		resDesc.Height = screenHeight;
+		resDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+		for (int i = 0; i < 2; i++) {
+			resDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			rtUpscaleColor[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, nullptr);
+			resDesc.Format = DXGI_FORMAT_R32_FLOAT;
+			rtUpscaleWeight[i] = scene->getDevice()->allocateResource(D3D12_HEAP_TYPE_DEFAULT, &resDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, nullptr);
+		}
+
+		// The color and the weight of each history are next to each other so they can be bound with a single handle.
+		if (upscaleRtvHeap == nullptr) {
+			D3D12_DESCRIPTOR_HEAP_DESC upscaleRtvHeapDesc = {};
+			upscaleRtvHeapDesc.NumDescriptors = 4;
+			upscaleRtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+			upscaleRtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+			D3D12_CHECK(scene->getDevice()->getD3D12Device()->CreateDescriptorHeap(&upscaleRtvHeapDesc, IID_PPV_ARGS(&upscaleRtvHeap)));
+		}
+
+		CD3DX12_CPU_DESCRIPTOR_HANDLE upscaleRtvHandle(upscaleRtvHeap->GetCPUDescriptorHandleForHeapStart());
+		for (int i = 0; i < 2; i++) {
+			scene->getDevice()->getD3D12Device()->CreateRenderTargetView(rtUpscaleColor[i].Get(), nullptr, upscaleRtvHandle);
+			upscaleRtvHandle.Offset(1, outputRtvDescriptorSize);
+			scene->getDevice()->getD3D12Device()->CreateRenderTargetView(rtUpscaleWeight[i].Get(), nullptr, upscaleRtvHandle);
+			upscaleRtvHandle.Offset(1, outputRtvDescriptorSize);
+		}
+	}
+
+	upscaleHistoryValid = false;
 
 	// Create the RTVs for the raster resources.
 	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
@@ -132,178 +405,366 @@ void RT64::View::createOutputBuffers() {
 	scene->getDevice()->getD3D12Device()->CreateRenderTargetView(rasterBg.Get(), nullptr, rtvBgHandle);
 	rtvBgHandle.Offset(1, outputRtvDescriptorSize);
 
+	rtWidth = 0;
+	rtHeight = 0;
+	updateActiveResolution();
+
 	if (denoiserEnabled) {
-		denoiser->set(rtWidth, rtHeight, rtOutput.Get(), rtAlbedo.Get(), rtNormal.Get());
+		createDenoiser();
 	}
+
+	outputBuffersDirty = false;
 }
 
 void RT64::View::releaseOutputBuffers() {
-	rasterBg.Release();
-	rtOutput.Release();
-	rtAlbedo.Release();
-	rtNormal.Release();
-	rtHitDistance.Release();
-	rtHitColor.Release();
-	rtHitNormal.Release();
-	rtHitInstanceId.Release();
-	rtHitSpecular.Release();
-}
-
-void RT64::View::createInstancePropertiesBuffer() {
-	uint32_t totalInstances = static_cast<uint32_t>(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
-	uint32_t newBufferSize = ROUND_UP(totalInstances * sizeof(InstanceProperties), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
-	if (activeInstancesBufferPropsSize != newBufferSize) {
-		activeInstancesBufferProps.Release();
-		activeInstancesBufferProps = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, newBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
-		activeInstancesBufferPropsSize = newBufferSize;
+	Device *device = scene->getDevice();
+	device->retire(rasterBg);
+	device->retire(rtOutput);
+	device->retire(rtAlbedo);
+	device->retire(rtNormal);
+	device->retire(rtHitBuffer);
+	device->retire(rtHitPrevPosition);
+	device->retire(rtMotion);
+	device->retire(rtInstanceId);
+	tracedInstances.clear();
+	device->retire(rtAccumColor[0]);
+	device->retire(rtAccumColor[1]);
+	device->retire(rtAccumDepth[0]);
+	device->retire(rtAccumDepth[1]);
+	device->retire(rtUpscaleColor[0]);
+	device->retire(rtUpscaleColor[1]);
+	device->retire(rtUpscaleWeight[0]);
+	device->retire(rtUpscaleWeight[1]);
+	device->retire(rtDepth);
+	device->retire(rtReconstructColor[0]);
+	device->retire(rtReconstructColor[1]);
+	device->retire(rtReconstructGuide[0]);
+	device->retire(rtReconstructGuide[1]);
+	device->retire(rtReconstructInstanceId[0]);
+	device->retire(rtReconstructInstanceId[1]);
+	device->retire(rtVarianceMoments);
+	device->retire(tileVariance);
+	device->retire(tileVarianceClear);
+	device->retire(tileVarianceReadback);
+	device->retire(tileUnits);
+	tileCapacity = 0;
+	for (unsigned int s = 0; s < CPUDenoiserSlotCount; s++) {
+		device->retire(cpuDenoiserSlots[s].readback);
+		device->retire(cpuDenoiserSlots[s].upload);
+		cpuDenoiserSlots[s].pending = false;
 	}
+
+	cpuDenoiserImageSize = 0;
 }
 
-void RT64::View::updateInstancePropertiesBuffer() {
-	InstanceProperties *current = nullptr;
-	CD3DX12_RANGE readRange(0, 0);
+void RT64::View::updateActiveResolution() {
+	int screenWidth = scene->getDevice()->getWidth();
+	int screenHeight = scene->getDevice()->getHeight();
+	int newWidth = std::min(std::max((int)(lround(screenWidth * rtScale)), 1), rtAllocWidth);
+	int newHeight = std::min(std::max((int)(lround(screenHeight * rtScale)), 1), rtAllocHeight);
+	if ((rtWidth == newWidth) && (rtHeight == newHeight)) {
+		return;
+	}
 
-	D3D12_CHECK(activeInstancesBufferProps.Get()->Map(0, &readRange, reinterpret_cast<void **>(&current)));
+	rtWidth = newWidth;
+	rtHeight = newHeight;
+	viewParamsBufferData.resolution[0] = (float)(rtWidth);
+	viewParamsBufferData.resolution[1] = (float)(rtHeight);
+	instanceQueries.setDimensions(rtWidth, rtHeight);
+
+	// The temporal and the reconstruction histories are kept, since the buffers are big enough for any resolution and the
+	// shaders scale the positions in the history by the ratio between the resolutions. The variance moments are updated
+	// in place, so they can't be resampled, and the tiles of adaptive sampling change with the resolution anyway, so the
+	// variance being read back can't be used either.
+	viewParamsBufferData.varianceHistoryValid = 0;
+	if (viewParamsBufferData.adaptiveSamplingEnabled) {
+		adaptiveSampler.set(rtWidth, rtHeight);
+		tileVariancePending = false;
+		tileUnitsDirty = true;
+	}
 
-	for (const RenderInstance &inst : rtInstances) {
-		// Store world transform.
-		current->objectToWorld = inst.transform;
+	if ((cpuDenoiser != nullptr) && (denoiserMode == RT64_DENOISER_CPU)) {
+		cpuDenoiser->set(rtWidth, rtHeight);
+	}
+}
 
-		// Store matrix to transform normal.
-		XMMATRIX upper3x3 = current->objectToWorld;
-		upper3x3.r[0].m128_f32[3] = 0.f;
-		upper3x3.r[1].m128_f32[3] = 0.f;
-		upper3x3.r[2].m128_f32[3] = 0.f;
-		upper3x3.r[3].m128_f32[0] = 0.f;
-		upper3x3.r[3].m128_f32[1] = 0.f;
-		upper3x3.r[3].m128_f32[2] = 0.f;
-		upper3x3.r[3].m128_f32[3] = 1.f;
+void RT64::View::createDenoiser() {
+	if (denoiserMode == RT64_DENOISER_CPU) {
+		if (cpuDenoiser == nullptr) {
+			cpuDenoiser = new RT64::CPUDenoiser();
+		}
 
-		XMVECTOR det;
-		current->objectToWorldNormal = XMMatrixTranspose(XMMatrixInverse(&det, upper3x3));
+		createCPUDenoiserBuffers();
+	}
+	else {
+		// Create the denoiser if it wasn't created yet.
+		if (denoiser == nullptr) {
+			denoiser = new RT64::Denoiser(scene->getDevice());
+		}
+
+		// Update the buffer sizes since they might've changed since the last time the denoiser was enabled. Setting up the
+		// denoiser is expensive, so it always works on the whole buffers instead of the region that is traced.
+		denoiser->set(rtAllocWidth, rtAllocHeight, rtOutput.Get(), rtAlbedo.Get(), rtNormal.Get());
+	}
+}
+
+void RT64::View::createCPUDenoiserBuffers() {
+	cpuDenoiser->set(rtWidth, rtHeight);
+
+	// The readback buffer of each slot stores the color, albedo and normal images one after another, followed by the motion vectors.
+	// It's sized for the whole buffers so it doesn't need to be recreated when the traced region changes.
+	cpuDenoiserRowPitch = ROUND_UP(rtAllocWidth * 4 * sizeof(float), D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	cpuDenoiserMotionRowPitch = ROUND_UP(rtAllocWidth * 2 * sizeof(float), D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	UINT64 imageSize = ROUND_UP((UINT64)(cpuDenoiserRowPitch) * rtAllocHeight, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	Device *device = scene->getDevice();
+	for (unsigned int s = 0; s < CPUDenoiserSlotCount; s++) {
+		CPUDenoiserSlot &slot = cpuDenoiserSlots[s];
+		if (cpuDenoiserImageSize != imageSize) {
+			device->retire(slot.readback);
+			device->retire(slot.upload);
+			slot.readback = device->allocateBuffer(D3D12_HEAP_TYPE_READBACK, imageSize * 3 + (UINT64)(cpuDenoiserMotionRowPitch) * rtAllocHeight, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+			slot.upload = device->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, imageSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+		}
 
-		// Store material.
-		current->material = inst.material;
-		current++;
+		// Frames read back before the denoiser was enabled again are too old to be shown.
+		slot.pending = false;
 	}
 
-	for (const RenderInstance &inst : rasterBgInstances) {
-		current->material = inst.material;
-		current++;
+	cpuDenoiserImageSize = imageSize;
+}
+
+void RT64::View::denoiseOnCPU() {
+	Device *device = scene->getDevice();
+	auto d3dCommandList = device->getD3D12CommandList();
+	auto bufferLocation = [this](ID3D12Resource *buffer, UINT64 offset, DXGI_FORMAT format = DXGI_FORMAT_R32G32B32A32_FLOAT, UINT rowPitch = 0) {
+		D3D12_TEXTURE_COPY_LOCATION location = {};
+		location.pResource = buffer;
+		location.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		location.PlacedFootprint.Offset = offset;
+		location.PlacedFootprint.Footprint.Format = format;
+		location.PlacedFootprint.Footprint.Width = rtWidth;
+		location.PlacedFootprint.Footprint.Height = rtHeight;
+		location.PlacedFootprint.Footprint.Depth = 1;
+		location.PlacedFootprint.Footprint.RowPitch = (rowPitch > 0) ? rowPitch : cpuDenoiserRowPitch;
+		return location;
+	};
+
+	// Filter the last frame if the GPU is done copying it. A frame that isn't done yet or that was traced at a
+	// different resolution is dropped, since the one being read back now is newer.
+	CPUDenoiserSlot &prevSlot = cpuDenoiserSlots[(cpuDenoiserSlotIndex + CPUDenoiserSlotCount - 1) % CPUDenoiserSlotCount];
+	bool prevSlotReady = prevSlot.pending && (prevSlot.width == rtWidth) && (prevSlot.height == rtHeight) && (device->getCompletedFenceValue() >= prevSlot.fenceValue);
+	prevSlot.pending = false;
+
+	if (prevSlotReady) {
+		// Filter the color in place on the readback memory and copy the result to the upload buffer.
+		uint8_t *readbackData = nullptr;
+		uint8_t *uploadData = nullptr;
+		CD3DX12_RANGE emptyRange(0, 0);
+		D3D12_CHECK(prevSlot.readback.Get()->Map(0, nullptr, reinterpret_cast<void **>(&readbackData)));
+		D3D12_CHECK(prevSlot.upload.Get()->Map(0, &emptyRange, reinterpret_cast<void **>(&uploadData)));
+
+		CPUDenoiser::Inputs inputs;
+		inputs.color = reinterpret_cast<float *>(readbackData);
+		inputs.albedo = reinterpret_cast<const float *>(readbackData + cpuDenoiserImageSize);
+		inputs.normal = reinterpret_cast<const float *>(readbackData + cpuDenoiserImageSize * 2);
+		inputs.motion = reinterpret_cast<const float *>(readbackData + cpuDenoiserImageSize * 3);
+		inputs.rowPitch = cpuDenoiserRowPitch;
+		inputs.motionRowPitch = cpuDenoiserMotionRowPitch;
+		cpuDenoiser->denoise(inputs);
+		memcpy(uploadData, readbackData, (size_t)(cpuDenoiserRowPitch) * rtHeight);
+
+		prevSlot.upload.Get()->Unmap(0, nullptr);
+		prevSlot.readback.Get()->Unmap(0, &emptyRange);
 	}
 
-	for (const RenderInstance& inst : rasterFgInstances) {
-		current->material = inst.material;
-		current++;
+	// Copy the region that was traced of the color and the guide buffers to the readback buffer of this frame.
+	CPUDenoiserSlot &slot = cpuDenoiserSlots[cpuDenoiserSlotIndex];
+	const D3D12_BOX srcBox = { 0, 0, 0, (UINT)(rtWidth), (UINT)(rtHeight), 1 };
+	ID3D12Resource *sources[] = { rtOutput.Get(), rtAlbedo.Get(), rtNormal.Get() };
+	CD3DX12_RESOURCE_BARRIER copyBarriers[] = {
+		CD3DX12_RESOURCE_BARRIER::Transition(rtOutput.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(rtAlbedo.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(rtNormal.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(rtMotion.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE)
+	};
+
+	d3dCommandList->ResourceBarrier(_countof(copyBarriers), copyBarriers);
+
+	for (UINT i = 0; i < _countof(sources); i++) {
+		D3D12_TEXTURE_COPY_LOCATION dstLocation = bufferLocation(slot.readback.Get(), cpuDenoiserImageSize * i);
+		CD3DX12_TEXTURE_COPY_LOCATION srcLocation(sources[i], 0);
+		d3dCommandList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, &srcBox);
 	}
 
-	activeInstancesBufferProps.Get()->Unmap(0, nullptr);
+	D3D12_TEXTURE_COPY_LOCATION motionDstLocation = bufferLocation(slot.readback.Get(), cpuDenoiserImageSize * 3, DXGI_FORMAT_R32G32_FLOAT, cpuDenoiserMotionRowPitch);
+	CD3DX12_TEXTURE_COPY_LOCATION motionSrcLocation(rtMotion.Get(), 0);
+	d3dCommandList->CopyTextureRegion(&motionDstLocation, 0, 0, 0, &motionSrcLocation, &srcBox);
+
+	// The output only goes through the copy destination state if there's a filtered frame to upload.
+	const D3D12_RESOURCE_STATES outputState = prevSlotReady ? D3D12_RESOURCE_STATE_COPY_DEST : D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+	CD3DX12_RESOURCE_BARRIER restoreBarriers[] = {
+		CD3DX12_RESOURCE_BARRIER::Transition(rtOutput.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, outputState),
+		CD3DX12_RESOURCE_BARRIER::Transition(rtAlbedo.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		CD3DX12_RESOURCE_BARRIER::Transition(rtNormal.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		CD3DX12_RESOURCE_BARRIER::Transition(rtMotion.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+	};
+
+	d3dCommandList->ResourceBarrier(_countof(restoreBarriers), restoreBarriers);
+
+	// The copies are done once the GPU reaches the fence that's signaled at the end of this frame.
+	slot.fenceValue = device->getFenceValue();
+	slot.width = rtWidth;
+	slot.height = rtHeight;
+	slot.pending = true;
+	cpuDenoiserSlotIndex = (cpuDenoiserSlotIndex + 1) % CPUDenoiserSlotCount;
+
+	// Replace the output with the filtered last frame. The copy to the readback buffer above comes first in the
+	// command list, so the noisy output of this frame is still the one that gets filtered next frame.
+	if (prevSlotReady) {
+		D3D12_TEXTURE_COPY_LOCATION srcLocation = bufferLocation(prevSlot.upload.Get(), 0);
+		CD3DX12_TEXTURE_COPY_LOCATION dstLocation(rtOutput.Get(), 0);
+		d3dCommandList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
+
+		CD3DX12_RESOURCE_BARRIER outputBarrier = CD3DX12_RESOURCE_BARRIER::Transition(rtOutput.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		d3dCommandList->ResourceBarrier(1, &outputBarrier);
+	}
 }
 
-void RT64::View::createTopLevelAS(const std::vector<RenderInstance>& rtInstances) {
-	// Reset the generator.
-	topLevelASGenerator.Reset();
+void RT64::View::updateTileUnits() {
+	// Pick the units of the tiles from the variance that was read back, which is usually from the last frame since
+	// the device waits for every frame. The units stay the same until the GPU is done with the copy.
+	const size_t tileBufferSize = (size_t)(adaptiveSampler.getTileCount()) * sizeof(uint32_t);
+	if (tileVariancePending && (scene->getDevice()->getCompletedFenceValue() >= tileVarianceFenceValue)) {
+		uint32_t *tileVarianceSums = nullptr;
+		D3D12_RANGE readRange = { 0, tileBufferSize };
+		D3D12_RANGE writtenRange = { 0, 0 };
+		D3D12_CHECK(tileVarianceReadback.Get()->Map(0, &readRange, reinterpret_cast<void **>(&tileVarianceSums)));
+		adaptiveSampler.update(tileVarianceSums);
+		tileVarianceReadback.Get()->Unmap(0, &writtenRange);
+		tileVariancePending = false;
+		tileUnitsDirty = true;
+	}
 
-	// Gather all the instances into the builder helper
-	for (size_t i = 0; i < rtInstances.size(); i++) {
-		topLevelASGenerator.AddInstance(rtInstances[i].bottomLevelAS, rtInstances[i].transform, static_cast<UINT>(i), static_cast<UINT>(2 * i), rtInstances[i].flags);
+	if (tileUnitsDirty) {
+		uint8_t *unitsData = nullptr;
+		CD3DX12_RANGE emptyRange(0, 0);
+		D3D12_CHECK(tileUnits.Get()->Map(0, &emptyRange, reinterpret_cast<void **>(&unitsData)));
+		memcpy(unitsData, adaptiveSampler.getUnits(), tileBufferSize);
+		tileUnits.Get()->Unmap(0, nullptr);
+		scene->getDevice()->getCounters()->bytesUploaded += tileBufferSize;
+		tileUnitsDirty = false;
 	}
 
-	// As for the bottom-level AS, the building the AS requires some scratch
-	// space to store temporary data in addition to the actual AS. In the case
-	// of the top-level AS, the instance descriptors also need to be stored in
-	// GPU memory. This call outputs the memory requirements for each (scratch,
-	// results, instance descriptors) so that the application can allocate the
-	// corresponding memory
-	UINT64 scratchSize, resultSize, instanceDescsSize;
-	topLevelASGenerator.ComputeASBufferSizes(scene->getDevice()->getD3D12Device(), true, &scratchSize, &resultSize, &instanceDescsSize);
-	
-	// Release the previous buffers and reallocate them if they're not big enough.
-	if ((topLevelASBuffers.scratchSize < scratchSize) || (topLevelASBuffers.resultSize < resultSize) || (topLevelASBuffers.instanceDescSize < instanceDescsSize)) {
-		topLevelASBuffers.Release();
-
-		// Create the scratch and result buffers. Since the build is all done on
-		// GPU, those can be allocated on the default heap
-		topLevelASBuffers.scratch = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		topLevelASBuffers.result = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_DEFAULT, resultSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
-
-		// The buffer describing the instances: ID, shader binding information,
-		// matrices ... Those will be copied into the buffer by the helper through
-		// mapping, so the buffer has to be allocated on the upload heap.
-		topLevelASBuffers.instanceDesc = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, instanceDescsSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
-
-		topLevelASBuffers.scratchSize = scratchSize;
-		topLevelASBuffers.resultSize = resultSize;
-		topLevelASBuffers.instanceDescSize = instanceDescsSize;
+	// Clear the variance of the tiles so the tracer can add up the variance of this frame.
+	auto d3dCommandList = scene->getDevice()->getD3D12CommandList();
+	CD3DX12_RESOURCE_BARRIER clearBarrier = CD3DX12_RESOURCE_BARRIER::Transition(tileVariance.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+	d3dCommandList->ResourceBarrier(1, &clearBarrier);
+	d3dCommandList->CopyBufferRegion(tileVariance.Get(), 0, tileVarianceClear.Get(), 0, tileBufferSize);
+	std::swap(clearBarrier.Transition.StateBefore, clearBarrier.Transition.StateAfter);
+	d3dCommandList->ResourceBarrier(1, &clearBarrier);
+}
+
+void RT64::View::copyTileVariance() {
+	// Only one copy is in flight at a time. The variance of the frames traced while it's pending is dropped.
+	if (!tileVariancePending) {
+		auto d3dCommandList = scene->getDevice()->getD3D12CommandList();
+		CD3DX12_RESOURCE_BARRIER copyBarrier = CD3DX12_RESOURCE_BARRIER::Transition(tileVariance.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		d3dCommandList->ResourceBarrier(1, &copyBarrier);
+		d3dCommandList->CopyBufferRegion(tileVarianceReadback.Get(), 0, tileVariance.Get(), 0, (UINT64)(adaptiveSampler.getTileCount()) * sizeof(uint32_t));
+		std::swap(copyBarrier.Transition.StateBefore, copyBarrier.Transition.StateAfter);
+		d3dCommandList->ResourceBarrier(1, &copyBarrier);
+
+		// The copy is done once the GPU reaches the fence that's signaled at the end of this frame.
+		tileVarianceFenceValue = scene->getDevice()->getFenceValue();
+		tileVariancePending = true;
 	}
 
-	// After all the buffers are allocated, or if only an update is required, we can build the acceleration structure. 
-	// Note that in the case of the update we also pass the existing AS as the 'previous' AS, so that it can be refitted in place.
-	topLevelASGenerator.Generate(scene->getDevice()->getD3D12CommandList(), topLevelASBuffers.scratch.Get(), topLevelASBuffers.result.Get(), topLevelASBuffers.instanceDesc.Get(), false, topLevelASBuffers.result.Get());
+	viewParamsBufferData.varianceHistoryValid = 1;
 }
 
 void RT64::View::createShaderResourceHeap() {
+	const std::vector<Texture *> &usedTextures = scene->getUsedTextures();
 	assert(usedTextures.size() <= 1024);
 
 	uint32_t entryCount = ((uint32_t)(HeapIndices::MAX) - 1) + (uint32_t)(usedTextures.size());
 
-	// Recreate descriptor heap to be bigger if necessary.
-	if (descriptorHeapEntryCount < entryCount) {
-		if (descriptorHeap != nullptr) {
-			descriptorHeap->Release();
-			descriptorHeap = nullptr;
-		}
-
-		descriptorHeap = nv_helpers_dx12::CreateDescriptorHeap(scene->getDevice()->getD3D12Device(), entryCount, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
-		descriptorHeapEntryCount = entryCount;
+	// Recreate descriptor set to be bigger if necessary.
+	if ((descriptorSet == nullptr) || (descriptorSet->getEntryCount() < entryCount)) {
+		delete descriptorSet;
+		descriptorSet = static_cast<D3D12RenderDescriptorSet *>(scene->getDevice()->getRenderDevice()->createDescriptorSet(entryCount));
 	}
 
-	const UINT handleIncrement = scene->getDevice()->getD3D12Device()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	scene->getDevice()->getCounters()->descriptorsUsed += entryCount;
 
-	// Get a handle to the heap memory on the CPU side, to be able to write the
-	// descriptors directly
-	D3D12_CPU_DESCRIPTOR_HANDLE handle = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	// The output buffers are still created directly with D3D12, so their descriptors are written to the set's heap.
+	ID3D12Device8 *d3dDevice = scene->getDevice()->getD3D12Device();
 
 	// UAV for output buffer.
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
 	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtOutput.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	d3dDevice->CreateUnorderedAccessView(rtOutput.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gOutput)));
 
 	// UAV for albedo output buffer.
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtAlbedo.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	d3dDevice->CreateUnorderedAccessView(rtAlbedo.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gAlbedo)));
 
 	// UAV for normal output buffer.
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtNormal.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	d3dDevice->CreateUnorderedAccessView(rtNormal.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gNormal)));
 
-	// UAV for hit distance buffer.
+	// UAV for hit buffer.
 	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 	uavDesc.Buffer.FirstElement = 0;
-	uavDesc.Buffer.NumElements = rtWidth * rtHeight * MaxQueries;
+	uavDesc.Buffer.NumElements = (UINT)(rtHitBufferSize / HitRecordSize);
+	uavDesc.Format = DXGI_FORMAT_R32G32B32A32_UINT;
+	d3dDevice->CreateUnorderedAccessView(rtHitBuffer.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gHitBuffer)));
+
+	// UAV for instance ID output buffer.
+	uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	uavDesc.Format = DXGI_FORMAT_R16_UINT;
+	d3dDevice->CreateUnorderedAccessView(rtInstanceId.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gInstanceId)));
+
+	// UAVs for the current and the previous temporal accumulation buffers. Null descriptors are used if it's disabled.
+	const int prevAccumIndex = rtAccumIndex ^ 1;
+	uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	d3dDevice->CreateUnorderedAccessView(rtAccumColor[rtAccumIndex].Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gAccumColor)));
+
+	uavDesc.Format = DXGI_FORMAT_R32G32_UINT;
+	d3dDevice->CreateUnorderedAccessView(rtAccumDepth[rtAccumIndex].Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gAccumDepth)));
+
+	uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	d3dDevice->CreateUnorderedAccessView(rtAccumColor[prevAccumIndex].Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gPrevAccumColor)));
+
+	uavDesc.Format = DXGI_FORMAT_R32G32_UINT;
+	d3dDevice->CreateUnorderedAccessView(rtAccumDepth[prevAccumIndex].Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gPrevAccumDepth)));
+
+	// UAV for motion vectors output buffer.
+	uavDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	d3dDevice->CreateUnorderedAccessView(rtMotion.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gMotion)));
+
+	// UAV for the depth of the closest hits. A null descriptor is used if every pixel is traced.
 	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtHitDistance.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	d3dDevice->CreateUnorderedAccessView(rtDepth.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gDepth)));
 
-	// UAV for hit color buffer.
-	uavDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtHitColor.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
-	
-	// UAV for hit normal buffer.
-	uavDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtHitNormal.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	// UAV for the luminance moments of adaptive sampling. A null descriptor is used if it's disabled.
+	uavDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	d3dDevice->CreateUnorderedAccessView(rtVarianceMoments.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gVarianceMoments)));
 
-	// UAV for hit shading buffer.
-	uavDesc.Format = DXGI_FORMAT_R16_UINT;
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtHitInstanceId.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	// UAV for the previous position of the closest hits. It has as many elements as a single layer of the hit buffer.
+	uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = (UINT)(rtHitBufferSize / HitRecordSize / (viewParamsBufferData.maxHitQueries + 1));
+	uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	d3dDevice->CreateUnorderedAccessView(rtHitPrevPosition.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gHitPrevPosition)));
 
-	uavDesc.Format = DXGI_FORMAT_R16_FLOAT;
-	scene->getDevice()->getD3D12Device()->CreateUnorderedAccessView(rtHitSpecular.Get(), nullptr, &uavDesc, handle);
-	handle.ptr += handleIncrement;
+	// UAV for the variance of the tiles of adaptive sampling.
+	uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = (UINT)(std::max(tileCapacity, 1));
+	uavDesc.Buffer.StructureByteStride = sizeof(uint32_t);
+	d3dDevice->CreateUnorderedAccessView(tileVariance.Get(), nullptr, &uavDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gTileVariance)));
 
 	// SRV for background texture.
 	D3D12_SHADER_RESOURCE_VIEW_DESC textureSRVDesc = {};
@@ -312,77 +773,99 @@ void RT64::View::createShaderResourceHeap() {
 	textureSRVDesc.Texture2D.MostDetailedMip = 0;
 	textureSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	textureSRVDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	scene->getDevice()->getD3D12Device()->CreateShaderResourceView(rasterBg.Get(), &textureSRVDesc, handle);
-	handle.ptr += handleIncrement;
+	d3dDevice->CreateShaderResourceView(rasterBg.Get(), &textureSRVDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gBackground)));
 
 	// Add the Top Level AS SRV right after the raytracing output buffer
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
-	if (!topLevelASBuffers.result.IsNull()) {
-		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.RaytracingAccelerationStructure.Location = topLevelASBuffers.result.Get()->GetGPUVirtualAddress();
-		scene->getDevice()->getD3D12Device()->CreateShaderResourceView(nullptr, &srvDesc, handle);
+	if (scene->getTopLevelAS() != nullptr) {
+		descriptorSet->setAccelerationStructure(HEAP_INDEX(SceneBVH), scene->getTopLevelAS());
 	}
 
-	handle.ptr += handleIncrement;
-
 	// Describe and create a constant buffer view for the camera
 	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
 	cbvDesc.BufferLocation = viewParamBufferResource.Get()->GetGPUVirtualAddress();
 	cbvDesc.SizeInBytes = viewParamsBufferSize;
-	scene->getDevice()->getD3D12Device()->CreateConstantBufferView(&cbvDesc, handle);
-	handle.ptr += handleIncrement;
+	d3dDevice->CreateConstantBufferView(&cbvDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(ViewParams)));
 
 	// Describe and create a constant buffer view for the lights
 	if (scene->getLightsCount() > 0) {
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-		srvDesc.Buffer.FirstElement = 0;
-		srvDesc.Buffer.NumElements = scene->getLightsCount();
-		srvDesc.Buffer.StructureByteStride = sizeof(RT64_LIGHT);
-		srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-		scene->getDevice()->getD3D12Device()->CreateShaderResourceView(scene->getLightsBuffer(), &srvDesc, handle);
+		descriptorSet->setStructuredBuffer(HEAP_INDEX(SceneLights), scene->getLightsBuffer(), scene->getLightsCount(), sizeof(RT64_LIGHT));
 	}
 
-	handle.ptr += handleIncrement;
-
 	// Describe the properties buffer per instance.
+	descriptorSet->setStructuredBuffer(HEAP_INDEX(instanceProps), scene->getInstancePropertiesBuffer(), (uint32_t)(scene->getRenderInstanceCount()), sizeof(InstanceProperties));
+
+	// Describe the sample units of the tiles of adaptive sampling.
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
 	srvDesc.Buffer.FirstElement = 0;
-	srvDesc.Buffer.NumElements = static_cast<UINT>(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
-	srvDesc.Buffer.StructureByteStride = sizeof(InstanceProperties);
 	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-	scene->getDevice()->getD3D12Device()->CreateShaderResourceView(activeInstancesBufferProps.Get(), &srvDesc, handle);
-	handle.ptr += handleIncrement;
+	srvDesc.Buffer.NumElements = (UINT)(std::max(tileCapacity, 1));
+	srvDesc.Buffer.StructureByteStride = sizeof(uint32_t);
+	d3dDevice->CreateShaderResourceView(tileUnits.Get(), &srvDesc, descriptorSet->getD3D12CPUHandle(HEAP_INDEX(gTileUnits)));
 
 	// Add the texture SRV.
 	for (size_t i = 0; i < usedTextures.size(); i++) {
-		scene->getDevice()->getD3D12Device()->CreateShaderResourceView(usedTextures[i]->getTexture(), &textureSRVDesc, handle);
-		handle.ptr += handleIncrement;
+		descriptorSet->setTexture(HEAP_INDEX(gTextures) + (uint32_t)(i), usedTextures[i]->getTexture());
 	}
 
 	{
 		// Create the heap for the compose shader.
 		if (composeHeap == nullptr) {
-			composeHeap = nv_helpers_dx12::CreateDescriptorHeap(scene->getDevice()->getD3D12Device(), 1, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
+			composeHeap = nv_helpers_dx12::CreateDescriptorHeap(d3dDevice, ComposeHeapSize, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
 		}
 
-		D3D12_CPU_DESCRIPTOR_HANDLE handle = composeHeap->GetCPUDescriptorHandleForHeapStart();
-
-		// SRV for denoised texture.
-		{
+		const UINT composeDescriptorSize = d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		auto createTextureSRV = [d3dDevice, composeDescriptorSize, this](ID3D12Resource *resource, DXGI_FORMAT format, int index) {
 			D3D12_SHADER_RESOURCE_VIEW_DESC textureSRVDesc = {};
 			textureSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 			textureSRVDesc.Texture2D.MipLevels = 1;
 			textureSRVDesc.Texture2D.MostDetailedMip = 0;
 			textureSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-			textureSRVDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-			scene->getDevice()->getD3D12Device()->CreateShaderResourceView(rtOutput.Get(), &textureSRVDesc, handle);
-			handle.ptr += handleIncrement;
+			textureSRVDesc.Format = format;
+			d3dDevice->CreateShaderResourceView(resource, &textureSRVDesc, CD3DX12_CPU_DESCRIPTOR_HANDLE(composeHeap->GetCPUDescriptorHandleForHeapStart(), index, composeDescriptorSize));
+		};
+
+		auto createTextureUAV = [d3dDevice, composeDescriptorSize, this](ID3D12Resource *resource, DXGI_FORMAT format, int index) {
+			D3D12_UNORDERED_ACCESS_VIEW_DESC textureUAVDesc = {};
+			textureUAVDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+			textureUAVDesc.Format = format;
+			d3dDevice->CreateUnorderedAccessView(resource, nullptr, &textureUAVDesc, CD3DX12_CPU_DESCRIPTOR_HANDLE(composeHeap->GetCPUDescriptorHandleForHeapStart(), index, composeDescriptorSize));
+		};
+
+		// SRV for denoised texture.
+		createTextureSRV(rtOutput.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, ComposeOutputDescriptor);
+
+		// SRVs for the upscaled textures and the inputs of the upscaler.
+		if (upscalerEnabled && !rtUpscaleColor[0].IsNull()) {
+			for (int i = 0; i < 2; i++) {
+				const int inputsDescriptor = UpscaleInputsDescriptor + i * UpscaleInputCount;
+				createTextureSRV(rtUpscaleColor[i].Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, ComposeUpscaledDescriptor + i);
+				createTextureSRV(rtOutput.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 0);
+				createTextureSRV(rtMotion.Get(), DXGI_FORMAT_R32G32_FLOAT, inputsDescriptor + 1);
+				createTextureSRV(rtUpscaleColor[i ^ 1].Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 2);
+				createTextureSRV(rtUpscaleWeight[i ^ 1].Get(), DXGI_FORMAT_R32_FLOAT, inputsDescriptor + 3);
+			}
+		}
+
+		// SRVs for the history of the reconstruction and UAVs for the buffers it fills. The accumulation buffers
+		// use null descriptors if it's disabled.
+		if (!rtReconstructColor[0].IsNull()) {
+			for (int i = 0; i < 2; i++) {
+				const int inputsDescriptor = ReconstructInputsDescriptor + i * ReconstructInputCount;
+				createTextureSRV(rtReconstructColor[i ^ 1].Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 0);
+				createTextureSRV(rtReconstructGuide[i ^ 1].Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 1);
+				createTextureSRV(rtReconstructInstanceId[i ^ 1].Get(), DXGI_FORMAT_R16_UINT, inputsDescriptor + 2);
+				createTextureUAV(rtOutput.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 3);
+				createTextureUAV(rtAlbedo.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 4);
+				createTextureUAV(rtNormal.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 5);
+				createTextureUAV(rtInstanceId.Get(), DXGI_FORMAT_R16_UINT, inputsDescriptor + 6);
+				createTextureUAV(rtMotion.Get(), DXGI_FORMAT_R32G32_FLOAT, inputsDescriptor + 7);
+				createTextureUAV(rtDepth.Get(), DXGI_FORMAT_R32_FLOAT, inputsDescriptor + 8);
+				createTextureUAV(rtAccumColor[rtAccumIndex].Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, inputsDescriptor + 9);
+				createTextureUAV(rtAccumDepth[rtAccumIndex].Get(), DXGI_FORMAT_R32G32_UINT, inputsDescriptor + 10);
+			}
 		}
 	}
 }
@@ -394,7 +877,7 @@ void RT64::View::createShaderBindingTable() {
 
 	// The pointer to the beginning of the heap is the only parameter required by
 	// shaders without root parameters
-	D3D12_GPU_DESCRIPTOR_HANDLE srvUavHeapHandle = descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+	D3D12_GPU_DESCRIPTOR_HANDLE srvUavHeapHandle = descriptorSet->getD3D12GPUHandle(0);
 	
 	// The helper treats both root parameter pointers and heap pointers as void*,
 	// while DX12 uses the
@@ -402,23 +885,32 @@ void RT64::View::createShaderBindingTable() {
 	// struct is a UINT64, which then has to be reinterpreted as a pointer.
 	auto heapPointer = reinterpret_cast<UINT64 *>(srvUavHeapHandle.ptr);
 
-	// The ray generation only uses heap data.
-	sbtHelper.AddRayGenerationProgram(L"TraceRayGen", { heapPointer });
+	// Add one ray generation record per tile. The tile offset is stored as two root constants packed
+	// in the same 8 bytes the helper copies for every input. Only one tile is used if tiling is disabled.
+	for (const CD3DX12_RECT &tile : getTraceTiles()) {
+		UINT64 tileOffset = (UINT64)(tile.left) | ((UINT64)(tile.top) << 32);
+		sbtHelper.AddRayGenerationProgram(L"TraceRayGen", { heapPointer, reinterpret_cast<void *>(tileOffset) });
+	}
 
 	// The shadow miss shader does not use any external data.
 	sbtHelper.AddMissProgram(L"ShadowMiss", {});
 
-	// Add the vertex buffers from all the meshes used by the instances to the hit group.
-	for (const RenderInstance &rtInstance :rtInstances) {
+	// Add the vertex buffers from all the meshes used by the instances to the hit group. The meshes share the
+	// buffers of the geometry pools, so the root SRVs point at the start of each mesh inside of them.
+	for (const Scene::RenderInstance &rtInstance : scene->getRtInstances()) {
+		const uint64_t vertexBufferAddress = rtInstance.vertexBuffer->getDeviceAddress() + (uint64_t)(rtInstance.firstVertex) * sizeof(RT64_VERTEX);
+		const uint64_t indexBufferAddress = rtInstance.indexBuffer->getDeviceAddress() + (uint64_t)(rtInstance.firstIndex) * sizeof(unsigned int);
 		sbtHelper.AddHitGroup(L"SurfaceHitGroup", {
-			(void *)(rtInstance.vertexBufferView->BufferLocation),
-			(void *)(rtInstance.indexBufferView->BufferLocation),
+			(void *)(vertexBufferAddress),
+			(void *)(indexBufferAddress),
+			(void *)(rtInstance.prevVertexBufferAddress),
 			heapPointer
 		});
 
 		sbtHelper.AddHitGroup(L"ShadowHitGroup", {
-			(void*)(rtInstance.vertexBufferView->BufferLocation),
-			(void*)(rtInstance.indexBufferView->BufferLocation),
+			(void*)(vertexBufferAddress),
+			(void*)(indexBufferAddress),
+			(void*)(rtInstance.prevVertexBufferAddress),
 			heapPointer
 		});
 	}
@@ -426,8 +918,8 @@ void RT64::View::createShaderBindingTable() {
 	// Compute the size of the SBT given the number of shaders and their parameters.
 	uint32_t sbtSize = sbtHelper.ComputeSBTSize();
 	if (sbtStorageSize < sbtSize) {
-		// Release previously allocated SBT storage.
-		sbtStorage.Release();
+		// Retire the previously allocated SBT storage, since the last frame might still be tracing with it.
+		scene->getDevice()->retire(sbtStorage);
 
 		// Create the SBT on the upload heap. This is required as the helper will use
 		// mapping to write the SBT contents. After the SBT compilation it could be
@@ -440,20 +932,31 @@ void RT64::View::createShaderBindingTable() {
 	sbtHelper.Generate(sbtStorage.Get(), scene->getDevice()->getD3D12RtStateObjectProperties());
 }
 
+std::vector<CD3DX12_RECT> RT64::View::getTraceTiles() const {
+	std::vector<CD3DX12_RECT> tiles;
+	const int tileSize = (int)(viewParamsBufferData.tileSize);
+	if (tileSize > 0) {
+		for (int y = 0; y < rtHeight; y += tileSize) {
+			for (int x = 0; x < rtWidth; x += tileSize) {
+				tiles.push_back(CD3DX12_RECT(x, y, std::min(x + tileSize, rtWidth), std::min(y + tileSize, rtHeight)));
+			}
+		}
+	}
+	else {
+		tiles.push_back(CD3DX12_RECT(0, 0, rtWidth, rtHeight));
+	}
+
+	return tiles;
+}
+
 void RT64::View::createViewParamsBuffer() {
-	viewParamsBufferSize = ROUND_UP(4 * sizeof(XMMATRIX) + 8, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	viewParamsBufferSize = ROUND_UP(sizeof(ViewParamsBuffer), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 	viewParamBufferResource = scene->getDevice()->allocateBuffer(D3D12_HEAP_TYPE_UPLOAD, viewParamsBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
 
 void RT64::View::updateViewParamsBuffer() {
 	assert(fovRadians > 0.0f);
 
-	// Previous view and projection matrices.
-	if (!viewParamsBufferUpdatedThisFrame) {
-		viewParamsBufferData.prevViewProj = XMMatrixMultiply(viewParamsBufferData.view, viewParamsBufferData.projection);
-		viewParamsBufferUpdatedThisFrame = true;
-	}
-
 	// Compute the hash of the view and projection matrices and use it as the random seed.
 	// This is to prevent the denoiser from showing movement when the game is paused.
 	XXHash32 viewProjHash(0);
@@ -471,134 +974,56 @@ void RT64::View::updateViewParamsBuffer() {
 	D3D12_CHECK(viewParamBufferResource.Get()->Map(0, nullptr, (void **)&pData));
 	memcpy(pData, &viewParamsBufferData, sizeof(ViewParamsBuffer));
 	viewParamBufferResource.Get()->Unmap(0, nullptr);
+	scene->getDevice()->getCounters()->bytesUploaded += sizeof(ViewParamsBuffer);
 }
 
 void RT64::View::update() {
-	if (rtScale != resolutionScale) {
+	RT64_PROFILE_SCOPE(scene->getDevice()->getProfiler(), "View update", RT64_TIMING_CPU_VIEW_UPDATE);
+
+	// The governor picks the scale from the time the rays and the reconstruction took on the last frame. The buffers
+	// are big enough for any of its scales, so only the region that is traced changes.
+	if (resolutionGovernor.isEnabled()) {
+		float governorScale = resolutionGovernor.update(rtGpuMilliseconds);
+		if (rtScale != governorScale) {
+			rtScale = governorScale;
+			updateActiveResolution();
+		}
+	}
+	else if (rtScale != resolutionScale) {
 		rtScale = std::max(std::min(resolutionScale, 2.0f), 0.01f);
 		resolutionScale = rtScale;
-		createOutputBuffers();
+		outputBuffersDirty = true;
 	}
 
-	if (!scene->getInstances().empty()) {
-		// Create the active instance vectors.
-		RenderInstance renderInstance;
-		Mesh* usedMesh = nullptr;
-		size_t totalInstances = scene->getInstances().size();
-		unsigned int instFlags = 0;
-		unsigned int screenHeight = getHeight();
-		rtInstances.clear();
-		rasterBgInstances.clear();
-		rasterFgInstances.clear();
-		usedTextures.clear();
-
-		rtInstances.reserve(totalInstances);
-		rasterBgInstances.reserve(totalInstances);
-		rasterFgInstances.reserve(totalInstances);
-		usedTextures.reserve(1024);
-
-		for (Instance *instance : scene->getInstances()) {
-			instFlags = instance->getFlags();
-			usedMesh = instance->getMesh();
-			renderInstance.instance = instance;
-			renderInstance.bottomLevelAS = usedMesh->getBottomLevelASResult();
-			renderInstance.transform = instance->getTransform();
-			renderInstance.material = instance->getMaterial();
-			renderInstance.indexCount = usedMesh->getIndexCount();
-			renderInstance.indexBufferView = usedMesh->getIndexBufferView();
-			renderInstance.vertexBufferView = usedMesh->getVertexBufferView();
-			renderInstance.material.diffuseTexIndex = (int)(usedTextures.size());
-			renderInstance.flags = (instFlags & RT64_INSTANCE_DISABLE_BACKFACE_CULLING) ? D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE : D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-			usedTextures.push_back(instance->getDiffuseTexture());
-
-			if (instance->hasScissorRect()) {
-				RT64_RECT rect = instance->getScissorRect();
-				renderInstance.scissorRect.left = rect.x;
-				renderInstance.scissorRect.top = screenHeight - rect.y - rect.h;
-				renderInstance.scissorRect.right = rect.x + rect.w;
-				renderInstance.scissorRect.bottom = screenHeight - rect.y;
-			}
-			else {
-				renderInstance.scissorRect = CD3DX12_RECT(0, 0, 0, 0);
-			}
+	rtGpuMilliseconds = 0.0f;
 
-			if (instance->hasViewportRect()) {
-				RT64_RECT rect = instance->getViewportRect();
-				renderInstance.viewport = CD3DX12_VIEWPORT(
-					static_cast<float>(rect.x),
-					static_cast<float>(screenHeight - rect.y - rect.h),
-					static_cast<float>(rect.w),
-					static_cast<float>(rect.h)
-				);
-			}
-			else {
-				renderInstance.viewport = CD3DX12_VIEWPORT(0.0f, 0.0f, 0.0f, 0.0f);
-			}
-
-			if (instance->getNormalTexture() != nullptr) {
-				renderInstance.material.normalTexIndex = (int)(usedTextures.size());
-				usedTextures.push_back(instance->getNormalTexture());
-			}
-			else {
-				renderInstance.material.normalTexIndex = -1;
-			}
-
-			if (instance->getSpecularTexture() != nullptr) {
-				renderInstance.material.specularTexIndex = (int)(usedTextures.size());
-				usedTextures.push_back(instance->getSpecularTexture());
-			}
-			else {
-				renderInstance.material.specularTexIndex = -1;
-			}
-			
-			if (renderInstance.bottomLevelAS != nullptr) {
-				rtInstances.push_back(renderInstance);
-			}
-			else if (instFlags & RT64_INSTANCE_RASTER_BACKGROUND) {
-				rasterBgInstances.push_back(renderInstance);
-			}
-			else {
-				rasterFgInstances.push_back(renderInstance);
-			}
-		}
-
-		// Create the acceleration structures used by the raytracer.
-		if (!rtInstances.empty()) {
-			createTopLevelAS(rtInstances);
-		}
+	if (outputBuffersDirty) {
+		createOutputBuffers();
+	}
 
-		// Create the instance properties buffer for the active instances (if necessary).
-		createInstancePropertiesBuffer();
-		
-		// Create the buffer containing the raytracing result (always output in a
-		// UAV), and create the heap referencing the resources used by the raytracing,
-		// such as the acceleration structure
+	// The instances, the top-level AS and the instance properties are shared by all the views and were already
+	// prepared by the scene, so the view only needs to reference them from its own heap and binding table.
+	if (!scene->getInstances().empty()) {
 		createShaderResourceHeap();
-		
-		// Create the shader binding table and indicating which shaders
-		// are invoked for each instance in the AS.
 		createShaderBindingTable();
-
-		// Update the instance properties buffer for the active instances.
-		updateInstancePropertiesBuffer();
-	}
-	else {
-		rtInstances.clear();
-		rasterBgInstances.clear();
-		rasterFgInstances.clear();
 	}
 }
 
 void RT64::View::render() {
-	if (descriptorHeap == nullptr) {
+	if (descriptorSet == nullptr) {
 		return;
 	}
 
+	Device *device = scene->getDevice();
+	RT64_PROFILE_SCOPE(device->getProfiler(), "View render", RT64_TIMING_CPU_VIEW_RENDER);
+	const std::vector<Scene::RenderInstance> &rtInstances = scene->getRtInstances();
+	const std::vector<Scene::RenderInstance> &rasterBgInstances = scene->getRasterBgInstances();
+	const std::vector<Scene::RenderInstance> &rasterFgInstances = scene->getRasterFgInstances();
 	auto viewport = scene->getDevice()->getD3D12Viewport();
 	auto scissorRect = scene->getDevice()->getD3D12ScissorRect();
 	auto d3dCommandList = scene->getDevice()->getD3D12CommandList();
 	auto d3d12RenderTarget = scene->getDevice()->getD3D12RenderTarget();
-	std::vector<ID3D12DescriptorHeap *> heaps = { descriptorHeap };
+	std::vector<ID3D12DescriptorHeap *> heaps = { descriptorSet->getD3D12Heap() };
 
 	auto resetPipeline = [d3dCommandList, &heaps, this]() {
 		// Set the right pipeline state and root graphics signature used for rasterization.
@@ -607,7 +1032,7 @@ void RT64::View::render() {
 
 		// Bind the descriptor heap and the set heap as a descriptor table.
 		d3dCommandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size()), heaps.data());
-		d3dCommandList->SetGraphicsRootDescriptorTable(1, descriptorHeap->GetGPUDescriptorHandleForHeapStart());
+		d3dCommandList->SetGraphicsRootDescriptorTable(1, descriptorSet->getD3D12GPUHandle(0));
 	};
 
 	// Configure the current viewport.
@@ -621,9 +1046,10 @@ void RT64::View::render() {
 		viewportApplied = false;
 	};
 
-	auto applyScissor = [this, d3dCommandList, resetScissor](const CD3DX12_RECT &rect) {
+	auto applyScissor = [this, d3dCommandList, resetScissor](const RenderRect &rect) {
 		if (rect.right > rect.left) {
-			d3dCommandList->RSSetScissorRects(1, &rect);
+			CD3DX12_RECT d3dRect(rect.left, rect.top, rect.right, rect.bottom);
+			d3dCommandList->RSSetScissorRects(1, &d3dRect);
 			scissorApplied = true;
 		}
 		else if (scissorApplied) {
@@ -631,9 +1057,10 @@ void RT64::View::render() {
 		}
 	};
 	
-	auto applyViewport = [this, d3dCommandList, resetViewport](const CD3DX12_VIEWPORT &viewport) {
-		if ((viewport.Width > 0) && (viewport.Height > 0)) {
-			d3dCommandList->RSSetViewports(1, &viewport);
+	auto applyViewport = [this, d3dCommandList, resetViewport](const RenderViewport &viewport) {
+		if (!viewport.isEmpty()) {
+			CD3DX12_VIEWPORT d3dViewport(viewport.x, viewport.y, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth);
+			d3dCommandList->RSSetViewports(1, &d3dViewport);
 			viewportApplied = true;
 		}
 		else if (viewportApplied) {
@@ -641,24 +1068,45 @@ void RT64::View::render() {
 		}
 	};
 
-	auto drawInstances = [d3dCommandList, &scissorRect, applyScissor, applyViewport, this](const std::vector<RT64::View::RenderInstance> &rasterInstances, UINT baseInstanceIndex, bool applyScissorsAndViewports) {
+	auto drawInstances = [d3dCommandList, &scissorRect, applyScissor, applyViewport, this](const std::vector<Scene::RenderInstance> &rasterInstances, UINT baseInstanceIndex, bool applyScissorsAndViewports) {
 		d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		// Most meshes share the same blocks of the geometry pools, so the buffers are only bound again when they change.
+		RenderBuffer *boundVertexBuffer = nullptr;
+		RenderBuffer *boundIndexBuffer = nullptr;
 		UINT rasterSz = (UINT)(rasterInstances.size());
 		for (UINT j = 0; j < rasterSz; j++) {
-			const RenderInstance &renderInstance = rasterInstances[j];
+			const Scene::RenderInstance &renderInstance = rasterInstances[j];
 			if (applyScissorsAndViewports) {
 				applyScissor(renderInstance.scissorRect);
 				applyViewport(renderInstance.viewport);
 			}
 
+			if (renderInstance.vertexBuffer != boundVertexBuffer) {
+				D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+				vertexBufferView.BufferLocation = renderInstance.vertexBuffer->getDeviceAddress();
+				vertexBufferView.SizeInBytes = (UINT)(renderInstance.vertexBuffer->getDesc().size);
+				vertexBufferView.StrideInBytes = sizeof(RT64_VERTEX);
+				d3dCommandList->IASetVertexBuffers(0, 1, &vertexBufferView);
+				boundVertexBuffer = renderInstance.vertexBuffer;
+			}
+
+			if (renderInstance.indexBuffer != boundIndexBuffer) {
+				D3D12_INDEX_BUFFER_VIEW indexBufferView;
+				indexBufferView.BufferLocation = renderInstance.indexBuffer->getDeviceAddress();
+				indexBufferView.SizeInBytes = (UINT)(renderInstance.indexBuffer->getDesc().size);
+				indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+				d3dCommandList->IASetIndexBuffer(&indexBufferView);
+				boundIndexBuffer = renderInstance.indexBuffer;
+			}
+
 			d3dCommandList->SetGraphicsRoot32BitConstant(0, baseInstanceIndex + j, 0);
-			d3dCommandList->IASetVertexBuffers(0, 1, renderInstance.vertexBufferView);
-			d3dCommandList->IASetIndexBuffer(renderInstance.indexBufferView);
-			d3dCommandList->DrawIndexedInstanced(renderInstance.indexCount, 1, 0, 0, 0);
+			d3dCommandList->DrawIndexedInstanced(renderInstance.indexCount, 1, renderInstance.firstIndex, (INT)(renderInstance.firstVertex), 0);
 		}
 	};
 
 	// Draw the background instances to the screen.
+	int gpuTimer = device->beginGpuTimer("Background raster", RT64_TIMING_GPU_BACKGROUND_RASTER);
 	resetPipeline();
 	resetScissor();
 	resetViewport();
@@ -686,34 +1134,58 @@ void RT64::View::render() {
 		d3dCommandList->ResourceBarrier(1, &bgBarrier);
 	}
 
+	device->endGpuTimer(gpuTimer);
+
 	// Raytracing.
 	if (!rtInstances.empty()) {
+		tracedInstances.resize(rtInstances.size());
+		for (size_t i = 0; i < rtInstances.size(); i++) {
+			tracedInstances[i] = rtInstances[i].instance->getSceneHandle();
+		}
+
 		CD3DX12_RESOURCE_BARRIER rtBarrier = CD3DX12_RESOURCE_BARRIER::Transition(rtOutput.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 		d3dCommandList->ResourceBarrier(1, &rtBarrier);
 
 		// Determine whether to use the viewport and scissor from the first RT Instance or not.
 		// TODO: Some less hackish way to determine what viewport to use for the raytraced content perhaps.
-		CD3DX12_RECT rtScissorRect = rtInstances[0].scissorRect;
-		CD3DX12_VIEWPORT rtViewport = rtInstances[0].viewport;
+		RenderRect rtScissorRect = rtInstances[0].scissorRect;
+		RenderViewport rtViewport = rtInstances[0].viewport;
 		if ((rtScissorRect.right <= rtScissorRect.left)) {
-			rtScissorRect = scissorRect;
+			rtScissorRect = { scissorRect.left, scissorRect.top, scissorRect.right, scissorRect.bottom };
+		}
+
+		if ((rtViewport.width == 0) || (rtViewport.height == 0)) {
+			rtViewport = { viewport.TopLeftX, viewport.TopLeftY, viewport.Width, viewport.Height, viewport.MinDepth, viewport.MaxDepth };
 		}
 
-		if ((rtViewport.Width == 0) || (rtViewport.Height == 0)) {
-			rtViewport = viewport;
+		viewParamsBufferData.viewport[0] = rtViewport.x;
+		viewParamsBufferData.viewport[1] = rtViewport.y;
+		viewParamsBufferData.viewport[2] = rtViewport.width;
+		viewParamsBufferData.viewport[3] = rtViewport.height;
+
+		// Jitter the rays inside their pixels so the upscaler can gather samples from all over the pixels of the screen.
+		const bool upscaling = upscalerEnabled && !rtUpscaleColor[0].IsNull();
+		if (upscaling) {
+			unsigned int phaseCount = TemporalUpscaler::jitterPhaseCount(rtWidth, rtHeight, getWidth(), getHeight());
+			TemporalUpscaler::jitterOffset(viewParamsBufferData.frameCount, phaseCount, viewParamsBufferData.jitter[0], viewParamsBufferData.jitter[1]);
+		}
+		else {
+			viewParamsBufferData.jitter[0] = 0.0f;
+			viewParamsBufferData.jitter[1] = 0.0f;
+		}
+
+		// Tiles get their share of the samples from the variance of the previous frames.
+		if (!tileVariance.IsNull()) {
+			updateTileUnits();
 		}
 
-		viewParamsBufferData.viewport[0] = rtViewport.TopLeftX;
-		viewParamsBufferData.viewport[1] = rtViewport.TopLeftY;
-		viewParamsBufferData.viewport[2] = rtViewport.Width;
-		viewParamsBufferData.viewport[3] = rtViewport.Height;
 		updateViewParamsBuffer();
 
 		// Ray generation.
 		D3D12_DISPATCH_RAYS_DESC desc = {};
 		uint32_t rayGenerationSectionSizeInBytes = sbtHelper.GetRayGenSectionSize();
 		desc.RayGenerationShaderRecord.StartAddress = sbtStorage.Get()->GetGPUVirtualAddress();
-		desc.RayGenerationShaderRecord.SizeInBytes = rayGenerationSectionSizeInBytes;
+		desc.RayGenerationShaderRecord.SizeInBytes = sbtHelper.GetRayGenEntrySize();
 
 		// Miss shader table.
 		uint32_t missSectionSizeInBytes = sbtHelper.GetMissSectionSize();
@@ -726,21 +1198,101 @@ void RT64::View::render() {
 		desc.HitGroupTable.StartAddress = sbtStorage.Get()->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes + missSectionSizeInBytes;
 		desc.HitGroupTable.SizeInBytes = hitGroupsSectionSize;
 		desc.HitGroupTable.StrideInBytes = sbtHelper.GetHitGroupEntrySize();
-		
-		// Dimensions.
-		desc.Width = rtWidth;
-		desc.Height = rtHeight;
-		desc.Depth = 1;
 
-		// Bind pipeline and dispatch rays.
+		// Bind pipeline and dispatch rays for each tile. Every tile uses its own ray generation record.
+		// The tiles share the same hit buffer, so they must be serialized with an UAV barrier.
+		// Only the rays for the pixels of the trace pattern are dispatched.
+		const InterleavedReconstructor::Pattern tracePattern = (InterleavedReconstructor::Pattern)(viewParamsBufferData.tracePattern);
+		gpuTimer = device->beginGpuTimer("Ray dispatch", RT64_TIMING_GPU_RAY_DISPATCH, &rtGpuMilliseconds);
 		d3dCommandList->SetPipelineState1(scene->getDevice()->getD3D12RtStateObject());
-		d3dCommandList->DispatchRays(&desc);
+		std::vector<CD3DX12_RECT> tiles = getTraceTiles();
+		for (size_t t = 0; t < tiles.size(); t++) {
+			if (t > 0) {
+				CD3DX12_RESOURCE_BARRIER hitBarrier = CD3DX12_RESOURCE_BARRIER::UAV(rtHitBuffer.Get());
+				d3dCommandList->ResourceBarrier(1, &hitBarrier);
+			}
+
+			desc.RayGenerationShaderRecord.StartAddress = sbtStorage.Get()->GetGPUVirtualAddress() + t * sbtHelper.GetRayGenEntrySize();
+			int launchWidth, launchHeight;
+			InterleavedReconstructor::launchDimensions(tracePattern, tiles[t].right - tiles[t].left, tiles[t].bottom - tiles[t].top, launchWidth, launchHeight);
+			desc.Width = launchWidth;
+			desc.Height = launchHeight;
+			desc.Depth = 1;
+			d3dCommandList->DispatchRays(&desc);
+		}
+
+		device->endGpuTimer(gpuTimer);
+
+		// Read back the variance the tracer measured on the tiles.
+		if (!tileVariance.IsNull()) {
+			copyTileVariance();
+		}
+
+		// Fill the pixels that weren't traced this frame with the history and the traced pixels around them.
+		if (!rtReconstructColor[0].IsNull()) {
+			// The pass covers the whole traced region, so its cost also depends on the scale and it's part of the governor's budget.
+			gpuTimer = device->beginGpuTimer("Reconstruct", RT64_TIMING_GPU_RECONSTRUCT, &rtGpuMilliseconds);
+			ID3D12Resource *historyResources[] = { rtReconstructColor[rtReconstructIndex].Get(), rtReconstructGuide[rtReconstructIndex].Get(), rtReconstructInstanceId[rtReconstructIndex].Get() };
+			CD3DX12_RESOURCE_BARRIER reconstructBarriers[] = {
+				CD3DX12_RESOURCE_BARRIER::Transition(historyResources[0], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+				CD3DX12_RESOURCE_BARRIER::Transition(historyResources[1], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+				CD3DX12_RESOURCE_BARRIER::Transition(historyResources[2], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+				CD3DX12_RESOURCE_BARRIER::UAV(nullptr)
+			};
+
+			d3dCommandList->ResourceBarrier(_countof(reconstructBarriers), reconstructBarriers);
+
+			// Only the region that was traced is reconstructed.
+			CD3DX12_CPU_DESCRIPTOR_HANDLE reconstructRtvHandle(reconstructRtvHeap->GetCPUDescriptorHandleForHeapStart(), rtReconstructIndex * 3, outputRtvDescriptorSize);
+			CD3DX12_VIEWPORT reconstructViewport(0.0f, 0.0f, (float)(rtWidth), (float)(rtHeight));
+			CD3DX12_RECT reconstructScissor(0, 0, rtWidth, rtHeight);
+			d3dCommandList->OMSetRenderTargets(3, &reconstructRtvHandle, TRUE, nullptr);
+			d3dCommandList->RSSetViewports(1, &reconstructViewport);
+			d3dCommandList->RSSetScissorRects(1, &reconstructScissor);
+
+			const UINT composeDescriptorSize = scene->getDevice()->getD3D12Device()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			CD3DX12_GPU_DESCRIPTOR_HANDLE reconstructInputsHandle(composeHeap->GetGPUDescriptorHandleForHeapStart(), ReconstructInputsDescriptor + rtReconstructIndex * ReconstructInputCount, composeDescriptorSize);
+			const UINT reconstructParams[8] = {
+				(UINT)(rtWidth),
+				(UINT)(rtHeight),
+				viewParamsBufferData.tracePattern,
+				viewParamsBufferData.frameCount,
+				reconstructHistoryValid ? 1U : 0U,
+				viewParamsBufferData.temporalEnabled,
+				(UINT)(viewParamsBufferData.prevResolution[0]),
+				(UINT)(viewParamsBufferData.prevResolution[1])
+			};
+
+			d3dCommandList->SetPipelineState(scene->getDevice()->getReconstructPipelineState());
+			d3dCommandList->SetGraphicsRootSignature(scene->getDevice()->getReconstructRootSignature());
+			std::vector<ID3D12DescriptorHeap *> reconstructHeaps = { composeHeap };
+			d3dCommandList->SetDescriptorHeaps(static_cast<UINT>(reconstructHeaps.size()), reconstructHeaps.data());
+			d3dCommandList->SetGraphicsRootDescriptorTable(0, reconstructInputsHandle);
+			d3dCommandList->SetGraphicsRoot32BitConstants(1, _countof(reconstructParams), reconstructParams, 0);
+			d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			d3dCommandList->IASetVertexBuffers(0, 0, nullptr);
+			d3dCommandList->DrawInstanced(3, 1, 0, 0);
+
+			for (int i = 0; i < 3; i++) {
+				std::swap(reconstructBarriers[i].Transition.StateBefore, reconstructBarriers[i].Transition.StateAfter);
+			}
+
+			d3dCommandList->ResourceBarrier(_countof(reconstructBarriers), reconstructBarriers);
+			resetScissor();
+			resetViewport();
+			device->endGpuTimer(gpuTimer);
+
+			rtReconstructIndex ^= 1;
+			reconstructHistoryValid = true;
+		}
 
 		CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(rtOutput.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 		d3dCommandList->ResourceBarrier(1, &barrier);
 
 		// Denoiser.
-		if (denoiserEnabled && (denoiser != nullptr)) {
+		if (denoiserEnabled && ((denoiser != nullptr) || (cpuDenoiser != nullptr))) {
+			RT64_PROFILE_SCOPE(device->getProfiler(), "Denoise");
+			gpuTimer = device->beginGpuTimer("Denoise", RT64_TIMING_GPU_DENOISE);
 			CD3DX12_RESOURCE_BARRIER barriers[] = {
 				CD3DX12_RESOURCE_BARRIER::UAV(rtAlbedo.Get()),
 				CD3DX12_RESOURCE_BARRIER::UAV(rtNormal.Get())
@@ -748,18 +1300,72 @@ void RT64::View::render() {
 
 			d3dCommandList->ResourceBarrier(_countof(barriers), barriers);
 			
-			// Wait for the raytracing step to be finished.
-			// TODO: Maybe use a fence for this instead so we don't need to wait on all of the GPU operations.
-			scene->getDevice()->submitCommandList();
-			scene->getDevice()->waitForGPU();
-			scene->getDevice()->resetCommandList();
-
-			// Execute the denoiser.
-			denoiser->denoise();
+			if (denoiserMode == RT64_DENOISER_CPU) {
+				denoiseOnCPU();
+			}
+			else {
+				// Wait for the raytracing step to be finished.
+				// TODO: Maybe use a fence for this instead so we don't need to wait on all of the GPU operations.
+				scene->getDevice()->submitCommandList();
+				scene->getDevice()->waitForGPU();
+				scene->getDevice()->resetCommandList();
+
+				// Execute the denoiser.
+				denoiser->denoise();
+			}
 			
 			// Reset the scissor and the viewport since the command list was reset.
 			resetScissor();
 			resetViewport();
+			device->endGpuTimer(gpuTimer);
+		}
+
+		// Reconstruct the output at the resolution of the screen by blending it with the history.
+		if (upscaling) {
+			gpuTimer = device->beginGpuTimer("Upscale", RT64_TIMING_GPU_UPSCALE);
+			ID3D12Resource *upscaleColor = rtUpscaleColor[rtUpscaleIndex].Get();
+			ID3D12Resource *upscaleWeight = rtUpscaleWeight[rtUpscaleIndex].Get();
+			CD3DX12_RESOURCE_BARRIER upscaleBarriers[] = {
+				CD3DX12_RESOURCE_BARRIER::Transition(rtMotion.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+				CD3DX12_RESOURCE_BARRIER::Transition(upscaleColor, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+				CD3DX12_RESOURCE_BARRIER::Transition(upscaleWeight, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET)
+			};
+
+			d3dCommandList->ResourceBarrier(_countof(upscaleBarriers), upscaleBarriers);
+
+			CD3DX12_CPU_DESCRIPTOR_HANDLE upscaleRtvHandle(upscaleRtvHeap->GetCPUDescriptorHandleForHeapStart(), rtUpscaleIndex * 2, outputRtvDescriptorSize);
+			d3dCommandList->OMSetRenderTargets(2, &upscaleRtvHandle, TRUE, nullptr);
+			resetScissor();
+			resetViewport();
+
+			const UINT composeDescriptorSize = scene->getDevice()->getD3D12Device()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			CD3DX12_GPU_DESCRIPTOR_HANDLE upscaleInputsHandle(composeHeap->GetGPUDescriptorHandleForHeapStart(), UpscaleInputsDescriptor + rtUpscaleIndex * UpscaleInputCount, composeDescriptorSize);
+			const float upscaleParams[6] = {
+				(float)(rtWidth),
+				(float)(rtHeight),
+				(float)(getWidth()),
+				(float)(getHeight()),
+				viewParamsBufferData.jitter[0],
+				viewParamsBufferData.jitter[1]
+			};
+
+			d3dCommandList->SetPipelineState(scene->getDevice()->getUpscalePipelineState());
+			d3dCommandList->SetGraphicsRootSignature(scene->getDevice()->getUpscaleRootSignature());
+			std::vector<ID3D12DescriptorHeap *> upscaleHeaps = { composeHeap };
+			d3dCommandList->SetDescriptorHeaps(static_cast<UINT>(upscaleHeaps.size()), upscaleHeaps.data());
+			d3dCommandList->SetGraphicsRootDescriptorTable(0, upscaleInputsHandle);
+			d3dCommandList->SetGraphicsRoot32BitConstants(1, _countof(upscaleParams), upscaleParams, 0);
+			d3dCommandList->SetGraphicsRoot32BitConstant(1, upscaleHistoryValid ? 1 : 0, _countof(upscaleParams));
+			d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			d3dCommandList->IASetVertexBuffers(0, 0, nullptr);
+			d3dCommandList->DrawInstanced(3, 1, 0, 0);
+
+			for (CD3DX12_RESOURCE_BARRIER &barrier : upscaleBarriers) {
+				std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+			}
+
+			d3dCommandList->ResourceBarrier(_countof(upscaleBarriers), upscaleBarriers);
+			device->endGpuTimer(gpuTimer);
 		}
 		
 		// Apply the same scissor and viewport that was determined for the raytracing step.
@@ -771,14 +1377,34 @@ void RT64::View::render() {
 		d3dCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
 
 		// Draw the raytracing output.
+		gpuTimer = device->beginGpuTimer("Compose", RT64_TIMING_GPU_COMPOSE);
 		d3dCommandList->SetPipelineState(scene->getDevice()->getComposePipelineState());
 		d3dCommandList->SetGraphicsRootSignature(scene->getDevice()->getComposeRootSignature());
 		std::vector<ID3D12DescriptorHeap *> composeHeaps = { composeHeap };
 		d3dCommandList->SetDescriptorHeaps(static_cast<UINT>(composeHeaps.size()), composeHeaps.data());
-		d3dCommandList->SetGraphicsRootDescriptorTable(0, composeHeap->GetGPUDescriptorHandleForHeapStart());
+		const UINT composeDescriptorSize = scene->getDevice()->getD3D12Device()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		const int composeDescriptor = upscaling ? (ComposeUpscaledDescriptor + rtUpscaleIndex) : ComposeOutputDescriptor;
+		d3dCommandList->SetGraphicsRootDescriptorTable(0, CD3DX12_GPU_DESCRIPTOR_HANDLE(composeHeap->GetGPUDescriptorHandleForHeapStart(), composeDescriptor, composeDescriptorSize));
+
+		// Only sample the region of the output that was traced, without filtering in the texels past its edges.
+		// The upscaled output always covers the whole texture.
+		const float composeParams[4] = {
+			upscaling ? 1.0f : (float)(rtWidth) / rtAllocWidth,
+			upscaling ? 1.0f : (float)(rtHeight) / rtAllocHeight,
+			upscaling ? 1.0f : (rtWidth - 0.5f) / rtAllocWidth,
+			upscaling ? 1.0f : (rtHeight - 0.5f) / rtAllocHeight
+		};
+
+		d3dCommandList->SetGraphicsRoot32BitConstants(1, _countof(composeParams), composeParams, 0);
 		d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 		d3dCommandList->IASetVertexBuffers(0, 0, nullptr);
 		d3dCommandList->DrawInstanced(3, 1, 0, 0);
+		device->endGpuTimer(gpuTimer);
+
+		if (upscaling) {
+			rtUpscaleIndex ^= 1;
+			upscaleHistoryValid = true;
+		}
 	}
 	else {
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle = scene->getDevice()->getD3D12RTV();
@@ -786,14 +1412,32 @@ void RT64::View::render() {
 	}
 	
 	// Draw the foreground to the screen.
+	gpuTimer = device->beginGpuTimer("Foreground raster", RT64_TIMING_GPU_FOREGROUND_RASTER);
 	resetPipeline();
 	resetScissor();
 	resetViewport();
 	drawInstances(rasterFgInstances, (UINT)(rasterBgInstances.size() + rtInstances.size()), true);
+	device->endGpuTimer(gpuTimer);
+
+	// Store the view and projection used for this frame so the next one can reproject into it.
+	viewParamsBufferData.prevViewProj = XMMatrixMultiply(viewParamsBufferData.view, viewParamsBufferData.projection);
+
+	// Swap the temporal accumulation buffers if they were written to.
+	if (viewParamsBufferData.temporalEnabled && !rtInstances.empty()) {
+		rtAccumIndex ^= 1;
+		viewParamsBufferData.temporalHistoryValid = 1;
+	}
+
+	// The histories written by this frame are read at the resolution of the next one.
+	if (!rtInstances.empty()) {
+		viewParamsBufferData.prevResolution[0] = viewParamsBufferData.resolution[0];
+		viewParamsBufferData.prevResolution[1] = viewParamsBufferData.resolution[1];
+	}
+
+	// Copy the regions of the instance ID buffer the pending queries need. The results are read once the GPU is done with them.
+	instanceQueries.submit();
 
 	// Clear flags.
-	rtHitInstanceIdReadbackUpdated = false;
-	viewParamsBufferUpdatedThisFrame = false;
 	viewParamsBufferData.frameCount++;
 }
 
@@ -804,9 +1448,9 @@ void RT64::View::renderInspector(Inspector *inspector) {
 		auto scissorRect = scene->getDevice()->getD3D12ScissorRect();
 		d3dCommandList->SetGraphicsRootSignature(scene->getDevice()->getIm3dRootSignature());
 
-		std::vector<ID3D12DescriptorHeap *> heaps = { descriptorHeap };
+		std::vector<ID3D12DescriptorHeap *> heaps = { descriptorSet->getD3D12Heap() };
 		d3dCommandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size()), heaps.data());
-		d3dCommandList->SetGraphicsRootDescriptorTable(0, descriptorHeap->GetGPUDescriptorHandleForHeapStart());
+		d3dCommandList->SetGraphicsRootDescriptorTable(0, descriptorSet->getD3D12GPUHandle(0));
 
 		d3dCommandList->RSSetViewports(1, &viewport);
 		d3dCommandList->RSSetScissorRects(1, &scissorRect);
@@ -818,9 +1462,9 @@ void RT64::View::renderInspector(Inspector *inspector) {
 		}
 
 		if (totalVertexCount > 0) {
-			// Release the previous vertex buffer if it should be bigger.
+			// Retire the previous vertex buffer if it should be bigger.
 			if (!im3dVertexBuffer.IsNull() && (totalVertexCount > im3dVertexCount)) {
-				im3dVertexBuffer.Release();
+				scene->getDevice()->retire(im3dVertexBuffer);
 			}
 
 			// Create the vertex buffer if it's empty.
@@ -989,15 +1633,25 @@ float RT64::View::getResolutionScale() const {
 	return resolutionScale;
 }
 
+void RT64::View::setDynamicResolution(float targetMilliseconds, float minScale, float maxScale) {
+	// The scale is picked so the rays and the reconstruction of the pixels that weren't traced take about the target
+	// time on the GPU. A target of zero disables the governor.
+	ResolutionGovernor::Settings settings = resolutionGovernor.getSettings();
+	settings.targetMilliseconds = targetMilliseconds;
+	settings.minScale = std::max(std::min(minScale, 2.0f), 0.01f);
+	settings.maxScale = std::max(std::min(maxScale, 2.0f), settings.minScale);
+	resolutionGovernor.setSettings(settings);
+
+	// Start from the scale in use and recreate the buffers for the new maximum, or for the manual scale if the governor
+	// was disabled.
+	resolutionGovernor.reset(rtScale);
+	rtScale = resolutionGovernor.isEnabled() ? resolutionGovernor.getScale() : std::max(std::min(resolutionScale, 2.0f), 0.01f);
+	outputBuffersDirty = true;
+}
+
 void RT64::View::setDenoiserEnabled(bool v) {
 	if (!denoiserEnabled && v) {
-		// Create the denoiser if it wasn't created yet.
-		if (denoiser == nullptr) {
-			denoiser = new RT64::Denoiser(scene->getDevice());
-		}
-
-		// Update the buffer sizes since they might've changed since the last time the denoiser was enabled.
-		denoiser->set(rtWidth, rtHeight, rtOutput.Get(), rtAlbedo.Get(), rtNormal.Get());
+		createDenoiser();
 	}
 
 	denoiserEnabled = v;
@@ -1007,6 +1661,112 @@ bool RT64::View::getDenoiserEnabled() const {
 	return denoiserEnabled;
 }
 
+void RT64::View::setDenoiserMode(unsigned int v) {
+	if (denoiserMode != v) {
+		denoiserMode = v;
+
+		// Create the denoiser for the new mode if it's already active.
+		if (denoiserEnabled) {
+			createDenoiser();
+		}
+	}
+}
+
+unsigned int RT64::View::getDenoiserMode() const {
+	return denoiserMode;
+}
+
+void RT64::View::setTemporalEnabled(bool v) {
+	if ((viewParamsBufferData.temporalEnabled != 0) != v) {
+		viewParamsBufferData.temporalEnabled = v;
+		outputBuffersDirty = true;
+	}
+}
+
+bool RT64::View::getTemporalEnabled() const {
+	return viewParamsBufferData.temporalEnabled;
+}
+
+void RT64::View::setUpscalerEnabled(bool v) {
+	if (upscalerEnabled != v) {
+		upscalerEnabled = v;
+		outputBuffersDirty = true;
+	}
+}
+
+bool RT64::View::getUpscalerEnabled() const {
+	return upscalerEnabled;
+}
+
+void RT64::View::setTracePattern(unsigned int v) {
+	unsigned int newTracePattern = (v <= RT64_TRACE_PATTERN_INTERLEAVED) ? v : RT64_TRACE_PATTERN_FULL;
+	if (viewParamsBufferData.tracePattern != newTracePattern) {
+		viewParamsBufferData.tracePattern = newTracePattern;
+		outputBuffersDirty = true;
+	}
+}
+
+unsigned int RT64::View::getTracePattern() const {
+	return viewParamsBufferData.tracePattern;
+}
+
+void RT64::View::setAdaptiveSamplingEnabled(bool v) {
+	if ((viewParamsBufferData.adaptiveSamplingEnabled != 0) != v) {
+		viewParamsBufferData.adaptiveSamplingEnabled = v;
+		outputBuffersDirty = true;
+	}
+}
+
+bool RT64::View::getAdaptiveSamplingEnabled() const {
+	return viewParamsBufferData.adaptiveSamplingEnabled;
+}
+
+void RT64::View::setMaxHitQueries(int v) {
+	unsigned int newMaxHitQueries = (v > 0) ? std::min(v, MaxHitQueries) : MaxHitQueries;
+	if (viewParamsBufferData.maxHitQueries != newMaxHitQueries) {
+		viewParamsBufferData.maxHitQueries = newMaxHitQueries;
+		outputBuffersDirty = true;
+	}
+}
+
+int RT64::View::getMaxHitQueries() const {
+	return viewParamsBufferData.maxHitQueries;
+}
+
+void RT64::View::setTileSize(int v) {
+	unsigned int newTileSize = std::max(v, 0);
+	if (viewParamsBufferData.tileSize != newTileSize) {
+		viewParamsBufferData.tileSize = newTileSize;
+		outputBuffersDirty = true;
+	}
+}
+
+int RT64::View::getTileSize() const {
+	return viewParamsBufferData.tileSize;
+}
+
+void RT64::View::getStats(RT64_VIEW_STATS *stats) const {
+	assert(stats != nullptr);
+	const UINT64 pixelCount = (UINT64)(rtAllocWidth) * rtAllocHeight;
+	stats->resolutionScale = rtScale;
+	stats->maxHitQueries = viewParamsBufferData.maxHitQueries;
+	stats->tileSize = viewParamsBufferData.tileSize;
+	stats->hitRecordSize = HitRecordSize;
+	stats->hitBufferBytes = rtHitBufferSize + rtHitBufferSize / (viewParamsBufferData.maxHitQueries + 1);
+	stats->outputBufferBytes = pixelCount * 16 * 3 + pixelCount * sizeof(uint16_t) + instanceQueryBackend.getAllocatedBytes() + pixelCount * sizeof(float) * 2;
+	if (!rtUpscaleColor[0].IsNull()) {
+		stats->outputBufferBytes += (UINT64)(getWidth()) * getHeight() * (16 + sizeof(float)) * 2;
+	}
+
+	if (!rtReconstructColor[0].IsNull()) {
+		stats->outputBufferBytes += pixelCount * sizeof(float) + pixelCount * (16 * 2 + sizeof(uint16_t)) * 2;
+	}
+
+	if (!rtVarianceMoments.IsNull()) {
+		stats->outputBufferBytes += pixelCount * sizeof(float) * 2 + (UINT64)(tileCapacity) * sizeof(uint32_t) * 4;
+	}
+}
+
 RT64_VECTOR3 RT64::View::getRayDirectionAt(int px, int py) {
 	float x = ((px + 0.5f) / getWidth()) * 2.0f - 1.0f;
 	float y = ((py + 0.5f) / getHeight()) * 2.0f - 1.0f;
@@ -1017,44 +1777,35 @@ RT64_VECTOR3 RT64::View::getRayDirectionAt(int px, int py) {
 }
 
 RT64_INSTANCE *RT64::View::getRaytracedInstanceAt(int x, int y) {
-	// TODO: This doesn't handle cases properly when nothing was hit at the target pixel and returns
-	// the first instance instead. We need to determine what's the best solution for that.
-
-	// Copy instance id resource to readback if necessary.
-	if (!rtHitInstanceIdReadbackUpdated) {
-		auto d3dCommandList = scene->getDevice()->getD3D12CommandList();
-		CD3DX12_RESOURCE_BARRIER rtBarrier = CD3DX12_RESOURCE_BARRIER::Transition(rtHitInstanceId.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-		d3dCommandList->ResourceBarrier(1, &rtBarrier);
-		d3dCommandList->CopyResource(rtHitInstanceIdReadback.Get(), rtHitInstanceId.Get());
-		rtBarrier = CD3DX12_RESOURCE_BARRIER::Transition(rtHitInstanceId.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		d3dCommandList->ResourceBarrier(1, &rtBarrier);
+	// Resolve a query right away by waiting for the GPU to copy its region. The copy is from the last frame that was
+	// traced, so the slot maps the IDs against the instances of that frame even if the scene was updated since.
+	unsigned int queryId = requestInstanceAt(x, y);
+	RT64_INSTANCE *instance = nullptr;
+	for (unsigned int i = 0; i <= InstanceQueryQueue::SlotCount; i++) {
+		instanceQueries.submit();
 		scene->getDevice()->submitCommandList();
 		scene->getDevice()->waitForGPU();
 		scene->getDevice()->resetCommandList();
-		rtHitInstanceIdReadbackUpdated = true;
+		if (pollInstanceQuery(queryId, &instance)) {
+			break;
+		}
 	}
 
-	// Check resource's bounds.
-	x = (int)(x * rtScale);
-	y = (int)(y * rtScale);
-	if ((x < 0) || (x >= rtWidth) || (y < 0) || (y >= rtHeight)) {
-		return nullptr;
-	}
-	
-	// Map the resource read the pixel.
-	size_t index = (rtWidth * y + x) * 2;
-	uint16_t instanceId = 0;
-	uint8_t *pData;
-	D3D12_CHECK(rtHitInstanceIdReadback.Get()->Map(0, nullptr, (void **)(&pData)));
-	memcpy(&instanceId, pData + index, sizeof(instanceId));
-	rtHitInstanceIdReadback.Get()->Unmap(0, nullptr);
-	
-	// Check the matching instance.
-	if (instanceId >= rtInstances.size()) {
-		return nullptr;
+	return instance;
+}
+
+unsigned int RT64::View::requestInstanceAt(int x, int y) {
+	return instanceQueries.request((int)(x * rtScale), (int)(y * rtScale));
+}
+
+bool RT64::View::pollInstanceQuery(unsigned int queryId, RT64_INSTANCE **instance) {
+	void *queryInstance = nullptr;
+	bool ready = instanceQueries.poll(queryId, &queryInstance);
+	if (instance != nullptr) {
+		*instance = (RT64_INSTANCE *)(queryInstance);
 	}
-	
-	return (RT64_INSTANCE *)(rtInstances[instanceId].instance);
+
+	return ready;
 }
 
 void RT64::View::resize() {
@@ -1090,7 +1841,20 @@ DLLEXPORT void RT64_SetViewDescription(RT64_VIEW *viewPtr, RT64_VIEW_DESC viewDe
 	view->setSoftLightSamples(viewDesc.softLightSamples);
 	view->setGIBounces(viewDesc.giBounces);
 	view->setAmbGIMixWeight(viewDesc.ambGiMixWeight);
+	view->setDenoiserMode(viewDesc.denoiserMode);
 	view->setDenoiserEnabled(viewDesc.denoiserEnabled);
+	view->setMaxHitQueries(viewDesc.maxHitQueries);
+	view->setTileSize(viewDesc.tileSize);
+	view->setTemporalEnabled(viewDesc.temporalEnabled);
+	view->setUpscalerEnabled(viewDesc.upscalerEnabled);
+	view->setTracePattern(viewDesc.tracePattern);
+	view->setAdaptiveSamplingEnabled(viewDesc.adaptiveSamplingEnabled);
+}
+
+DLLEXPORT void RT64_SetViewDynamicResolution(RT64_VIEW *viewPtr, float targetMilliseconds, float minScale, float maxScale) {
+	assert(viewPtr != nullptr);
+	RT64::View *view = (RT64::View *)(viewPtr);
+	view->setDynamicResolution(targetMilliseconds, minScale, maxScale);
 }
 
 DLLEXPORT RT64_INSTANCE *RT64_GetViewRaytracedInstanceAt(RT64_VIEW *viewPtr, int x, int y) {
@@ -1099,6 +1863,24 @@ DLLEXPORT RT64_INSTANCE *RT64_GetViewRaytracedInstanceAt(RT64_VIEW *viewPtr, int
 	return view->getRaytracedInstanceAt(x, y);
 }
 
+DLLEXPORT unsigned int RT64_RequestInstanceAt(RT64_VIEW *viewPtr, int x, int y) {
+	assert(viewPtr != nullptr);
+	RT64::View *view = (RT64::View *)(viewPtr);
+	return view->requestInstanceAt(x, y);
+}
+
+DLLEXPORT bool RT64_PollInstanceQuery(RT64_VIEW *viewPtr, unsigned int queryId, RT64_INSTANCE **instance) {
+	assert(viewPtr != nullptr);
+	RT64::View *view = (RT64::View *)(viewPtr);
+	return view->pollInstanceQuery(queryId, instance);
+}
+
+DLLEXPORT void RT64_GetViewStats(RT64_VIEW *viewPtr, RT64_VIEW_STATS *viewStats) {
+	assert(viewPtr != nullptr);
+	RT64::View *view = (RT64::View *)(viewPtr);
+	view->getStats(viewStats);
+}
+
 DLLEXPORT void RT64_DestroyView(RT64_VIEW *viewPtr) {
 	delete (RT64::View *)(viewPtr);
 }
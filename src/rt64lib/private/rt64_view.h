@@ -4,14 +4,19 @@
 
 #pragma once
 
+#include "rt64_adaptive_sampler.h"
 #include "rt64_common.h"
+#include "rt64_instance_query.h"
+#include "rt64_render_interface_d3d12.h"
+#include "rt64_resolution_governor.h"
+#include "rt64_slot_map.h"
 
 #include <map>
 
-#include "nv_helpers_dx12/TopLevelASGenerator.h"
 #include "nv_helpers_dx12/ShaderBindingTableGenerator.h"
 
 namespace RT64 {
+	class CPUDenoiser;
 	class Denoiser;
 	class Scene;
 	class Inspector;
@@ -20,17 +25,36 @@ namespace RT64 {
 
 	class View {
 	private:
-		struct RenderInstance {
-			Instance *instance;
-			const D3D12_VERTEX_BUFFER_VIEW* vertexBufferView;
-			const D3D12_INDEX_BUFFER_VIEW* indexBufferView;
-			int indexCount;
-			ID3D12Resource* bottomLevelAS;
-			DirectX::XMMATRIX transform;
-			RT64_MATERIAL material;
-			CD3DX12_RECT scissorRect;
-			CD3DX12_VIEWPORT viewport;
-			UINT flags;
+		// Copies the regions of the instance ID buffer requested by the queries into a ring of readback buffers.
+		class InstanceQueryBackend : public InstanceQueryQueue::Backend {
+		private:
+			View *view;
+			AllocatedResource readbacks[InstanceQueryQueue::SlotCount];
+			UINT64 fenceValues[InstanceQueryQueue::SlotCount];
+			std::vector<SlotMap<Instance *>::Handle> instances[InstanceQueryQueue::SlotCount];
+		public:
+			InstanceQueryBackend(View *view);
+			void release();
+			UINT64 getAllocatedBytes() const;
+			virtual void beginSlot(unsigned int slot) override;
+			virtual void copyRegion(unsigned int slot, unsigned int regionIndex, int x, int y, int width, int height) override;
+			virtual void endSlot(unsigned int slot) override;
+			virtual bool isSlotComplete(unsigned int slot) override;
+			virtual void readSlot(unsigned int slot, unsigned int regionCount, uint16_t *ids) override;
+			virtual void *getInstance(unsigned int slot, uint16_t instanceId) override;
+		};
+
+		// The guide buffers of a frame are read back into a slot and denoised on the CPU during the next frame, so
+		// the CPU never waits for the GPU to finish tracing. The output lags a frame behind while it's enabled.
+		static const unsigned int CPUDenoiserSlotCount = 3;
+
+		struct CPUDenoiserSlot {
+			AllocatedResource readback;
+			AllocatedResource upload;
+			UINT64 fenceValue;
+			int width;
+			int height;
+			bool pending;
 		};
 
 		struct ViewParamsBuffer {
@@ -41,6 +65,7 @@ namespace RT64 {
 			XMMATRIX prevViewProj;
 			float viewport[4];
 			float resolution[4];
+			float jitter[2];
 			unsigned int randomSeed;
 			unsigned int softLightSamples;
 			unsigned int giBounces;
@@ -48,6 +73,16 @@ namespace RT64 {
 			unsigned int maxLightSamples;
 			float ambGIMixWeight;
 			unsigned int frameCount;
+			unsigned int maxHitQueries;
+			unsigned int tileSize;
+			unsigned int temporalEnabled;
+			unsigned int temporalHistoryValid;
+			unsigned int tracePattern;
+			unsigned int adaptiveSamplingEnabled;
+			unsigned int varianceHistoryValid;
+
+			// Resolution the temporal and the reconstruction histories were traced at.
+			float prevResolution[2];
 		};
 
 		Scene *scene;
@@ -55,30 +90,67 @@ namespace RT64 {
 		float nearDist;
 		float farDist;
 		bool perspectiveControlActive;
-		AccelerationStructureBuffers topLevelASBuffers;
-		nv_helpers_dx12::TopLevelASGenerator topLevelASGenerator;
 		AllocatedResource rasterBg;
 		ID3D12DescriptorHeap *rasterBgHeap;
 		AllocatedResource rtOutput;
 		AllocatedResource rtAlbedo;
 		AllocatedResource rtNormal;
-		AllocatedResource rtHitDistance;
-		AllocatedResource rtHitColor;
-		AllocatedResource rtHitNormal;
-		AllocatedResource rtHitSpecular;
-		AllocatedResource rtHitInstanceId;
-		AllocatedResource rtHitInstanceIdReadback;
+		AllocatedResource rtHitBuffer;
+		AllocatedResource rtHitPrevPosition;
+		AllocatedResource rtInstanceId;
+		AllocatedResource rtAccumColor[2];
+		AllocatedResource rtAccumDepth[2];
+		AllocatedResource rtMotion;
+		AllocatedResource rtDepth;
+		AllocatedResource rtReconstructColor[2];
+		AllocatedResource rtReconstructGuide[2];
+		AllocatedResource rtReconstructInstanceId[2];
+		ID3D12DescriptorHeap *reconstructRtvHeap;
+		int rtReconstructIndex;
+		bool reconstructHistoryValid;
+		AllocatedResource rtVarianceMoments;
+		AllocatedResource tileVariance;
+		AllocatedResource tileVarianceClear;
+		AllocatedResource tileVarianceReadback;
+		AllocatedResource tileUnits;
+		AdaptiveSampler adaptiveSampler;
+		int tileCapacity;
+		UINT64 tileVarianceFenceValue;
+		bool tileVariancePending;
+		bool tileUnitsDirty;
+		AllocatedResource rtUpscaleColor[2];
+		AllocatedResource rtUpscaleWeight[2];
+		ID3D12DescriptorHeap *upscaleRtvHeap;
+		int rtAccumIndex;
+		int rtUpscaleIndex;
+		bool upscalerEnabled;
+		bool upscaleHistoryValid;
+		UINT64 rtHitBufferSize;
 		int rtWidth;
 		int rtHeight;
+		int rtAllocWidth;
+		int rtAllocHeight;
 		float rtScale;
 		float resolutionScale;
+		bool outputBuffersDirty;
+		ResolutionGovernor resolutionGovernor;
+		float rtGpuMilliseconds;
 		bool denoiserEnabled;
+		unsigned int denoiserMode;
 		Denoiser *denoiser;
+		CPUDenoiser *cpuDenoiser;
+		CPUDenoiserSlot cpuDenoiserSlots[CPUDenoiserSlotCount];
+		unsigned int cpuDenoiserSlotIndex;
+		UINT cpuDenoiserRowPitch;
+		UINT cpuDenoiserMotionRowPitch;
+		UINT64 cpuDenoiserImageSize;
 
-		bool rtHitInstanceIdReadbackUpdated;
+		// Instances of the last frame that was traced, which the IDs in the instance ID buffer are indices into.
+		std::vector<SlotMap<Instance *>::Handle> tracedInstances;
+		InstanceQueryBackend instanceQueryBackend;
+		InstanceQueryQueue instanceQueries;
 		UINT outputRtvDescriptorSize;
-		ID3D12DescriptorHeap *descriptorHeap;
-		UINT descriptorHeapEntryCount;
+		D3D12RenderDescriptorSet *descriptorSet;
 		ID3D12DescriptorHeap *composeHeap;
 		nv_helpers_dx12::ShaderBindingTableGenerator sbtHelper;
 		AllocatedResource sbtStorage;
@@ -86,13 +158,6 @@ namespace RT64 {
 		AllocatedResource viewParamBufferResource;
 		ViewParamsBuffer viewParamsBufferData;
 		uint32_t viewParamsBufferSize;
-		bool viewParamsBufferUpdatedThisFrame;
-		AllocatedResource activeInstancesBufferProps;
-		uint32_t activeInstancesBufferPropsSize;
-		std::vector<RenderInstance> rasterBgInstances;
-		std::vector<RenderInstance> rasterFgInstances;
-		std::vector<RenderInstance> rtInstances;
-		std::vector<Texture*> usedTextures;
 		bool scissorApplied;
 		bool viewportApplied;
 
@@ -102,11 +167,15 @@ namespace RT64 {
 		
 		void createOutputBuffers();
 		void releaseOutputBuffers();
-		void createInstancePropertiesBuffer();
-		void updateInstancePropertiesBuffer();
-		void createTopLevelAS(const std::vector<RenderInstance> &rtInstances);
+		void updateActiveResolution();
+		void createDenoiser();
+		void createCPUDenoiserBuffers();
+		void denoiseOnCPU();
+		void updateTileUnits();
+		void copyTileVariance();
 		void createShaderResourceHeap();
 		void createShaderBindingTable();
+		std::vector<CD3DX12_RECT> getTraceTiles() const;
 		void createViewParamsBuffer();
 		void updateViewParamsBuffer();
 	public:
@@ -136,10 +205,30 @@ namespace RT64 {
 		float getAmbGIMixWeight() const;
 		void setResolutionScale(float v);
 		float getResolutionScale() const;
+		void setDynamicResolution(float targetMilliseconds, float minScale, float maxScale);
 		void setDenoiserEnabled(bool v);
 		bool getDenoiserEnabled() const;
+		void setDenoiserMode(unsigned int v);
+		unsigned int getDenoiserMode() const;
+		void setTemporalEnabled(bool v);
+		bool getTemporalEnabled() const;
+		void setUpscalerEnabled(bool v);
+		bool getUpscalerEnabled() const;
+		void setTracePattern(unsigned int v);
+		unsigned int getTracePattern() const;
+		void setAdaptiveSamplingEnabled(bool v);
+		bool getAdaptiveSamplingEnabled() const;
+		void setMaxHitQueries(int v);
+		int getMaxHitQueries() const;
+		void setTileSize(int v);
+		int getTileSize() const;
+		void getStats(RT64_VIEW_STATS *stats) const;
 		RT64_VECTOR3 getRayDirectionAt(int x, int y);
+		// Waits for the GPU to resolve a query on the last frame that was traced. Returns null if the instance that was
+		// traced there has been destroyed since.
 		RT64_INSTANCE *getRaytracedInstanceAt(int x, int y);
+		unsigned int requestInstanceAt(int x, int y);
+		bool pollInstanceQuery(unsigned int queryId, RT64_INSTANCE **instance);
 		void resize();
 		int getWidth() const;
 		int getHeight() const;
@@ -5,7 +5,10 @@
 #ifndef RT64_H_INCLUDED
 #define RT64_H_INCLUDED
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
+
 #include <stdio.h>
 
 // Material constants.
@@ -23,6 +26,43 @@
 #define RT64_MATERIAL_CC_SHADER_TEXEL0A			6
 #define RT64_MATERIAL_CC_SHADER_TEXEL1			7
 
+// View denoiser modes. The CPU denoiser shows the raytraced output one frame late so it never waits for the GPU.
+#define RT64_DENOISER_OPTIX						0
+#define RT64_DENOISER_CPU						1
+
+// View trace patterns. The pixels that aren't traced on a frame are reconstructed from the previous frames.
+#define RT64_TRACE_PATTERN_FULL					0
+#define RT64_TRACE_PATTERN_CHECKERBOARD			1
+#define RT64_TRACE_PATTERN_INTERLEAVED			2
+
+// Frame capture formats.
+#define RT64_CAPTURE_FORMAT_BMP					0
+#define RT64_CAPTURE_FORMAT_PNG					1
+#define RT64_CAPTURE_FORMAT_EXR					2
+#define RT64_CAPTURE_UNLIMITED					-1
+
+// Heap types in the device stats.
+#define RT64_HEAP_DEFAULT						0
+#define RT64_HEAP_UPLOAD						1
+#define RT64_HEAP_READBACK						2
+#define RT64_HEAP_CUSTOM						3
+#define RT64_HEAP_COUNT							4
+
+// Frame timing stages.
+#define RT64_TIMING_CPU_DRAW					0
+#define RT64_TIMING_CPU_SCENE_UPDATE			1
+#define RT64_TIMING_CPU_VIEW_UPDATE				2
+#define RT64_TIMING_CPU_VIEW_RENDER				3
+#define RT64_TIMING_CPU_PRESENT					4
+#define RT64_TIMING_GPU_BACKGROUND_RASTER		5
+#define RT64_TIMING_GPU_RAY_DISPATCH			6
+#define RT64_TIMING_GPU_DENOISE					7
+#define RT64_TIMING_GPU_COMPOSE					8
+#define RT64_TIMING_GPU_FOREGROUND_RASTER		9
+#define RT64_TIMING_GPU_UPSCALE					10
+#define RT64_TIMING_GPU_RECONSTRUCT				11
+#define RT64_TIMING_COUNT						12
+
 // Material attributes.
 #define RT64_ATTRIBUTE_NONE							0x0000
 #define RT64_ATTRIBUTE_IGNORE_NORMAL_FACTOR			0x0001
@@ -152,8 +192,65 @@ typedef struct {
 	unsigned int giBounces;
 	float ambGiMixWeight;
 	bool denoiserEnabled;
+	unsigned int maxHitQueries;		// Hits stored per pixel, up to 16. Zero uses the maximum.
+	unsigned int tileSize;			// Trace in square tiles of this size to reduce the hit buffer memory. Zero disables tiling.
+	unsigned int denoiserMode;		// One of the RT64_DENOISER_* modes.
+	bool temporalEnabled;			// Accumulate the output over multiple frames using reprojection.
+	bool upscalerEnabled;			// Reconstruct the output at the screen resolution over multiple frames with jittered rays.
+	unsigned int tracePattern;		// One of the RT64_TRACE_PATTERN_* patterns. Checkerboard traces half of the pixels every frame and interleaved a quarter.
+	bool adaptiveSamplingEnabled;	// Move the light and GI samples to the noisiest regions of the previous frames while keeping the same total.
 } RT64_VIEW_DESC;
 
+typedef struct {
+	float resolutionScale;			// Scale in use, which is picked every frame when the resolution is dynamic.
+	unsigned int maxHitQueries;
+	unsigned int tileSize;
+	unsigned int hitRecordSize;
+	unsigned long long hitBufferBytes;
+	unsigned long long outputBufferBytes;
+} RT64_VIEW_STATS;
+
+typedef struct {
+	// Last frame, added up across views.
+	unsigned int rtInstances;
+	unsigned int rasterBgInstances;
+	unsigned int rasterFgInstances;
+	unsigned long long tlasBytes;
+	unsigned int descriptorsUsed;
+
+	// Work done between the previous frame and the last one.
+	unsigned int blasBuilds;
+	unsigned int blasUpdates;
+	unsigned int blasBuildsPending;	// Delayed to later frames by the build budget.
+	unsigned int tlasBuilds;
+	unsigned int tlasRefits;
+	unsigned long long bytesUploaded;
+
+	// Objects currently alive.
+	unsigned int sceneCount;
+	unsigned int meshCount;
+	unsigned int textureCount;
+	unsigned long long blasBytes;
+	unsigned long long blasUncompactedBytes;	// Part of blasBytes that belongs to bottom-level ASes that haven't been compacted yet.
+	unsigned long long scratchBytes;			// Shared by all the acceleration structure builds.
+	unsigned long long geometryBytes;			// Vertices and indices of all the meshes.
+	unsigned long long geometryCapacityBytes;	// Size of the blocks the geometry is suballocated from.
+	unsigned int geometryBlockCount;
+
+	// Memory allocated by the device, indexed by the RT64_HEAP_* types.
+	unsigned long long heapUsedBytes[RT64_HEAP_COUNT];
+	unsigned int heapAllocationCount[RT64_HEAP_COUNT];
+	unsigned long long gpuUsageBytes;
+	unsigned long long gpuBudgetBytes;
+	unsigned long long cpuUsageBytes;
+	unsigned long long cpuBudgetBytes;
+} RT64_DEVICE_STATS;
+
+typedef struct {
+	unsigned long long frameIndex;
+	float milliseconds[RT64_TIMING_COUNT];	// Indexed by the RT64_TIMING_* stages. Stages with multiple views are added together.
+} RT64_FRAME_TIMINGS;
+
 typedef struct {
 	RT64_MESH *mesh;
 	RT64_MATRIX4 transform;
@@ -228,26 +325,43 @@ inline void RT64_ApplyMaterialAttributes(RT64_MATERIAL *dst, RT64_MATERIAL *src)
 	}
 }
 
+// The library can only be loaded on Windows. The types above are also used by the parts of the library that are tested on other platforms.
+#ifdef _WIN32
+
 // Internal function pointer types.
 typedef const char *(*GetLastErrorPtr)();
 typedef RT64_DEVICE* (*CreateDevicePtr)(void *hwnd);
 typedef void(*DestroyDevicePtr)(RT64_DEVICE* device);
 typedef void(*DrawDevicePtr)(RT64_DEVICE *device, int vsyncInterval);
+typedef void(*CaptureFramesPtr)(RT64_DEVICE *device, const char *directory, int format, int frameCount);
+typedef void(*SetBuildBudgetPtr)(RT64_DEVICE *device, unsigned int primitivesPerFrame);
+typedef void(*GetDeviceStatsPtr)(RT64_DEVICE *device, RT64_DEVICE_STATS *stats);
+typedef bool(*GetFrameTimingsPtr)(RT64_DEVICE *device, RT64_FRAME_TIMINGS *timings);
+typedef bool(*ExportChromeTracePtr)(RT64_DEVICE *device, const char *path);
 typedef RT64_VIEW* (*CreateViewPtr)(RT64_SCENE* scenePtr);
 typedef void(*SetViewPerspectivePtr)(RT64_VIEW *viewPtr, RT64_MATRIX4 viewMatrix, float fovRadians, float nearDist, float farDist);
 typedef void(*SetViewDescriptionPtr)(RT64_VIEW *viewPtr, RT64_VIEW_DESC viewDesc);
+typedef void(*SetViewDynamicResolutionPtr)(RT64_VIEW *viewPtr, float targetMilliseconds, float minScale, float maxScale);
 typedef RT64_INSTANCE* (*GetViewRaytracedInstanceAtPtr)(RT64_VIEW *viewPtr, int x, int y);
+typedef unsigned int(*RequestInstanceAtPtr)(RT64_VIEW *viewPtr, int x, int y);
+typedef bool(*PollInstanceQueryPtr)(RT64_VIEW *viewPtr, unsigned int queryId, RT64_INSTANCE **instance);
+typedef void(*GetViewStatsPtr)(RT64_VIEW *viewPtr, RT64_VIEW_STATS *viewStats);
 typedef void(*DestroyViewPtr)(RT64_VIEW* viewPtr);
 typedef RT64_SCENE* (*CreateScenePtr)(RT64_DEVICE* devicePtr);
 typedef void (*SetSceneLightsPtr)(RT64_SCENE* scenePtr, RT64_LIGHT* lightArray, int lightCount);
 typedef void(*DestroyScenePtr)(RT64_SCENE* scenePtr);
 typedef RT64_MESH* (*CreateMeshPtr)(RT64_DEVICE* devicePtr, int flags);
 typedef void (*SetMeshPtr)(RT64_MESH* meshPtr, RT64_VERTEX* vertexArray, int vertexCount, unsigned int* indexArray, int indexCount);
+typedef RT64_VERTEX* (*MapMeshVerticesPtr)(RT64_MESH* meshPtr, int vertexCount);
+typedef void (*UnmapMeshVerticesPtr)(RT64_MESH* meshPtr);
+typedef void (*UpdateMeshVerticesPtr)(RT64_MESH* meshPtr, int firstVertex, int vertexCount, RT64_VERTEX* vertexArray);
 typedef void (*DestroyMeshPtr)(RT64_MESH* meshPtr);
 typedef RT64_INSTANCE* (*CreateInstancePtr)(RT64_SCENE* scenePtr);
 typedef void (*SetInstanceDescriptionPtr)(RT64_INSTANCE* instancePtr, RT64_INSTANCE_DESC instanceDesc);
 typedef void (*DestroyInstancePtr)(RT64_INSTANCE* instancePtr);
 typedef RT64_TEXTURE* (*CreateTextureFromRGBA8Ptr)(RT64_DEVICE* devicePtr, const void* bytes, int width, int height, int stride);
+typedef void* (*MapTextureUploadPtr)(RT64_TEXTURE* texturePtr, unsigned int* rowPitch);
+typedef void(*UnmapTextureUploadPtr)(RT64_TEXTURE* texturePtr);
 typedef void(*DestroyTexturePtr)(RT64_TEXTURE* texture);
 typedef RT64_INSPECTOR* (*CreateInspectorPtr)(RT64_DEVICE* devicePtr);
 typedef bool(*HandleMessageInspectorPtr)(RT64_INSPECTOR* inspectorPtr, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -264,21 +378,35 @@ typedef struct {
 	DestroyDevicePtr DestroyDevice;
 #ifndef RT64_MINIMAL
 	DrawDevicePtr DrawDevice;
+	CaptureFramesPtr CaptureFrames;
+	SetBuildBudgetPtr SetBuildBudget;
+	GetDeviceStatsPtr GetDeviceStats;
+	GetFrameTimingsPtr GetFrameTimings;
+	ExportChromeTracePtr ExportChromeTrace;
 	CreateViewPtr CreateView;
 	SetViewPerspectivePtr SetViewPerspective;
 	SetViewDescriptionPtr SetViewDescription;
+	SetViewDynamicResolutionPtr SetViewDynamicResolution;
 	GetViewRaytracedInstanceAtPtr GetViewRaytracedInstanceAt;
+	RequestInstanceAtPtr RequestInstanceAt;
+	PollInstanceQueryPtr PollInstanceQuery;
+	GetViewStatsPtr GetViewStats;
 	DestroyViewPtr DestroyView;
 	CreateScenePtr CreateScene;
 	SetSceneLightsPtr SetSceneLights;
 	DestroyScenePtr DestroyScene;
 	CreateMeshPtr CreateMesh;
 	SetMeshPtr SetMesh;
+	MapMeshVerticesPtr MapMeshVertices;
+	UnmapMeshVerticesPtr UnmapMeshVertices;
+	UpdateMeshVerticesPtr UpdateMeshVertices;
 	DestroyMeshPtr DestroyMesh;
 	CreateInstancePtr CreateInstance;
 	SetInstanceDescriptionPtr SetInstanceDescription;
 	DestroyInstancePtr DestroyInstance;
 	CreateTextureFromRGBA8Ptr CreateTextureFromRGBA8;
+	MapTextureUploadPtr MapTextureUpload;
+	UnmapTextureUploadPtr UnmapTextureUpload;
 	DestroyTexturePtr DestroyTexture;
 	CreateInspectorPtr CreateInspector;
 	HandleMessageInspectorPtr HandleMessageInspector;
@@ -309,21 +437,35 @@ inline RT64_LIBRARY RT64_LoadLibrary() {
 
 #ifndef RT64_MINIMAL
 		lib.DrawDevice = (DrawDevicePtr)(GetProcAddress(lib.handle, "RT64_DrawDevice"));
+		lib.CaptureFrames = (CaptureFramesPtr)(GetProcAddress(lib.handle, "RT64_CaptureFrames"));
+		lib.SetBuildBudget = (SetBuildBudgetPtr)(GetProcAddress(lib.handle, "RT64_SetBuildBudget"));
+		lib.GetDeviceStats = (GetDeviceStatsPtr)(GetProcAddress(lib.handle, "RT64_GetDeviceStats"));
+		lib.GetFrameTimings = (GetFrameTimingsPtr)(GetProcAddress(lib.handle, "RT64_GetFrameTimings"));
+		lib.ExportChromeTrace = (ExportChromeTracePtr)(GetProcAddress(lib.handle, "RT64_ExportChromeTrace"));
 		lib.CreateView = (CreateViewPtr)(GetProcAddress(lib.handle, "RT64_CreateView"));
 		lib.SetViewPerspective = (SetViewPerspectivePtr)(GetProcAddress(lib.handle, "RT64_SetViewPerspective"));
 		lib.SetViewDescription = (SetViewDescriptionPtr)(GetProcAddress(lib.handle, "RT64_SetViewDescription"));
+		lib.SetViewDynamicResolution = (SetViewDynamicResolutionPtr)(GetProcAddress(lib.handle, "RT64_SetViewDynamicResolution"));
 		lib.GetViewRaytracedInstanceAt = (GetViewRaytracedInstanceAtPtr)(GetProcAddress(lib.handle, "RT64_GetViewRaytracedInstanceAt"));
+		lib.RequestInstanceAt = (RequestInstanceAtPtr)(GetProcAddress(lib.handle, "RT64_RequestInstanceAt"));
+		lib.PollInstanceQuery = (PollInstanceQueryPtr)(GetProcAddress(lib.handle, "RT64_PollInstanceQuery"));
+		lib.GetViewStats = (GetViewStatsPtr)(GetProcAddress(lib.handle, "RT64_GetViewStats"));
 		lib.DestroyView = (DestroyViewPtr)(GetProcAddress(lib.handle, "RT64_DestroyView"));
 		lib.CreateScene = (CreateScenePtr)(GetProcAddress(lib.handle, "RT64_CreateScene"));
 		lib.SetSceneLights = (SetSceneLightsPtr)(GetProcAddress(lib.handle, "RT64_SetSceneLights"));
 		lib.DestroyScene = (DestroyScenePtr)(GetProcAddress(lib.handle, "RT64_DestroyScene"));
 		lib.CreateMesh = (CreateMeshPtr)(GetProcAddress(lib.handle, "RT64_CreateMesh"));
 		lib.SetMesh = (SetMeshPtr)(GetProcAddress(lib.handle, "RT64_SetMesh"));
+		lib.MapMeshVertices = (MapMeshVerticesPtr)(GetProcAddress(lib.handle, "RT64_MapMeshVertices"));
+		lib.UnmapMeshVertices = (UnmapMeshVerticesPtr)(GetProcAddress(lib.handle, "RT64_UnmapMeshVertices"));
+		lib.UpdateMeshVertices = (UpdateMeshVerticesPtr)(GetProcAddress(lib.handle, "RT64_UpdateMeshVertices"));
 		lib.DestroyMesh = (DestroyMeshPtr)(GetProcAddress(lib.handle, "RT64_DestroyMesh"));
 		lib.CreateInstance = (CreateInstancePtr)(GetProcAddress(lib.handle, "RT64_CreateInstance"));
 		lib.SetInstanceDescription = (SetInstanceDescriptionPtr)(GetProcAddress(lib.handle, "RT64_SetInstanceDescription"));
 		lib.DestroyInstance = (DestroyInstancePtr)(GetProcAddress(lib.handle, "RT64_DestroyInstance"));
 		lib.CreateTextureFromRGBA8 = (CreateTextureFromRGBA8Ptr)(GetProcAddress(lib.handle, "RT64_CreateTextureFromRGBA8"));
+		lib.MapTextureUpload = (MapTextureUploadPtr)(GetProcAddress(lib.handle, "RT64_MapTextureUpload"));
+		lib.UnmapTextureUpload = (UnmapTextureUploadPtr)(GetProcAddress(lib.handle, "RT64_UnmapTextureUpload"));
 		lib.DestroyTexture = (DestroyTexturePtr)(GetProcAddress(lib.handle, "RT64_DestroyTexture"));
 		lib.CreateInspector = (CreateInspectorPtr)(GetProcAddress(lib.handle, "RT64_CreateInspector"));
 		lib.HandleMessageInspector = (HandleMessageInspectorPtr)(GetProcAddress(lib.handle, "RT64_HandleMessageInspector"));
@@ -346,4 +488,6 @@ inline void RT64_UnloadLibrary(RT64_LIBRARY lib) {
 	FreeLibrary(lib.handle);
 }
 
+#endif
+
 #endif
\ No newline at end of file
@@ -6,6 +6,13 @@
 
 Texture2D<float4> gOutput : register(t0);
 
+// Only the top-left region of the output is traced when the resolution is dynamic. The maximum keeps the
+// filter from sampling the texels outside of it.
+cbuffer ComposeParams : register(b0) {
+    float2 uvScale;
+    float2 uvMax;
+};
+
 float4 PSMain(in float4 pos : SV_Position, in float2 uv : TEXCOORD0) : SV_TARGET {
-    return gOutput.SampleLevel(linearClampClamp, uv, 0);
+    return gOutput.SampleLevel(linearClampClamp, min(uv * uvScale, uvMax), 0);
 }
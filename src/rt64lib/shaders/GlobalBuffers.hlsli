@@ -5,5 +5,26 @@
 RWTexture2D<float4> gOutput : register(u0);
 RWTexture2D<float4> gAlbedo : register(u1);
 RWTexture2D<float4> gNormal : register(u2);
+RWTexture2D<uint> gInstanceId : register(u4);
+
+// Temporal accumulation history. Color stores the history length in alpha, while depth
+// stores the view depth as a float and the instance ID of the closest hit.
+RWTexture2D<float4> gAccumColor : register(u5);
+RWTexture2D<uint2> gAccumDepth : register(u6);
+RWTexture2D<float4> gPrevAccumColor : register(u7);
+RWTexture2D<uint2> gPrevAccumDepth : register(u8);
+
+// Offset in pixels from each pixel to the position of its closest hit in the previous frame.
+RWTexture2D<float2> gMotion : register(u9);
+
+// View depth of the closest hit of each pixel, or zero if nothing was hit.
+RWTexture2D<float> gDepth : register(u11);
+
+// Running mean of the luminance of each pixel and of its square, which give the variance of the pixel between frames.
+// The relative variance of the pixels is added up in fixed point for every tile of adaptive sampling and read back to
+// pick the sample units of the tiles for the next frames.
+RWTexture2D<float2> gVarianceMoments : register(u12);
+RWStructuredBuffer<uint> gTileVariance : register(u13);
+StructuredBuffer<uint> gTileUnits : register(t6);
 
 Texture2D<float4> gBackground : register(t1);
\ No newline at end of file
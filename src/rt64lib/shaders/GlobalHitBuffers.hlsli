@@ -2,14 +2,73 @@
 // RT64
 //
 
+// Upper bound for the amount of hits a view can request. The active limit is set per view with maxHitQueries.
 #define MAX_HIT_QUERIES	16
 
-RWBuffer<float> gHitDistance : register(u3);
-RWBuffer<half4> gHitColor : register(u4);
-RWBuffer<half4> gHitNormal : register(u5);
-RWBuffer<uint> gHitInstanceId : register(u6);
-RWBuffer<half> gHitSpecular : register(u7);
+// Every hit is packed into a single 16 byte record.
+// x: Biased hit distance.
+// y: Instance ID on the lower 16 bits, specular as a half on the upper 16 bits.
+// z: Color as RGBA8.
+// w: Octahedral encoded normal as two 16-bit SNORM values.
+RWBuffer<uint4> gHitBuffer : register(u3);
+
+// World position of the closest primary hit in the previous frame. Only uses the first hit layer.
+RWBuffer<float4> gHitPrevPosition : register(u10);
+
+struct HitRecord {
+	float distance;
+	uint instanceId;
+	float specular;
+	float4 color;
+	float3 normal;
+};
 
 uint getHitBufferIndex(uint hitPos, uint2 pixelIdx, uint2 pixelDims) {
 	return (hitPos * pixelDims.y + pixelIdx.y) * pixelDims.x + pixelIdx.x;
+}
+
+uint packUnorm4x8(float4 v) {
+	uint4 u = uint4(round(saturate(v) * 255.0f));
+	return u.x | (u.y << 8) | (u.z << 16) | (u.w << 24);
+}
+
+float4 unpackUnorm4x8(uint p) {
+	return float4(p & 0xFF, (p >> 8) & 0xFF, (p >> 16) & 0xFF, p >> 24) / 255.0f;
+}
+
+float2 octWrap(float2 v) {
+	return (1.0f - abs(v.yx)) * ((v.xy >= 0.0f) ? 1.0f : -1.0f);
+}
+
+uint packNormal(float3 n) {
+	n /= (abs(n.x) + abs(n.y) + abs(n.z));
+	float2 e = (n.z >= 0.0f) ? n.xy : octWrap(n.xy);
+	int2 s = int2(round(clamp(e, -1.0f, 1.0f) * 32767.0f));
+	return (uint(s.x) & 0xFFFF) | (uint(s.y) << 16);
+}
+
+float3 unpackNormal(uint p) {
+	float2 e = float2(int(p << 16) >> 16, int(p) >> 16) / 32767.0f;
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+
+uint4 packHitRecord(HitRecord r) {
+	return uint4(asuint(r.distance), (r.instanceId & 0xFFFF) | (f32tof16(r.specular) << 16), packUnorm4x8(r.color), packNormal(r.normal));
+}
+
+HitRecord unpackHitRecord(uint4 p) {
+	HitRecord r;
+	r.distance = asfloat(p.x);
+	r.instanceId = p.y & 0xFFFF;
+	r.specular = f16tof32(p.y >> 16);
+	r.color = unpackUnorm4x8(p.z);
+	r.normal = unpackNormal(p.w);
+	return r;
+}
+
+float getHitDistance(uint hitBufferIndex) {
+	return asfloat(gHitBuffer[hitBufferIndex].x);
 }
\ No newline at end of file
@@ -10,7 +10,9 @@ float4 PSMain(VS_OUTPUT _in) : SV_Target {
 	uint2 pixelDims = round(resolution.xy);
 	uint2 pixelPos = clamp(_in.m_position.xy, uint2(0, 0), pixelDims);
 	uint hitBufferIndex = getHitBufferIndex(0, pixelPos, pixelDims);
-	float occlDistance = gHitDistance[hitBufferIndex];
+
+	// The hit buffer only covers the last traced tile when tiled tracing is enabled, so occlusion is not available.
+	float occlDistance = (tileSize == 0) ? getHitDistance(hitBufferIndex) : 1e+30f;
 	float3 viewPos = mul(viewI, float4(0.0f, 0.0f, 0.0f, 1.0f)).xyz;
 	float pixelDistance = length(_in.m_worldPosition - viewPos);
 	float4 ret = _in.m_color;
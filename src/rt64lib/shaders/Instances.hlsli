@@ -8,6 +8,7 @@
 struct InstanceProperties {
 	float4x4 objectToWorld;
 	float4x4 objectToWorldNormal;
+	float4x4 objectToWorldPrevious;
 	MaterialProperties materialProperties;
 	ColorCombinerFeatures ccFeatures;
 };
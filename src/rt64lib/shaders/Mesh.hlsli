@@ -7,6 +7,10 @@
 ByteAddressBuffer vertexBuffer : register(t2);
 ByteAddressBuffer indexBuffer : register(t3);
 
+// Vertex buffer before the last update of the mesh. It's the same as the current
+// vertex buffer if the mesh wasn't updated since it was last rendered.
+ByteAddressBuffer prevVertexBuffer : register(t2, space1);
+
 // TODO: With specialized shader generation, this structure should match the VBO
 // from the client application instead of using a fixed structure to avoid copying
 // in memory and interpolating useless attributes.
@@ -114,3 +118,11 @@ VertexAttributes GetVertexAttributes(ByteAddressBuffer vertexBuffer, ByteAddress
 
 	return v;
 }
+
+float3 GetPreviousPosition(ByteAddressBuffer prevVertexBuffer, ByteAddressBuffer indexBuffer, uint triangleIndex, float3 barycentrics) {
+	uint3 index3 = GetIndices(indexBuffer, triangleIndex);
+	float3 pos0 = asfloat(prevVertexBuffer.Load3(PosAddr(index3[0])));
+	float3 pos1 = asfloat(prevVertexBuffer.Load3(PosAddr(index3[1])));
+	float3 pos2 = asfloat(prevVertexBuffer.Load3(PosAddr(index3[2])));
+	return pos0 * barycentrics[0] + pos1 * barycentrics[1] + pos2 * barycentrics[2];
+}
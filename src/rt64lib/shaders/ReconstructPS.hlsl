@@ -0,0 +1,238 @@
+//
+// RT64
+//
+
+#include "TracePattern.hlsli"
+
+// Must match the constants in InterleavedReconstructor.
+#define DEPTH_TOLERANCE			0.1f
+#define NORMAL_THRESHOLD		0.8f
+#define STATIC_MOTION_THRESHOLD	0.01f
+#define NO_HIT_INSTANCE_ID		0xFFFF
+
+// History of the reconstruction. The guide stores the normal in XYZ and the view depth in W.
+Texture2D<float4> gPrevColor : register(t0);
+Texture2D<float4> gPrevGuide : register(t1);
+Texture2D<uint> gPrevInstanceId : register(t2);
+
+// Output buffers of the tracer. The pixels that weren't traced this frame are filled in place, which is
+// safe since they're never read by the other pixels. The registers start after the render targets.
+RWTexture2D<float4> gOutput : register(u3);
+RWTexture2D<float4> gAlbedo : register(u4);
+RWTexture2D<float4> gNormal : register(u5);
+RWTexture2D<uint> gInstanceId : register(u6);
+RWTexture2D<float2> gMotion : register(u7);
+RWTexture2D<float> gDepth : register(u8);
+RWTexture2D<float4> gAccumColor : register(u9);
+RWTexture2D<uint2> gAccumDepth : register(u10);
+
+cbuffer ReconstructParams : register(b0) {
+	uint2 outputDims;
+	uint tracePattern;
+	uint frameIndex;
+	uint historyValid;
+	uint temporalEnabled;
+
+	// Size of the region the history was reconstructed at. Positions are scaled to it if it's different.
+	uint2 historyDims;
+};
+
+struct PSOutput {
+	float4 color : SV_TARGET0;
+	float4 guide : SV_TARGET1;
+	uint instanceId : SV_TARGET2;
+};
+
+struct Guide {
+	float depth;
+	uint instanceId;
+	float3 normal;
+};
+
+Guide LoadGuide(int2 pixel) {
+	Guide guide;
+	guide.depth = gDepth[pixel];
+	guide.instanceId = gInstanceId[pixel];
+	guide.normal = gNormal[pixel].xyz;
+	return guide;
+}
+
+// Similarity between the surfaces of two pixels, from zero if they're different surfaces to one if they're the same.
+float GuideWeight(Guide a, Guide b) {
+	if (a.instanceId != b.instanceId) {
+		return 0.0f;
+	}
+
+	// Pixels where nothing was hit only show the background.
+	if (a.instanceId == NO_HIT_INSTANCE_ID) {
+		return 1.0f;
+	}
+
+	float maxDepth = max(a.depth, b.depth);
+	float depthWeight = (maxDepth > 0.0f) ? max(1.0f - abs(a.depth - b.depth) / (DEPTH_TOLERANCE * maxDepth), 0.0f) : 1.0f;
+
+	// Normals are only written for surfaces that receive light, so they're ignored if either of them is missing.
+	float normalLengths = dot(a.normal, a.normal) * dot(b.normal, b.normal);
+	float normalWeight = (normalLengths > 0.0f) ? saturate((dot(a.normal, b.normal) - NORMAL_THRESHOLD) / (1.0f - NORMAL_THRESHOLD)) : 1.0f;
+	return depthWeight * normalWeight;
+}
+
+float4 CatmullRomWeights(float t) {
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return 0.5f * float4(-t3 + 2.0f * t2 - t, 3.0f * t3 - 5.0f * t2 + 2.0f, -3.0f * t3 + 4.0f * t2 + t, t3 - t2);
+}
+
+float4 SampleHistory(float2 pos) {
+	float2 f = pos - 0.5f;
+	int2 p0 = int2(floor(f));
+	float2 t = f - p0;
+	float4 wx = CatmullRomWeights(t.x);
+	float4 wy = CatmullRomWeights(t.y);
+	int2 maxIndex = int2(historyDims) - 1;
+	float4 color = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	[unroll]
+	for (int j = 0; j < 4; j++) {
+		[unroll]
+		for (int i = 0; i < 4; i++) {
+			int2 s = clamp(p0 + int2(i - 1, j - 1), int2(0, 0), maxIndex);
+			color += gPrevColor.Load(int3(s, 0)) * wx[i] * wy[j];
+		}
+	}
+
+	return color;
+}
+
+PSOutput PSMain(in float4 pos : SV_Position, in float2 uv : TEXCOORD0) {
+	int2 pixel = int2(pos.xy);
+	PSOutput output;
+	if (IsPixelTraced(tracePattern, frameIndex, pixel)) {
+		output.color = gOutput[pixel];
+		output.guide = float4(gNormal[pixel].xyz, gDepth[pixel]);
+		output.instanceId = gInstanceId[pixel];
+		return output;
+	}
+
+	// Gather the pixels around that were traced this frame. The closest one to the camera is used to
+	// find the history, so the edges of the objects in front keep moving with them.
+	int2 neighbors[8];
+	uint neighborCount = 0;
+	uint closest = 0;
+	float closestDepth = 0.0f;
+	[unroll]
+	for (int dy = -1; dy <= 1; dy++) {
+		[unroll]
+		for (int dx = -1; dx <= 1; dx++) {
+			int2 s = pixel + int2(dx, dy);
+			if (((dx != 0) || (dy != 0)) && all(s >= 0) && all(s < int2(outputDims)) && IsPixelTraced(tracePattern, frameIndex, s)) {
+				bool hit = (gInstanceId[s] != NO_HIT_INSTANCE_ID);
+				float depth = gDepth[s];
+				if ((neighborCount == 0) || (hit && ((closestDepth <= 0.0f) || (depth < closestDepth)))) {
+					closest = neighborCount;
+					closestDepth = hit ? depth : 0.0f;
+				}
+
+				neighbors[neighborCount] = s;
+				neighborCount++;
+			}
+		}
+	}
+
+	// Nothing around was traced, which can only happen on regions narrower than the pattern.
+	float2 historyScale = float2(historyDims) / float2(outputDims);
+	if (neighborCount == 0) {
+		int2 historyPixel = min(int2((pixel + 0.5f) * historyScale), int2(historyDims) - 1);
+		output.color = historyValid ? gPrevColor.Load(int3(historyPixel, 0)) : float4(0.0f, 0.0f, 0.0f, 0.0f);
+		output.guide = historyValid ? gPrevGuide.Load(int3(historyPixel, 0)) : float4(0.0f, 0.0f, 0.0f, 0.0f);
+		output.instanceId = historyValid ? gPrevInstanceId.Load(int3(historyPixel, 0)) : NO_HIT_INSTANCE_ID;
+		gOutput[pixel] = output.color;
+		return output;
+	}
+
+	int2 closestPixel = neighbors[closest];
+	Guide reference = LoadGuide(closestPixel);
+	float2 motion = gMotion[closestPixel];
+
+	// The history is only used if it shows the same surface as one of the traced pixels. The guides are taken from
+	// the closest pixel of the history, while the color is resampled with a Catmull-Rom filter so the moving surfaces stay sharp.
+	bool useHistory = false;
+	bool staticHistory = false;
+	float4 history = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	if (historyValid) {
+		float2 historyPos = (pixel + 0.5f + motion) * historyScale;
+		int2 historyPixel = int2(floor(historyPos));
+		if (all(historyPixel >= 0) && all(historyPixel < int2(historyDims))) {
+			float4 historyGuide = gPrevGuide.Load(int3(historyPixel, 0));
+			Guide prevGuide;
+			prevGuide.depth = historyGuide.w;
+			prevGuide.instanceId = gPrevInstanceId.Load(int3(historyPixel, 0));
+			prevGuide.normal = historyGuide.xyz;
+			for (uint n = 0; (n < neighborCount) && !useHistory; n++) {
+				useHistory = GuideWeight(prevGuide, LoadGuide(neighbors[n])) > 0.0f;
+			}
+
+			// A pixel that didn't move shows what it showed when it was last traced, at most a cycle of the pattern
+			// ago, so its history is read as is. Clamping it would replace any detail finer than the pattern with
+			// the range of the traced pixels around it, and a static image would never converge. No pixel maps exactly
+			// to one of the history if the resolution changed, so it's filtered and clamped like moving history.
+			staticHistory = all(historyDims == outputDims) && all(abs(motion) <= STATIC_MOTION_THRESHOLD);
+			if (useHistory) {
+				history = staticHistory ? gPrevColor.Load(int3(historyPixel, 0)) : SampleHistory(historyPos);
+				reference = prevGuide;
+			}
+		}
+	}
+
+	// Interpolate the traced pixels that belong to the same surface and find the range of their colors.
+	float4 spatial = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float4 spatialAlbedo = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float4 minColor = gOutput[closestPixel];
+	float4 maxColor = minColor;
+	float spatialWeight = 0.0f;
+	float historyLength = 0.0f;
+	for (uint n = 0; n < neighborCount; n++) {
+		int2 s = neighbors[n];
+		float4 c = gOutput[s];
+		float w = GuideWeight(reference, LoadGuide(s));
+		spatial += c * w;
+		spatialAlbedo += gAlbedo[s] * w;
+		minColor = min(minColor, c);
+		maxColor = max(maxColor, c);
+		spatialWeight += w;
+
+		// The accumulation history of the pixel continues from the traced pixels of the same surface.
+		if ((w > 0.0f) && temporalEnabled) {
+			historyLength = max(historyLength, gAccumColor[s].a);
+		}
+	}
+
+	if (spatialWeight > 0.0f) {
+		spatial /= spatialWeight;
+		spatialAlbedo /= spatialWeight;
+	}
+	else {
+		spatial = gOutput[closestPixel];
+		spatialAlbedo = gAlbedo[closestPixel];
+	}
+
+	// Moving history is clamped to the colors around it, so it can't show something that's no longer there.
+	float4 result = useHistory ? (staticHistory ? history : clamp(history, minColor, maxColor)) : spatial;
+
+	// Fill the buffers of the pixel so the denoiser, the upscaler, the instance queries and the next
+	// frame's accumulation see the same as if it had been traced.
+	gOutput[pixel] = result;
+	gAlbedo[pixel] = spatialAlbedo;
+	gNormal[pixel] = float4(reference.normal, 0.0f);
+	gInstanceId[pixel] = reference.instanceId;
+	gMotion[pixel] = motion;
+	gDepth[pixel] = reference.depth;
+	if (temporalEnabled) {
+		gAccumColor[pixel] = float4(result.rgb, max(historyLength, 1.0f));
+		gAccumDepth[pixel] = uint2(asuint(reference.depth), reference.instanceId);
+	}
+
+	output.color = result;
+	output.guide = float4(reference.normal, reference.depth);
+	output.instanceId = reference.instanceId;
+	return output;
+}
@@ -48,22 +48,18 @@ void SurfaceAnyHit(inout HitInfo payload, Attributes attrib) {
 		// HACK: Add some bias for the comparison based on the instance ID so coplanar surfaces are friendlier with each other.
 		// This can likely be implemented as an instance property at some point to control depth sorting.
 		float tval = WithDistanceBias(RayTCurrent(), instanceId);
-		uint hi = getHitBufferIndex(min(payload.nhits, MAX_HIT_QUERIES), pixelIdx, pixelDims);
+		uint hi = getHitBufferIndex(min(payload.nhits, maxHitQueries), pixelIdx, pixelDims);
 		uint minHi = getHitBufferIndex(payload.ohits, pixelIdx, pixelDims);
 		uint lo = hi - hitStride;
-		while ((hi > minHi) && (tval < gHitDistance[lo]))
+		while ((hi > minHi) && (tval < getHitDistance(lo)))
 		{
-			gHitDistance[hi] = gHitDistance[lo];
-			gHitColor[hi] = gHitColor[lo];
-			gHitNormal[hi] = gHitNormal[lo];
-			gHitSpecular[hi] = gHitSpecular[lo];
-			gHitInstanceId[hi] = gHitInstanceId[lo];
+			gHitBuffer[hi] = gHitBuffer[lo];
 			hi -= hitStride;
 			lo -= hitStride;
 		}
 		
 		uint hitPos = hi / hitStride;
-		if (hitPos < MAX_HIT_QUERIES) {
+		if (hitPos < maxHitQueries) {
 			// Only mix the final diffuse color if the alpha is positive.
 			resultColor.rgb = lerp(resultColor.rgb, diffuseColorMix.rgb, max(diffuseColorMix.a, 0.0f));
 
@@ -96,15 +92,23 @@ void SurfaceAnyHit(inout HitInfo payload, Attributes attrib) {
 				}
 
 			// Store hit data and increment the hit counter.
-			gHitDistance[hi] = tval;
-			gHitColor[hi] = resultColor;
-			gHitSpecular[hi] = specularColor;
-			gHitNormal[hi] = float4(vertex.normal, 1.0f);
-			gHitInstanceId[hi] = instanceId;
-			
+			HitRecord hitRecord;
+			hitRecord.distance = tval;
+			hitRecord.instanceId = instanceId;
+			hitRecord.specular = specularColor;
+			hitRecord.color = resultColor;
+			hitRecord.normal = vertex.normal;
+			gHitBuffer[hi] = packHitRecord(hitRecord);
+
+			// Store where the closest primary hit was in the previous frame for the motion vectors.
+			if (hitPos == 0) {
+				float3 prevPosition = GetPreviousPosition(prevVertexBuffer, indexBuffer, triangleId, barycentrics);
+				gHitPrevPosition[hi] = float4(mul(instanceProps[instanceId].objectToWorldPrevious, float4(prevPosition, 1.0f)).xyz, 1.0f);
+			}
+
 			++payload.nhits;
 
-			if (hitPos != MAX_HIT_QUERIES - 1) {
+			if (hitPos != maxHitQueries - 1) {
 				IgnoreHit();
 			}
 		}
@@ -2,4 +2,4 @@
 // RT64
 //
 
-Texture2D<float4> gTextures[1024] : register(t6);
\ No newline at end of file
+Texture2D<float4> gTextures[1024] : register(t7);
\ No newline at end of file
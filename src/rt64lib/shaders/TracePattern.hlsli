@@ -0,0 +1,50 @@
+//
+// RT64
+//
+
+// Must match the RT64_TRACE_PATTERN_* constants and the pixel mapping in InterleavedReconstructor.
+#define TRACE_PATTERN_FULL				0
+#define TRACE_PATTERN_CHECKERBOARD		1
+#define TRACE_PATTERN_INTERLEAVED		2
+
+uint TracePatternPhaseCount(uint pattern) {
+	if (pattern == TRACE_PATTERN_CHECKERBOARD) {
+		return 2;
+	}
+	else if (pattern == TRACE_PATTERN_INTERLEAVED) {
+		return 4;
+	}
+	else {
+		return 1;
+	}
+}
+
+// Checkerboard traces every other pixel of each row, starting on alternate columns on every row and frame.
+// Interleaved traces one pixel of every 2x2 block, visiting the corners of the block in diagonal order.
+uint2 TracePatternPixel(uint pattern, uint frameIndex, uint2 regionOffset, uint2 launchIndex) {
+	uint phase = frameIndex % TracePatternPhaseCount(pattern);
+	if (pattern == TRACE_PATTERN_CHECKERBOARD) {
+		uint y = regionOffset.y + launchIndex.y;
+		return uint2(regionOffset.x + launchIndex.x * 2 + ((y - regionOffset.x + phase) & 1), y);
+	}
+	else if (pattern == TRACE_PATTERN_INTERLEAVED) {
+		uint2 offset = uint2((phase ^ (phase >> 1)) & 1, phase & 1);
+		return regionOffset + launchIndex * 2 + ((offset - regionOffset) & 1);
+	}
+	else {
+		return regionOffset + launchIndex;
+	}
+}
+
+bool IsPixelTraced(uint pattern, uint frameIndex, uint2 pixel) {
+	uint phase = frameIndex % TracePatternPhaseCount(pattern);
+	if (pattern == TRACE_PATTERN_CHECKERBOARD) {
+		return ((pixel.x + pixel.y + phase) & 1) == 0;
+	}
+	else if (pattern == TRACE_PATTERN_INTERLEAVED) {
+		return all((pixel & 1) == uint2((phase ^ (phase >> 1)) & 1, phase & 1));
+	}
+	else {
+		return true;
+	}
+}
@@ -9,6 +9,7 @@
 #include "Ray.hlsli"
 #include "Random.hlsli"
 #include "Samplers.hlsli"
+#include "TracePattern.hlsli"
 #include "ViewParams.hlsli"
 
 #define EPSILON								1e-6
@@ -20,6 +21,28 @@
 #define GI_MINIMUM_ALPHA					0.25f
 
 #define DEBUG_HIT_COUNT						0
+#define NO_HIT_INSTANCE_ID					0xFFFF
+
+// Must match the constants in TemporalAccumulator.
+#define TEMPORAL_MIN_BLEND_ALPHA			0.1f
+#define TEMPORAL_DEPTH_TOLERANCE			0.05f
+#define TEMPORAL_MAX_HISTORY_LENGTH			32
+
+// Must match the constants in AdaptiveSampler.
+#define ADAPTIVE_TILE_SIZE					16
+#define ADAPTIVE_BASE_UNITS					4
+#define VARIANCE_SCALE						1024.0f
+#define VARIANCE_MAX_PIXEL					64.0f
+
+// Weight of the current frame in the running luminance moments and the smallest squared mean the variance is divided by.
+#define VARIANCE_BLEND_ALPHA				0.2f
+#define VARIANCE_MIN_MEAN_SQUARED			0.01f
+
+// Offset of the tile being traced when the view uses tiled tracing. The hit buffers
+// are only as big as the tile, while the output buffers cover the whole resolution.
+cbuffer TileParams : register(b1) {
+	uint2 tileOffset;
+}
 
 // Has better results for avoiding shadow terminator glitches, but has unintended side effects on
 // terrain with really bad normals or geometry that had backfaces removed to be optimized and
@@ -56,7 +79,7 @@ float CalculateLightIntensitySimple(uint l, float3 position) {
 	return sampleIntensityFactor * dot(SceneLights[l].diffuseColor, float3(1.0f, 1.0f, 1.0f));
 }
 
-float3 ComputeLights(float3 rayDirection, uint instanceId, float3 position, float3 normal, uint maxLights, const bool checkShadows, uint seed) {
+float3 ComputeLights(float3 rayDirection, uint instanceId, float3 position, float3 normal, uint maxLights, uint lightSamples, const bool checkShadows, uint seed) {
 	float3 resultLight = float3(0.0f, 0.0f, 0.0f);
 	uint lightGroupMaskBits = instanceProps[instanceId].materialProperties.lightGroupMaskBits;
 	if (lightGroupMaskBits > 0) {
@@ -100,7 +123,7 @@ float3 ComputeLights(float3 rayDirection, uint instanceId, float3 position, floa
 			float3 lightDirection = normalize(lightPosition - position);
 			float lightRadius = SceneLights[l].attenuationRadius;
 			float lightAttenuation = SceneLights[l].attenuationExponent;
-			float lightPointRadius = (softLightSamples > 0) ? SceneLights[l].pointRadius : 0.0f;
+			float lightPointRadius = (lightSamples > 0) ? SceneLights[l].pointRadius : 0.0f;
 			float3 perpX = cross(-lightDirection, float3(0.f, 1.0f, 0.f));
 			if (all(perpX == 0.0f)) {
 				perpX.x = 1.0;
@@ -108,7 +131,7 @@ float3 ComputeLights(float3 rayDirection, uint instanceId, float3 position, floa
 
 			float3 perpY = cross(perpX, -lightDirection);
 			float shadowOffset = SceneLights[l].shadowOffset;
-			const uint maxSamples = max(softLightSamples, 1);
+			const uint maxSamples = max(lightSamples, 1);
 			uint samples = maxSamples;
 			float lLambertFactor = 0.0f;
 			float lSpecularityFactor = 0.0f;
@@ -184,20 +207,21 @@ float3 SimpleShadeFromGBuffers(uint hitOffset, uint hitCount, float3 rayOrigin,
 	uint maxSimpleLights = 1;
 	for (uint hit = hitOffset; hit < hitCount; hit++) {
 		uint hitBufferIndex = getHitBufferIndex(hit, launchIndex, pixelDims);
-		float4 hitColor = gHitColor[hitBufferIndex];
+		HitRecord hitRecord = unpackHitRecord(gHitBuffer[hitBufferIndex]);
+		float4 hitColor = hitRecord.color;
 		float alphaContrib = (resColor.a * hitColor.a);
 		if (alphaContrib >= EPSILON) {
-			uint instanceId = gHitInstanceId[hitBufferIndex];
+			uint instanceId = hitRecord.instanceId;
 			uint lightGroupMaskBits = instanceProps[instanceId].materialProperties.lightGroupMaskBits;
-			float3 vertexPosition = rayOrigin + rayDirection * WithoutDistanceBias(gHitDistance[hitBufferIndex], instanceId);
-			float3 vertexNormal = gHitNormal[hitBufferIndex].xyz;
+			float3 vertexPosition = rayOrigin + rayDirection * WithoutDistanceBias(hitRecord.distance, instanceId);
+			float3 vertexNormal = hitRecord.normal;
 			float3 resultLight = instanceProps[instanceId].materialProperties.selfLight;
 			float3 resultGiLight = float3(0.0f, 0.0f, 0.0f);
 
 			// Reuse the previous computed lights result if available.
 			if (lightGroupMaskBits > 0) {
 				if (maxSimpleLights > 0) {
-					simpleLightsResult = ComputeLights(rayDirection, instanceId, vertexPosition, vertexNormal, 1, checkShadows, seed + hit);
+					simpleLightsResult = ComputeLights(rayDirection, instanceId, vertexPosition, vertexNormal, 1, softLightSamples, checkShadows, seed + hit);
 					maxSimpleLights--;
 				}
 				
@@ -251,7 +275,7 @@ uint TraceSurface(float3 rayOrigin, float3 rayDirection, float rayMinDist, float
 
 float3 TraceSimple(float3 rayOrigin, float3 rayDirection, float rayMinDist, float rayMaxDist, uint hitOffset, uint2 launchIndex, uint2 pixelDims, const bool checkShadows, uint seed) {
 	uint hitCount = TraceSurface(rayOrigin, rayDirection, rayMinDist, rayMaxDist, hitOffset);
-	return SimpleShadeFromGBuffers(hitOffset, min(hitCount, MAX_HIT_QUERIES), rayOrigin, rayDirection, launchIndex, pixelDims, checkShadows, seed);
+	return SimpleShadeFromGBuffers(hitOffset, min(hitCount, maxHitQueries), rayOrigin, rayDirection, launchIndex, pixelDims, checkShadows, seed);
 }
 
 float FresnelReflectAmount(float3 normal, float3 incident, float reflectivity, float fresnelMultiplier) {
@@ -272,7 +296,7 @@ float4 ComputeReflection(float reflectionFactor, float reflectionShineFactor, fl
 	return reflectionColor;
 }
 
-void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection, uint2 launchIndex, uint2 pixelDims, uint seed) {
+void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection, uint2 launchIndex, uint2 pixelDims, uint2 outputIndex, uint lightSamples, uint giSamples, uint seed) {
 	float4 resColor = float4(0, 0, 0, 1);
 	float4 finalAlbedo = float4(0.0f, 0.0f, 0.0f, 0.0f);
 	float4 finalNormal = float4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -283,14 +307,15 @@ void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection,
 	uint maxGI = 1;
 	for (uint hit = 0; hit < hitCount; hit++) {
 		uint hitBufferIndex = getHitBufferIndex(hit, launchIndex, pixelDims);
-		uint instanceId = gHitInstanceId[hitBufferIndex];
-		float hitDistance = WithoutDistanceBias(gHitDistance[hitBufferIndex], instanceId);
+		HitRecord hitRecord = unpackHitRecord(gHitBuffer[hitBufferIndex]);
+		uint instanceId = hitRecord.instanceId;
+		float hitDistance = WithoutDistanceBias(hitRecord.distance, instanceId);
 		seed += asuint(hitDistance);
 
-		float4 hitColor = gHitColor[hitBufferIndex];
+		float4 hitColor = hitRecord.color;
 		float3 vertexPosition = rayOrigin + rayDirection * hitDistance;
-		float3 vertexNormal = gHitNormal[hitBufferIndex].xyz;
-		half hitSpecular = gHitSpecular[hitBufferIndex];
+		float3 vertexNormal = hitRecord.normal;
+		half hitSpecular = half(hitRecord.specular);
 		float refractionFactor = instanceProps[instanceId].materialProperties.refractionFactor;
 		float alphaContrib = (resColor.a * hitColor.a);
 		if (alphaContrib >= EPSILON) {
@@ -304,13 +329,13 @@ void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection,
 				if ((maxFullLights > 0) && (solidColor || lastHit)) {
 					finalAlbedo = hitColor;
 					finalNormal = float4(vertexNormal, 0.0f);
-					resultLight += ComputeLights(rayDirection, instanceId, vertexPosition, vertexNormal, maxLightSamples, true, seed);
+					resultLight += ComputeLights(rayDirection, instanceId, vertexPosition, vertexNormal, maxLightSamples, lightSamples, true, seed);
 					maxFullLights--;
 				}
 				else {
 					// Simple light sampling. Reuse previous result if calculated once already.
 					if (maxSimpleLights > 0) {
-						simpleLightsResult += ComputeLights(rayDirection, instanceId, vertexPosition, vertexNormal, 2, true, seed);
+						simpleLightsResult += ComputeLights(rayDirection, instanceId, vertexPosition, vertexNormal, 2, lightSamples, true, seed);
 						maxSimpleLights--;
 					}
 
@@ -320,13 +345,13 @@ void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection,
 				// Global illumination.
 				bool alphaGIRequired = (alphaContrib >= GI_MINIMUM_ALPHA);
 				if ((maxGI > 0) && (alphaGIRequired || lastHit)) {
-					uint giSamples = giBounces;
+					uint giSample = giSamples;
 					uint seedCopy = seed;
-					while (giSamples > 0) {
+					while (giSample > 0) {
 						float3 bounceDir = getCosHemisphereSample(seedCopy, vertexNormal);
-						float3 bounceColor = TraceSimple(vertexPosition, bounceDir, RAY_MIN_DISTANCE, RAY_MAX_DISTANCE, hitCount, launchIndex, pixelDims, true, seed + giSamples);
-						resultGiLight += bounceColor / giBounces;
-						giSamples--;
+						float3 bounceColor = TraceSimple(vertexPosition, bounceDir, RAY_MIN_DISTANCE, RAY_MAX_DISTANCE, hitCount, launchIndex, pixelDims, true, seed + giSample);
+						resultGiLight += bounceColor / giSamples;
+						giSample--;
 					}
 
 					maxGI--;
@@ -386,9 +411,9 @@ void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection,
 		}
 	}
 
-	gOutput[launchIndex] = float4(resColor.rgb, (1.0f - resColor.a));
-	gAlbedo[launchIndex] = finalAlbedo;
-	gNormal[launchIndex] = finalNormal;
+	gOutput[outputIndex] = float4(resColor.rgb, (1.0f - resColor.a));
+	gAlbedo[outputIndex] = finalAlbedo;
+	gNormal[outputIndex] = finalNormal;
 
 #if DEBUG_HIT_COUNT == 1
 	float4 colors[MAX_HIT_QUERIES + 1] =
@@ -412,23 +437,143 @@ void FullShadeFromGBuffers(uint hitCount, float3 rayOrigin, float3 rayDirection,
 		float4(1.00, 1.00, 1.00, 1.00),
 	};
 
-	gOutput[launchIndex] = colors[hitCount];
+	gOutput[outputIndex] = colors[hitCount];
 #endif
 }
 
-void TraceFull(float3 rayOrigin, float3 rayDirection, float rayMinDist, float rayMaxDist, uint2 launchIndex, uint2 pixelDims, uint seed) {
+void AccumulateTemporal(uint2 outputIndex, uint2 outputDims, uint instanceId, float depth, float3 prevWorldPosition) {
+	float4 color = gOutput[outputIndex];
+	uint historyLength = 0;
+	if (instanceId != NO_HIT_INSTANCE_ID) {
+		// Reproject the closest hit into the previous frame and reject the history if it
+		// belongs to another instance or if it was occluded by something else.
+		// The history can have a different resolution if the dynamic resolution changed the scale.
+		float4 prevClipPos = mul(prevViewProj, float4(prevWorldPosition, 1.0f));
+		if (temporalHistoryValid && (prevClipPos.w > 0.0f)) {
+			uint2 prevDims = uint2(prevResolution);
+			float2 prevNdc = prevClipPos.xy / prevClipPos.w;
+			int2 prevIndex = int2(floor(float2(prevNdc.x * 0.5f + 0.5f, 0.5f - prevNdc.y * 0.5f) * prevDims));
+			if (all(prevIndex >= 0) && all(prevIndex < int2(prevDims))) {
+				uint2 prevDepthId = gPrevAccumDepth[prevIndex];
+				float prevDepth = asfloat(prevDepthId.x);
+				if ((prevDepthId.y == instanceId) && (abs(prevClipPos.w - prevDepth) <= (TEMPORAL_DEPTH_TOLERANCE * max(prevClipPos.w, prevDepth)))) {
+					float4 prevColor = gPrevAccumColor[prevIndex];
+					historyLength = uint(prevColor.a);
+					color.rgb = lerp(prevColor.rgb, color.rgb, max(1.0f / (historyLength + 1), TEMPORAL_MIN_BLEND_ALPHA));
+				}
+			}
+		}
+	}
+
+	gAccumColor[outputIndex] = float4(color.rgb, min(historyLength + 1, TEMPORAL_MAX_HISTORY_LENGTH));
+	gAccumDepth[outputIndex] = uint2(asuint(depth), instanceId);
+	gOutput[outputIndex] = color;
+}
+
+// Amount of samples traced by a tile of adaptive sampling. Must match AdaptiveSampler::scaleSamples.
+uint ScaleSamples(uint samples, uint units) {
+	return (samples > 0) ? max((samples * units + ADAPTIVE_BASE_UNITS / 2) / ADAPTIVE_BASE_UNITS, 1) : 0;
+}
+
+uint AdaptiveTileIndex(uint2 outputIndex, uint2 outputDims) {
+	uint tilesX = (outputDims.x + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+	uint2 tile = outputIndex / ADAPTIVE_TILE_SIZE;
+	return tile.y * tilesX + tile.x;
+}
+
+// Updates the luminance moments of the pixel with the shaded color and adds its relative variance to its tile.
+void AccumulateVariance(uint2 outputIndex, uint tileIndex) {
+	float luminance = dot(gOutput[outputIndex].rgb, float3(0.2126f, 0.7152f, 0.0722f));
+	float2 moments = float2(luminance, luminance * luminance);
+	if (varianceHistoryValid) {
+		moments = lerp(gVarianceMoments[outputIndex], moments, VARIANCE_BLEND_ALPHA);
+	}
+
+	gVarianceMoments[outputIndex] = moments;
+
+	float variance = max(moments.y - moments.x * moments.x, 0.0f);
+	float relativeVariance = min(variance / max(moments.x * moments.x, VARIANCE_MIN_MEAN_SQUARED), VARIANCE_MAX_PIXEL);
+	InterlockedAdd(gTileVariance[tileIndex], uint(relativeVariance * VARIANCE_SCALE));
+}
+
+void TraceFull(float3 rayOrigin, float3 rayDirection, float rayMinDist, float rayMaxDist, uint2 launchIndex, uint2 pixelDims, uint2 outputIndex, uint2 outputDims, uint seed) {
 	uint hitCount = TraceSurface(rayOrigin, rayDirection, rayMinDist, rayMaxDist, 0);
-	FullShadeFromGBuffers(min(hitCount, MAX_HIT_QUERIES), rayOrigin, rayDirection, launchIndex, pixelDims, seed);
+
+	// Store the closest instance for picking.
+	uint instanceId = NO_HIT_INSTANCE_ID;
+	float3 worldPosition = rayOrigin;
+	float3 prevWorldPosition = rayOrigin + rayDirection * RAY_MAX_DISTANCE;
+	if (hitCount > 0) {
+		uint hitBufferIndex = getHitBufferIndex(0, launchIndex, pixelDims);
+		HitRecord hitRecord = unpackHitRecord(gHitBuffer[hitBufferIndex]);
+		instanceId = hitRecord.instanceId;
+		worldPosition = rayOrigin + rayDirection * WithoutDistanceBias(hitRecord.distance, instanceId);
+		prevWorldPosition = gHitPrevPosition[hitBufferIndex].xyz;
+	}
+
+	gInstanceId[outputIndex] = instanceId;
+
+	// Store the view depth of the closest hit. It guides the reconstruction of the pixels that aren't traced every frame.
+	float depth = 0.0f;
+	if (instanceId != NO_HIT_INSTANCE_ID) {
+		depth = mul(mul(projection, view), float4(worldPosition, 1.0f)).w;
+	}
+
+	gDepth[outputIndex] = depth;
+
+	// Project the previous position of the closest hit with the previous view to get the motion vector.
+	// Pixels without hits only move with the camera, so they use a point far away in the ray's direction.
+	float2 motion = float2(0.0f, 0.0f);
+	float4 prevClipPos = mul(prevViewProj, float4(prevWorldPosition, 1.0f));
+	if (prevClipPos.w > 0.0f) {
+		float2 prevNdc = prevClipPos.xy / prevClipPos.w;
+		motion = float2(prevNdc.x * 0.5f + 0.5f, 0.5f - prevNdc.y * 0.5f) * outputDims - (outputIndex + 0.5f + jitter);
+	}
+
+	gMotion[outputIndex] = motion;
+
+	// Tiles get more or less samples than the view's settings depending on how noisy they were on the previous frames.
+	uint lightSamples = softLightSamples;
+	uint giSamples = giBounces;
+	uint tileIndex = 0;
+	if (adaptiveSamplingEnabled) {
+		tileIndex = AdaptiveTileIndex(outputIndex, outputDims);
+		uint units = gTileUnits[tileIndex];
+		lightSamples = ScaleSamples(softLightSamples, units);
+		giSamples = ScaleSamples(giBounces, units);
+	}
+
+	FullShadeFromGBuffers(min(hitCount, maxHitQueries), rayOrigin, rayDirection, launchIndex, pixelDims, outputIndex, lightSamples, giSamples, seed);
+
+	// The variance is measured before the temporal accumulation blends the color with the history.
+	if (adaptiveSamplingEnabled) {
+		AccumulateVariance(outputIndex, tileIndex);
+	}
+
+	if (temporalEnabled) {
+		AccumulateTemporal(outputIndex, outputDims, instanceId, depth, prevWorldPosition);
+	}
 }
 
 [shader("raygeneration")]
 void TraceRayGen() {
 	uint2 launchIndex = DispatchRaysIndex().xy;
 	uint2 launchDims = DispatchRaysDimensions().xy;
-	float2 d = (((launchIndex.xy + 0.5f) / float2(launchDims)) * 2.f - 1.f);
+	uint2 outputDims = uint2(resolution.xy);
+
+	// Only a pattern of the pixels is traced every frame when the view uses checkerboard or interleaved tracing.
+	// The dispatch is smaller in that case, and its last rays can land past the tile when its size is odd.
+	uint2 outputIndex = TracePatternPixel(tracePattern, frameCount, tileOffset, launchIndex);
+	uint2 regionEnd = (tileSize > 0) ? min(tileOffset + tileSize, outputDims) : outputDims;
+	if (any(outputIndex >= regionEnd)) {
+		return;
+	}
+
+	// The rays are jittered inside their pixels when the output is upscaled, so the upscaler gets samples from all over each pixel.
+	float2 d = (((outputIndex.xy + 0.5f + jitter) / float2(outputDims)) * 2.f - 1.f);
 	float3 rayOrigin = mul(viewI, float4(0, 0, 0, 1)).xyz;
 	float4 target = mul(projectionI, float4(d.x, -d.y, 1, 1));
 	float3 rayDirection = mul(viewI, float4(target.xyz, 0)).xyz;
-	uint seed = initRand(launchIndex.x + launchIndex.y * launchDims.x, randomSeed, 16);
-	TraceFull(rayOrigin, rayDirection, RAY_MIN_DISTANCE, RAY_MAX_DISTANCE, launchIndex, launchDims, seed);
+	uint seed = initRand(outputIndex.x + outputIndex.y * outputDims.x, randomSeed, 16);
+	TraceFull(rayOrigin, rayDirection, RAY_MIN_DISTANCE, RAY_MAX_DISTANCE, launchIndex, launchDims, outputIndex, outputDims, seed);
 }
@@ -0,0 +1,111 @@
+//
+// RT64
+//
+
+// Must match the constants in TemporalUpscaler.
+#define KERNEL_SHARPNESS		2.29f
+#define MAX_HISTORY_WEIGHT		8.0f
+#define CLAMP_DEVIATIONS		1.5f
+
+Texture2D<float4> gOutput : register(t0);
+Texture2D<float2> gMotion : register(t1);
+Texture2D<float4> gPrevColor : register(t2);
+Texture2D<float> gPrevWeight : register(t3);
+
+cbuffer UpscaleParams : register(b0) {
+	float2 inputDims;
+	float2 outputDims;
+	float2 jitter;
+	uint historyValid;
+};
+
+struct PSOutput {
+	float4 color : SV_TARGET0;
+	float weight : SV_TARGET1;
+};
+
+float4 CatmullRomWeights(float t) {
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return 0.5f * float4(-t3 + 2.0f * t2 - t, 3.0f * t3 - 5.0f * t2 + 2.0f, -3.0f * t3 + 4.0f * t2 + t, t3 - t2);
+}
+
+// The color is resampled with a Catmull-Rom filter, since the blur of a bilinear filter would add up over the frames.
+// The weight is only interpolated bilinearly so it can't become negative.
+void SampleHistory(float2 pos, out float4 color, out float weight) {
+	color = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	weight = 0.0f;
+	if (any(pos < 0.0f) || any(pos >= outputDims)) {
+		return;
+	}
+
+	float2 f = pos - 0.5f;
+	int2 p0 = int2(floor(f));
+	float2 t = f - p0;
+	float4 wx = CatmullRomWeights(t.x);
+	float4 wy = CatmullRomWeights(t.y);
+	int2 maxIndex = int2(outputDims) - 1;
+	[unroll]
+	for (int j = 0; j < 4; j++) {
+		[unroll]
+		for (int i = 0; i < 4; i++) {
+			int2 s = clamp(p0 + int2(i - 1, j - 1), int2(0, 0), maxIndex);
+			color += gPrevColor.Load(int3(s, 0)) * wx[i] * wy[j];
+			if (((i == 1) || (i == 2)) && ((j == 1) || (j == 2))) {
+				weight += gPrevWeight.Load(int3(s, 0)) * ((i == 2) ? t.x : (1.0f - t.x)) * ((j == 2) ? t.y : (1.0f - t.y));
+			}
+		}
+	}
+}
+
+PSOutput PSMain(in float4 pos : SV_Position, in float2 uv : TEXCOORD0) {
+	// Find the sample closest to the center of the output pixel.
+	float2 scale = outputDims / inputDims;
+	float2 inputPos = pos.xy / scale;
+	int2 maxInput = int2(inputDims) - 1;
+	int2 center = clamp(int2(floor(inputPos - jitter)), int2(0, 0), maxInput);
+
+	// Filter the samples around it and gather the statistics of the neighborhood.
+	float4 current = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float4 mean = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float4 meanSq = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float currentWeight = 0.0f;
+	float sampleCount = 0.0f;
+	[unroll]
+	for (int dy = -1; dy <= 1; dy++) {
+		[unroll]
+		for (int dx = -1; dx <= 1; dx++) {
+			int2 s = center + int2(dx, dy);
+			if (all(s >= 0) && all(s <= maxInput)) {
+				float4 c = gOutput.Load(int3(s, 0));
+				float2 d = (s + 0.5f + jitter - inputPos) * scale;
+				float w = exp(-KERNEL_SHARPNESS * dot(d, d));
+				current += c * w;
+				mean += c;
+				meanSq += c * c;
+				currentWeight += w;
+				sampleCount += 1.0f;
+			}
+		}
+	}
+
+	current = (currentWeight > 0.0f) ? (current / currentWeight) : gOutput.Load(int3(center, 0));
+
+	// Reproject the center of the output pixel with the motion of the closest sample.
+	float4 history = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float weight = 0.0f;
+	if (historyValid) {
+		SampleHistory(pos.xy + gMotion.Load(int3(center, 0)) * scale, history, weight);
+	}
+
+	// Clamp the history to the colors around the pixel to reject it where it's no longer visible.
+	weight = min(weight, MAX_HISTORY_WEIGHT);
+	mean /= sampleCount;
+	float4 deviation = sqrt(max(meanSq / sampleCount - mean * mean, 0.0f)) * CLAMP_DEVIATIONS;
+	history = clamp(history, mean - deviation, mean + deviation);
+
+	PSOutput output;
+	output.color = (weight > 0.0f) ? ((history * weight + current * currentWeight) / (weight + currentWeight)) : current;
+	output.weight = weight + currentWeight;
+	return output;
+}
@@ -10,6 +10,7 @@ cbuffer ViewParams : register(b0) {
 	float4x4 prevViewProj;
 	float4 viewport;
 	float4 resolution;
+	float2 jitter;
 	uint randomSeed;
 	uint softLightSamples;
 	uint giBounces;
@@ -17,4 +18,12 @@ cbuffer ViewParams : register(b0) {
 	uint maxLightSamples;
 	float ambGIMixWeight;
 	uint frameCount;
+	uint maxHitQueries;
+	uint tileSize;
+	uint temporalEnabled;
+	uint temporalHistoryValid;
+	uint tracePattern;
+	uint adaptiveSamplingEnabled;
+	uint varianceHistoryValid;
+	float2 prevResolution;
 }
\ No newline at end of file
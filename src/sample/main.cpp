@@ -23,6 +23,9 @@ static void errorMessage(HWND hWnd, const char *message) {
 #ifndef RT64_MINIMAL
 
 #include <stdio.h>
+#include <string.h>
+
+#include <chrono>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -134,6 +137,45 @@ bool createRT64(HWND hwnd) {
 	return true;
 }
 
+bool benchmarkStartup(HWND hwnd) {
+	// The library is unloaded between runs so each one pays for loading the DLL again. The first run
+	// also has to fill the pipeline cache, so it's reported separately from the average.
+	const int RunCount = 10;
+	double libraryTotal = 0.0;
+	double deviceTotal = 0.0;
+	for (int i = 0; i < RunCount; i++) {
+		auto startTime = std::chrono::steady_clock::now();
+		RT64_LIBRARY lib = RT64_LoadLibrary();
+		if (lib.handle == 0) {
+			errorMessage(hwnd, "Failed to load RT64 library.");
+			return false;
+		}
+
+		auto loadedTime = std::chrono::steady_clock::now();
+		RT64_DEVICE *device = lib.CreateDevice(hwnd);
+		if (device == nullptr) {
+			errorMessage(hwnd, lib.GetLastError());
+			RT64_UnloadLibrary(lib);
+			return false;
+		}
+
+		auto createdTime = std::chrono::steady_clock::now();
+		lib.DestroyDevice(device);
+		RT64_UnloadLibrary(lib);
+
+		double libraryMs = std::chrono::duration<double, std::milli>(loadedTime - startTime).count();
+		double deviceMs = std::chrono::duration<double, std::milli>(createdTime - loadedTime).count();
+		printf("Run %d: library %.2f ms, device %.2f ms\n", i, libraryMs, deviceMs);
+		if (i > 0) {
+			libraryTotal += libraryMs;
+			deviceTotal += deviceMs;
+		}
+	}
+
+	printf("Average without the first run: library %.2f ms, device %.2f ms\n", libraryTotal / (RunCount - 1), deviceTotal / (RunCount - 1));
+	return true;
+}
+
 void setupRT64Scene() {
 	// Setup scene.
 	RT64.scene = RT64.lib.CreateScene(RT64.device);
@@ -388,10 +430,15 @@ void destroyRT64() {
 }
 
 int main(int argc, char *argv[]) {
+	// Only measure how long it takes to load the library and create the device when requested.
+	bool startupBenchmark = (argc > 1) && (strcmp(argv[1], "--benchmark-startup") == 0);
+
 	// Show a basic message to the user so they know what the sample is meant to do.
-	infoMessage(NULL, 
-		"This sample application will test if your system has the required hardware to run RT64.\n\n"
-		"If you see some shapes in the screen after pressing OK, then you're good to go!");
+	if (!startupBenchmark) {
+		infoMessage(NULL,
+			"This sample application will test if your system has the required hardware to run RT64.\n\n"
+			"If you see some shapes in the screen after pressing OK, then you're good to go!");
+	}
 
 	// Register window class.
 	WNDCLASS wc;
@@ -415,6 +462,10 @@ int main(int argc, char *argv[]) {
 
 	HWND hwnd = CreateWindow(wc.lpszClassName, WINDOW_TITLE, dwStyle, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, 0, 0, wc.hInstance, NULL);
 
+	if (startupBenchmark) {
+		return benchmarkStartup(hwnd) ? 0 : 1;
+	}
+
 	// Create RT64.
 	if (!createRT64(hwnd)) {
 		errorMessage(hwnd,
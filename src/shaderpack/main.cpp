@@ -0,0 +1,116 @@
+//
+// RT64
+//
+
+// Packs the compiled shaders into the archive that gets embedded in the library.
+//
+// Usage: shaderpack [-store] <list file> <output header>
+//
+// Every line of the list file names a shader, whose bytecode is read from <name>.hlsl.cso in the same directory.
+// Passing -store writes the archive without compressing it, which is useful for comparing load times.
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#include "rt64_shader_archive.h"
+
+bool readFile(const std::filesystem::path &path, std::vector<uint8_t> &data) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !file.bad();
+}
+
+bool writeHeader(const std::filesystem::path &path, const std::vector<uint8_t> &archive) {
+	std::stringstream ss;
+	ss << "// Generated by shaderpack. Do not edit." << std::endl;
+	ss << "#pragma once" << std::endl << std::endl;
+	ss << "static const unsigned char ShaderArchiveBlob[] = {" << std::endl;
+	ss << std::hex << std::setfill('0');
+	for (size_t i = 0; i < archive.size(); i++) {
+		ss << ((i % 16) == 0 ? "\t" : " ") << "0x" << std::setw(2) << (int)(archive[i]) << ",";
+		if (((i % 16) == 15) || ((i + 1) == archive.size())) {
+			ss << std::endl;
+		}
+	}
+
+	ss << "};" << std::endl;
+
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	file << ss.str();
+	return !file.fail();
+}
+
+int main(int argc, char *argv[]) {
+	bool compress = true;
+	int argIndex = 1;
+	if ((argIndex < argc) && (strcmp(argv[argIndex], "-store") == 0)) {
+		compress = false;
+		argIndex++;
+	}
+
+	if ((argc - argIndex) != 2) {
+		fprintf(stderr, "Usage: shaderpack [-store] <list file> <output header>\n");
+		return 1;
+	}
+
+	const std::filesystem::path listPath = std::filesystem::u8path(argv[argIndex]);
+	const std::filesystem::path outputPath = std::filesystem::u8path(argv[argIndex + 1]);
+	std::ifstream listFile(listPath);
+	if (!listFile.is_open()) {
+		fprintf(stderr, "Unable to open %s.\n", argv[argIndex]);
+		return 1;
+	}
+
+	std::vector<RT64::ShaderArchive::Source> sources;
+	size_t totalSize = 0;
+	std::string line;
+	while (std::getline(listFile, line)) {
+		// Ignore comments, empty lines and the carriage returns left over by Windows line endings.
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || (line[0] == '#')) {
+			continue;
+		}
+
+		RT64::ShaderArchive::Source source;
+		source.name = line;
+
+		const std::filesystem::path shaderPath = listPath.parent_path() / (line + ".hlsl.cso");
+		if (!readFile(shaderPath, source.bytecode)) {
+			fprintf(stderr, "Unable to read %s.\n", shaderPath.u8string().c_str());
+			return 1;
+		}
+
+		totalSize += source.bytecode.size();
+		sources.push_back(std::move(source));
+	}
+
+	std::vector<uint8_t> archive;
+	try {
+		RT64::ShaderArchive::build(sources, compress, archive);
+	}
+	catch (const std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	if (!writeHeader(outputPath, archive)) {
+		fprintf(stderr, "Unable to write %s.\n", argv[argIndex + 1]);
+		return 1;
+	}
+
+	printf("Packed %zu shaders: %zu bytes into %zu bytes.\n", sources.size(), totalSize, archive.size());
+	return 0;
+}
@@ -0,0 +1,211 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <vector>
+
+#include "rt64_adaptive_sampler.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::AdaptiveSampler Sampler;
+
+	// Small deterministic generator so the random cases are the same on every platform.
+	struct Random {
+		uint32_t state = 12345;
+
+		uint32_t next() {
+			state = state * 1664525U + 1013904223U;
+			return state >> 8;
+		}
+
+		float nextFloat() {
+			return (float)(next()) / (float)(1U << 24);
+		}
+	};
+
+	uint64_t unitsUsed(const std::vector<unsigned int> &units, const std::vector<unsigned int> &pixelCounts) {
+		uint64_t used = 0;
+		for (size_t t = 0; t < units.size(); t++) {
+			used += (uint64_t)(units[t]) * pixelCounts[t];
+		}
+
+		return used;
+	}
+
+	// Variance sums the shader would add up for a tile with the given units and variance of a single sample per pixel.
+	uint32_t tileVarianceSum(unsigned int pixelCount, unsigned int units, float sampleVariance) {
+		const float pixelVariance = std::min(sampleVariance * Sampler::BaseUnits / units, Sampler::MaxPixelVariance);
+		return (uint32_t)(pixelVariance * Sampler::VarianceScale) * pixelCount;
+	}
+};
+
+RT64_TEST(budgetIsConservedOnRandomWeights) {
+	Random random;
+	for (int iteration = 0; iteration < 500; iteration++) {
+		const size_t tileCount = 1 + random.next() % 200;
+		std::vector<float> weights(tileCount);
+		std::vector<unsigned int> pixelCounts(tileCount), units(tileCount);
+		uint64_t totalPixels = 0;
+		unsigned int maxPixelCount = 0;
+		for (size_t t = 0; t < tileCount; t++) {
+			// A quarter of the tiles have no variance, and the rest span several orders of magnitude.
+			const float magnitudes[] = { 0.001f, 0.01f, 0.1f, 1.0f, 10.0f, 100.0f };
+			weights[t] = ((random.next() % 4) == 0) ? 0.0f : random.nextFloat() * magnitudes[random.next() % 6];
+			pixelCounts[t] = 1 + random.next() % 256;
+			totalPixels += pixelCounts[t];
+			maxPixelCount = std::max(maxPixelCount, pixelCounts[t]);
+		}
+
+		const uint64_t budget = totalPixels * Sampler::BaseUnits;
+		Sampler::allocate(weights.data(), pixelCounts.data(), tileCount, budget, Sampler::MinUnits, Sampler::MaxUnits, units.data());
+		const uint64_t used = unitsUsed(units, pixelCounts);
+		RT64_CHECK(used <= budget);
+
+		bool allWeightedAtMax = true;
+		for (size_t t = 0; t < tileCount; t++) {
+			RT64_CHECK((units[t] >= Sampler::MinUnits) && (units[t] <= Sampler::MaxUnits));
+			allWeightedAtMax = allWeightedAtMax && ((weights[t] <= 0.0f) || (units[t] == Sampler::MaxUnits));
+		}
+
+		// Nothing that could still be handed out to a tile is left unused.
+		RT64_CHECK(((budget - used) < maxPixelCount) || allWeightedAtMax);
+
+		// Tiles with more weight never get fewer units, other than by rounding.
+		for (size_t a = 0; a < tileCount; a++) {
+			for (size_t b = 0; b < tileCount; b++) {
+				RT64_CHECK(!(weights[a] > weights[b]) || ((units[a] + 1) >= units[b]));
+			}
+		}
+	}
+}
+
+RT64_TEST(unitsAreProportionalToWeights) {
+	const float weights[] = { 1.0f, 3.0f, 2.0f, 2.0f };
+	const unsigned int pixelCounts[] = { 4, 4, 4, 4 };
+	unsigned int units[4];
+	Sampler::allocate(weights, pixelCounts, 4, 16 * 4, 1, 16, units);
+	RT64_CHECK((units[0] == 2) && (units[1] == 6) && (units[2] == 4) && (units[3] == 4));
+}
+
+RT64_TEST(unitsAreClampedToTheRange) {
+	const float weights[] = { 0.0f, 1.0f, 1000.0f, 0.001f };
+	const unsigned int pixelCounts[] = { 16, 16, 16, 16 };
+	unsigned int units[4];
+
+	// The tile with almost all the weight can't take more than the maximum, and the rest get at least the minimum.
+	Sampler::allocate(weights, pixelCounts, 4, 64 * 4, 1, 8, units);
+	RT64_CHECK(units[2] == 8);
+	RT64_CHECK((units[0] >= 1) && (units[1] >= 1) && (units[3] >= 1));
+	RT64_CHECK((units[0] * 16 + units[1] * 16 + units[2] * 16 + units[3] * 16) <= (64 * 4));
+
+	// A budget below the minimum of every tile is exceeded, since the minimum always wins.
+	Sampler::allocate(weights, pixelCounts, 4, 10, 2, 8, units);
+	RT64_CHECK((units[0] == 2) && (units[1] == 2) && (units[2] == 2) && (units[3] == 2));
+
+	// A budget above the maximum of every tile leaves the tiles with weight at the maximum and the rest at the minimum.
+	Sampler::allocate(weights, pixelCounts, 4, 64 * 100, 2, 8, units);
+	RT64_CHECK((units[0] == 2) && (units[1] == 8) && (units[2] == 8) && (units[3] == 8));
+}
+
+RT64_TEST(budgetIsSplitEvenlyWithoutWeights) {
+	const float weights[] = { 0.0f, 0.0f, 0.0f };
+	const unsigned int pixelCounts[] = { 256, 64, 16 };
+	unsigned int units[3];
+	Sampler::allocate(weights, pixelCounts, 3, 336 * 5, 1, 16, units);
+	RT64_CHECK((units[0] == 5) && (units[1] == 5) && (units[2] == 5));
+
+	// The even split is clamped too.
+	Sampler::allocate(weights, pixelCounts, 3, 336 * 40, 1, 16, units);
+	RT64_CHECK((units[0] == 16) && (units[1] == 16) && (units[2] == 16));
+	Sampler::allocate(weights, pixelCounts, 3, 0, 1, 16, units);
+	RT64_CHECK((units[0] == 1) && (units[1] == 1) && (units[2] == 1));
+}
+
+RT64_TEST(uniformVarianceKeepsUniformSampling) {
+	// Odd sizes give smaller tiles on the right and bottom edges.
+	Sampler sampler;
+	sampler.set(100, 40);
+	RT64_CHECK((sampler.getTilesX() == 7) && (sampler.getTilesY() == 3) && (sampler.getTileCount() == 21));
+
+	std::vector<uint32_t> sums(sampler.getTileCount());
+	for (int frame = 0; frame < 4; frame++) {
+		for (int ty = 0; ty < sampler.getTilesY(); ty++) {
+			for (int tx = 0; tx < sampler.getTilesX(); tx++) {
+				const int t = ty * sampler.getTilesX() + tx;
+				const unsigned int pixelCount = (unsigned int)(std::min(16, 100 - tx * 16) * std::min(16, 40 - ty * 16));
+				sums[t] = tileVarianceSum(pixelCount, sampler.getUnits()[t], 0.5f);
+			}
+		}
+
+		sampler.update(sums.data());
+		for (int t = 0; t < sampler.getTileCount(); t++) {
+			RT64_CHECK(sampler.getUnits()[t] == Sampler::BaseUnits);
+		}
+	}
+}
+
+RT64_TEST(noisyTilesTakeSamplesFromFlatOnes) {
+	const int width = 160;
+	const int height = 96;
+	Sampler sampler;
+	sampler.set(width, height);
+	const int tilesX = sampler.getTilesX();
+	const int tileCount = sampler.getTileCount();
+	const unsigned int tilePixels = (unsigned int)(Sampler::TileSize * Sampler::TileSize);
+	auto sampleVariance = [&](int t) {
+		// A column of penumbrae and a noisy corner on a flat lit background.
+		const int tx = t % tilesX;
+		const int ty = t / tilesX;
+		if (tx == 3) {
+			return 0.5f;
+		}
+		else if ((tx >= 8) && (ty >= 4)) {
+			return 0.2f;
+		}
+		else {
+			return 0.001f;
+		}
+	};
+
+	std::vector<uint32_t> sums(tileCount);
+	std::vector<unsigned int> pixelCounts(tileCount, tilePixels);
+	for (int frame = 0; frame < 8; frame++) {
+		for (int t = 0; t < tileCount; t++) {
+			sums[t] = tileVarianceSum(tilePixels, sampler.getUnits()[t], sampleVariance(t));
+		}
+
+		sampler.update(sums.data());
+		std::vector<unsigned int> units(sampler.getUnits(), sampler.getUnits() + tileCount);
+		RT64_CHECK(unitsUsed(units, pixelCounts) <= ((uint64_t)(width) * height * Sampler::BaseUnits));
+	}
+
+	const unsigned int *units = sampler.getUnits();
+	const int penumbraTile = 3;
+	const int cornerTile = tileCount - 1;
+	const int flatTile = 0;
+	RT64_CHECK(units[penumbraTile] > Sampler::BaseUnits);
+	RT64_CHECK(units[cornerTile] > Sampler::BaseUnits);
+	RT64_CHECK(units[penumbraTile] >= units[cornerTile]);
+	RT64_CHECK(units[flatTile] < Sampler::BaseUnits);
+
+	sampler.reset();
+	for (int t = 0; t < tileCount; t++) {
+		RT64_CHECK(sampler.getUnits()[t] == Sampler::BaseUnits);
+	}
+}
+
+RT64_TEST(samplesScaleWithUnits) {
+	RT64_CHECK(Sampler::scaleSamples(0, Sampler::MaxUnits) == 0);
+	for (unsigned int samples = 1; samples <= 8; samples++) {
+		RT64_CHECK(Sampler::scaleSamples(samples, Sampler::BaseUnits) == samples);
+		RT64_CHECK(Sampler::scaleSamples(samples, Sampler::MinUnits) >= 1);
+		RT64_CHECK(Sampler::scaleSamples(samples, Sampler::MaxUnits) == (samples * Sampler::MaxUnits / Sampler::BaseUnits));
+	}
+
+	// Rounded to the nearest amount of samples.
+	RT64_CHECK(Sampler::scaleSamples(3, 2) == 2);
+	RT64_CHECK(Sampler::scaleSamples(3, 5) == 4);
+	RT64_CHECK(Sampler::scaleSamples(4, 1) == 1);
+}
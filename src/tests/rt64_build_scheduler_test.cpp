@@ -0,0 +1,119 @@
+//
+// RT64
+//
+
+#include "rt64_build_scheduler.h"
+#include "rt64_test.h"
+
+namespace {
+	// The scheduler only compares the keys, so they can point anywhere.
+	const int Meshes[8] = {};
+
+	std::vector<const void *> scheduledKeys(RT64::BuildScheduler &scheduler) {
+		std::vector<RT64::BuildScheduler::Build> builds;
+		scheduler.schedule(builds);
+
+		std::vector<const void *> keys;
+		for (const RT64::BuildScheduler::Build &build : builds) {
+			keys.push_back(build.key);
+		}
+
+		return keys;
+	}
+
+	RT64::BuildScheduler makeScheduler(uint64_t frameBudget) {
+		RT64::BuildScheduler scheduler;
+		RT64::BuildScheduler::Settings settings;
+		settings.frameBudget = frameBudget;
+		scheduler.setSettings(settings);
+		return scheduler;
+	}
+};
+
+RT64_TEST(everythingIsBuiltWithoutABudget) {
+	RT64::BuildScheduler scheduler = makeScheduler(0);
+	for (int i = 0; i < 4; i++) {
+		scheduler.enqueue(&Meshes[i], 1000, false);
+	}
+
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[0], &Meshes[1], &Meshes[2], &Meshes[3] }));
+	RT64_CHECK(scheduler.getPendingCount() == 0);
+}
+
+RT64_TEST(optionalBuildsAreSplitByTheBudget) {
+	RT64::BuildScheduler scheduler = makeScheduler(100);
+	scheduler.enqueue(&Meshes[0], 40, false);
+	scheduler.enqueue(&Meshes[1], 50, false);
+	scheduler.enqueue(&Meshes[2], 30, false);
+	scheduler.enqueue(&Meshes[3], 10, false);
+
+	// The third build doesn't fit, and the ones after it wait too so the requests are built in order.
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[0], &Meshes[1] }));
+	RT64_CHECK(scheduler.getPendingCount() == 2);
+	RT64_CHECK(scheduler.isPending(&Meshes[2]) && scheduler.isPending(&Meshes[3]));
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[2], &Meshes[3] }));
+	RT64_CHECK(scheduledKeys(scheduler).empty());
+}
+
+RT64_TEST(buildsOverTheBudgetAreStillDone) {
+	RT64::BuildScheduler scheduler = makeScheduler(100);
+	scheduler.enqueue(&Meshes[0], 500, false);
+	scheduler.enqueue(&Meshes[1], 10, false);
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[0] }));
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[1] }));
+}
+
+RT64_TEST(requiredBuildsOverrideTheBudget) {
+	RT64::BuildScheduler scheduler = makeScheduler(100);
+	scheduler.enqueue(&Meshes[0], 80, false);
+	scheduler.enqueue(&Meshes[1], 500, true);
+	scheduler.enqueue(&Meshes[2], 50, false);
+	scheduler.enqueue(&Meshes[3], 500, true);
+
+	// Required builds don't count against the budget of the optional ones.
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[0], &Meshes[1], &Meshes[3] }));
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[2] }));
+}
+
+RT64_TEST(requestingAgainKeepsThePlaceAndTheRequirement) {
+	RT64::BuildScheduler scheduler = makeScheduler(100);
+	scheduler.enqueue(&Meshes[0], 60, false);
+	scheduler.enqueue(&Meshes[1], 60, false);
+	scheduler.enqueue(&Meshes[0], 60, true);
+	scheduler.enqueue(&Meshes[0], 10, false);
+	RT64_CHECK(scheduler.getPendingCount() == 2);
+
+	std::vector<RT64::BuildScheduler::Build> builds;
+	scheduler.schedule(builds);
+	RT64_CHECK(builds.size() == 2);
+	RT64_CHECK((builds[0].key == &Meshes[0]) && builds[0].required && (builds[0].cost == 10));
+	RT64_CHECK((builds[1].key == &Meshes[1]) && !builds[1].required);
+}
+
+RT64_TEST(cancelledBuildsAreNeverScheduled) {
+	RT64::BuildScheduler scheduler = makeScheduler(100);
+	scheduler.enqueue(&Meshes[0], 60, false);
+	scheduler.enqueue(&Meshes[1], 60, true);
+	scheduler.enqueue(&Meshes[2], 30, false);
+	scheduler.cancel(&Meshes[1]);
+	scheduler.cancel(&Meshes[0]);
+	RT64_CHECK(!scheduler.isPending(&Meshes[0]) && !scheduler.isPending(&Meshes[1]));
+
+	// Cancelling a key that isn't pending does nothing.
+	scheduler.cancel(&Meshes[7]);
+	RT64_CHECK(scheduler.getPendingCount() == 1);
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[2] }));
+}
+
+RT64_TEST(cancellingWhileDeferredFreesTheBudget) {
+	RT64::BuildScheduler scheduler = makeScheduler(100);
+	scheduler.enqueue(&Meshes[0], 90, false);
+	scheduler.enqueue(&Meshes[1], 90, false);
+	scheduler.enqueue(&Meshes[2], 10, false);
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[0] }));
+
+	// The deferred build is cancelled, so the next one moves up.
+	scheduler.cancel(&Meshes[1]);
+	RT64_CHECK((scheduledKeys(scheduler) == std::vector<const void *>{ &Meshes[2] }));
+	RT64_CHECK(scheduler.getPendingCount() == 0);
+}
@@ -0,0 +1,284 @@
+//
+// RT64
+//
+
+#include <cmath>
+#include <vector>
+
+#include "rt64_cpu_denoiser.h"
+#include "rt64_test.h"
+
+namespace {
+	const int Width = 64;
+	const int Height = 48;
+
+	// Rows are padded like the readback buffers the view hands to the denoiser.
+	const int RowFloats = Width * 4 + 16;
+
+	// The albedo changes between the left and right halves, and the normal and the lighting between the top and bottom halves.
+	const int AlbedoEdgeX = Width / 2;
+	const int NormalEdgeY = Height / 2;
+
+	// Small deterministic generator so the noise is the same on every platform.
+	struct Random {
+		uint32_t state = 12345;
+
+		float nextFloat() {
+			state = state * 1664525U + 1013904223U;
+			return (float)(state >> 8) / (float)(1U << 24);
+		}
+	};
+
+	struct Scene {
+		float topIllumination = 1.0f;
+		float bottomIllumination = 0.4f;
+		float topNormalZ = 1.0f;
+
+		// Every pixel is scaled by a random factor in [1 - noise, 1 + noise].
+		float noise = 0.6f;
+	};
+
+	struct Frame {
+		std::vector<float> color;
+		std::vector<float> clean;
+		std::vector<float> albedo;
+		std::vector<float> normal;
+
+		Frame() : color(Height * RowFloats), clean(Height * RowFloats), albedo(Height * RowFloats), normal(Height * RowFloats) { }
+
+		float *pixel(std::vector<float> &image, int x, int y) {
+			return &image[y * RowFloats + x * 4];
+		}
+
+		RT64::CPUDenoiser::Inputs inputs() {
+			RT64::CPUDenoiser::Inputs inputs;
+			inputs.color = color.data();
+			inputs.albedo = albedo.data();
+			inputs.normal = normal.data();
+			inputs.rowPitch = RowFloats * sizeof(float);
+			return inputs;
+		}
+	};
+
+	void render(const Scene &scene, Random &random, Frame &frame) {
+		const float leftAlbedo[3] = { 0.8f, 0.3f, 0.2f };
+		const float rightAlbedo[3] = { 0.2f, 0.4f, 0.8f };
+		for (int y = 0; y < Height; y++) {
+			for (int x = 0; x < Width; x++) {
+				const bool top = y < NormalEdgeY;
+				const float *a = (x < AlbedoEdgeX) ? leftAlbedo : rightAlbedo;
+				const float illumination = top ? scene.topIllumination : scene.bottomIllumination;
+				const float factor = 1.0f + (random.nextFloat() * 2.0f - 1.0f) * scene.noise;
+				float *albedo = frame.pixel(frame.albedo, x, y);
+				float *normal = frame.pixel(frame.normal, x, y);
+				float *clean = frame.pixel(frame.clean, x, y);
+				float *color = frame.pixel(frame.color, x, y);
+				for (int k = 0; k < 3; k++) {
+					albedo[k] = a[k];
+					clean[k] = a[k] * illumination;
+					color[k] = clean[k] * factor;
+				}
+
+				albedo[3] = 1.0f;
+				normal[0] = 0.0f;
+				normal[1] = top ? 0.0f : 1.0f;
+				normal[2] = top ? scene.topNormalZ : 0.0f;
+				normal[3] = 0.0f;
+
+				// A gradient the filter must leave untouched.
+				clean[3] = color[3] = (float)(x + y) / (Width + Height);
+			}
+		}
+	}
+
+	// Relative RMSE of the color against the clean image over the given rows and columns.
+	float relativeError(Frame &frame, int x0, int y0, int x1, int y1) {
+		double sum = 0.0;
+		int count = 0;
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				const float *color = frame.pixel(frame.color, x, y);
+				const float *clean = frame.pixel(frame.clean, x, y);
+				for (int k = 0; k < 3; k++) {
+					const double d = (color[k] - clean[k]) / clean[k];
+					sum += d * d;
+					count++;
+				}
+			}
+		}
+
+		return (float)(sqrt(sum / count));
+	}
+
+	float relativeError(Frame &frame) {
+		return relativeError(frame, 0, 0, Width, Height);
+	}
+
+	// Mean of the color relative to the clean image, which is one if the filter doesn't lag behind a change.
+	float relativeMean(Frame &frame, int y0, int y1) {
+		double sum = 0.0;
+		int count = 0;
+		for (int y = y0; y < y1; y++) {
+			for (int x = 0; x < Width; x++) {
+				const float *color = frame.pixel(frame.color, x, y);
+				const float *clean = frame.pixel(frame.clean, x, y);
+				for (int k = 0; k < 3; k++) {
+					sum += color[k] / clean[k];
+					count++;
+				}
+			}
+		}
+
+		return (float)(sum / count);
+	}
+
+	void denoiseFrames(RT64::CPUDenoiser &denoiser, const Scene &scene, Random &random, Frame &frame, int frameCount) {
+		for (int i = 0; i < frameCount; i++) {
+			render(scene, random, frame);
+			denoiser.denoise(frame.inputs());
+		}
+	}
+
+	void createDenoiser(RT64::CPUDenoiser &denoiser, unsigned int threadCount = 4) {
+		RT64::CPUDenoiser::Settings settings;
+		settings.threadCount = threadCount;
+		denoiser.setSettings(settings);
+		denoiser.set(Width, Height);
+	}
+};
+
+RT64_TEST(errorDropsOverFrames) {
+	RT64::CPUDenoiser denoiser;
+	createDenoiser(denoiser);
+
+	Scene scene;
+	Random random;
+	Frame frame;
+	render(scene, random, frame);
+	const float noisyError = relativeError(frame);
+	denoiser.denoise(frame.inputs());
+	const float firstFrameError = relativeError(frame);
+	denoiseFrames(denoiser, scene, random, frame, 15);
+	const float convergedError = relativeError(frame);
+
+	// The spatial filter alone must cut the noise by a factor of ten, and the accumulated history by a factor of twenty.
+	RT64_CHECK(firstFrameError < noisyError / 10.0f);
+	RT64_CHECK(convergedError < noisyError / 20.0f);
+	RT64_CHECK(convergedError < firstFrameError * 0.5f);
+}
+
+RT64_TEST(edgesStaySharp) {
+	RT64::CPUDenoiser denoiser;
+	createDenoiser(denoiser);
+
+	Scene scene;
+	Random random;
+	Frame frame;
+	denoiseFrames(denoiser, scene, random, frame, 16);
+
+	// The pixels on both sides of the edges must be as close to the reference as the rest of the image. A filter that
+	// blurred across them would mix colors that are at least twice as bright on one side.
+	const float error = relativeError(frame);
+	const float albedoEdgeError = relativeError(frame, AlbedoEdgeX - 1, 0, AlbedoEdgeX + 1, Height);
+	const float normalEdgeError = relativeError(frame, 0, NormalEdgeY - 1, Width, NormalEdgeY + 1);
+	RT64_CHECK(albedoEdgeError < 0.1f);
+	RT64_CHECK(normalEdgeError < 0.1f);
+	RT64_CHECK(albedoEdgeError < error * 2.0f);
+	RT64_CHECK(normalEdgeError < error * 2.0f);
+}
+
+RT64_TEST(historyIsRejectedOnNormalFlip) {
+	RT64::CPUDenoiser denoiser;
+	createDenoiser(denoiser);
+
+	Scene scene;
+	Random random;
+	Frame frame;
+	denoiseFrames(denoiser, scene, random, frame, 16);
+
+	// The top half now faces away and is lit three times as much. Blending with the old history would leave it
+	// far darker than the reference.
+	scene.topNormalZ = -1.0f;
+	scene.topIllumination = 3.0f;
+	denoiseFrames(denoiser, scene, random, frame, 1);
+	RT64_CHECK_NEAR(relativeMean(frame, 0, NormalEdgeY), 1.0f, 0.1f);
+
+	// The bottom half kept its history, so it's still converged.
+	RT64_CHECK(relativeError(frame, 0, NormalEdgeY + 1, Width, Height) < 0.1f);
+}
+
+RT64_TEST(historyIsAcceptedWithoutChanges) {
+	RT64::CPUDenoiser denoiser;
+	createDenoiser(denoiser);
+
+	Scene scene;
+	Random random;
+	Frame frame;
+	denoiseFrames(denoiser, scene, random, frame, 16);
+
+	// The same change to the lighting without flipping the normals is blended with the history, so the result lags behind.
+	scene.topIllumination = 3.0f;
+	denoiseFrames(denoiser, scene, random, frame, 1);
+	RT64_CHECK(relativeMean(frame, 0, NormalEdgeY) < 0.6f);
+}
+
+RT64_TEST(historyIsDiscardedOnReset) {
+	RT64::CPUDenoiser denoiser;
+	createDenoiser(denoiser);
+
+	Scene scene;
+	Random random;
+	Frame frame;
+	denoiseFrames(denoiser, scene, random, frame, 16);
+
+	scene.topIllumination = 3.0f;
+	scene.bottomIllumination = 0.1f;
+	denoiser.reset();
+	denoiseFrames(denoiser, scene, random, frame, 1);
+	RT64_CHECK_NEAR(relativeMean(frame, 0, NormalEdgeY), 1.0f, 0.1f);
+	RT64_CHECK_NEAR(relativeMean(frame, NormalEdgeY, Height), 1.0f, 0.1f);
+}
+
+RT64_TEST(alphaIsPreserved) {
+	RT64::CPUDenoiser denoiser;
+	createDenoiser(denoiser);
+
+	Scene scene;
+	Random random;
+	Frame frame;
+	for (int i = 0; i < 4; i++) {
+		denoiseFrames(denoiser, scene, random, frame, 1);
+
+		bool preserved = true;
+		for (int y = 0; y < Height; y++) {
+			for (int x = 0; x < Width; x++) {
+				preserved = preserved && (frame.pixel(frame.color, x, y)[3] == frame.pixel(frame.clean, x, y)[3]);
+			}
+		}
+
+		RT64_CHECK(preserved);
+	}
+}
+
+RT64_TEST(threadCountDoesNotChangeTheResult) {
+	RT64::CPUDenoiser singleThreaded, multiThreaded;
+	createDenoiser(singleThreaded, 1);
+	createDenoiser(multiThreaded, 5);
+
+	Scene scene;
+	Random singleRandom, multiRandom;
+	Frame singleFrame, multiFrame;
+	for (int i = 0; i < 4; i++) {
+		denoiseFrames(singleThreaded, scene, singleRandom, singleFrame, 1);
+		denoiseFrames(multiThreaded, scene, multiRandom, multiFrame, 1);
+		RT64_CHECK(singleFrame.color == multiFrame.color);
+	}
+
+	// The workers are created again when the amount of threads changes.
+	RT64::CPUDenoiser::Settings settings = multiThreaded.getSettings();
+	settings.threadCount = 3;
+	multiThreaded.setSettings(settings);
+	denoiseFrames(singleThreaded, scene, singleRandom, singleFrame, 1);
+	denoiseFrames(multiThreaded, scene, multiRandom, multiFrame, 1);
+	RT64_CHECK(singleFrame.color == multiFrame.color);
+}
@@ -0,0 +1,285 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <set>
+
+#include "rt64_instance_query.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::InstanceQueryQueue Queue;
+
+	// Behaves like the view's backend: the regions are copied out of an instance ID buffer, the slot keeps the table
+	// of the instances that were traced, and the copies are done once the fake fence reaches the value of the slot.
+	// Instances are resolved when the query resolves, so the ones destroyed in the meantime resolve to nothing.
+	class FakeBackend : public Queue::Backend {
+	public:
+		int width;
+		int height;
+		std::vector<uint16_t> idBuffer;
+		std::vector<void *> tracedInstances;
+		std::set<void *> liveInstances;
+		uint64_t fenceValue = 1;
+		uint64_t completedFenceValue = 0;
+		unsigned int copyCount = 0;
+		std::vector<int> copyWidths;
+		std::vector<int> copyHeights;
+	private:
+		struct Slot {
+			std::vector<uint16_t> ids;
+			std::vector<void *> instances;
+			uint64_t fenceValue = 0;
+		};
+
+		Slot slots[Queue::SlotCount];
+	public:
+		FakeBackend(int width, int height) : width(width), height(height), idBuffer((size_t)(width) * height, (uint16_t)(Queue::NoHitInstanceId)) { }
+
+		void fill(int x, int y, int w, int h, uint16_t id) {
+			for (int j = y; j < (y + h); j++) {
+				for (int i = x; i < (x + w); i++) {
+					idBuffer[(size_t)(j) * width + i] = id;
+				}
+			}
+		}
+
+		// Ends the frame and lets the GPU finish everything that was recorded.
+		void finishFrame() {
+			completedFenceValue = fenceValue;
+			fenceValue++;
+		}
+
+		virtual void beginSlot(unsigned int slot) override {
+			slots[slot].ids.assign((size_t)(Queue::MaxRegionsPerSlot) * Queue::RegionSize * Queue::RegionSize, 0);
+		}
+
+		virtual void copyRegion(unsigned int slot, unsigned int regionIndex, int x, int y, int width, int height) override {
+			copyCount++;
+			copyWidths.push_back(width);
+			copyHeights.push_back(height);
+			for (int j = 0; j < height; j++) {
+				for (int i = 0; i < width; i++) {
+					slots[slot].ids[((size_t)(regionIndex) * Queue::RegionSize + j) * Queue::RegionSize + i] = idBuffer[(size_t)(y + j) * this->width + x + i];
+				}
+			}
+		}
+
+		virtual void endSlot(unsigned int slot) override {
+			slots[slot].instances = tracedInstances;
+			slots[slot].fenceValue = fenceValue;
+		}
+
+		virtual bool isSlotComplete(unsigned int slot) override {
+			return completedFenceValue >= slots[slot].fenceValue;
+		}
+
+		virtual void readSlot(unsigned int slot, unsigned int regionCount, uint16_t *ids) override {
+			std::copy(slots[slot].ids.begin(), slots[slot].ids.begin() + (size_t)(regionCount) * Queue::RegionSize * Queue::RegionSize, ids);
+		}
+
+		virtual void *getInstance(unsigned int slot, uint16_t instanceId) override {
+			if (instanceId >= slots[slot].instances.size()) {
+				return nullptr;
+			}
+
+			void *instance = slots[slot].instances[instanceId];
+			return (liveInstances.count(instance) > 0) ? instance : nullptr;
+		}
+	};
+
+	int InstanceA = 0;
+	int InstanceB = 0;
+	int InstanceC = 0;
+
+	// A 64x64 buffer with instance A on the left half and instance B on the right half, except for a background
+	// pixel at the origin that nothing was hit on.
+	struct Fixture {
+		FakeBackend backend;
+		Queue queue;
+
+		Fixture() : backend(64, 64), queue(&backend) {
+			backend.fill(0, 0, 32, 64, 0);
+			backend.fill(32, 0, 32, 64, 1);
+			backend.fill(0, 0, 1, 1, Queue::NoHitInstanceId);
+			backend.tracedInstances = { &InstanceA, &InstanceB };
+			backend.liveInstances = { &InstanceA, &InstanceB, &InstanceC };
+			queue.setDimensions(64, 64);
+		}
+	};
+};
+
+RT64_TEST(queriesResolveOnceTheCopyIsDone) {
+	Fixture f;
+	Queue::QueryId a = f.queue.request(10, 10);
+	Queue::QueryId b = f.queue.request(40, 20);
+	RT64_CHECK((a != Queue::InvalidQueryId) && (b != Queue::InvalidQueryId) && (a != b));
+	void *instance = nullptr;
+	RT64_CHECK(!f.queue.poll(a, &instance));
+
+	f.queue.submit();
+	RT64_CHECK(!f.queue.poll(a, &instance));
+
+	f.backend.finishFrame();
+	RT64_CHECK(f.queue.poll(a, &instance) && (instance == &InstanceA));
+	RT64_CHECK(f.queue.poll(b, &instance) && (instance == &InstanceB));
+	RT64_CHECK(f.queue.getQueryCount() == 0);
+}
+
+RT64_TEST(missesResolveToNoInstance) {
+	Fixture f;
+	Queue::QueryId queryId = f.queue.request(0, 0);
+	f.queue.submit();
+	f.backend.finishFrame();
+	void *instance = &InstanceC;
+	RT64_CHECK(f.queue.poll(queryId, &instance) && (instance == nullptr));
+}
+
+RT64_TEST(queriesOutsideTheBufferResolveRightAway) {
+	Fixture f;
+	Queue::QueryId queries[] = { f.queue.request(-1, 5), f.queue.request(5, -1), f.queue.request(64, 5), f.queue.request(5, 64) };
+	f.queue.submit();
+	RT64_CHECK(f.backend.copyCount == 0);
+	for (Queue::QueryId queryId : queries) {
+		void *instance = &InstanceC;
+		RT64_CHECK(f.queue.poll(queryId, &instance) && (instance == nullptr));
+	}
+}
+
+RT64_TEST(unknownQueriesResolveToNoInstance) {
+	Fixture f;
+	void *instance = &InstanceC;
+	RT64_CHECK(f.queue.poll(12345, &instance) && (instance == nullptr));
+	RT64_CHECK(f.queue.poll(Queue::InvalidQueryId, &instance) && (instance == nullptr));
+}
+
+RT64_TEST(queriesInTheSameRegionShareACopy) {
+	Fixture f;
+	std::vector<Queue::QueryId> queries;
+	for (int i = 0; i < Queue::RegionSize; i++) {
+		queries.push_back(f.queue.request(8 + i, 16 + i));
+	}
+
+	f.queue.submit();
+	RT64_CHECK(f.backend.copyCount == 1);
+	f.backend.finishFrame();
+	for (Queue::QueryId queryId : queries) {
+		void *instance = nullptr;
+		RT64_CHECK(f.queue.poll(queryId, &instance) && (instance == &InstanceA));
+	}
+}
+
+RT64_TEST(regionsAreClippedToTheBuffer) {
+	FakeBackend backend(20, 12);
+	Queue queue(&backend);
+	queue.setDimensions(20, 12);
+	backend.fill(0, 0, 20, 12, 0);
+	backend.tracedInstances = { &InstanceA };
+	backend.liveInstances = { &InstanceA };
+
+	Queue::QueryId queryId = queue.request(19, 11);
+	queue.submit();
+	RT64_CHECK(backend.copyCount == 1);
+	RT64_CHECK((backend.copyWidths[0] == 4) && (backend.copyHeights[0] == 4));
+	backend.finishFrame();
+	void *instance = nullptr;
+	RT64_CHECK(queue.poll(queryId, &instance) && (instance == &InstanceA));
+}
+
+RT64_TEST(queriesOverTheRegionLimitWaitForTheNextSlot) {
+	// Enough rows of regions for one more than the limit.
+	const int RegionsPerRow = 8;
+	const int Width = RegionsPerRow * Queue::RegionSize;
+	const int Height = (Queue::MaxRegionsPerSlot / RegionsPerRow + 1) * Queue::RegionSize;
+	FakeBackend backend(Width, Height);
+	Queue queue(&backend);
+	queue.setDimensions(Width, Height);
+	backend.fill(0, 0, Width, Height, 0);
+	backend.tracedInstances = { &InstanceA };
+	backend.liveInstances = { &InstanceA };
+
+	std::vector<Queue::QueryId> queries;
+	for (unsigned int r = 0; r <= Queue::MaxRegionsPerSlot; r++) {
+		queries.push_back(queue.request((r % RegionsPerRow) * Queue::RegionSize + 1, (r / RegionsPerRow) * Queue::RegionSize + 1));
+	}
+
+	queue.submit();
+	RT64_CHECK(backend.copyCount == Queue::MaxRegionsPerSlot);
+	RT64_CHECK(queue.getPendingQueryCount() == 1);
+
+	queue.submit();
+	RT64_CHECK(backend.copyCount == (Queue::MaxRegionsPerSlot + 1));
+	RT64_CHECK(queue.getPendingQueryCount() == 0);
+
+	backend.finishFrame();
+	for (Queue::QueryId queryId : queries) {
+		void *instance = nullptr;
+		RT64_CHECK(queue.poll(queryId, &instance) && (instance == &InstanceA));
+	}
+}
+
+RT64_TEST(nothingIsCopiedWhileTheRingIsFull) {
+	Fixture f;
+	std::vector<Queue::QueryId> queries;
+	for (unsigned int s = 0; s < Queue::SlotCount; s++) {
+		queries.push_back(f.queue.request(10, 10));
+		f.queue.submit();
+	}
+
+	RT64_CHECK(f.backend.copyCount == Queue::SlotCount);
+
+	Queue::QueryId waiting = f.queue.request(40, 10);
+	f.queue.submit();
+	RT64_CHECK(f.backend.copyCount == Queue::SlotCount);
+	RT64_CHECK(f.queue.getPendingQueryCount() == 1);
+
+	// Once the GPU catches up, the slots are resolved and the waiting query goes into the next one.
+	f.backend.finishFrame();
+	f.queue.submit();
+	RT64_CHECK(f.backend.copyCount == (Queue::SlotCount + 1));
+	f.backend.finishFrame();
+
+	queries.push_back(waiting);
+	for (size_t i = 0; i < queries.size(); i++) {
+		void *instance = nullptr;
+		RT64_CHECK(f.queue.poll(queries[i], &instance) && (instance == ((queries[i] == waiting) ? (void *)(&InstanceB) : (void *)(&InstanceA))));
+	}
+}
+
+RT64_TEST(idsMapToTheInstancesOfTheTracedFrame) {
+	Fixture f;
+	Queue::QueryId queryId = f.queue.request(40, 10);
+	f.queue.submit();
+
+	// The scene is updated before the copy is done and the same ID now refers to another instance.
+	f.backend.tracedInstances = { &InstanceC, &InstanceA };
+	f.backend.finishFrame();
+	void *instance = nullptr;
+	RT64_CHECK(f.queue.poll(queryId, &instance) && (instance == &InstanceB));
+}
+
+RT64_TEST(destroyedInstancesResolveToNoInstance) {
+	Fixture f;
+	Queue::QueryId queryId = f.queue.request(40, 10);
+	f.queue.submit();
+	f.backend.liveInstances.erase(&InstanceB);
+	f.backend.finishFrame();
+	void *instance = &InstanceC;
+	RT64_CHECK(f.queue.poll(queryId, &instance) && (instance == nullptr));
+}
+
+RT64_TEST(clearForgetsEverything) {
+	Fixture f;
+	Queue::QueryId submitted = f.queue.request(10, 10);
+	f.queue.submit();
+	f.queue.request(40, 10);
+	f.queue.clear();
+	RT64_CHECK(f.queue.getQueryCount() == 0);
+	RT64_CHECK(f.queue.getPendingQueryCount() == 0);
+
+	// The result of the slot that was in flight is ignored.
+	f.backend.finishFrame();
+	void *instance = &InstanceC;
+	RT64_CHECK(f.queue.poll(submitted, &instance) && (instance == nullptr));
+}
@@ -0,0 +1,337 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "rt64_interleaved_reconstructor.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::InterleavedReconstructor Reconstructor;
+	typedef Reconstructor::Pattern Pattern;
+
+	const Pattern SparsePatterns[] = { Pattern::Checkerboard, Pattern::Interleaved };
+
+	// Value written on the pixels that aren't traced, which must never make it to the output.
+	const float SkippedColor = 99.0f;
+
+	// Buffers of a frame of the tracer. Every pixel has a ground truth, but only the ones traced this frame keep it.
+	struct Frame {
+		int width;
+		int height;
+		std::vector<float> truth;
+		std::vector<float> color;
+		std::vector<float> normal;
+		std::vector<float> depth;
+		std::vector<uint16_t> instanceId;
+		std::vector<float> motion;
+
+		Frame(int width, int height) {
+			this->width = width;
+			this->height = height;
+			const size_t pixelCount = (size_t)(width) * height;
+			truth.resize(pixelCount * 4);
+			color.resize(pixelCount * 4);
+			normal.assign(pixelCount * 4, 0.0f);
+			depth.assign(pixelCount, 5.0f);
+			instanceId.assign(pixelCount, 1);
+			motion.assign(pixelCount * 2, 0.0f);
+			for (size_t p = 0; p < pixelCount; p++) {
+				normal[p * 4 + 2] = 1.0f;
+			}
+		}
+
+		// Images with detail at every scale, down to single pixels.
+		void paint(int image) {
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					float v;
+					switch (image) {
+					case 0:
+						v = 0.5f + 0.5f * sinf(x * 0.7f) * cosf(y * 0.5f);
+						break;
+					case 1:
+						v = (float)((x + y) & 1);
+						break;
+					case 2:
+						v = (float)((x * 7 + y * 13) % 5) / 4.0f;
+						break;
+					default:
+						v = (float)(image) / 10.0f;
+						break;
+					}
+
+					float *t = &truth[((size_t)(y) * width + x) * 4];
+					t[0] = v;
+					t[1] = v * 0.5f;
+					t[2] = 1.0f - v;
+					t[3] = 1.0f;
+				}
+			}
+		}
+
+		Reconstructor::FrameInputs trace(Pattern pattern, unsigned int frameIndex) {
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					const size_t p = (size_t)(y) * width + x;
+					const bool traced = Reconstructor::isTraced(pattern, frameIndex, x, y);
+					for (int k = 0; k < 4; k++) {
+						color[p * 4 + k] = traced ? truth[p * 4 + k] : SkippedColor;
+					}
+				}
+			}
+
+			Reconstructor::FrameInputs inputs;
+			inputs.color = color.data();
+			inputs.normal = normal.data();
+			inputs.depth = depth.data();
+			inputs.instanceId = instanceId.data();
+			inputs.motion = motion.data();
+			inputs.pattern = pattern;
+			inputs.frameIndex = frameIndex;
+			return inputs;
+		}
+	};
+};
+
+RT64_TEST(patternsTraceEveryPixelOncePerCycle) {
+	RT64_CHECK(Reconstructor::phaseCount(Pattern::Full) == 1);
+	RT64_CHECK(Reconstructor::phaseCount(Pattern::Checkerboard) == 2);
+	RT64_CHECK(Reconstructor::phaseCount(Pattern::Interleaved) == 4);
+
+	const Pattern patterns[] = { Pattern::Full, Pattern::Checkerboard, Pattern::Interleaved };
+	for (Pattern pattern : patterns) {
+		const unsigned int phaseCount = Reconstructor::phaseCount(pattern);
+		for (int y = 0; y < 6; y++) {
+			for (int x = 0; x < 6; x++) {
+				unsigned int tracedCount = 0;
+				for (unsigned int f = 0; f < phaseCount; f++) {
+					tracedCount += Reconstructor::isTraced(pattern, f + 7, x, y) ? 1 : 0;
+				}
+
+				RT64_CHECK(tracedCount == 1);
+			}
+		}
+	}
+}
+
+RT64_TEST(launchesMatchTheTracedPixels) {
+	// Regions of odd sizes and at odd offsets, like the tiles of the tracer.
+	const Pattern patterns[] = { Pattern::Full, Pattern::Checkerboard, Pattern::Interleaved };
+	const int width = 13;
+	const int height = 9;
+	for (Pattern pattern : patterns) {
+		for (int tileSize : { 3, 4, 5, 100 }) {
+			for (unsigned int f = 0; f < 4; f++) {
+				std::vector<int> hits((size_t)(width) * height, 0);
+				for (int regionY = 0; regionY < height; regionY += tileSize) {
+					for (int regionX = 0; regionX < width; regionX += tileSize) {
+						const int regionWidth = std::min(tileSize, width - regionX);
+						const int regionHeight = std::min(tileSize, height - regionY);
+						int launchWidth, launchHeight;
+						Reconstructor::launchDimensions(pattern, regionWidth, regionHeight, launchWidth, launchHeight);
+						for (int launchY = 0; launchY < launchHeight; launchY++) {
+							for (int launchX = 0; launchX < launchWidth; launchX++) {
+								int x, y;
+								Reconstructor::launchToPixel(pattern, f, regionX, regionY, launchX, launchY, x, y);
+								RT64_CHECK((x >= regionX) && (y >= regionY));
+								if ((x < (regionX + regionWidth)) && (y < (regionY + regionHeight))) {
+									hits[(size_t)(y) * width + x]++;
+								}
+							}
+						}
+					}
+				}
+
+				for (int y = 0; y < height; y++) {
+					for (int x = 0; x < width; x++) {
+						RT64_CHECK(hits[(size_t)(y) * width + x] == (Reconstructor::isTraced(pattern, f, x, y) ? 1 : 0));
+					}
+				}
+			}
+		}
+	}
+}
+
+RT64_TEST(staticImagesAreExactAfterOneCycle) {
+	for (Pattern pattern : SparsePatterns) {
+		const unsigned int phaseCount = Reconstructor::phaseCount(pattern);
+		for (int image = 0; image < 3; image++) {
+			for (unsigned int firstFrame : { 0U, 5U }) {
+				Frame frame(15, 9);
+				frame.paint(image);
+				Reconstructor reconstructor;
+				reconstructor.set(frame.width, frame.height);
+				std::vector<float> output(frame.truth.size());
+				for (unsigned int f = 0; f < (phaseCount * 3); f++) {
+					reconstructor.reconstruct(frame.trace(pattern, firstFrame + f), output.data());
+
+					// Traced pixels are always exact. Once every pixel was traced, the rest are too.
+					for (int y = 0; y < frame.height; y++) {
+						for (int x = 0; x < frame.width; x++) {
+							const size_t p = (size_t)(y) * frame.width + x;
+							if ((f < (phaseCount - 1)) && !Reconstructor::isTraced(pattern, firstFrame + f, x, y)) {
+								RT64_CHECK(output[p * 4] != SkippedColor);
+								continue;
+							}
+
+							for (int k = 0; k < 4; k++) {
+								RT64_CHECK(output[p * 4 + k] == frame.truth[p * 4 + k]);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+RT64_TEST(movingHistoryIsClamped) {
+	for (Pattern pattern : SparsePatterns) {
+		Frame frame(12, 8);
+		frame.paint(2);
+		Reconstructor reconstructor;
+		reconstructor.set(frame.width, frame.height);
+		std::vector<float> output(frame.truth.size());
+		for (unsigned int f = 0; f < 4; f++) {
+			reconstructor.reconstruct(frame.trace(pattern, f), output.data());
+		}
+
+		// The surface moves and turns flat. The history it brings along is out of the range of the traced pixels.
+		frame.paint(3);
+		for (size_t p = 0; p < frame.depth.size(); p++) {
+			frame.motion[p * 2] = -1.0f;
+		}
+
+		reconstructor.reconstruct(frame.trace(pattern, 4), output.data());
+		for (size_t i = 0; i < output.size(); i++) {
+			RT64_CHECK(output[i] == frame.truth[i]);
+		}
+	}
+}
+
+RT64_TEST(historyOfOtherSurfacesIsRejected) {
+	for (Pattern pattern : SparsePatterns) {
+		Frame frame(12, 8);
+		frame.paint(2);
+		Reconstructor reconstructor;
+		reconstructor.set(frame.width, frame.height);
+		std::vector<float> output(frame.truth.size());
+		for (unsigned int f = 0; f < 4; f++) {
+			reconstructor.reconstruct(frame.trace(pattern, f), output.data());
+		}
+
+		// Another instance shows up in the same place without moving, so the history is replaced by the traced pixels.
+		frame.paint(4);
+		frame.instanceId.assign(frame.instanceId.size(), 2);
+		reconstructor.reconstruct(frame.trace(pattern, 4), output.data());
+		for (size_t i = 0; i < output.size(); i++) {
+			RT64_CHECK(output[i] == frame.truth[i]);
+		}
+
+		// Once reset, the skipped pixels are interpolated instead of using the history.
+		frame.paint(2);
+		reconstructor.reset();
+		RT64_CHECK(!reconstructor.isHistoryValid());
+		reconstructor.reconstruct(frame.trace(pattern, 5), output.data());
+		RT64_CHECK(reconstructor.isHistoryValid());
+		bool anyDifferent = false;
+		for (size_t i = 0; i < output.size(); i++) {
+			anyDifferent = anyDifferent || (output[i] != frame.truth[i]);
+		}
+
+		RT64_CHECK(anyDifferent);
+	}
+}
+
+RT64_TEST(historyIsScaledWhenTheSizeChanges) {
+	const int sizes[][2] = { { 18, 12 }, { 8, 6 } };
+	for (Pattern pattern : SparsePatterns) {
+		for (const int *size : sizes) {
+			Frame first(12, 8);
+			first.paint(5);
+			Reconstructor reconstructor;
+			reconstructor.set(first.width, first.height);
+			std::vector<float> output(first.truth.size());
+			for (unsigned int f = 0; f < 4; f++) {
+				reconstructor.reconstruct(first.trace(pattern, f), output.data());
+			}
+
+			// The history is flat, so wherever it's sampled it's the same color, which is then clamped to the traced pixels around.
+			Frame resized(size[0], size[1]);
+			resized.paint(2);
+			reconstructor.set(resized.width, resized.height);
+			RT64_CHECK(reconstructor.isHistoryValid());
+			output.resize(resized.truth.size());
+			reconstructor.reconstruct(resized.trace(pattern, 4), output.data());
+			bool anyFromHistory = false;
+			for (int y = 0; y < resized.height; y++) {
+				for (int x = 0; x < resized.width; x++) {
+					const size_t p = (size_t)(y) * resized.width + x;
+					if (Reconstructor::isTraced(pattern, 4, x, y)) {
+						continue;
+					}
+
+					for (int k = 0; k < 4; k++) {
+						float minColor = SkippedColor;
+						float maxColor = -SkippedColor;
+						for (int dy = -1; dy <= 1; dy++) {
+							for (int dx = -1; dx <= 1; dx++) {
+								const int sx = x + dx;
+								const int sy = y + dy;
+								if ((sx >= 0) && (sx < resized.width) && (sy >= 0) && (sy < resized.height) && Reconstructor::isTraced(pattern, 4, sx, sy)) {
+									const float c = resized.truth[((size_t)(sy) * resized.width + sx) * 4 + k];
+									minColor = std::min(minColor, c);
+									maxColor = std::max(maxColor, c);
+								}
+							}
+						}
+
+						const float history = first.truth[k];
+						const float expected = std::min(std::max(history, minColor), maxColor);
+						RT64_CHECK_NEAR(output[p * 4 + k], expected, 1e-5f);
+						anyFromHistory = anyFromHistory || ((expected == history) && (minColor != maxColor));
+					}
+				}
+			}
+
+			RT64_CHECK(anyFromHistory);
+		}
+	}
+}
+
+RT64_TEST(guideWeights) {
+	Reconstructor::Guide a;
+	a.depth = 10.0f;
+	a.instanceId = 3;
+	a.normal[2] = 1.0f;
+	Reconstructor::Guide b = a;
+	RT64_CHECK(Reconstructor::guideWeight(a, b) == 1.0f);
+
+	b.depth = 10.5f;
+	RT64_CHECK_NEAR(Reconstructor::guideWeight(a, b), 1.0f - 0.5f / (Reconstructor::DepthTolerance * 10.5f), 1e-5f);
+	b.depth = 20.0f;
+	RT64_CHECK(Reconstructor::guideWeight(a, b) == 0.0f);
+
+	b = a;
+	b.normal[2] = 0.0f;
+	b.normal[0] = 1.0f;
+	RT64_CHECK(Reconstructor::guideWeight(a, b) == 0.0f);
+
+	// Missing normals are ignored.
+	b.normal[0] = 0.0f;
+	RT64_CHECK(Reconstructor::guideWeight(a, b) == 1.0f);
+
+	b = a;
+	b.instanceId = 4;
+	RT64_CHECK(Reconstructor::guideWeight(a, b) == 0.0f);
+
+	// The background always matches the background.
+	a.instanceId = Reconstructor::NoInstanceId;
+	b.instanceId = Reconstructor::NoInstanceId;
+	b.depth = 0.0f;
+	RT64_CHECK(Reconstructor::guideWeight(a, b) == 1.0f);
+}
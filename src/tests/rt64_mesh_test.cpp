@@ -0,0 +1,496 @@
+//
+// RT64
+//
+
+#include <stdexcept>
+
+#include "rt64_geometry_pool.h"
+#include "rt64_mesh.h"
+#include "rt64_render_context.h"
+#include "rt64_scratch_pool.h"
+#include "rt64_mock_render_device.h"
+#include "rt64_test.h"
+
+namespace {
+	using RT64Test::MockCommand;
+	using RT64Test::MockCommandType;
+
+	// Enough triangles for the compacted size to be smaller than the aligned size of the AS.
+	const int TriangleCount = 30;
+
+	struct TestMesh {
+		std::vector<RT64_VERTEX> vertices;
+		std::vector<unsigned int> indices;
+
+		TestMesh(int triangleCount) {
+			vertices.resize(triangleCount * 3);
+			indices.resize(triangleCount * 3);
+			for (int i = 0; i < triangleCount * 3; i++) {
+				vertices[i] = {};
+				vertices[i].position = { (float)(i % 3), (float)(i / 3), 0.0f };
+				indices[i] = i;
+			}
+		}
+
+		// Same sequence as RT64_SetMesh.
+		void set(RT64::Mesh &mesh) {
+			mesh.updateVertexBuffer(vertices.data(), (int)(vertices.size()));
+			mesh.updateIndexBuffer(indices.data(), (int)(indices.size()));
+			mesh.updateBottomLevelAS();
+		}
+	};
+
+	// Drives the render context in the same order as the device. The frame is split so the tests can look at the
+	// commands and the resources before the GPU is done with them.
+	struct TestFrame {
+		RT64Test::MockRenderDevice &renderDevice;
+		RT64::RenderContext &renderContext;
+
+		void record() {
+			renderDevice.commandList.clear();
+			renderContext.uploadMeshVertices();
+			renderContext.prepareGeometryPools();
+			renderContext.compactBottomLevelASes();
+			renderContext.buildBottomLevelASes();
+			renderContext.queryCompactedSizes();
+
+			// Nothing used by the frame can be released yet.
+			renderContext.releaseFrameResources();
+		}
+
+		void finish() {
+			renderContext.waitForGPU();
+			renderContext.releaseFrameResources();
+		}
+
+		void run() {
+			record();
+			finish();
+		}
+	};
+};
+
+RT64_TEST(buildsAreRecordedWithTheFrame) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	RT64_CHECK(renderContext.getCounters()->meshCount == 1);
+
+	TestMesh testMesh(TriangleCount);
+	testMesh.set(mesh);
+
+	// Only the uploads to the geometry pools are recorded when the mesh is set.
+	std::vector<MockCommand> copies = renderDevice.commandList.find(MockCommandType::CopyBufferRegion);
+	RT64_CHECK(copies.size() == 2);
+	if (copies.size() == 2) {
+		RT64_CHECK(copies[0].dst == mesh.getVertexBuffer());
+		RT64_CHECK(copies[0].dstOffset == mesh.getFirstVertex() * sizeof(RT64_VERTEX));
+		RT64_CHECK(copies[1].dst == mesh.getIndexBuffer());
+		RT64_CHECK(copies[1].dstOffset == mesh.getFirstIndex() * sizeof(unsigned int));
+	}
+
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS).empty());
+	RT64_CHECK(mesh.getBottomLevelASResult() == nullptr);
+	RT64_CHECK(renderContext.getPendingBuildCount() == 1);
+
+	// Setting the mesh again before the frame doesn't build it twice.
+	testMesh.set(mesh);
+	RT64_CHECK(renderContext.getPendingBuildCount() == 1);
+
+	frame.record();
+	std::vector<MockCommand> builds = renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS);
+	RT64_CHECK(builds.size() == 1);
+	if (!builds.empty()) {
+		RT64_CHECK(builds[0].dst == mesh.getBottomLevelASResult());
+		RT64_CHECK(builds[0].src != nullptr);
+		RT64_CHECK(builds[0].src->getDesc().size == renderContext.getScratchPool()->getCapacity());
+		RT64_CHECK(builds[0].updateSource == nullptr);
+		RT64_CHECK(builds[0].compactable);
+		RT64_CHECK(!builds[0].updatable);
+		RT64_CHECK(builds[0].primitiveCount == TriangleCount);
+	}
+
+	// The compacted size is queried at the end of the same frame.
+	std::vector<MockCommand> queries = renderDevice.commandList.find(MockCommandType::QueryCompactedSize);
+	RT64_CHECK(queries.size() == 1);
+	if (!queries.empty()) {
+		RT64_CHECK(queries[0].src == mesh.getBottomLevelASResult());
+	}
+
+	const uint64_t meshBytes = testMesh.vertices.size() * sizeof(RT64_VERTEX) + testMesh.indices.size() * sizeof(unsigned int);
+	RT64_CHECK(renderContext.getCounters()->bytesUploaded == meshBytes * 2);
+	RT64_CHECK(renderContext.getCounters()->blasBuilds == 1);
+	RT64_CHECK(renderContext.getCounters()->blasUpdates == 0);
+	RT64_CHECK(renderContext.getCounters()->blasBytes == mesh.getBottomLevelASResult()->getDesc().size);
+	RT64_CHECK(renderContext.getCounters()->blasUncompactedBytes == mesh.getBottomLevelASResult()->getDesc().size);
+	RT64_CHECK(renderContext.getPendingBuildCount() == 0);
+	frame.finish();
+}
+
+RT64_TEST(meshesShareTheGeometryPools) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	RT64::Mesh meshA(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	RT64::Mesh meshB(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(meshA);
+	TestMesh(TriangleCount).set(meshB);
+
+	RT64_CHECK(meshA.getVertexBuffer() == meshB.getVertexBuffer());
+	RT64_CHECK(meshA.getIndexBuffer() == meshB.getIndexBuffer());
+	RT64_CHECK(meshB.getVertexBufferAddress() == meshB.getVertexBuffer()->getDeviceAddress() + meshB.getFirstVertex() * sizeof(RT64_VERTEX));
+	RT64_CHECK(renderContext.getVertexPool()->getBlockCount() == 1);
+	RT64_CHECK(renderContext.getIndexPool()->getBlockCount() == 1);
+
+	// The vertices of each mesh are copied into their own range of the block.
+	const uint64_t vertexBytes = TriangleCount * 3 * sizeof(RT64_VERTEX);
+	std::vector<MockCommand> vertexCopies;
+	for (const MockCommand &copy : renderDevice.commandList.find(MockCommandType::CopyBufferRegion)) {
+		if (copy.dst == meshA.getVertexBuffer()) {
+			vertexCopies.push_back(copy);
+		}
+	}
+
+	RT64_CHECK(vertexCopies.size() == 2);
+	if (vertexCopies.size() == 2) {
+		RT64_CHECK(vertexCopies[0].dstOffset == meshA.getFirstVertex() * sizeof(RT64_VERTEX));
+		RT64_CHECK(vertexCopies[1].dstOffset == meshB.getFirstVertex() * sizeof(RT64_VERTEX));
+		RT64_CHECK((vertexCopies[0].dstOffset + vertexBytes <= vertexCopies[1].dstOffset) || (vertexCopies[1].dstOffset + vertexBytes <= vertexCopies[0].dstOffset));
+	}
+
+	// Both meshes are built from the shared blocks with the frame.
+	TestFrame frame = { renderDevice, renderContext };
+	frame.record();
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS).size() == 2);
+	frame.finish();
+}
+
+RT64_TEST(updatableMeshesUpdateInPlace) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED | RT64_MESH_RAYTRACE_UPDATABLE);
+	TestMesh testMesh(TriangleCount);
+	testMesh.set(mesh);
+	frame.run();
+	RT64_CHECK(mesh.getPreviousVertexBufferAddress() == mesh.getVertexBuffer()->getDeviceAddress());
+
+	RT64::RenderBuffer *builtResult = mesh.getBottomLevelASResult();
+	RT64::RenderBuffer *vertexBuffer = mesh.getVertexBuffer();
+	const uint32_t builtVersion = mesh.getBottomLevelASVersion();
+	testMesh.vertices[0].position.y = 1.0f;
+	renderDevice.commandList.clear();
+	testMesh.set(mesh);
+
+	// The vertices are kept for the motion vectors before they're overwritten.
+	std::vector<MockCommand> copies = renderDevice.commandList.find(MockCommandType::CopyBufferRegion);
+	RT64_CHECK(!copies.empty());
+	if (!copies.empty()) {
+		RT64_CHECK(copies[0].src == vertexBuffer);
+		RT64_CHECK(copies[0].srcOffset == mesh.getFirstVertex() * sizeof(RT64_VERTEX));
+		RT64_CHECK(copies[0].dst != vertexBuffer);
+		RT64_CHECK(mesh.getPreviousVertexBufferAddress() == copies[0].dst->getDeviceAddress());
+	}
+
+	frame.record();
+	std::vector<MockCommand> builds = renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS);
+	RT64_CHECK(builds.size() == 1);
+	if (!builds.empty()) {
+		RT64_CHECK(builds[0].dst == builtResult);
+		RT64_CHECK(builds[0].updateSource == builtResult);
+		RT64_CHECK(builds[0].updatable);
+		RT64_CHECK(!builds[0].compactable);
+	}
+
+	// The address of the AS doesn't change, but the version does so the top-level AS is refitted.
+	RT64_CHECK(mesh.getBottomLevelASResult() == builtResult);
+	RT64_CHECK(mesh.getBottomLevelASVersion() == builtVersion + 1);
+	RT64_CHECK(mesh.getVertexBuffer() == vertexBuffer);
+	RT64_CHECK(renderContext.getCounters()->blasBuilds == 1);
+	RT64_CHECK(renderContext.getCounters()->blasUpdates == 1);
+
+	mesh.discardPreviousVertices();
+	RT64_CHECK(mesh.getPreviousVertexBufferAddress() == vertexBuffer->getDeviceAddress());
+
+	// Compacted ASes can't be updated, so they're never queried.
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::QueryCompactedSize).empty());
+	frame.finish();
+}
+
+RT64_TEST(changingTheVertexCountRebuilds) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED | RT64_MESH_RAYTRACE_UPDATABLE);
+	TestMesh(TriangleCount).set(mesh);
+	frame.run();
+
+	// The AS can't be updated with a different amount of geometry, even if it's updatable. The previous one might
+	// still be used by the commands recorded so far, so it's only released after the frame.
+	RT64::RenderBuffer *builtResult = mesh.getBottomLevelASResult();
+	TestMesh(TriangleCount * 2).set(mesh);
+	RT64_CHECK(mesh.getBottomLevelASResult() == nullptr);
+	RT64_CHECK(renderDevice.isAlive(builtResult));
+
+	frame.record();
+	std::vector<MockCommand> builds = renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS);
+	RT64_CHECK(builds.size() == 1);
+	if (!builds.empty()) {
+		RT64_CHECK(builds[0].dst == mesh.getBottomLevelASResult());
+		RT64_CHECK(builds[0].updateSource == nullptr);
+		RT64_CHECK(builds[0].primitiveCount == TriangleCount * 2);
+	}
+
+	RT64_CHECK(renderContext.getCounters()->blasBuilds == 2);
+	RT64_CHECK(renderContext.getCounters()->blasUpdates == 0);
+	RT64_CHECK(renderContext.getCounters()->blasBytes == mesh.getBottomLevelASResult()->getDesc().size);
+	frame.finish();
+	RT64_CHECK(!renderDevice.isAlive(builtResult));
+}
+
+RT64_TEST(mappedVerticesAreCopiedOnUnmap) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh testMesh(TriangleCount);
+	const int vertexCount = (int)(testMesh.vertices.size());
+	RT64_VERTEX *vertices = mesh.mapVertexBuffer(vertexCount);
+	RT64_CHECK(vertices != nullptr);
+	RT64_CHECK(renderDevice.commandList.commands.empty());
+	for (int i = 0; i < vertexCount; i++) {
+		vertices[i] = testMesh.vertices[i];
+	}
+
+	mesh.unmapVertexBuffer();
+	std::vector<MockCommand> copies = renderDevice.commandList.find(MockCommandType::CopyBufferRegion);
+	RT64_CHECK(copies.size() == 1);
+	if (!copies.empty()) {
+		RT64_CHECK(copies[0].dst == mesh.getVertexBuffer());
+	}
+
+	RT64_CHECK(renderContext.getCounters()->bytesUploaded == vertexCount * sizeof(RT64_VERTEX));
+
+	// The build waits until the mesh has indices.
+	mesh.updateBottomLevelAS();
+	RT64_CHECK(renderContext.getPendingBuildCount() == 0);
+	mesh.updateIndexBuffer(testMesh.indices.data(), (int)(testMesh.indices.size()));
+	mesh.updateBottomLevelAS();
+	RT64_CHECK(renderContext.getPendingBuildCount() == 1);
+}
+
+RT64_TEST(vertexRangesAreCopiedWithTheFrame) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED | RT64_MESH_RAYTRACE_UPDATABLE);
+	TestMesh testMesh(TriangleCount);
+	testMesh.set(mesh);
+	frame.run();
+
+	// Ranges that are close together are merged into a single copy.
+	RT64::RenderBuffer *builtResult = mesh.getBottomLevelASResult();
+	testMesh.vertices[0].position.y = 1.0f;
+	testMesh.vertices[2].position.y = 1.0f;
+	renderDevice.commandList.clear();
+	mesh.updateVertexRange(&testMesh.vertices[0], 0, 1);
+	mesh.updateVertexRange(&testMesh.vertices[2], 2, 1);
+	for (const MockCommand &copy : renderDevice.commandList.find(MockCommandType::CopyBufferRegion)) {
+		RT64_CHECK(copy.dst != mesh.getVertexBuffer());
+	}
+
+	RT64_CHECK(renderContext.getPendingBuildCount() == 1);
+
+	frame.record();
+	std::vector<MockCommand> copies = renderDevice.commandList.find(MockCommandType::CopyBufferRegion);
+	RT64_CHECK(copies.size() == 1);
+	if (!copies.empty()) {
+		RT64_CHECK(copies[0].dst == mesh.getVertexBuffer());
+		RT64_CHECK(copies[0].size == sizeof(RT64_VERTEX) * 3);
+	}
+
+	// The AS is refitted in place after the copy.
+	std::vector<MockCommand> builds = renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS);
+	RT64_CHECK(builds.size() == 1);
+	if (!builds.empty()) {
+		RT64_CHECK(builds[0].dst == builtResult);
+		RT64_CHECK(builds[0].updateSource == builtResult);
+	}
+
+	RT64_CHECK(renderContext.getCounters()->blasUpdates == 1);
+	frame.finish();
+
+	// Nothing is copied again in the next frame.
+	frame.record();
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::CopyBufferRegion).empty());
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS).empty());
+	frame.finish();
+
+	bool outOfBoundsThrows = false;
+	try {
+		mesh.updateVertexRange(testMesh.vertices.data(), 1, (int)(testMesh.vertices.size()));
+	}
+	catch (const std::runtime_error &) {
+		outOfBoundsThrows = true;
+	}
+
+	RT64_CHECK(outOfBoundsThrows);
+}
+
+RT64_TEST(buildBudgetDefersRebuilds) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh meshA(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	RT64::Mesh meshB(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(meshA);
+	TestMesh(TriangleCount).set(meshB);
+
+	// Meshes without an AS are always built in the next frame.
+	renderContext.setBuildBudget(1);
+	frame.record();
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS).size() == 2);
+	frame.finish();
+
+	// Rebuilds of meshes that can still be traced with their previous AS are spread across frames.
+	TestMesh(TriangleCount).set(meshA);
+	TestMesh(TriangleCount).set(meshB);
+	frame.record();
+	std::vector<MockCommand> builds = renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS);
+	RT64_CHECK(builds.size() == 1);
+	if (!builds.empty()) {
+		RT64_CHECK(builds[0].dst == meshA.getBottomLevelASResult());
+	}
+
+	RT64_CHECK(renderContext.getPendingBuildCount() == 1);
+	frame.finish();
+
+	frame.record();
+	builds = renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS);
+	RT64_CHECK(builds.size() == 1);
+	if (!builds.empty()) {
+		RT64_CHECK(builds[0].dst == meshB.getBottomLevelASResult());
+	}
+
+	RT64_CHECK(renderContext.getPendingBuildCount() == 0);
+	frame.finish();
+}
+
+RT64_TEST(compactionHappensTheFrameAfterTheQuery) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(mesh);
+	frame.run();
+
+	RT64::RenderBuffer *builtResult = mesh.getBottomLevelASResult();
+	const uint64_t builtSize = builtResult->getDesc().size;
+	const uint32_t builtVersion = mesh.getBottomLevelASVersion();
+	frame.record();
+
+	std::vector<MockCommand> compactions = renderDevice.commandList.find(MockCommandType::CompactAccelerationStructure);
+	RT64_CHECK(compactions.size() == 1);
+	if (!compactions.empty()) {
+		RT64_CHECK(compactions[0].src == builtResult);
+		RT64_CHECK(compactions[0].dst == mesh.getBottomLevelASResult());
+	}
+
+	const uint64_t compactedSize = RT64Test::MockRenderDevice::align((uint64_t)(builtSize * renderDevice.compactionRatio));
+	RT64_CHECK(mesh.getBottomLevelASResult() != builtResult);
+	RT64_CHECK(mesh.getBottomLevelASResult()->getDesc().size == compactedSize);
+	RT64_CHECK(mesh.getBottomLevelASVersion() == builtVersion + 1);
+	RT64_CHECK(renderContext.getCounters()->blasBytes == compactedSize);
+	RT64_CHECK(renderContext.getCounters()->blasUncompactedBytes == 0);
+
+	// Compacted ASes aren't queried again.
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::QueryCompactedSize).empty());
+
+	// The AS that was compacted is only released once the GPU is done with the copy.
+	RT64_CHECK(renderDevice.isAlive(builtResult));
+	frame.finish();
+	RT64_CHECK(!renderDevice.isAlive(builtResult));
+}
+
+RT64_TEST(compactionIsSkippedWhenTheMeshChanges) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(mesh);
+	frame.run();
+
+	// The queried size belongs to an AS that's released when the vertex count changes.
+	RT64::RenderBuffer *builtResult = mesh.getBottomLevelASResult();
+	TestMesh(TriangleCount * 2).set(mesh);
+	RT64_CHECK(mesh.getBottomLevelASResult() == nullptr);
+
+	frame.record();
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::CompactAccelerationStructure).empty());
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS).size() == 1);
+	RT64_CHECK(mesh.getBottomLevelASResult() != nullptr);
+	RT64_CHECK(renderContext.getCounters()->blasBytes == mesh.getBottomLevelASResult()->getDesc().size);
+	frame.finish();
+	RT64_CHECK(!renderDevice.isAlive(builtResult));
+
+	// The new AS is compacted with its own size.
+	frame.record();
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::CompactAccelerationStructure).size() == 1);
+	frame.finish();
+}
+
+RT64_TEST(destroyedMeshesReleaseTheirBuffers) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	{
+		RT64::Mesh mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+		TestMesh(TriangleCount).set(mesh);
+		frame.run();
+		RT64_CHECK(!renderDevice.liveBuffers.empty());
+
+		// The pending upload, the rebuild and the queried compaction are cancelled along with the mesh.
+		TestMesh testMesh(TriangleCount);
+		mesh.updateVertexRange(testMesh.vertices.data(), 0, 1);
+	}
+
+	frame.record();
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::CopyBufferRegion).empty());
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::BuildBottomLevelAS).empty());
+	RT64_CHECK(renderDevice.commandList.find(MockCommandType::CompactAccelerationStructure).empty());
+	frame.finish();
+
+	// Only the buffers shared by all the meshes are left once the frame is over: the blocks of the geometry pools, the
+	// scratch buffer, the buffers the compacted sizes are queried with and the upload buffers the cache keeps for reuse.
+	RT64_CHECK(renderDevice.liveBuffers.size() == 7);
+	RT64_CHECK(renderContext.getCounters()->meshCount == 0);
+	RT64_CHECK(renderContext.getPendingBuildCount() == 0);
+}
+
+RT64_TEST(uploadBuffersAreReusedOnceTheFrameIsDone) {
+	RT64Test::MockRenderDevice renderDevice;
+	RT64::RenderContext renderContext(&renderDevice);
+	TestFrame frame = { renderDevice, renderContext };
+	RT64::Mesh *mesh = new RT64::Mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(*mesh);
+	frame.run();
+
+	// The frame that used the upload buffers of the destroyed mesh isn't done yet, so the next mesh needs its own.
+	frame.record();
+	delete mesh;
+	size_t liveBufferCount = renderDevice.liveBuffers.size();
+	mesh = new RT64::Mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(*mesh);
+	RT64_CHECK(renderDevice.liveBuffers.size() == liveBufferCount + 2);
+	frame.finish();
+
+	// Once it's done, the buffers of the same size are taken from the cache instead.
+	frame.record();
+	delete mesh;
+	frame.finish();
+	liveBufferCount = renderDevice.liveBuffers.size();
+	mesh = new RT64::Mesh(&renderContext, RT64_MESH_RAYTRACE_ENABLED);
+	TestMesh(TriangleCount).set(*mesh);
+	RT64_CHECK(renderDevice.liveBuffers.size() == liveBufferCount);
+	frame.run();
+	delete mesh;
+}
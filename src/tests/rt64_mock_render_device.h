@@ -0,0 +1,348 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include "rt64_render_interface.h"
+
+// Render device that runs everything on the CPU and records the commands, so the scene logic written against the
+// render interface can be tested without a GPU. Buffers on the upload and readback heaps and the buffers with
+// unordered access are backed by memory, so the copies between them and the queries of the compacted sizes really
+// move data. The geometry and the acceleration structures only exist as descriptions.
+//
+// The GPU is done with the commands as soon as the fence is signaled, so the fence only completes a value once the
+// owner has signaled it and waited for it, like it would after submitting the commands.
+
+namespace RT64Test {
+	class MockRenderDevice;
+
+	enum class MockCommandType {
+		BufferBarrier,
+		TextureBarrier,
+		AccelerationStructureBarrier,
+		CopyBuffer,
+		CopyBufferRegion,
+		CopyBufferToTexture,
+		BuildBottomLevelAS,
+		BuildTopLevelAS,
+		QueryCompactedSize,
+		CompactAccelerationStructure
+	};
+
+	struct MockCommand {
+		MockCommandType type;
+		RT64::RenderBuffer *dst = nullptr;
+		RT64::RenderBuffer *src = nullptr;
+		uint64_t dstOffset = 0;
+		uint64_t srcOffset = 0;
+		uint64_t size = 0;
+		RT64::RenderBufferAccess access = RT64::RenderBufferAccess::Common;
+
+		// Builds store the scratch buffer as the source, and the AS they update separately.
+		RT64::RenderBuffer *updateSource = nullptr;
+		bool updatable = false;
+		bool compactable = false;
+		uint32_t primitiveCount = 0;
+	};
+
+	class MockRenderBuffer : public RT64::RenderBuffer {
+	public:
+		MockRenderDevice *device;
+		RT64::RenderBufferDesc desc;
+		std::vector<uint8_t> data;
+		uint64_t address;
+
+		MockRenderBuffer(MockRenderDevice *device, const RT64::RenderBufferDesc &desc, uint64_t address);
+		virtual ~MockRenderBuffer();
+
+		virtual void *map() override {
+			return data.data();
+		}
+
+		virtual void unmap() override { }
+
+		virtual const RT64::RenderBufferDesc &getDesc() const override {
+			return desc;
+		}
+
+		virtual uint64_t getDeviceAddress() const override {
+			return address;
+		}
+	};
+
+	class MockRenderTexture : public RT64::RenderTexture {
+	public:
+		RT64::RenderTextureDesc desc;
+
+		MockRenderTexture(const RT64::RenderTextureDesc &desc) : desc(desc) { }
+
+		virtual const RT64::RenderTextureDesc &getDesc() const override {
+			return desc;
+		}
+	};
+
+	class MockRenderDescriptorSet : public RT64::RenderDescriptorSet {
+	public:
+		uint32_t entryCount;
+
+		MockRenderDescriptorSet(uint32_t entryCount) : entryCount(entryCount) { }
+		virtual void setConstantBuffer(uint32_t, RT64::RenderBuffer *, uint64_t) override { }
+		virtual void setStructuredBuffer(uint32_t, RT64::RenderBuffer *, uint32_t, uint32_t) override { }
+		virtual void setReadWriteBuffer(uint32_t, RT64::RenderBuffer *, RT64::RenderFormat, uint32_t) override { }
+		virtual void setTexture(uint32_t, RT64::RenderTexture *) override { }
+		virtual void setReadWriteTexture(uint32_t, RT64::RenderTexture *) override { }
+		virtual void setAccelerationStructure(uint32_t, RT64::RenderBuffer *) override { }
+
+		virtual uint32_t getEntryCount() const override {
+			return entryCount;
+		}
+	};
+
+	class MockRenderFence : public RT64::RenderFence {
+	public:
+		uint64_t signaledValue = 0;
+		uint64_t completedValue = 0;
+
+		virtual uint64_t getCompletedValue() const override {
+			return completedValue;
+		}
+
+		virtual void wait(uint64_t value) override {
+			// Waiting is the same as letting the GPU finish everything that was submitted.
+			completedValue = std::max(completedValue, std::min(value, signaledValue));
+		}
+	};
+
+	class MockRenderCommandList : public RT64::RenderCommandList {
+	public:
+		MockRenderDevice *device;
+		std::vector<MockCommand> commands;
+
+		MockRenderCommandList(MockRenderDevice *device) : device(device) { }
+
+		virtual void barrier(RT64::RenderBuffer *buffer, RT64::RenderBufferAccess access) override {
+			MockCommand command;
+			command.type = MockCommandType::BufferBarrier;
+			command.dst = buffer;
+			command.access = access;
+			commands.push_back(command);
+		}
+
+		virtual void barrier(RT64::RenderTexture *, RT64::RenderTextureAccess) override {
+			MockCommand command;
+			command.type = MockCommandType::TextureBarrier;
+			commands.push_back(command);
+		}
+
+		virtual void accelerationStructureBarrier(RT64::RenderBuffer *buffer) override {
+			MockCommand command;
+			command.type = MockCommandType::AccelerationStructureBarrier;
+			command.dst = buffer;
+			commands.push_back(command);
+		}
+
+		virtual void copyBuffer(RT64::RenderBuffer *dst, RT64::RenderBuffer *src) override {
+			MockCommand command;
+			command.type = MockCommandType::CopyBuffer;
+			command.dst = dst;
+			command.src = src;
+			command.size = std::min(dst->getDesc().size, src->getDesc().size);
+			commands.push_back(command);
+			copyData(dst, 0, src, 0, command.size);
+		}
+
+		virtual void copyBufferRegion(RT64::RenderBuffer *dst, uint64_t dstOffset, RT64::RenderBuffer *src, uint64_t srcOffset, uint64_t size) override {
+			MockCommand command;
+			command.type = MockCommandType::CopyBufferRegion;
+			command.dst = dst;
+			command.src = src;
+			command.dstOffset = dstOffset;
+			command.srcOffset = srcOffset;
+			command.size = size;
+			commands.push_back(command);
+			copyData(dst, dstOffset, src, srcOffset, size);
+		}
+
+		virtual void copyBufferToTexture(RT64::RenderTexture *, RT64::RenderBuffer *src, uint64_t srcOffset, uint32_t) override {
+			MockCommand command;
+			command.type = MockCommandType::CopyBufferToTexture;
+			command.src = src;
+			command.srcOffset = srcOffset;
+			commands.push_back(command);
+		}
+
+		virtual void buildBottomLevelAS(const RT64::RenderBottomLevelASDesc &desc, RT64::RenderBuffer *scratch, uint64_t scratchOffset, RT64::RenderBuffer *result, RT64::RenderBuffer *updateSource) override {
+			MockCommand command;
+			command.type = MockCommandType::BuildBottomLevelAS;
+			command.dst = result;
+			command.src = scratch;
+			command.srcOffset = scratchOffset;
+			command.updateSource = updateSource;
+			command.updatable = desc.updatable;
+			command.compactable = desc.compactable;
+			for (const RT64::RenderBottomLevelASMesh &mesh : desc.meshes) {
+				command.primitiveCount += mesh.indexCount / 3;
+			}
+
+			commands.push_back(command);
+		}
+
+		virtual void buildTopLevelAS(const RT64::RenderTopLevelASDesc &desc, RT64::RenderBuffer *scratch, RT64::RenderBuffer *result, RT64::RenderBuffer *updateSource) override {
+			MockCommand command;
+			command.type = MockCommandType::BuildTopLevelAS;
+			command.dst = result;
+			command.src = scratch;
+			command.updateSource = updateSource;
+			command.updatable = desc.updatable;
+			command.primitiveCount = desc.instanceCount;
+			commands.push_back(command);
+		}
+
+		virtual void queryCompactedSize(RT64::RenderBuffer *accelerationStructure, RT64::RenderBuffer *dst, uint64_t dstOffset) override;
+
+		virtual void compactAccelerationStructure(RT64::RenderBuffer *dst, RT64::RenderBuffer *src) override {
+			MockCommand command;
+			command.type = MockCommandType::CompactAccelerationStructure;
+			command.dst = dst;
+			command.src = src;
+			commands.push_back(command);
+		}
+
+		// Commands of the given type recorded since the last clear.
+		std::vector<MockCommand> find(MockCommandType type) const {
+			std::vector<MockCommand> found;
+			for (const MockCommand &command : commands) {
+				if (command.type == type) {
+					found.push_back(command);
+				}
+			}
+
+			return found;
+		}
+
+		void clear() {
+			commands.clear();
+		}
+	private:
+		void copyData(RT64::RenderBuffer *dst, uint64_t dstOffset, RT64::RenderBuffer *src, uint64_t srcOffset, uint64_t size) {
+			MockRenderBuffer *mockDst = static_cast<MockRenderBuffer *>(dst);
+			MockRenderBuffer *mockSrc = static_cast<MockRenderBuffer *>(src);
+			if (!mockDst->data.empty() && !mockSrc->data.empty()) {
+				memcpy(mockDst->data.data() + dstOffset, mockSrc->data.data() + srcOffset, size);
+			}
+		}
+	};
+
+	class MockRenderDevice : public RT64::RenderDevice {
+	public:
+		MockRenderCommandList commandList;
+		std::unordered_set<const RT64::RenderBuffer *> liveBuffers;
+		uint64_t nextAddress = 0x10000;
+
+		// The size reported by the queries of the compacted size, relative to the size of the acceleration structure.
+		double compactionRatio = 0.5;
+
+		MockRenderDevice() : commandList(this) { }
+
+		virtual ~MockRenderDevice() { }
+
+		virtual RT64::RenderBuffer *createBuffer(const RT64::RenderBufferDesc &desc) override {
+			MockRenderBuffer *buffer = new MockRenderBuffer(this, desc, nextAddress);
+			nextAddress += std::max(desc.size, (uint64_t)(RT64::RenderAccelerationStructureScratchAlignment));
+			return buffer;
+		}
+
+		virtual RT64::RenderTexture *createTexture(const RT64::RenderTextureDesc &desc) override {
+			return new MockRenderTexture(desc);
+		}
+
+		virtual RT64::RenderDescriptorSet *createDescriptorSet(uint32_t entryCount) override {
+			return new MockRenderDescriptorSet(entryCount);
+		}
+
+		virtual RT64::RenderFence *createFence() override {
+			return new MockRenderFence();
+		}
+
+		virtual RT64::RenderCommandList *getCommandList() override {
+			return &commandList;
+		}
+
+		virtual void signal(RT64::RenderFence *fence, uint64_t value) override {
+			MockRenderFence *mockFence = static_cast<MockRenderFence *>(fence);
+			mockFence->signaledValue = std::max(mockFence->signaledValue, value);
+		}
+
+		// Sizes grow with the amount of primitives and are always aligned like the ones reported by real devices.
+		virtual RT64::RenderAccelerationStructureSizes getBottomLevelASSizes(const RT64::RenderBottomLevelASDesc &desc) override {
+			uint64_t primitiveCount = 0;
+			for (const RT64::RenderBottomLevelASMesh &mesh : desc.meshes) {
+				primitiveCount += mesh.indexCount / 3;
+			}
+
+			RT64::RenderAccelerationStructureSizes sizes;
+			sizes.resultSize = align((primitiveCount + 1) * 128);
+			sizes.scratchSize = align((primitiveCount + 1) * 64);
+			sizes.updateScratchSize = desc.updatable ? align((primitiveCount + 1) * 16) : 0;
+			return sizes;
+		}
+
+		virtual RT64::RenderAccelerationStructureSizes getTopLevelASSizes(const RT64::RenderTopLevelASDesc &desc) override {
+			RT64::RenderAccelerationStructureSizes sizes;
+			sizes.resultSize = align((desc.instanceCount + 1) * 128);
+			sizes.scratchSize = align((desc.instanceCount + 1) * 64);
+			sizes.updateScratchSize = desc.updatable ? align((desc.instanceCount + 1) * 16) : 0;
+			return sizes;
+		}
+
+		virtual uint32_t getTextureRowAlignment() const override {
+			return 256;
+		}
+
+		virtual uint32_t getConstantBufferAlignment() const override {
+			return 256;
+		}
+
+		bool isAlive(const RT64::RenderBuffer *buffer) const {
+			return liveBuffers.find(buffer) != liveBuffers.end();
+		}
+
+		static uint64_t align(uint64_t size) {
+			const uint64_t alignment = RT64::RenderAccelerationStructureScratchAlignment;
+			return ((size + alignment - 1) / alignment) * alignment;
+		}
+	};
+
+	inline MockRenderBuffer::MockRenderBuffer(MockRenderDevice *device, const RT64::RenderBufferDesc &desc, uint64_t address) : device(device), desc(desc), address(address) {
+		const bool hostVisible = (desc.heapType == RT64::RenderHeapType::Upload) || (desc.heapType == RT64::RenderHeapType::Readback);
+		const bool unorderedAccess = (desc.flags & RT64::RenderBufferFlagUnorderedAccess) && !(desc.flags & RT64::RenderBufferFlagAccelerationStructure);
+		if (hostVisible || unorderedAccess) {
+			data.resize(desc.size);
+		}
+
+		device->liveBuffers.insert(this);
+	}
+
+	inline MockRenderBuffer::~MockRenderBuffer() {
+		device->liveBuffers.erase(this);
+	}
+
+	inline void MockRenderCommandList::queryCompactedSize(RT64::RenderBuffer *accelerationStructure, RT64::RenderBuffer *dst, uint64_t dstOffset) {
+		MockCommand command;
+		command.type = MockCommandType::QueryCompactedSize;
+		command.dst = dst;
+		command.src = accelerationStructure;
+		command.dstOffset = dstOffset;
+		commands.push_back(command);
+
+		const uint64_t compactedSize = (uint64_t)(accelerationStructure->getDesc().size * device->compactionRatio);
+		MockRenderBuffer *mockDst = static_cast<MockRenderBuffer *>(dst);
+		memcpy(mockDst->data.data() + dstOffset, &compactedSize, sizeof(compactedSize));
+	}
+};
@@ -0,0 +1,193 @@
+//
+// RT64
+//
+
+#include <filesystem>
+#include <fstream>
+
+#include "rt64_pipeline_cache.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::PipelineCache::LoadResult LoadResult;
+
+	const uint64_t EnvironmentId = 0x1234567890ABCDEFULL;
+	const size_t HeaderSize = 32;
+	const size_t TableEntrySize = 32;
+
+	// Creates an empty directory for the test and removes it when it's done.
+	struct TempDirectory {
+		std::filesystem::path path;
+
+		TempDirectory(const char *name) {
+			path = std::filesystem::temp_directory_path() / (std::string("rt64_pipeline_cache_test_") + name);
+			std::filesystem::remove_all(path);
+			std::filesystem::create_directories(path);
+		}
+
+		~TempDirectory() {
+			std::error_code ec;
+			std::filesystem::remove_all(path, ec);
+		}
+
+		std::string file() const {
+			return (path / "pipelines.bin").string();
+		}
+	};
+
+	std::vector<uint8_t> makeBlob(uint8_t seed, size_t size) {
+		std::vector<uint8_t> blob(size);
+		for (size_t i = 0; i < size; i++) {
+			blob[i] = (uint8_t)(seed + i * 7);
+		}
+
+		return blob;
+	}
+
+	// Writes a cache with three blobs of different sizes.
+	void writeCache(const std::string &path) {
+		RT64::PipelineCache cache;
+		cache.open(path, EnvironmentId);
+		for (uint8_t k = 1; k <= 3; k++) {
+			std::vector<uint8_t> blob = makeBlob(k, 100 * k + 3);
+			cache.store(k, blob.data(), blob.size());
+		}
+
+		cache.save();
+	}
+
+	std::vector<uint8_t> readFile(const std::string &path) {
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	void writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write((const char *)(data.data()), data.size());
+	}
+
+	bool hasBlob(RT64::PipelineCache &cache, uint8_t k) {
+		std::vector<uint8_t> blob;
+		return cache.find(k, blob) && (blob == makeBlob(k, 100 * k + 3));
+	}
+
+	// The cache must be usable after a file is discarded: new blobs can be stored and saved over the broken file.
+	void checkRecovers(RT64::PipelineCache &cache, const std::string &path) {
+		RT64_CHECK(cache.getEntryCount() == 0);
+		RT64_CHECK(cache.isDirty());
+
+		std::vector<uint8_t> blob = makeBlob(9, 64);
+		cache.store(9, blob.data(), blob.size());
+		RT64_CHECK(cache.save());
+
+		RT64::PipelineCache reopened;
+		RT64_CHECK(reopened.open(path, EnvironmentId) == LoadResult::Loaded);
+		std::vector<uint8_t> found;
+		RT64_CHECK(reopened.find(9, found) && (found == blob));
+	}
+};
+
+RT64_TEST(missingFilesStartEmpty) {
+	TempDirectory directory("missing");
+	RT64::PipelineCache cache;
+	RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Missing);
+	checkRecovers(cache, directory.file());
+}
+
+RT64_TEST(savedBlobsAreLoadedBack) {
+	TempDirectory directory("roundtrip");
+	writeCache(directory.file());
+
+	RT64::PipelineCache cache;
+	RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Loaded);
+	RT64_CHECK(cache.getEntryCount() == 3);
+	RT64_CHECK(!cache.isDirty());
+	RT64_CHECK(hasBlob(cache, 1) && hasBlob(cache, 2) && hasBlob(cache, 3));
+
+	std::vector<uint8_t> blob;
+	RT64_CHECK(!cache.find(4, blob));
+}
+
+RT64_TEST(emptyFilesAreMissing) {
+	TempDirectory directory("empty");
+	writeFile(directory.file(), {});
+	RT64::PipelineCache cache;
+	RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Missing);
+	checkRecovers(cache, directory.file());
+}
+
+RT64_TEST(truncatedFilesAreDiscarded) {
+	TempDirectory directory("truncated");
+	writeCache(directory.file());
+	const std::vector<uint8_t> original = readFile(directory.file());
+
+	// Cut inside the header, inside the table and inside the last blob.
+	const size_t cuts[] = { 7, HeaderSize - 1, HeaderSize + TableEntrySize + 5, original.size() - 1 };
+	for (size_t cut : cuts) {
+		writeFile(directory.file(), std::vector<uint8_t>(original.begin(), original.begin() + cut));
+		RT64::PipelineCache cache;
+		RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Corrupted);
+		checkRecovers(cache, directory.file());
+		writeFile(directory.file(), original);
+	}
+}
+
+RT64_TEST(corruptedHeadersAndTablesAreDiscarded) {
+	TempDirectory directory("corrupted_table");
+	writeCache(directory.file());
+	const std::vector<uint8_t> original = readFile(directory.file());
+
+	// The magic, the table checksum and an entry of the table.
+	const size_t offsets[] = { 0, 24, HeaderSize + TableEntrySize + 8 };
+	for (size_t offset : offsets) {
+		std::vector<uint8_t> corrupted = original;
+		corrupted[offset] ^= 0x5A;
+		writeFile(directory.file(), corrupted);
+		RT64::PipelineCache cache;
+		RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Corrupted);
+		checkRecovers(cache, directory.file());
+		writeFile(directory.file(), original);
+	}
+}
+
+RT64_TEST(corruptedBlobsAreDroppedWhenLookedUp) {
+	TempDirectory directory("corrupted_blob");
+	writeCache(directory.file());
+	std::vector<uint8_t> data = readFile(directory.file());
+
+	// The last byte of the file belongs to the last blob in the table.
+	data.back() ^= 0xFF;
+	writeFile(directory.file(), data);
+
+	RT64::PipelineCache cache;
+	RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Loaded);
+	int validCount = 0;
+	for (uint8_t k = 1; k <= 3; k++) {
+		validCount += hasBlob(cache, k) ? 1 : 0;
+	}
+
+	RT64_CHECK(validCount == 2);
+	RT64_CHECK(cache.getEntryCount() == 2);
+	RT64_CHECK(cache.isDirty());
+
+	// Saving writes the file again without the broken blob.
+	RT64_CHECK(cache.save());
+	RT64::PipelineCache reopened;
+	RT64_CHECK(reopened.open(directory.file(), EnvironmentId) == LoadResult::Loaded);
+	RT64_CHECK(reopened.getEntryCount() == 2);
+}
+
+RT64_TEST(otherEnvironmentsAndVersionsAreStale) {
+	TempDirectory directory("stale");
+	writeCache(directory.file());
+
+	RT64::PipelineCache cache;
+	RT64_CHECK(cache.open(directory.file(), EnvironmentId + 1) == LoadResult::Stale);
+	RT64_CHECK(cache.getEntryCount() == 0);
+
+	std::vector<uint8_t> data = readFile(directory.file());
+	data[8] = (uint8_t)(RT64::PipelineCache::FormatVersion + 1);
+	writeFile(directory.file(), data);
+	RT64_CHECK(cache.open(directory.file(), EnvironmentId) == LoadResult::Stale);
+	checkRecovers(cache, directory.file());
+}
@@ -0,0 +1,382 @@
+//
+// RT64
+//
+
+#include <cctype>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rt64_profiler.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::Profiler Profiler;
+
+	// Names must outlive the profiler, so every event of the tests takes its name from here.
+	const char *EventNames[] = { "E0", "E1", "E2", "E3", "E4", "E5", "E6", "E7", "E8", "E9" };
+
+	// Just enough of a JSON parser to validate the trace. Only the escapes the profiler writes are accepted, and
+	// duplicated keys are rejected.
+	struct JsonValue {
+		enum class Type {
+			Null,
+			Number,
+			String,
+			Object,
+			Array
+		};
+
+		Type type = Type::Null;
+		double number = 0.0;
+		std::string string;
+		std::map<std::string, JsonValue> members;
+		std::vector<JsonValue> elements;
+	};
+
+	class JsonParser {
+	private:
+		std::string text;
+		size_t position = 0;
+
+		void skipWhitespace() {
+			while ((position < text.size()) && isspace((unsigned char)(text[position]))) {
+				position++;
+			}
+		}
+
+		bool consume(char c) {
+			skipWhitespace();
+			if ((position < text.size()) && (text[position] == c)) {
+				position++;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool parseString(std::string &string) {
+			if (!consume('"')) {
+				return false;
+			}
+
+			while (position < text.size()) {
+				char c = text[position++];
+				if (c == '"') {
+					return true;
+				}
+				else if ((unsigned char)(c) < 0x20) {
+					return false;
+				}
+				else if (c == '\\') {
+					if (position >= text.size()) {
+						return false;
+					}
+
+					char escaped = text[position++];
+					if ((escaped != '"') && (escaped != '\\') && (escaped != '/')) {
+						return false;
+					}
+
+					string += escaped;
+				}
+				else {
+					string += c;
+				}
+			}
+
+			return false;
+		}
+
+		bool parseValue(JsonValue &value) {
+			skipWhitespace();
+			if (position >= text.size()) {
+				return false;
+			}
+
+			const char c = text[position];
+			if (c == '{') {
+				value.type = JsonValue::Type::Object;
+				position++;
+				if (consume('}')) {
+					return true;
+				}
+
+				do {
+					std::string key;
+					if (!parseString(key) || !consume(':') || (value.members.count(key) > 0) || !parseValue(value.members[key])) {
+						return false;
+					}
+				} while (consume(','));
+
+				return consume('}');
+			}
+			else if (c == '[') {
+				value.type = JsonValue::Type::Array;
+				position++;
+				if (consume(']')) {
+					return true;
+				}
+
+				do {
+					value.elements.emplace_back();
+					if (!parseValue(value.elements.back())) {
+						return false;
+					}
+				} while (consume(','));
+
+				return consume(']');
+			}
+			else if (c == '"') {
+				value.type = JsonValue::Type::String;
+				return parseString(value.string);
+			}
+			else {
+				value.type = JsonValue::Type::Number;
+				const char *begin = text.c_str() + position;
+				char *end = nullptr;
+				value.number = strtod(begin, &end);
+				position += (size_t)(end - begin);
+				return end != begin;
+			}
+		}
+	public:
+		JsonParser(const std::string &text) : text(text) { }
+
+		bool parse(JsonValue &value) {
+			if (!parseValue(value)) {
+				return false;
+			}
+
+			skipWhitespace();
+			return position == text.size();
+		}
+	};
+
+	bool isNumber(const JsonValue &object, const char *key) {
+		auto it = object.members.find(key);
+		return (it != object.members.end()) && (it->second.type == JsonValue::Type::Number);
+	}
+
+	bool isString(const JsonValue &object, const char *key, const char *expected = nullptr) {
+		auto it = object.members.find(key);
+		return (it != object.members.end()) && (it->second.type == JsonValue::Type::String) && ((expected == nullptr) || (it->second.string == expected));
+	}
+
+	Profiler::Event makeEvent(const char *name, int stage, Profiler::Track track, uint64_t frame, double startUs, double durationUs) {
+		Profiler::Event event;
+		event.name = name;
+		event.stage = stage;
+		event.track = track;
+		event.threadId = (track == Profiler::Track::GPU) ? 0 : 7;
+		event.frame = frame;
+		event.startUs = startUs;
+		event.durationUs = durationUs;
+		return event;
+	}
+};
+
+RT64_TEST(nestedScopesAreTimed) {
+	Profiler profiler;
+	{
+		RT64_PROFILE_SCOPE(&profiler, "Outer", 1);
+
+		// Scopes keep the frame they were opened in.
+		profiler.nextFrame();
+		{
+			RT64_PROFILE_SCOPE(&profiler, "Inner", 2);
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+
+	std::vector<Profiler::Event> events;
+	profiler.collect(events);
+	RT64_CHECK(events.size() == 2);
+	if (events.size() != 2) {
+		return;
+	}
+
+	// The inner scope is closed first, so it's recorded first.
+	const Profiler::Event &inner = events[0];
+	const Profiler::Event &outer = events[1];
+	RT64_CHECK(std::string(inner.name) == "Inner");
+	RT64_CHECK(std::string(outer.name) == "Outer");
+	RT64_CHECK((inner.stage == 2) && (outer.stage == 1));
+	RT64_CHECK((inner.frame == 1) && (outer.frame == 0));
+	RT64_CHECK((inner.track == Profiler::Track::CPU) && (outer.track == Profiler::Track::CPU));
+	RT64_CHECK(inner.threadId == Profiler::getCurrentThreadId());
+	RT64_CHECK(inner.threadId != 0);
+	RT64_CHECK(inner.durationUs >= 2000.0);
+	RT64_CHECK(outer.startUs <= inner.startUs);
+	RT64_CHECK((outer.startUs + outer.durationUs) >= (inner.startUs + inner.durationUs));
+	RT64_CHECK(outer.durationUs >= inner.durationUs);
+}
+
+RT64_TEST(ringKeepsTheNewestEventsWhenItWraps) {
+	Profiler profiler(4);
+	for (int i = 0; i < 10; i++) {
+		profiler.record(EventNames[i], i, Profiler::Track::CPU, 0, (double)(i), 1.0);
+	}
+
+	// The slots of the first six events were reused, so only the last four are left, from oldest to newest.
+	std::vector<Profiler::Event> events;
+	profiler.collect(events);
+	RT64_CHECK(events.size() == 4);
+	for (size_t i = 0; i < events.size(); i++) {
+		RT64_CHECK(events[i].name == EventNames[6 + i]);
+		RT64_CHECK(events[i].stage == (int)(6 + i));
+		RT64_CHECK(events[i].startUs == (double)(6 + i));
+	}
+
+	// The same slots keep being reused in order.
+	profiler.record(EventNames[0], 0, Profiler::Track::CPU, 0, 10.0, 1.0);
+	profiler.collect(events);
+	RT64_CHECK(events.size() == 4);
+	if (events.size() == 4) {
+		RT64_CHECK(events[0].name == EventNames[7]);
+		RT64_CHECK(events[3].name == EventNames[0]);
+	}
+}
+
+RT64_TEST(concurrentWritersNeverTearEvents) {
+	const int ThreadCount = 4;
+	const int EventsPerThread = 20000;
+	Profiler profiler(256);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < ThreadCount; t++) {
+		threads.emplace_back([&profiler, t]() {
+			for (int i = 0; i < EventsPerThread; i++) {
+				// The fields of every event are derived from its name, so a torn event can be detected.
+				profiler.record(EventNames[t], t, Profiler::Track::CPU, (uint64_t)(t), (double)(t), (double)(i));
+			}
+		});
+	}
+
+	// Reading while the ring is being written must only skip the slots that are being overwritten.
+	std::vector<Profiler::Event> events;
+	bool consistent = true;
+	for (int i = 0; i < 100; i++) {
+		profiler.collect(events);
+		for (const Profiler::Event &event : events) {
+			const int t = event.stage;
+			consistent = consistent && (t >= 0) && (t < ThreadCount) && (event.name == EventNames[t]) && (event.frame == (uint64_t)(t)) && (event.startUs == (double)(t));
+		}
+	}
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	RT64_CHECK(consistent);
+
+	// Once the writers are done, the ring is full of complete events.
+	profiler.collect(events);
+	RT64_CHECK(events.size() == 256);
+}
+
+RT64_TEST(stageDurationsAreSummedPerStage) {
+	Profiler profiler;
+	for (uint64_t frame = 0; frame < 3; frame++) {
+		const double scale = (double)(frame + 1);
+		profiler.record(EventNames[0], 0, Profiler::Track::CPU, frame, 0.0, 100.0 * scale);
+		profiler.record(EventNames[1], 0, Profiler::Track::CPU, frame, 0.0, 50.0 * scale);
+		profiler.record(EventNames[2], 2, Profiler::Track::GPU, frame, 0.0, 25.0 * scale);
+
+		// Events without a stage or with one out of range are only in the trace.
+		profiler.record(EventNames[3], -1, Profiler::Track::CPU, frame, 0.0, 1000.0);
+		profiler.record(EventNames[4], 3, Profiler::Track::CPU, frame, 0.0, 1000.0);
+	}
+
+	// A GPU event of the second frame that was read back late.
+	profiler.record(EventNames[5], 1, Profiler::Track::GPU, 1, 0.0, 10.0);
+
+	double durations[3];
+	profiler.getStageDurations(1, durations, 3);
+	RT64_CHECK_NEAR(durations[0], 300.0, 1e-9);
+	RT64_CHECK_NEAR(durations[1], 10.0, 1e-9);
+	RT64_CHECK_NEAR(durations[2], 50.0, 1e-9);
+
+	profiler.getStageDurations(2, durations, 3);
+	RT64_CHECK_NEAR(durations[0], 450.0, 1e-9);
+	RT64_CHECK_NEAR(durations[1], 0.0, 1e-9);
+	RT64_CHECK_NEAR(durations[2], 75.0, 1e-9);
+
+	profiler.getStageDurations(5, durations, 3);
+	RT64_CHECK((durations[0] == 0.0) && (durations[1] == 0.0) && (durations[2] == 0.0));
+}
+
+RT64_TEST(stageDurationsOnlyUseTheEventsInTheRing) {
+	Profiler profiler(4);
+	for (int i = 0; i < 6; i++) {
+		profiler.record(EventNames[i], 0, Profiler::Track::CPU, 0, 0.0, 10.0);
+	}
+
+	double duration;
+	profiler.getStageDurations(0, &duration, 1);
+	RT64_CHECK_NEAR(duration, 40.0, 1e-9);
+}
+
+RT64_TEST(chromeTraceIsWellFormed) {
+	std::vector<Profiler::Event> events;
+	events.push_back(makeEvent("Frame", 0, Profiler::Track::CPU, 3, 10.0, 500.0));
+	events.push_back(makeEvent("Ray \"dispatch\" \\ pass\n", 1, Profiler::Track::GPU, 3, 20.5, 250.25));
+	events.push_back(makeEvent(nullptr, -1, Profiler::Track::CPU, 4, 600.0, 0.0));
+
+	// Quotes and backslashes are escaped, and control characters are dropped.
+	const char *expectedNames[] = { "Frame", "Ray \"dispatch\" \\ pass", "" };
+
+	std::stringstream stream;
+	Profiler::writeChromeTrace(stream, events);
+
+	JsonValue trace;
+	JsonParser parser(stream.str());
+	RT64_CHECK(parser.parse(trace));
+	RT64_CHECK(trace.type == JsonValue::Type::Object);
+	RT64_CHECK(isString(trace, "displayTimeUnit", "ms"));
+
+	auto traceEvents = trace.members.find("traceEvents");
+	RT64_CHECK((traceEvents != trace.members.end()) && (traceEvents->second.type == JsonValue::Type::Array));
+	if ((traceEvents == trace.members.end()) || (traceEvents->second.elements.size() != (events.size() + 1))) {
+		RT64_CHECK(false);
+		return;
+	}
+
+	// The GPU track is named by a metadata event, and every event is a complete event with its duration.
+	const std::vector<JsonValue> &elements = traceEvents->second.elements;
+	RT64_CHECK(isString(elements[0], "ph", "M"));
+	RT64_CHECK(isString(elements[0], "name", "thread_name"));
+	RT64_CHECK(isNumber(elements[0], "tid") && (elements[0].members.at("tid").number == 0.0));
+	for (size_t i = 0; i < events.size(); i++) {
+		const JsonValue &element = elements[i + 1];
+		const Profiler::Event &event = events[i];
+		RT64_CHECK(isString(element, "ph", "X"));
+		RT64_CHECK(isString(element, "name", expectedNames[i]));
+		RT64_CHECK(isString(element, "cat", (event.track == Profiler::Track::GPU) ? "gpu" : "cpu"));
+		RT64_CHECK(isNumber(element, "pid") && isNumber(element, "tid") && isNumber(element, "ts") && isNumber(element, "dur"));
+		if (isNumber(element, "tid") && isNumber(element, "ts") && isNumber(element, "dur")) {
+			RT64_CHECK(element.members.at("tid").number == (double)(event.threadId));
+			RT64_CHECK_NEAR(element.members.at("ts").number, event.startUs, 1e-3);
+			RT64_CHECK_NEAR(element.members.at("dur").number, event.durationUs, 1e-3);
+		}
+
+		auto args = element.members.find("args");
+		RT64_CHECK((args != element.members.end()) && isNumber(args->second, "frame"));
+		if ((args != element.members.end()) && isNumber(args->second, "frame")) {
+			RT64_CHECK(args->second.members.at("frame").number == (double)(event.frame));
+		}
+	}
+}
+
+RT64_TEST(chromeTraceOfAnEmptyProfilerIsWellFormed) {
+	std::vector<Profiler::Event> events;
+	std::stringstream stream;
+	Profiler::writeChromeTrace(stream, events);
+
+	JsonValue trace;
+	JsonParser parser(stream.str());
+	RT64_CHECK(parser.parse(trace));
+	RT64_CHECK(trace.members.count("traceEvents") == 1);
+}
@@ -0,0 +1,81 @@
+//
+// RT64
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "rt64_range_allocator.h"
+
+// Simulates the churn of a geometry pool: meshes with sizes spread between a few dozen and tens of thousands of
+// vertices are created until the pool is mostly full, and then random meshes are destroyed and replaced by new ones.
+// Reports the time per operation, how fragmented the free space becomes and how many allocations can't be placed.
+
+namespace {
+	const uint64_t Capacity = 64ULL * 1024 * 1024;
+	const double TargetUsage = 0.75;
+	const int ChurnRounds = 10;
+	const int OperationsPerRound = 200000;
+	const double MinSize = 64.0;
+	const double MaxSize = 65536.0;
+};
+
+int main() {
+	typedef std::chrono::steady_clock Clock;
+	RT64::RangeAllocator allocator(Capacity);
+	std::mt19937_64 random(0x52543634);
+	std::uniform_real_distribution<double> logSize(std::log(MinSize), std::log(MaxSize));
+	auto randomSize = [&]() {
+		return (uint64_t)(std::exp(logSize(random)));
+	};
+
+	std::vector<uint64_t> live;
+	uint64_t failures = 0;
+	Clock::time_point start = Clock::now();
+	while (allocator.getAllocatedSize() < (uint64_t)(Capacity * TargetUsage)) {
+		uint64_t offset = 0;
+		if (allocator.allocate(randomSize(), offset)) {
+			live.push_back(offset);
+		}
+		else {
+			failures++;
+		}
+	}
+
+	double fillSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	printf("Fill: %zu allocations in %.3f ms (%.1f ns per allocation), %llu failed.\n", live.size(), fillSeconds * 1000.0, fillSeconds * 1e9 / live.size(), (unsigned long long)(failures));
+	printf("%8s %12s %12s %14s %12s %10s\n", "Round", "ns/op", "Usage", "Largest free", "Fragment.", "Failed");
+
+	for (int round = 0; round < ChurnRounds; round++) {
+		failures = 0;
+		start = Clock::now();
+		for (int i = 0; i < OperationsPerRound; i++) {
+			// Keep the usage around the target by freeing more often when it's above it.
+			const bool doFree = !live.empty() && (allocator.getAllocatedSize() >= (uint64_t)(Capacity * TargetUsage));
+			if (doFree) {
+				const size_t index = random() % live.size();
+				allocator.free(live[index]);
+				live[index] = live.back();
+				live.pop_back();
+			}
+			else {
+				uint64_t offset = 0;
+				if (allocator.allocate(randomSize(), offset)) {
+					live.push_back(offset);
+				}
+				else {
+					failures++;
+				}
+			}
+		}
+
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		printf("%8d %12.1f %11.1f%% %14llu %11.1f%% %10llu\n", round, seconds * 1e9 / OperationsPerRound, 100.0 * allocator.getAllocatedSize() / Capacity,
+			(unsigned long long)(allocator.getLargestFreeRange()), 100.0 * allocator.getFragmentation(), (unsigned long long)(failures));
+	}
+
+	return 0;
+}
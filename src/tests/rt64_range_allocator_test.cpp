@@ -0,0 +1,151 @@
+//
+// RT64
+//
+
+#include <random>
+
+#include "rt64_range_allocator.h"
+#include "rt64_test.h"
+
+RT64_TEST(allocationsAreContiguousFromTheStart) {
+	RT64::RangeAllocator allocator(100);
+	uint64_t offsets[3] = {};
+	RT64_CHECK(allocator.allocate(10, offsets[0]));
+	RT64_CHECK(allocator.allocate(20, offsets[1]));
+	RT64_CHECK(allocator.allocate(30, offsets[2]));
+	RT64_CHECK(offsets[0] == 0);
+	RT64_CHECK(offsets[1] == 10);
+	RT64_CHECK(offsets[2] == 30);
+	RT64_CHECK(allocator.getAllocatedSize() == 60);
+	RT64_CHECK(allocator.getAllocationCount() == 3);
+	RT64_CHECK(allocator.getLargestFreeRange() == 40);
+}
+
+RT64_TEST(allocationFailsWithoutARangeBigEnough) {
+	RT64::RangeAllocator allocator(100);
+	uint64_t offset = 0;
+	RT64_CHECK(!allocator.allocate(101, offset));
+	RT64_CHECK(allocator.allocate(100, offset));
+	RT64_CHECK(!allocator.allocate(1, offset));
+	RT64_CHECK(allocator.getLargestFreeRange() == 0);
+
+	RT64::RangeAllocator emptyAllocator(0);
+	RT64_CHECK(!emptyAllocator.allocate(1, offset));
+}
+
+RT64_TEST(allocationsPickTheBestFit) {
+	// Leave free ranges of 30 and 10 elements, with the bigger one first.
+	RT64::RangeAllocator allocator(100);
+	uint64_t a, b, c, d;
+	allocator.allocate(30, a);
+	allocator.allocate(10, b);
+	allocator.allocate(10, c);
+	allocator.allocate(50, d);
+	allocator.free(a);
+	allocator.free(c);
+
+	uint64_t offset = 0;
+	RT64_CHECK(allocator.allocate(8, offset));
+	RT64_CHECK(offset == c);
+	RT64_CHECK(allocator.allocate(25, offset));
+	RT64_CHECK(offset == a);
+}
+
+RT64_TEST(freedRangesMergeWithTheirNeighbours) {
+	RT64::RangeAllocator allocator(40);
+	uint64_t offsets[4];
+	for (uint64_t &offset : offsets) {
+		allocator.allocate(10, offset);
+	}
+
+	// Merges with the free range after it.
+	allocator.free(offsets[3]);
+	allocator.free(offsets[2]);
+	RT64_CHECK(allocator.getLargestFreeRange() == 20);
+
+	// Merges with the free range before it, and then with the ones on both sides.
+	allocator.free(offsets[0]);
+	RT64_CHECK(allocator.getLargestFreeRange() == 20);
+	allocator.free(offsets[1]);
+	RT64_CHECK(allocator.getLargestFreeRange() == 40);
+	RT64_CHECK(allocator.getAllocatedSize() == 0);
+	RT64_CHECK(allocator.getAllocationCount() == 0);
+	RT64_CHECK(allocator.getFragmentation() == 0.0f);
+
+	uint64_t offset = 0;
+	RT64_CHECK(allocator.allocate(40, offset));
+	RT64_CHECK(offset == 0);
+}
+
+RT64_TEST(fragmentationMeasuresTheUnusableFreeSpace) {
+	RT64::RangeAllocator allocator(100);
+	RT64_CHECK(allocator.getFragmentation() == 0.0f);
+
+	uint64_t offsets[10];
+	for (uint64_t &offset : offsets) {
+		allocator.allocate(10, offset);
+	}
+
+	RT64_CHECK(allocator.getFragmentation() == 0.0f);
+
+	// Five free ranges of 10 elements can only fit allocations of a fifth of the free space.
+	for (int i = 0; i < 10; i += 2) {
+		allocator.free(offsets[i]);
+	}
+
+	RT64_CHECK_NEAR(allocator.getFragmentation(), 0.8f, 1e-6f);
+}
+
+RT64_TEST(randomAllocationsNeverOverlap) {
+	const uint64_t Capacity = 4096;
+	RT64::RangeAllocator allocator(Capacity);
+	std::vector<int> owners(Capacity, -1);
+	std::vector<std::pair<uint64_t, uint64_t>> live;
+	std::mt19937 random(1234);
+	int nextOwner = 0;
+	for (int i = 0; i < 20000; i++) {
+		const bool doAllocate = live.empty() || ((random() % 100) < 55);
+		if (doAllocate) {
+			const uint64_t size = 1 + (random() % 64);
+			uint64_t offset = 0;
+			if (!allocator.allocate(size, offset)) {
+				RT64_CHECK(allocator.getLargestFreeRange() < size);
+				continue;
+			}
+
+			RT64_CHECK((offset + size) <= Capacity);
+			for (uint64_t e = offset; e < (offset + size); e++) {
+				RT64_CHECK(owners[e] < 0);
+				owners[e] = nextOwner;
+			}
+
+			live.push_back({ offset, size });
+			nextOwner++;
+		}
+		else {
+			const size_t index = random() % live.size();
+			allocator.free(live[index].first);
+			for (uint64_t e = live[index].first; e < (live[index].first + live[index].second); e++) {
+				owners[e] = -1;
+			}
+
+			live[index] = live.back();
+			live.pop_back();
+		}
+
+		uint64_t liveSize = 0;
+		for (const auto &allocation : live) {
+			liveSize += allocation.second;
+		}
+
+		RT64_CHECK(allocator.getAllocatedSize() == liveSize);
+		RT64_CHECK(allocator.getAllocationCount() == live.size());
+	}
+
+	// Once everything is freed the whole capacity is a single range again.
+	for (const auto &allocation : live) {
+		allocator.free(allocation.first);
+	}
+
+	RT64_CHECK(allocator.getLargestFreeRange() == Capacity);
+}
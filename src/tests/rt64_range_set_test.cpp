@@ -0,0 +1,109 @@
+//
+// RT64
+//
+
+#include "rt64_range_set.h"
+#include "rt64_test.h"
+
+namespace {
+	bool rangesEqual(const RT64::RangeSet &set, const std::vector<RT64::RangeSet::Range> &expected) {
+		const std::vector<RT64::RangeSet::Range> &ranges = set.getRanges();
+		if (ranges.size() != expected.size()) {
+			return false;
+		}
+
+		for (size_t i = 0; i < ranges.size(); i++) {
+			if ((ranges[i].begin != expected[i].begin) || (ranges[i].end != expected[i].end)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+RT64_TEST(emptyRangesAreIgnored) {
+	RT64::RangeSet set;
+	set.add(5, 5);
+	RT64_CHECK(set.empty());
+	RT64_CHECK(set.getSize() == 0);
+}
+
+RT64_TEST(adjacentRangesMerge) {
+	RT64::RangeSet set;
+	set.add(0, 10);
+	set.add(10, 20);
+	RT64_CHECK(rangesEqual(set, { { 0, 20 } }));
+
+	// Also when the new range comes before the existing one.
+	RT64::RangeSet reversed;
+	reversed.add(10, 20);
+	reversed.add(0, 10);
+	RT64_CHECK(rangesEqual(reversed, { { 0, 20 } }));
+}
+
+RT64_TEST(overlappingRangesMerge) {
+	RT64::RangeSet set;
+	set.add(0, 10);
+	set.add(5, 15);
+	RT64_CHECK(rangesEqual(set, { { 0, 15 } }));
+
+	set.add(12, 30);
+	RT64_CHECK(rangesEqual(set, { { 0, 30 } }));
+	RT64_CHECK(set.getSize() == 30);
+}
+
+RT64_TEST(containedRangesAreAbsorbed) {
+	RT64::RangeSet set;
+	set.add(0, 100);
+	set.add(20, 30);
+	set.add(0, 100);
+	RT64_CHECK(rangesEqual(set, { { 0, 100 } }));
+
+	// A new range that contains several existing ones replaces all of them.
+	RT64::RangeSet outer;
+	outer.add(10, 20);
+	outer.add(30, 40);
+	outer.add(50, 60);
+	outer.add(70, 80);
+	outer.add(5, 65);
+	RT64_CHECK(rangesEqual(outer, { { 5, 65 }, { 70, 80 } }));
+}
+
+RT64_TEST(rangesWithGapsStaySeparate) {
+	RT64::RangeSet set;
+	set.add(40, 50);
+	set.add(0, 10);
+	set.add(20, 30);
+	RT64_CHECK(rangesEqual(set, { { 0, 10 }, { 20, 30 }, { 40, 50 } }));
+	RT64_CHECK(set.getSize() == 30);
+
+	// Filling a gap joins its neighbours.
+	set.add(10, 20);
+	RT64_CHECK(rangesEqual(set, { { 0, 30 }, { 40, 50 } }));
+}
+
+RT64_TEST(gapsWithinMergeDistanceMerge) {
+	RT64::RangeSet set(4);
+	set.add(0, 10);
+	set.add(14, 20);
+	RT64_CHECK(rangesEqual(set, { { 0, 20 } }));
+
+	// One element further away than the merge distance stays separate.
+	set.add(25, 30);
+	RT64_CHECK(rangesEqual(set, { { 0, 20 }, { 25, 30 } }));
+
+	// The gap is measured from both sides of the new range.
+	set.add(21, 21);
+	set.add(22, 23);
+	RT64_CHECK(rangesEqual(set, { { 0, 30 } }));
+}
+
+RT64_TEST(clearRemovesEverything) {
+	RT64::RangeSet set;
+	set.add(0, 10);
+	set.add(20, 30);
+	set.clear();
+	RT64_CHECK(set.empty());
+	RT64_CHECK(set.getRanges().empty());
+}
@@ -0,0 +1,182 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "rt64_resolution_governor.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::ResolutionGovernor Governor;
+
+	// Simulated GPU that takes a fixed time plus a time proportional to the traced area.
+	struct SimulatedGPU {
+		float fixedMilliseconds;
+		float areaMilliseconds;
+
+		float frameTime(float scale) const {
+			return fixedMilliseconds + areaMilliseconds * scale * scale;
+		}
+	};
+
+	Governor::Settings makeSettings(float targetMilliseconds) {
+		Governor::Settings settings;
+		settings.targetMilliseconds = targetMilliseconds;
+		settings.minScale = 0.25f;
+		settings.maxScale = 1.0f;
+		return settings;
+	}
+
+	// Runs the governor against the GPU and returns the scale it settled on, checking it never moves by more than a step.
+	float run(Governor &governor, const SimulatedGPU &gpu, int frameCount) {
+		const float maxStep = governor.getSettings().maxStep;
+		for (int i = 0; i < frameCount; i++) {
+			const float previousScale = governor.getScale();
+			const float newScale = governor.update(gpu.frameTime(previousScale));
+			RT64_CHECK(std::abs(newScale - previousScale) <= (maxStep + 1e-6f));
+			RT64_CHECK((newScale >= governor.getSettings().minScale) && (newScale <= governor.getSettings().maxScale));
+		}
+
+		return governor.getScale();
+	}
+
+	bool withinTolerance(const Governor &governor, float milliseconds) {
+		const Governor::Settings &settings = governor.getSettings();
+		return std::abs(milliseconds - settings.targetMilliseconds) <= (settings.targetMilliseconds * settings.tolerance * 1.001f);
+	}
+};
+
+RT64_TEST(disabledGovernorKeepsTheScale) {
+	Governor governor;
+	RT64_CHECK(!governor.isEnabled());
+	governor.reset(0.75f);
+	RT64_CHECK(governor.update(100.0f) == 0.75f);
+	RT64_CHECK(governor.update(0.1f) == 0.75f);
+}
+
+RT64_TEST(scaleConvergesToTheTargetFromAbove) {
+	Governor governor;
+	governor.setSettings(makeSettings(8.0f));
+	governor.reset(1.0f);
+
+	// Twice as expensive as the target at full resolution.
+	SimulatedGPU gpu = { 0.0f, 16.0f };
+	const float scale = run(governor, gpu, 60);
+	RT64_CHECK(withinTolerance(governor, gpu.frameTime(scale)));
+	RT64_CHECK(scale < 1.0f);
+}
+
+RT64_TEST(scaleConvergesToTheTargetFromBelow) {
+	Governor governor;
+	governor.setSettings(makeSettings(10.0f));
+	governor.reset(0.25f);
+
+	// The time doesn't grow only with the area, so the first estimates of the cost are off.
+	SimulatedGPU gpu = { 3.0f, 9.0f };
+	const float scale = run(governor, gpu, 60);
+	RT64_CHECK(withinTolerance(governor, gpu.frameTime(scale)));
+	RT64_CHECK(scale > 0.25f);
+}
+
+RT64_TEST(scaleIsClampedToTheRange) {
+	Governor governor;
+	governor.setSettings(makeSettings(8.0f));
+	governor.reset(1.0f);
+
+	// Too slow even at the minimum scale.
+	SimulatedGPU slowGPU = { 20.0f, 16.0f };
+	RT64_CHECK(run(governor, slowGPU, 60) == 0.25f);
+
+	// Faster than the target even at the maximum scale.
+	SimulatedGPU fastGPU = { 0.0f, 2.0f };
+	RT64_CHECK(run(governor, fastGPU, 60) == 1.0f);
+}
+
+RT64_TEST(changesAreLimitedByTheStep) {
+	Governor governor;
+	governor.setSettings(makeSettings(1.0f));
+	governor.reset(1.0f);
+
+	// The first measurement alone asks for a much lower scale.
+	RT64_CHECK_NEAR(governor.update(64.0f), 1.0f - governor.getSettings().maxStep, 1e-6f);
+	RT64_CHECK_NEAR(governor.update(64.0f * 0.9f * 0.9f), 1.0f - governor.getSettings().maxStep * 2.0f, 1e-6f);
+}
+
+RT64_TEST(timesWithinToleranceKeepTheScale) {
+	Governor governor;
+	governor.setSettings(makeSettings(10.0f));
+	governor.reset(0.8f);
+
+	// Noise around the target that stays within the margin never moves the scale.
+	const float noise[] = { 0.04f, -0.03f, 0.05f, -0.05f, 0.0f, 0.02f, -0.04f, 0.045f };
+	for (int i = 0; i < 64; i++) {
+		RT64_CHECK(governor.update(10.0f * (1.0f + noise[i % 8])) == 0.8f);
+	}
+}
+
+RT64_TEST(noisyTimesDoNotOscillate) {
+	Governor governor;
+	governor.setSettings(makeSettings(8.0f));
+	governor.reset(1.0f);
+	SimulatedGPU gpu = { 1.0f, 14.0f };
+	run(governor, gpu, 60);
+
+	// Once settled, alternating timings of +-15% around the converged value cause far fewer changes than frames.
+	int changes = 0;
+	float previousScale = governor.getScale();
+	float minScale = previousScale;
+	float maxScale = previousScale;
+	for (int i = 0; i < 100; i++) {
+		const float noise = ((i % 2) == 0) ? 1.15f : 0.85f;
+		const float newScale = governor.update(gpu.frameTime(previousScale) * noise);
+		changes += (newScale != previousScale) ? 1 : 0;
+		minScale = std::min(minScale, newScale);
+		maxScale = std::max(maxScale, newScale);
+		previousScale = newScale;
+	}
+
+	RT64_CHECK(changes < 10);
+	RT64_CHECK((maxScale - minScale) < 0.05f);
+}
+
+RT64_TEST(singleSlowFramesAreSmoothed) {
+	Governor governor;
+	governor.setSettings(makeSettings(8.0f));
+	governor.reset(1.0f);
+	SimulatedGPU gpu = { 0.0f, 8.0f };
+	RT64_CHECK(run(governor, gpu, 10) == 1.0f);
+
+	// A frame that takes twice as long only moves the smoothed cost by a fraction, so the scale drops much less than
+	// the measurement alone would ask for.
+	const float scale = governor.update(16.0f);
+	RT64_CHECK(scale < 1.0f);
+	RT64_CHECK(scale > std::sqrt(0.5f) + 0.1f);
+}
+
+RT64_TEST(invalidTimesAreIgnored) {
+	Governor governor;
+	governor.setSettings(makeSettings(8.0f));
+	governor.reset(0.5f);
+	RT64_CHECK(governor.update(0.0f) == 0.5f);
+	RT64_CHECK(governor.update(-1.0f) == 0.5f);
+	RT64_CHECK(governor.update(std::nanf("")) == 0.5f);
+
+	// The first valid measurement is taken as is.
+	RT64_CHECK_NEAR(governor.update(8.0f * 0.25f * 0.25f / (0.5f * 0.5f)), 0.6f, 1e-6f);
+}
+
+RT64_TEST(resetDiscardsTheSmoothedCost) {
+	Governor governor;
+	governor.setSettings(makeSettings(8.0f));
+	governor.reset(1.0f);
+	SimulatedGPU expensiveGPU = { 0.0f, 32.0f };
+	run(governor, expensiveGPU, 30);
+
+	// After a reset, a cheaper scene is measured as is instead of being blended with the old cost.
+	governor.reset(0.5f);
+	RT64_CHECK_NEAR(governor.update(2.0f), 0.6f, 1e-6f);
+	governor.reset(0.5f);
+	RT64_CHECK(governor.update(8.0f) == 0.5f);
+}
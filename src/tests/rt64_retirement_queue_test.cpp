@@ -0,0 +1,152 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <random>
+
+#include "rt64_retirement_queue.h"
+#include "rt64_test.h"
+
+namespace {
+	// Follows the device: commands recorded while the fence value is N are done once the GPU reaches N. Submitting
+	// signals the current value and moves on to the next one, and the GPU catches up whenever the test says so.
+	struct FakeFence {
+		uint64_t value = 1;
+		uint64_t completedValue = 0;
+
+		void submit() {
+			value++;
+		}
+
+		void complete(uint64_t completedValue) {
+			this->completedValue = completedValue;
+		}
+	};
+};
+
+RT64_TEST(entriesWaitForTheirFenceValue) {
+	FakeFence fence;
+	RT64::RetirementQueue queue;
+	bool released = false;
+	queue.retire(fence.value, [&]() { released = true; });
+	fence.submit();
+
+	RT64_CHECK(queue.collect(fence.completedValue) == 0);
+	RT64_CHECK(!released);
+
+	fence.complete(1);
+	RT64_CHECK(queue.collect(fence.completedValue) == 1);
+	RT64_CHECK(released);
+	RT64_CHECK(queue.getPendingCount() == 0);
+}
+
+RT64_TEST(entriesAreReleasedInOrder) {
+	FakeFence fence;
+	RT64::RetirementQueue queue;
+	std::vector<int> released;
+	for (int frame = 0; frame < 4; frame++) {
+		queue.retire(fence.value, [&released, frame]() { released.push_back(frame * 2); });
+		queue.retire(fence.value, [&released, frame]() { released.push_back(frame * 2 + 1); });
+		fence.submit();
+	}
+
+	// Only the frames the GPU finished are released.
+	fence.complete(2);
+	RT64_CHECK(queue.collect(fence.completedValue) == 4);
+	RT64_CHECK((released == std::vector<int>{ 0, 1, 2, 3 }));
+	RT64_CHECK(queue.getPendingCount() == 4);
+
+	fence.complete(4);
+	queue.collect(fence.completedValue);
+	RT64_CHECK((released == std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7 }));
+}
+
+RT64_TEST(earlierFenceValuesWaitForTheLatestOne) {
+	RT64::RetirementQueue queue;
+	std::vector<int> released;
+	queue.retire(5, [&]() { released.push_back(0); });
+	queue.retire(3, [&]() { released.push_back(1); });
+
+	// The second entry is held back to keep the queue sorted, which is always safe.
+	RT64_CHECK(queue.collect(4) == 0);
+	RT64_CHECK(queue.collect(5) == 2);
+	RT64_CHECK((released == std::vector<int>{ 0, 1 }));
+}
+
+RT64_TEST(callbacksCanRetireMoreEntries) {
+	FakeFence fence;
+	RT64::RetirementQueue queue;
+	bool parentReleased = false;
+	bool childReleased = false;
+	queue.retire(fence.value, [&]() {
+		parentReleased = true;
+		queue.retire(fence.value, [&]() { childReleased = true; });
+	});
+
+	fence.submit();
+	fence.complete(1);
+	queue.collect(fence.completedValue);
+	RT64_CHECK(parentReleased);
+	RT64_CHECK(!childReleased);
+	RT64_CHECK(queue.getPendingCount() == 1);
+
+	fence.submit();
+	fence.complete(2);
+	queue.collect(fence.completedValue);
+	RT64_CHECK(childReleased);
+}
+
+RT64_TEST(flushReleasesEverything) {
+	RT64::RetirementQueue queue;
+	int releasedCount = 0;
+	for (uint64_t value = 1; value <= 10; value++) {
+		queue.retire(value, [&]() { releasedCount++; });
+	}
+
+	queue.flush();
+	RT64_CHECK(releasedCount == 10);
+	RT64_CHECK(queue.getPendingCount() == 0);
+}
+
+RT64_TEST(resourcesOutliveTheFramesThatUseThem) {
+	// A buffer is resized at random and the GPU lags up to three frames behind. Every frame that's recorded uses the
+	// current buffer, and a buffer must never be released while a frame that used it is still running.
+	struct Buffer {
+		uint64_t lastUsedFenceValue = 0;
+		bool released = false;
+	};
+
+	FakeFence fence;
+	RT64::RetirementQueue queue;
+	std::vector<Buffer *> buffers;
+	Buffer *current = new Buffer();
+	buffers.push_back(current);
+	std::mt19937 random(42);
+	for (int frame = 0; frame < 1000; frame++) {
+		queue.collect(fence.completedValue);
+		for (Buffer *buffer : buffers) {
+			RT64_CHECK(!buffer->released || (buffer->lastUsedFenceValue <= fence.completedValue));
+		}
+
+		if ((random() % 4) == 0) {
+			Buffer *retired = current;
+			queue.retire(fence.value, [retired]() { retired->released = true; });
+			current = new Buffer();
+			buffers.push_back(current);
+		}
+
+		current->lastUsedFenceValue = fence.value;
+		fence.submit();
+
+		const uint64_t lag = random() % 4;
+		const uint64_t completedValue = (fence.value > (lag + 1)) ? (fence.value - lag - 1) : 0;
+		fence.complete(std::max(fence.completedValue, completedValue));
+	}
+
+	queue.flush();
+	for (Buffer *buffer : buffers) {
+		RT64_CHECK(buffer->released == (buffer != current));
+		delete buffer;
+	}
+}
@@ -0,0 +1,116 @@
+//
+// RT64
+//
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "rt64_shader_archive.h"
+
+// Measures the part of the startup of a device that doesn't need a GPU: parsing the embedded shader archive and
+// decompressing every shader the first time it's requested, compared against an archive that stores them as is.
+//
+// Usage: rt64_shader_archive_benchmark <list file>
+//
+// The list file is the same one shaderpack takes. Each shader is read from <name>.hlsl.cso like shaderpack does, and
+// from <name>.hlsl when it hasn't been compiled, in which case the sizes and times are only an approximation since
+// the source compresses differently from the bytecode.
+
+namespace {
+	const int RunCount = 50;
+
+	typedef std::chrono::steady_clock Clock;
+
+	bool readFile(const std::filesystem::path &path, std::vector<uint8_t> &data) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return !file.bad();
+	}
+
+	double elapsedMilliseconds(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Opens the archive and requests every shader once, like a device does while creating its pipelines.
+	void benchmarkArchive(const char *label, const std::vector<uint8_t> &archive, const std::vector<RT64::ShaderArchive::Source> &sources) {
+		double openTotal = 0.0;
+		double decodeTotal = 0.0;
+		for (int i = 0; i < RunCount; i++) {
+			Clock::time_point start = Clock::now();
+			RT64::ShaderArchive shaderArchive(archive.data(), archive.size());
+			openTotal += elapsedMilliseconds(start);
+
+			start = Clock::now();
+			for (const RT64::ShaderArchive::Source &source : sources) {
+				if (shaderArchive.get(source.name).size() != source.bytecode.size()) {
+					fprintf(stderr, "Shader %s doesn't match its source.\n", source.name.c_str());
+				}
+			}
+
+			decodeTotal += elapsedMilliseconds(start);
+		}
+
+		printf("%s: %zu bytes, open %.3f ms, first request of every shader %.3f ms\n", label, archive.size(), openTotal / RunCount, decodeTotal / RunCount);
+	}
+};
+
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: rt64_shader_archive_benchmark <list file>\n");
+		return 1;
+	}
+
+	const std::filesystem::path listPath = std::filesystem::u8path(argv[1]);
+	std::ifstream listFile(listPath);
+	if (!listFile.is_open()) {
+		fprintf(stderr, "Unable to open %s.\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<RT64::ShaderArchive::Source> sources;
+	size_t totalSize = 0;
+	int sourceCount = 0;
+	std::string line;
+	while (std::getline(listFile, line)) {
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || (line[0] == '#')) {
+			continue;
+		}
+
+		RT64::ShaderArchive::Source source;
+		source.name = line;
+		if (!readFile(listPath.parent_path() / (line + ".hlsl.cso"), source.bytecode)) {
+			if (!readFile(listPath.parent_path() / (line + ".hlsl"), source.bytecode)) {
+				fprintf(stderr, "Unable to read %s.\n", line.c_str());
+				return 1;
+			}
+
+			sourceCount++;
+		}
+
+		totalSize += source.bytecode.size();
+		sources.push_back(std::move(source));
+	}
+
+	if (sourceCount > 0) {
+		printf("%d of %zu shaders aren't compiled and were read from their source.\n", sourceCount, sources.size());
+	}
+
+	std::vector<uint8_t> storedArchive, compressedArchive;
+	RT64::ShaderArchive::build(sources, false, storedArchive);
+	Clock::time_point start = Clock::now();
+	RT64::ShaderArchive::build(sources, true, compressedArchive);
+	const double buildMs = elapsedMilliseconds(start);
+
+	printf("%zu shaders, %zu bytes. Compressing took %.2f ms.\n", sources.size(), totalSize, buildMs);
+	benchmarkArchive("Stored", storedArchive, sources);
+	benchmarkArchive("Compressed", compressedArchive, sources);
+	return 0;
+}
@@ -0,0 +1,94 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "rt64_object_pool.h"
+#include "rt64_slot_map.h"
+
+// Compares the instance storage the scene used before, a vector that is searched and erased from on every removal,
+// with the slot map of pooled records it uses now. 100k instances are created and destroyed in random order, and the
+// slot map is compacted every 1000 removals like the scene does once per frame.
+
+namespace {
+	const int InstanceCount = 100000;
+	const int RemovalsPerFrame = 1000;
+
+	// Stand-in for the instance record, which needs a device to be created.
+	struct Instance {
+		float transform[16];
+		float previousTransform[16];
+		void *mesh;
+		void *texture;
+		unsigned int flags;
+		RT64::SlotMap<Instance *>::Handle handle;
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	double benchmarkVector(const std::vector<int> &order) {
+		Clock::time_point start = Clock::now();
+		std::vector<Instance *> instances;
+		std::vector<Instance *> created;
+		created.reserve(InstanceCount);
+		for (int i = 0; i < InstanceCount; i++) {
+			Instance *instance = new Instance();
+			instances.push_back(instance);
+			created.push_back(instance);
+		}
+
+		for (int i : order) {
+			auto it = std::find(instances.begin(), instances.end(), created[i]);
+			instances.erase(it);
+			delete created[i];
+		}
+
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	double benchmarkSlotMap(const std::vector<int> &order) {
+		Clock::time_point start = Clock::now();
+		RT64::ObjectPool<Instance> pool;
+		RT64::SlotMap<Instance *> instances;
+		std::vector<Instance *> created;
+		created.reserve(InstanceCount);
+		for (int i = 0; i < InstanceCount; i++) {
+			Instance *instance = pool.create();
+			instance->handle = instances.insert(instance);
+			created.push_back(instance);
+		}
+
+		int removals = 0;
+		for (int i : order) {
+			instances.remove(created[i]->handle);
+			pool.destroy(created[i]);
+			if ((++removals % RemovalsPerFrame) == 0) {
+				instances.compact();
+			}
+		}
+
+		instances.compact();
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+};
+
+int main() {
+	std::vector<int> order(InstanceCount);
+	for (int i = 0; i < InstanceCount; i++) {
+		order[i] = i;
+	}
+
+	std::shuffle(order.begin(), order.end(), std::mt19937(0x52543634));
+
+	const double vectorSeconds = benchmarkVector(order);
+	const double slotMapSeconds = benchmarkSlotMap(order);
+	printf("%d instances created and destroyed in random order.\n", InstanceCount);
+	printf("Vector with find and erase: %.1f ms\n", vectorSeconds * 1000.0);
+	printf("Slot map with object pool:  %.1f ms\n", slotMapSeconds * 1000.0);
+	return 0;
+}
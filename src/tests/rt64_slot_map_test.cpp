@@ -0,0 +1,157 @@
+//
+// RT64
+//
+
+#include <stdexcept>
+
+#include "rt64_object_pool.h"
+#include "rt64_slot_map.h"
+#include "rt64_test.h"
+
+RT64_TEST(handlesFindTheirValues) {
+	RT64::SlotMap<int> map;
+	RT64::SlotMap<int>::Handle a = map.insert(10);
+	RT64::SlotMap<int>::Handle b = map.insert(20);
+	RT64_CHECK(map.contains(a) && map.contains(b));
+	RT64_CHECK((map.get(a) != nullptr) && (*map.get(a) == 10));
+	RT64_CHECK((map.get(b) != nullptr) && (*map.get(b) == 20));
+	RT64_CHECK(map.size() == 2);
+
+	RT64::SlotMap<int>::Handle defaultHandle;
+	RT64_CHECK(!map.contains(defaultHandle));
+	RT64_CHECK(map.get(defaultHandle) == nullptr);
+}
+
+RT64_TEST(removedHandlesAreRejected) {
+	RT64::SlotMap<int> map;
+	RT64::SlotMap<int>::Handle handle = map.insert(10);
+	RT64_CHECK(map.remove(handle));
+	RT64_CHECK(!map.contains(handle));
+	RT64_CHECK(map.get(handle) == nullptr);
+	RT64_CHECK(!map.remove(handle));
+	RT64_CHECK(map.size() == 0);
+}
+
+RT64_TEST(staleHandlesAreRejectedAfterTheSlotIsReused) {
+	RT64::SlotMap<int> map;
+	RT64::SlotMap<int>::Handle stale = map.insert(10);
+	map.remove(stale);
+
+	// The new value gets the same slot with the next generation.
+	RT64::SlotMap<int>::Handle reused = map.insert(20);
+	RT64_CHECK(reused.index == stale.index);
+	RT64_CHECK(reused.generation != stale.generation);
+	RT64_CHECK(!map.contains(stale));
+	RT64_CHECK(map.get(stale) == nullptr);
+	RT64_CHECK(!map.remove(stale));
+	RT64_CHECK((map.get(reused) != nullptr) && (*map.get(reused) == 20));
+}
+
+RT64_TEST(compactKeepsTheInsertionOrderAndTheHandles) {
+	RT64::SlotMap<int> map;
+	std::vector<RT64::SlotMap<int>::Handle> handles;
+	for (int i = 0; i < 8; i++) {
+		handles.push_back(map.insert(i));
+	}
+
+	map.remove(handles[1]);
+	map.remove(handles[4]);
+	map.remove(handles[5]);
+	RT64_CHECK(!map.isCompact());
+	map.compact();
+	RT64_CHECK(map.isCompact());
+	RT64_CHECK((map.getValues() == std::vector<int>{ 0, 2, 3, 6, 7 }));
+	for (int i : { 0, 2, 3, 6, 7 }) {
+		RT64_CHECK((map.get(handles[i]) != nullptr) && (*map.get(handles[i]) == i));
+	}
+
+	// Values inserted after compacting go after the existing ones even if they reuse an older slot.
+	RT64::SlotMap<int>::Handle handle = map.insert(8);
+	RT64_CHECK(map.getValues().back() == 8);
+	RT64_CHECK(*map.get(handle) == 8);
+}
+
+namespace {
+	struct Counted {
+		static int liveCount;
+		int value;
+
+		Counted(int value) : value(value) {
+			if (value < 0) {
+				throw std::runtime_error("Negative value.");
+			}
+
+			liveCount++;
+		}
+
+		~Counted() {
+			liveCount--;
+		}
+	};
+
+	int Counted::liveCount = 0;
+};
+
+RT64_TEST(poolConstructsAndDestroysObjects) {
+	RT64::ObjectPool<Counted, 4> pool;
+	Counted *a = pool.create(1);
+	Counted *b = pool.create(2);
+	RT64_CHECK((a->value == 1) && (b->value == 2));
+	RT64_CHECK(Counted::liveCount == 2);
+	RT64_CHECK(pool.getObjectCount() == 2);
+
+	pool.destroy(a);
+	pool.destroy(b);
+	RT64_CHECK(Counted::liveCount == 0);
+	RT64_CHECK(pool.getObjectCount() == 0);
+}
+
+RT64_TEST(poolReusesTheMemoryOfDestroyedObjects) {
+	RT64::ObjectPool<Counted, 4> pool;
+	Counted *a = pool.create(1);
+	pool.destroy(a);
+	Counted *b = pool.create(2);
+	RT64_CHECK(a == b);
+	pool.destroy(b);
+}
+
+RT64_TEST(poolAddressesStayStableAcrossChunks) {
+	RT64::ObjectPool<Counted, 4> pool;
+	std::vector<Counted *> objects;
+	for (int i = 0; i < 64; i++) {
+		objects.push_back(pool.create(i));
+		RT64_CHECK((reinterpret_cast<uintptr_t>(objects.back()) % alignof(Counted)) == 0);
+	}
+
+	for (int i = 0; i < 64; i++) {
+		RT64_CHECK(objects[i]->value == i);
+		for (int j = i + 1; j < 64; j++) {
+			RT64_CHECK(objects[i] != objects[j]);
+		}
+	}
+
+	for (Counted *object : objects) {
+		pool.destroy(object);
+	}
+}
+
+RT64_TEST(poolRecoversFromAThrowingConstructor) {
+	RT64::ObjectPool<Counted, 4> pool;
+	bool thrown = false;
+	try {
+		pool.create(-1);
+	}
+	catch (const std::runtime_error &) {
+		thrown = true;
+	}
+
+	RT64_CHECK(thrown);
+	RT64_CHECK(pool.getObjectCount() == 0);
+
+	// The entry that failed goes back to the pool.
+	Counted *object = pool.create(3);
+	Counted *other = pool.create(4);
+	RT64_CHECK(object != other);
+	pool.destroy(object);
+	pool.destroy(other);
+}
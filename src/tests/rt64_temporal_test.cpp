@@ -0,0 +1,285 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "rt64_temporal.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::TemporalAccumulator Accumulator;
+
+	const int Width = 8;
+	const int Height = 4;
+	const float PlaneDepth = 5.0f;
+
+	// Projection where the clip position is (x + offsetX, y, 0, z), so W is the view depth. Moving the offset by
+	// 2 * z / width shifts the image by exactly one pixel on a plane at depth z.
+	void makeViewProj(float offsetX, float viewProj[16]) {
+		memset(viewProj, 0, sizeof(float) * 16);
+		viewProj[0] = 1.0f;
+		viewProj[5] = 1.0f;
+		viewProj[11] = 1.0f;
+		viewProj[12] = offsetX;
+	}
+
+	// A plane at a fixed depth in front of the camera, traced through the center of every pixel like the ray
+	// generation shader does. The color of every pixel is the world X coordinate plus a per frame offset.
+	struct Frame {
+		int width;
+		int height;
+		std::vector<float> color;
+		std::vector<float> position;
+		std::vector<float> previousPosition;
+		std::vector<uint16_t> instanceId;
+		Accumulator::FrameInputs inputs;
+
+		Frame(float cameraOffsetX, float colorOffset, uint16_t instance = 0, float depth = PlaneDepth, int width = Width, int height = Height) {
+			this->width = width;
+			this->height = height;
+			color.resize(width * height * 4);
+			position.resize(width * height * 3);
+			instanceId.assign(width * height, instance);
+			makeViewProj(cameraOffsetX, inputs.viewProj);
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					const size_t i = (size_t)(y) * width + x;
+					const float ndcX = ((x + 0.5f) / width) * 2.0f - 1.0f;
+					const float ndcY = 1.0f - ((y + 0.5f) / height) * 2.0f;
+					position[i * 3 + 0] = ndcX * depth - cameraOffsetX;
+					position[i * 3 + 1] = ndcY * depth;
+					position[i * 3 + 2] = depth;
+					for (int k = 0; k < 3; k++) {
+						color[i * 4 + k] = position[i * 3 + 0] + colorOffset;
+					}
+
+					color[i * 4 + 3] = 0.25f;
+				}
+			}
+
+			inputs.color = color.data();
+			inputs.worldPosition = position.data();
+			inputs.instanceId = instanceId.data();
+		}
+
+		float worldX(int x, int y) const {
+			return position[((size_t)(y) * width + x) * 3];
+		}
+	};
+
+	float outputAt(const std::vector<float> &output, int x, int y, int channel = 0, int width = Width) {
+		return output[((size_t)(y) * width + x) * 4 + channel];
+	}
+};
+
+RT64_TEST(transformPointReturnsTheViewDepth) {
+	float viewProj[16];
+	makeViewProj(2.0f, viewProj);
+	const float position[3] = { 1.0f, -3.0f, 7.0f };
+	float clipPos[4];
+	RT64_CHECK(Accumulator::transformPoint(viewProj, position, clipPos) == 7.0f);
+	RT64_CHECK((clipPos[0] == 3.0f) && (clipPos[1] == -3.0f) && (clipPos[2] == 0.0f) && (clipPos[3] == 7.0f));
+}
+
+RT64_TEST(reprojectionInvertsTheRayMapping) {
+	float viewProj[16];
+	makeViewProj(0.0f, viewProj);
+	Accumulator::Reprojection reprojection;
+
+	// The center of the screen and the corners.
+	const float center[3] = { 0.0f, 0.0f, PlaneDepth };
+	RT64_CHECK(Accumulator::reproject(viewProj, center, Width, Height, reprojection));
+	RT64_CHECK((reprojection.x == Width / 2) && (reprojection.y == Height / 2) && (reprojection.depth == PlaneDepth));
+
+	const float topLeft[3] = { -PlaneDepth * 0.99f, PlaneDepth * 0.99f, PlaneDepth };
+	RT64_CHECK(Accumulator::reproject(viewProj, topLeft, Width, Height, reprojection));
+	RT64_CHECK((reprojection.x == 0) && (reprojection.y == 0));
+
+	const float bottomRight[3] = { PlaneDepth * 0.99f, -PlaneDepth * 0.99f, PlaneDepth };
+	RT64_CHECK(Accumulator::reproject(viewProj, bottomRight, Width, Height, reprojection));
+	RT64_CHECK((reprojection.x == (Width - 1)) && (reprojection.y == (Height - 1)));
+
+	// Every pixel center of a traced frame goes back to its own pixel.
+	Frame frame(0.0f, 0.0f);
+	for (int y = 0; y < Height; y++) {
+		for (int x = 0; x < Width; x++) {
+			RT64_CHECK(Accumulator::reproject(viewProj, &frame.position[((size_t)(y) * Width + x) * 3], Width, Height, reprojection));
+			RT64_CHECK((reprojection.x == x) && (reprojection.y == y));
+		}
+	}
+}
+
+RT64_TEST(reprojectionRejectsPointsOffScreenOrBehind) {
+	float viewProj[16];
+	makeViewProj(0.0f, viewProj);
+	Accumulator::Reprojection reprojection;
+	const float right[3] = { PlaneDepth * 1.01f, 0.0f, PlaneDepth };
+	const float above[3] = { 0.0f, PlaneDepth * 1.01f, PlaneDepth };
+	const float behind[3] = { 0.0f, 0.0f, -PlaneDepth };
+	const float atCamera[3] = { 0.0f, 0.0f, 0.0f };
+	RT64_CHECK(!Accumulator::reproject(viewProj, right, Width, Height, reprojection));
+	RT64_CHECK(!Accumulator::reproject(viewProj, above, Width, Height, reprojection));
+	RT64_CHECK(!Accumulator::reproject(viewProj, behind, Width, Height, reprojection));
+	RT64_CHECK(!Accumulator::reproject(viewProj, atCamera, Width, Height, reprojection));
+}
+
+RT64_TEST(historyIsRejectedByInstanceAndDepth) {
+	RT64_CHECK(Accumulator::isHistorySampleValid(3, 10.0f, 3, 10.0f));
+	RT64_CHECK(Accumulator::isHistorySampleValid(3, 10.0f, 3, 10.4f));
+	RT64_CHECK(!Accumulator::isHistorySampleValid(3, 10.0f, 3, 10.6f));
+	RT64_CHECK(!Accumulator::isHistorySampleValid(3, 10.6f, 3, 10.0f));
+	RT64_CHECK(!Accumulator::isHistorySampleValid(3, 10.0f, 4, 10.0f));
+	RT64_CHECK(!Accumulator::isHistorySampleValid(Accumulator::NoInstanceId, 10.0f, Accumulator::NoInstanceId, 10.0f));
+}
+
+RT64_TEST(blendAlphaAveragesUntilTheMinimum) {
+	RT64_CHECK(Accumulator::blendAlpha(0) == 1.0f);
+	RT64_CHECK(Accumulator::blendAlpha(1) == 0.5f);
+	RT64_CHECK_NEAR(Accumulator::blendAlpha(3), 0.25f, 1e-7f);
+	RT64_CHECK_NEAR(Accumulator::blendAlpha(9), Accumulator::MinBlendAlpha, 1e-7f);
+	RT64_CHECK(Accumulator::blendAlpha(Accumulator::MaxHistoryLength) == Accumulator::MinBlendAlpha);
+}
+
+RT64_TEST(staticFramesConvergeToTheirMean) {
+	Accumulator accumulator;
+	accumulator.set(Width, Height);
+	std::vector<float> output(Width * Height * 4);
+
+	// Until the minimum alpha is reached the result is the exact mean of the frames.
+	const float offsets[] = { 4.0f, -2.0f, 1.0f, 3.0f, -6.0f, 0.5f, 2.5f, -1.0f, 0.0f, 2.0f };
+	float sum = 0.0f;
+	for (int n = 0; n < 10; n++) {
+		Frame frame(0.0f, offsets[n]);
+		accumulator.accumulate(frame.inputs, output.data());
+		sum += offsets[n];
+		for (int y = 0; y < Height; y++) {
+			for (int x = 0; x < Width; x++) {
+				RT64_CHECK_NEAR(outputAt(output, x, y), frame.worldX(x, y) + sum / (n + 1), 1e-4f);
+			}
+		}
+	}
+
+	// Alpha isn't blended.
+	RT64_CHECK(outputAt(output, 0, 0, 3) == 0.25f);
+}
+
+RT64_TEST(cameraMotionReusesTheReprojectedHistory) {
+	Accumulator accumulator;
+	accumulator.set(Width, Height);
+	std::vector<float> output(Width * Height * 4);
+	Frame first(0.0f, 0.0f);
+	accumulator.accumulate(first.inputs, output.data());
+
+	// Shift the camera one pixel. Every pixel sees what its right neighbour saw before, except for the last column,
+	// which wasn't on screen and starts over.
+	Frame second(-2.0f * PlaneDepth / Width, 1.0f);
+	accumulator.accumulate(second.inputs, output.data());
+	for (int y = 0; y < Height; y++) {
+		for (int x = 0; x < Width; x++) {
+			RT64_CHECK_NEAR(second.worldX(x, y), first.worldX(std::min(x + 1, Width - 1), y) + ((x == (Width - 1)) ? (2.0f * PlaneDepth / Width) : 0.0f), 1e-5f);
+			const float expected = second.worldX(x, y) + ((x < (Width - 1)) ? 0.5f : 1.0f);
+			RT64_CHECK_NEAR(outputAt(output, x, y), expected, 1e-5f);
+		}
+	}
+}
+
+RT64_TEST(disocclusionsStartOver) {
+	Accumulator accumulator;
+	accumulator.set(Width, Height);
+	std::vector<float> output(Width * Height * 4);
+	Frame first(0.0f, 0.0f);
+	accumulator.accumulate(first.inputs, output.data());
+
+	// Another instance at the same depth.
+	Frame otherInstance(0.0f, 1.0f, 1);
+	accumulator.accumulate(otherInstance.inputs, output.data());
+	RT64_CHECK_NEAR(outputAt(output, 2, 1), otherInstance.worldX(2, 1) + 1.0f, 1e-5f);
+
+	// The same instance moved closer without providing where it was in the previous frame.
+	Frame closer(0.0f, 2.0f, 1, PlaneDepth * 0.5f);
+	accumulator.accumulate(closer.inputs, output.data());
+	RT64_CHECK_NEAR(outputAt(output, 2, 1), closer.worldX(2, 1) + 2.0f, 1e-5f);
+}
+
+RT64_TEST(previousPositionsFollowMovingInstances) {
+	Accumulator accumulator;
+	accumulator.set(Width, Height);
+	std::vector<float> output(Width * Height * 4);
+	Frame first(0.0f, 0.0f);
+	accumulator.accumulate(first.inputs, output.data());
+
+	// The instance moves one pixel to the left. The previous world position is where each point was a frame ago,
+	// which is the position traced by the right neighbour. The color moves along with the instance.
+	const float step = 2.0f * PlaneDepth / Width;
+	Frame moved(0.0f, 1.0f);
+	moved.previousPosition = moved.position;
+	for (size_t i = 0; i < (size_t)(Width * Height); i++) {
+		moved.previousPosition[i * 3] += step;
+		for (int k = 0; k < 3; k++) {
+			moved.color[i * 4 + k] += step;
+		}
+	}
+
+	moved.inputs.previousWorldPosition = moved.previousPosition.data();
+	accumulator.accumulate(moved.inputs, output.data());
+	for (int y = 0; y < Height; y++) {
+		for (int x = 0; x < Width; x++) {
+			const float expected = moved.worldX(x, y) + step + ((x < (Width - 1)) ? 0.5f : 1.0f);
+			RT64_CHECK_NEAR(outputAt(output, x, y), expected, 1e-5f);
+		}
+	}
+}
+
+RT64_TEST(resetDiscardsTheHistory) {
+	Accumulator accumulator;
+	accumulator.set(Width, Height);
+	std::vector<float> output(Width * Height * 4);
+	RT64_CHECK(!accumulator.isHistoryValid());
+	Frame first(0.0f, 0.0f);
+	accumulator.accumulate(first.inputs, output.data());
+	RT64_CHECK(accumulator.isHistoryValid());
+
+	accumulator.reset();
+	RT64_CHECK(!accumulator.isHistoryValid());
+	Frame second(0.0f, 3.0f);
+	accumulator.accumulate(second.inputs, output.data());
+	RT64_CHECK_NEAR(outputAt(output, 4, 2), second.worldX(4, 2) + 3.0f, 1e-5f);
+}
+
+RT64_TEST(historyIsReprojectedWhenTheSizeChanges) {
+	Accumulator accumulator;
+	accumulator.set(Width, Height);
+	std::vector<float> output(Width * Height * 4);
+	Frame small(0.0f, 0.0f);
+	accumulator.accumulate(small.inputs, output.data());
+
+	// At twice the size, every pixel finds its history in the pixel of the small frame that covers it.
+	const int LargeWidth = Width * 2;
+	const int LargeHeight = Height * 2;
+	accumulator.set(LargeWidth, LargeHeight);
+	RT64_CHECK(accumulator.isHistoryValid());
+	std::vector<float> largeOutput(LargeWidth * LargeHeight * 4);
+	Frame large(0.0f, 1.0f, 0, PlaneDepth, LargeWidth, LargeHeight);
+	accumulator.accumulate(large.inputs, largeOutput.data());
+	for (int y = 0; y < LargeHeight; y++) {
+		for (int x = 0; x < LargeWidth; x++) {
+			const float expected = (small.worldX(x / 2, y / 2) + large.worldX(x, y) + 1.0f) * 0.5f;
+			RT64_CHECK_NEAR(outputAt(largeOutput, x, y, 0, LargeWidth), expected, 1e-5f);
+		}
+	}
+
+	// Back at the original size, the center of every pixel falls on the bottom right pixel of the four that covered it.
+	accumulator.set(Width, Height);
+	Frame back(0.0f, 2.0f);
+	accumulator.accumulate(back.inputs, output.data());
+	for (int y = 0; y < Height; y++) {
+		for (int x = 0; x < Width; x++) {
+			const float history = outputAt(largeOutput, x * 2 + 1, y * 2 + 1, 0, LargeWidth);
+			const float expected = history + (back.worldX(x, y) + 2.0f - history) * Accumulator::blendAlpha(2);
+			RT64_CHECK_NEAR(outputAt(output, x, y), expected, 1e-5f);
+		}
+	}
+}
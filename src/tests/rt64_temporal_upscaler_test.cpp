@@ -0,0 +1,238 @@
+//
+// RT64
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "rt64_temporal_upscaler.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::TemporalUpscaler Upscaler;
+
+	const int InputWidth = 32;
+	const int InputHeight = 24;
+	const int OutputWidth = 64;
+	const int OutputHeight = 48;
+	const float ScaleX = (float)(OutputWidth) / InputWidth;
+	const float ScaleY = (float)(OutputHeight) / InputHeight;
+
+	// Reference image, defined continuously in output pixels. It has a smooth gradient, a pattern close to the
+	// frequency limit of the input and a hard diagonal edge.
+	float reference(float x, float y, int channel) {
+		const float pattern = 0.5f + 0.5f * sinf(x * 0.9f) * cosf(y * 0.7f);
+		const float edge = ((x + y * 0.5f) > 40.0f) ? 1.0f : 0.0f;
+		switch (channel) {
+		case 0:
+			return pattern;
+		case 1:
+			return edge;
+		case 2:
+			return x / OutputWidth;
+		default:
+			return 1.0f;
+		}
+	}
+
+	// Samples the reference at the jittered positions of the input pixels like the ray generation shader does. The
+	// image can be moved to the right by a distance in input pixels.
+	void traceFrame(float jitterX, float jitterY, float offsetX, std::vector<float> &color) {
+		color.resize((size_t)(InputWidth) * InputHeight * 4);
+		for (int y = 0; y < InputHeight; y++) {
+			for (int x = 0; x < InputWidth; x++) {
+				for (int k = 0; k < 4; k++) {
+					color[((size_t)(y) * InputWidth + x) * 4 + k] = reference((x + 0.5f + jitterX - offsetX) * ScaleX, (y + 0.5f + jitterY) * ScaleY, k);
+				}
+			}
+		}
+	}
+
+	// Root mean square difference against the reference sampled at the centers of the output pixels. The border is
+	// left out since the filter has no samples past it.
+	float referenceError(const std::vector<float> &output, float offsetX = 0.0f) {
+		const int border = 2;
+		double sum = 0.0;
+		size_t count = 0;
+		for (int y = border; y < (OutputHeight - border); y++) {
+			for (int x = border; x < (OutputWidth - border); x++) {
+				for (int k = 0; k < 4; k++) {
+					const double d = output[((size_t)(y) * OutputWidth + x) * 4 + k] - reference(x + 0.5f - offsetX * ScaleX, y + 0.5f, k);
+					sum += d * d;
+					count++;
+				}
+			}
+		}
+
+		return (float)(sqrt(sum / count));
+	}
+
+	// Upscales the given amount of frames with the jitter sequence and returns the last output. The image moves by
+	// the given distance in input pixels every frame and the motion vectors are provided.
+	std::vector<float> upscaleFrames(Upscaler &upscaler, int frameCount, float velocityX = 0.0f) {
+		const unsigned int phaseCount = Upscaler::jitterPhaseCount(InputWidth, InputHeight, OutputWidth, OutputHeight);
+		std::vector<float> color;
+		std::vector<float> motion((size_t)(InputWidth) * InputHeight * 2, 0.0f);
+		std::vector<float> output((size_t)(OutputWidth) * OutputHeight * 4);
+		for (size_t i = 0; i < (motion.size() / 2); i++) {
+			motion[i * 2] = -velocityX;
+		}
+
+		for (int f = 0; f < frameCount; f++) {
+			Upscaler::FrameInputs inputs;
+			Upscaler::jitterOffset(f, phaseCount, inputs.jitterX, inputs.jitterY);
+			traceFrame(inputs.jitterX, inputs.jitterY, velocityX * f, color);
+			inputs.color = color.data();
+			inputs.motion = motion.data();
+			inputs.width = InputWidth;
+			inputs.height = InputHeight;
+			upscaler.upscale(inputs, output.data());
+		}
+
+		return output;
+	}
+};
+
+RT64_TEST(accumulatedFramesApproachTheReference) {
+	Upscaler upscaler;
+	upscaler.set(OutputWidth, OutputHeight);
+	const float singleFrameError = referenceError(upscaleFrames(upscaler, 1));
+	upscaler.reset();
+	const float accumulatedError = referenceError(upscaleFrames(upscaler, 32));
+	upscaler.reset();
+	const float longError = referenceError(upscaleFrames(upscaler, 128));
+
+	// The jittered frames add detail a single frame can't have, and it doesn't drift away once the history is full.
+	RT64_CHECK(accumulatedError < (singleFrameError * 0.6f));
+	RT64_CHECK(accumulatedError < 0.04f);
+	RT64_CHECK(std::abs(longError - accumulatedError) < 0.005f);
+}
+
+RT64_TEST(motionVectorsKeepTheHistory) {
+	// Moving the image by a whole input pixel every frame should reconstruct it as well as if it didn't move.
+	Upscaler staticUpscaler;
+	staticUpscaler.set(OutputWidth, OutputHeight);
+	const float staticError = referenceError(upscaleFrames(staticUpscaler, 32));
+
+	const int frameCount = 32;
+	const float velocityX = 1.0f;
+	Upscaler movingUpscaler;
+	movingUpscaler.set(OutputWidth, OutputHeight);
+	std::vector<float> output = upscaleFrames(movingUpscaler, frameCount, velocityX);
+	const float movingError = referenceError(output, velocityX * (frameCount - 1));
+	RT64_CHECK(movingError < (staticError * 1.25f));
+}
+
+RT64_TEST(flatImagesAreExact) {
+	Upscaler upscaler;
+	upscaler.set(OutputWidth, OutputHeight);
+	const float flatColor[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+	std::vector<float> color((size_t)(InputWidth) * InputHeight * 4);
+	std::vector<float> output((size_t)(OutputWidth) * OutputHeight * 4);
+	for (size_t i = 0; i < (color.size() / 4); i++) {
+		memcpy(&color[i * 4], flatColor, sizeof(flatColor));
+	}
+
+	for (unsigned int f = 0; f < 16; f++) {
+		Upscaler::FrameInputs inputs;
+		Upscaler::jitterOffset(f, 32, inputs.jitterX, inputs.jitterY);
+		inputs.color = color.data();
+		inputs.width = InputWidth;
+		inputs.height = InputHeight;
+		upscaler.upscale(inputs, output.data());
+		for (size_t i = 0; i < output.size(); i++) {
+			RT64_CHECK_NEAR(output[i], flatColor[i % 4], 1e-5f);
+		}
+	}
+}
+
+RT64_TEST(historyIsClampedWhenTheImageChanges) {
+	Upscaler upscaler;
+	upscaler.set(OutputWidth, OutputHeight);
+	upscaleFrames(upscaler, 16);
+
+	// A new flat image replaces the history right away, since the old colors are far from the neighborhood.
+	std::vector<float> color((size_t)(InputWidth) * InputHeight * 4, 2.0f);
+	std::vector<float> output((size_t)(OutputWidth) * OutputHeight * 4);
+	Upscaler::FrameInputs inputs;
+	inputs.color = color.data();
+	inputs.width = InputWidth;
+	inputs.height = InputHeight;
+	upscaler.upscale(inputs, output.data());
+	for (size_t i = 0; i < output.size(); i++) {
+		RT64_CHECK_NEAR(output[i], 2.0f, 1e-5f);
+	}
+}
+
+RT64_TEST(rowPitchesArePadded) {
+	const unsigned int phaseCount = Upscaler::jitterPhaseCount(InputWidth, InputHeight, OutputWidth, OutputHeight);
+	Upscaler packedUpscaler, paddedUpscaler;
+	packedUpscaler.set(OutputWidth, OutputHeight);
+	paddedUpscaler.set(OutputWidth, OutputHeight);
+
+	const int paddedWidth = InputWidth + 3;
+	std::vector<float> color, paddedColor((size_t)(paddedWidth) * InputHeight * 4, -1.0f);
+	std::vector<float> packedOutput((size_t)(OutputWidth) * OutputHeight * 4), paddedOutput(packedOutput.size());
+	for (unsigned int f = 0; f < 4; f++) {
+		Upscaler::FrameInputs inputs;
+		Upscaler::jitterOffset(f, phaseCount, inputs.jitterX, inputs.jitterY);
+		traceFrame(inputs.jitterX, inputs.jitterY, 0.0f, color);
+		for (int y = 0; y < InputHeight; y++) {
+			memcpy(&paddedColor[(size_t)(y) * paddedWidth * 4], &color[(size_t)(y) * InputWidth * 4], sizeof(float) * InputWidth * 4);
+		}
+
+		inputs.color = color.data();
+		inputs.width = InputWidth;
+		inputs.height = InputHeight;
+		packedUpscaler.upscale(inputs, packedOutput.data());
+		inputs.color = paddedColor.data();
+		inputs.colorRowPitch = sizeof(float) * paddedWidth * 4;
+		paddedUpscaler.upscale(inputs, paddedOutput.data());
+		RT64_CHECK(packedOutput == paddedOutput);
+	}
+}
+
+RT64_TEST(jitterCoversThePixel) {
+	RT64_CHECK(Upscaler::halton(1, 2) == 0.5f);
+	RT64_CHECK(Upscaler::halton(2, 2) == 0.25f);
+	RT64_CHECK(Upscaler::halton(3, 2) == 0.75f);
+	RT64_CHECK_NEAR(Upscaler::halton(1, 3), 1.0f / 3.0f, 1e-7f);
+	RT64_CHECK_NEAR(Upscaler::halton(5, 3), 7.0f / 9.0f, 1e-7f);
+
+	// Twice the resolution on each axis needs four times the phases.
+	const unsigned int phaseCount = Upscaler::jitterPhaseCount(InputWidth, InputHeight, OutputWidth, OutputHeight);
+	RT64_CHECK(phaseCount == (Upscaler::JitterPhasesPerPixel * 4));
+	RT64_CHECK(Upscaler::jitterPhaseCount(InputWidth, InputHeight, InputWidth, InputHeight) == Upscaler::JitterPhasesPerPixel);
+
+	// Every quadrant of the pixel gets the same amount of samples over a full cycle, and the cycle repeats.
+	int quadrants[4] = {};
+	for (unsigned int f = 0; f < phaseCount; f++) {
+		float x, y, repeatX, repeatY;
+		Upscaler::jitterOffset(f, phaseCount, x, y);
+		Upscaler::jitterOffset(f + phaseCount, phaseCount, repeatX, repeatY);
+		RT64_CHECK((x >= -0.5f) && (x < 0.5f) && (y >= -0.5f) && (y < 0.5f));
+		RT64_CHECK((x == repeatX) && (y == repeatY));
+		quadrants[((x < 0.0f) ? 0 : 1) + ((y < 0.0f) ? 0 : 2)]++;
+	}
+
+	const int minQuadrant = *std::min_element(quadrants, quadrants + 4);
+	const int maxQuadrant = *std::max_element(quadrants, quadrants + 4);
+	RT64_CHECK((maxQuadrant - minQuadrant) <= 2);
+}
+
+RT64_TEST(filterWeights) {
+	for (float t : { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f }) {
+		float weights[4];
+		Upscaler::catmullRomWeights(t, weights);
+		RT64_CHECK_NEAR(weights[0] + weights[1] + weights[2] + weights[3], 1.0f, 1e-6f);
+	}
+
+	float weights[4];
+	Upscaler::catmullRomWeights(0.0f, weights);
+	RT64_CHECK((weights[0] == 0.0f) && (weights[1] == 1.0f) && (weights[2] == 0.0f) && (weights[3] == 0.0f));
+	RT64_CHECK(Upscaler::sampleWeight(0.0f, 0.0f) == 1.0f);
+	RT64_CHECK(Upscaler::sampleWeight(1.0f, 0.0f) == Upscaler::sampleWeight(0.0f, -1.0f));
+	RT64_CHECK(Upscaler::sampleWeight(1.0f, 0.0f) < Upscaler::sampleWeight(0.5f, 0.0f));
+}
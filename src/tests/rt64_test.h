@@ -0,0 +1,60 @@
+//
+// RT64
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Minimal test registry. Every test is a function registered with RT64_TEST, and the checks report the failures
+// without stopping the test so all of them are visible in a single run.
+
+namespace RT64Test {
+	typedef void (*TestFunction)();
+
+	struct TestCase {
+		const char *name;
+		TestFunction function;
+	};
+
+	inline std::vector<TestCase> &getTests() {
+		static std::vector<TestCase> tests;
+		return tests;
+	}
+
+	inline int &getFailureCount() {
+		static int failureCount = 0;
+		return failureCount;
+	}
+
+	struct Registrar {
+		Registrar(const char *name, TestFunction function) {
+			getTests().push_back({ name, function });
+		}
+	};
+};
+
+#define RT64_TEST(name) \
+	static void name(); \
+	static RT64Test::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define RT64_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #condition); \
+			RT64Test::getFailureCount()++; \
+		} \
+	} while (0)
+
+#define RT64_CHECK_NEAR(a, b, epsilon) \
+	do { \
+		const double rt64CheckA = (double)(a); \
+		const double rt64CheckB = (double)(b); \
+		if (!(std::fabs(rt64CheckA - rt64CheckB) <= (double)(epsilon))) { \
+			fprintf(stderr, "%s:%d: Check failed: %s (%g) is not within %g of %s (%g)\n", __FILE__, __LINE__, #a, rt64CheckA, (double)(epsilon), #b, rt64CheckB); \
+			RT64Test::getFailureCount()++; \
+		} \
+	} while (0)
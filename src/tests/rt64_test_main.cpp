@@ -0,0 +1,21 @@
+//
+// RT64
+//
+
+#include "rt64_test.h"
+
+int main() {
+	for (const RT64Test::TestCase &test : RT64Test::getTests()) {
+		const int previousFailureCount = RT64Test::getFailureCount();
+		test.function();
+		printf("%s %s\n", (RT64Test::getFailureCount() == previousFailureCount) ? "[PASS]" : "[FAIL]", test.name);
+	}
+
+	const int failureCount = RT64Test::getFailureCount();
+	if (failureCount > 0) {
+		fprintf(stderr, "%d check(s) failed.\n", failureCount);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,166 @@
+//
+// RT64
+//
+
+#include "rt64_top_level_as_tracker.h"
+#include "rt64_test.h"
+
+namespace {
+	typedef RT64::TopLevelASTracker::Action Action;
+
+	RT64::RenderTopLevelASInstance makeInstance(uint64_t bottomLevelASAddress, float x, float y, float z) {
+		RT64::RenderTopLevelASInstance instance = {};
+		instance.transform[0][0] = 1.0f;
+		instance.transform[1][1] = 1.0f;
+		instance.transform[2][2] = 1.0f;
+		instance.transform[0][3] = x;
+		instance.transform[1][3] = y;
+		instance.transform[2][3] = z;
+		instance.instanceMask = 0xFF;
+		instance.bottomLevelASAddress = bottomLevelASAddress;
+		return instance;
+	}
+
+	// Two instances 10 units apart, so the extent of the built hierarchy is 10.
+	struct TestScene {
+		std::vector<RT64::RenderTopLevelASInstance> instances = { makeInstance(0x1000, 0.0f, 0.0f, 0.0f), makeInstance(0x2000, 10.0f, 0.0f, 0.0f) };
+		std::vector<uint32_t> versions = { 0, 0 };
+
+		Action update(RT64::TopLevelASTracker &tracker) const {
+			return tracker.update(instances.data(), versions.data(), instances.size());
+		}
+	};
+};
+
+RT64_TEST(firstUpdateBuilds) {
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	RT64_CHECK(scene.update(tracker) == Action::Build);
+	RT64_CHECK(tracker.getRefitCount() == 0);
+}
+
+RT64_TEST(unchangedInstancesNeedNothing) {
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	scene.update(tracker);
+	RT64_CHECK(scene.update(tracker) == Action::None);
+	RT64_CHECK(scene.update(tracker) == Action::None);
+	RT64_CHECK(tracker.getRefitCount() == 0);
+}
+
+RT64_TEST(smallMovementsRefit) {
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	scene.update(tracker);
+	scene.instances[1].transform[1][3] = 0.5f;
+	RT64_CHECK(scene.update(tracker) == Action::Refit);
+	RT64_CHECK(tracker.getRefitCount() == 1);
+
+	// Moving back also refits, since the reference is still the built hierarchy.
+	scene.instances[1].transform[1][3] = 0.0f;
+	RT64_CHECK(scene.update(tracker) == Action::Refit);
+	RT64_CHECK(tracker.getRefitCount() == 2);
+}
+
+RT64_TEST(updatedBottomLevelASesRefit) {
+	// A bottom-level AS that was rebuilt or refitted in place keeps its address, but the top-level AS needs its bounds.
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	scene.update(tracker);
+	scene.versions[0]++;
+	RT64_CHECK(scene.update(tracker) == Action::Refit);
+}
+
+RT64_TEST(layoutChangesBuild) {
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	scene.update(tracker);
+
+	TestScene swapped = scene;
+	swapped.instances[0].bottomLevelASAddress = 0x3000;
+	RT64_CHECK(swapped.update(tracker) == Action::Build);
+
+	TestScene flagged = swapped;
+	flagged.instances[1].flags = RT64::RenderTopLevelASInstanceFlagCullDisable;
+	RT64_CHECK(flagged.update(tracker) == Action::Build);
+
+	TestScene added = flagged;
+	added.instances.push_back(makeInstance(0x4000, 5.0f, 0.0f, 0.0f));
+	added.versions.push_back(0);
+	RT64_CHECK(added.update(tracker) == Action::Build);
+
+	TestScene removed = added;
+	removed.instances.pop_back();
+	removed.versions.pop_back();
+	RT64_CHECK(removed.update(tracker) == Action::Build);
+}
+
+RT64_TEST(degradationIsRelativeToTheBuiltExtent) {
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	scene.update(tracker);
+	RT64_CHECK_NEAR(tracker.estimateDegradation(scene.instances.data(), scene.instances.size()), 0.0f, 1e-6f);
+
+	// Only the instance that moved the most counts.
+	TestScene moved = scene;
+	moved.instances[0].transform[0][3] = 1.0f;
+	moved.instances[1].transform[2][3] = 2.0f;
+	RT64_CHECK_NEAR(tracker.estimateDegradation(moved.instances.data(), moved.instances.size()), 0.2f, 1e-6f);
+
+	// Changes to the rotation or scale are added as the largest difference of the basis.
+	moved.instances[1].transform[0][0] = 1.5f;
+	RT64_CHECK_NEAR(tracker.estimateDegradation(moved.instances.data(), moved.instances.size()), 0.7f, 1e-6f);
+}
+
+RT64_TEST(degradationOverTheLimitBuilds) {
+	RT64::TopLevelASTracker tracker;
+	RT64::TopLevelASTracker::Settings settings;
+	settings.maxDegradation = 0.25f;
+	tracker.setSettings(settings);
+
+	TestScene scene;
+	scene.update(tracker);
+	scene.instances[1].transform[0][3] = 12.0f;
+	RT64_CHECK(scene.update(tracker) == Action::Refit);
+	scene.instances[1].transform[0][3] = 13.0f;
+	RT64_CHECK(scene.update(tracker) == Action::Build);
+	RT64_CHECK(tracker.getRefitCount() == 0);
+
+	// The build is the new reference, so the same position can be refitted around.
+	scene.instances[1].transform[0][3] = 13.5f;
+	RT64_CHECK(scene.update(tracker) == Action::Refit);
+}
+
+RT64_TEST(tooManyRefitsBuild) {
+	RT64::TopLevelASTracker tracker;
+	RT64::TopLevelASTracker::Settings settings;
+	settings.maxRefits = 3;
+	tracker.setSettings(settings);
+
+	TestScene scene;
+	scene.update(tracker);
+	for (int i = 1; i <= 3; i++) {
+		scene.instances[0].transform[1][3] = 0.01f * i;
+		RT64_CHECK(scene.update(tracker) == Action::Refit);
+		RT64_CHECK(tracker.getRefitCount() == (unsigned int)(i));
+	}
+
+	scene.instances[0].transform[1][3] = 0.0f;
+	RT64_CHECK(scene.update(tracker) == Action::Build);
+	RT64_CHECK(tracker.getRefitCount() == 0);
+}
+
+RT64_TEST(invalidateForcesABuild) {
+	RT64::TopLevelASTracker tracker;
+	TestScene scene;
+	scene.update(tracker);
+	tracker.invalidate();
+	RT64_CHECK(scene.update(tracker) == Action::Build);
+	RT64_CHECK(scene.update(tracker) == Action::None);
+}
+
+RT64_TEST(emptySceneBuildsOnce) {
+	RT64::TopLevelASTracker tracker;
+	RT64_CHECK(tracker.update(nullptr, nullptr, 0) == Action::Build);
+	RT64_CHECK(tracker.update(nullptr, nullptr, 0) == Action::None);
+}